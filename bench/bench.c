@@ -0,0 +1,506 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libswo/libswo.h>
+
+#include "bench.h"
+
+/**
+ * @file
+ *
+ * Throughput benchmark for the packet decoder.
+ */
+
+/* Default size of the generated trace data in bytes. */
+#define DEFAULT_DATA_SIZE	(4 * 1024 * 1024)
+
+/* Default minimum measurement time per benchmark in seconds. */
+#define DEFAULT_MIN_TIME	1.0
+
+/* Size of the decoder buffer in bytes. */
+#define BUFFER_SIZE		(128 * 1024)
+
+/* Number of bytes passed to libswo_feed() at once in block mode. */
+#define BLOCK_SIZE		(BUFFER_SIZE / 2)
+
+/* Seed for the workload generators. */
+#define SEED			0x2a2a2a2a
+
+enum feed_mode {
+	FEED_MODE_BLOCK = (1 << 0),
+	FEED_MODE_BYTE = (1 << 1)
+};
+
+enum output_format {
+	OUTPUT_FORMAT_TEXT,
+	OUTPUT_FORMAT_CSV,
+	OUTPUT_FORMAT_JSON
+};
+
+struct result {
+	const char *workload;
+	const char *feed_mode;
+	size_t length;
+	uint64_t num_packets;
+	unsigned int iterations;
+	double time;
+	uint64_t counters[NUM_PERF_COUNTERS];
+	unsigned int valid_counters;
+};
+
+static unsigned int num_results;
+
+static bool use_perf;
+static struct perf_counters perf;
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)packet;
+
+	(*(uint64_t *)user_data)++;
+
+	return true;
+}
+
+static int decode_block(struct libswo_context *ctx, const uint8_t *data,
+		size_t length)
+{
+	int ret;
+	size_t tmp;
+
+	while (length > 0) {
+		tmp = (length < BLOCK_SIZE) ? length : BLOCK_SIZE;
+
+		ret = libswo_feed(ctx, data, tmp);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		ret = libswo_decode(ctx, 0);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		data += tmp;
+		length -= tmp;
+	}
+
+	return libswo_decode(ctx, LIBSWO_DF_EOS);
+}
+
+static int decode_byte(struct libswo_context *ctx, const uint8_t *data,
+		size_t length)
+{
+	int ret;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		ret = libswo_feed(ctx, data + i, 1);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		ret = libswo_decode(ctx, 0);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	return libswo_decode(ctx, LIBSWO_DF_EOS);
+}
+
+static int run(struct result *result, const uint8_t *data, size_t length,
+		enum feed_mode mode, double min_time)
+{
+	struct libswo_context *ctx;
+	uint64_t num_packets;
+	double start;
+	double time;
+	unsigned int iterations;
+	int ret;
+
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	libswo_log_set_level(ctx, LIBSWO_LOG_LEVEL_NONE);
+	libswo_set_callback(ctx, &packet_callback, &num_packets);
+
+	num_packets = 0;
+	iterations = 0;
+
+	if (use_perf)
+		perf_start(&perf);
+
+	start = get_time();
+
+	do {
+		if (mode == FEED_MODE_BYTE)
+			ret = decode_byte(ctx, data, length);
+		else
+			ret = decode_block(ctx, data, length);
+
+		if (ret != LIBSWO_OK) {
+			libswo_exit(ctx);
+			return ret;
+		}
+
+		iterations++;
+		time = get_time() - start;
+	} while (time < min_time);
+
+	if (use_perf)
+		result->valid_counters = perf_stop(&perf, result->counters);
+	else
+		result->valid_counters = 0;
+
+	libswo_exit(ctx);
+
+	result->feed_mode = (mode == FEED_MODE_BYTE) ? "byte" : "block";
+	result->length = length;
+	result->num_packets = num_packets / iterations;
+	result->iterations = iterations;
+	result->time = time;
+
+	return LIBSWO_OK;
+}
+
+/* Return the value of a counter per packet, or a negative value if invalid. */
+static double counter_per_packet(const struct result *result,
+		enum perf_counter counter)
+{
+	uint64_t num_packets;
+
+	num_packets = result->num_packets * result->iterations;
+
+	if (!(result->valid_counters & (1 << counter)) || !num_packets)
+		return -1;
+
+	return (double)result->counters[counter] / num_packets;
+}
+
+static void print_counters(const struct result *result,
+		enum output_format format)
+{
+	unsigned int i;
+	double tmp;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+		tmp = counter_per_packet(result, i);
+
+		switch (format) {
+		case OUTPUT_FORMAT_CSV:
+			if (tmp < 0)
+				printf(",");
+			else
+				printf(",%.3f", tmp);
+			break;
+		case OUTPUT_FORMAT_JSON:
+			if (tmp < 0)
+				printf(", \"%s_per_packet\": null",
+					perf_counter_names[i]);
+			else
+				printf(", \"%s_per_packet\": %.3f",
+					perf_counter_names[i], tmp);
+			break;
+		default:
+			if (tmp < 0)
+				printf(" %10s", "-");
+			else
+				printf(" %10.2f", tmp);
+			break;
+		}
+	}
+}
+
+static void print_header(enum output_format format)
+{
+	unsigned int i;
+
+	switch (format) {
+	case OUTPUT_FORMAT_CSV:
+		printf("workload,feed,bytes,packets,iterations,seconds,"
+			"mb_per_s,packets_per_s,ns_per_packet");
+
+		for (i = 0; use_perf && i < NUM_PERF_COUNTERS; i++)
+			printf(",%s_per_packet", perf_counter_names[i]);
+
+		printf("\n");
+		break;
+	case OUTPUT_FORMAT_JSON:
+		break;
+	default:
+		printf("%-12s %-6s %12s %14s %10s", "workload", "feed", "MB/s",
+			"packets/s", "ns/packet");
+
+		if (use_perf)
+			printf(" %10s %10s %10s %10s %10s", "cyc/pkt",
+				"ins/pkt", "brmis/pkt", "l1dmis/pkt",
+				"llcmis/pkt");
+
+		printf("\n");
+		break;
+	}
+}
+
+static void print_result(const struct result *result,
+		enum output_format format)
+{
+	double bytes_per_second;
+	double packets_per_second;
+	double ns_per_packet;
+	double time;
+
+	time = result->time / result->iterations;
+	bytes_per_second = result->length / time;
+	packets_per_second = result->num_packets / time;
+
+	if (result->num_packets > 0)
+		ns_per_packet = time * 1e9 / result->num_packets;
+	else
+		ns_per_packet = 0;
+
+	if (!num_results)
+		print_header(format);
+
+	switch (format) {
+	case OUTPUT_FORMAT_CSV:
+		printf("%s,%s,%zu,%llu,%u,%.6f,%.3f,%.0f,%.3f",
+			result->workload, result->feed_mode, result->length,
+			(unsigned long long)result->num_packets,
+			result->iterations, result->time,
+			bytes_per_second / 1e6, packets_per_second,
+			ns_per_packet);
+		break;
+	case OUTPUT_FORMAT_JSON:
+		printf("%s\n  {\"workload\": \"%s\", \"feed\": \"%s\", "
+			"\"bytes\": %zu, \"packets\": %llu, "
+			"\"iterations\": %u, \"seconds\": %.6f, "
+			"\"mb_per_s\": %.3f, \"packets_per_s\": %.0f, "
+			"\"ns_per_packet\": %.3f",
+			num_results ? "," : "[", result->workload,
+			result->feed_mode, result->length,
+			(unsigned long long)result->num_packets,
+			result->iterations, result->time,
+			bytes_per_second / 1e6, packets_per_second,
+			ns_per_packet);
+		break;
+	default:
+		printf("%-12s %-6s %12.2f %14.0f %10.2f", result->workload,
+			result->feed_mode, bytes_per_second / 1e6,
+			packets_per_second, ns_per_packet);
+		break;
+	}
+
+	if (use_perf)
+		print_counters(result, format);
+
+	printf("%s", (format == OUTPUT_FORMAT_JSON) ? "}" : "\n");
+
+	num_results++;
+	fflush(stdout);
+}
+
+static void show_workloads(void)
+{
+	const struct workload *workload;
+
+	for (workload = workloads; workload->name; workload++)
+		printf("%-12s %s\n", workload->name, workload->description);
+}
+
+static void show_help(const char *name)
+{
+	printf("Usage: %s [options]\n\n", name);
+	printf("Options:\n");
+	printf("  -w <name>    Run the given workload only (default: all)\n");
+	printf("  -f <mode>    Feed mode: block, byte or all (default: all)\n");
+	printf("  -s <bytes>   Size of the trace data (default: %u)\n",
+		DEFAULT_DATA_SIZE);
+	printf("  -t <sec>     Minimum time per benchmark (default: %.1f)\n",
+		DEFAULT_MIN_TIME);
+	printf("  -o <format>  Output format: text, csv or json "
+		"(default: text)\n");
+	printf("  -p           Collect hardware performance counters\n");
+	printf("  -l           List available workloads\n");
+	printf("  -h           Show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	const struct workload *workload;
+	const char *name;
+	struct result result;
+	enum output_format format;
+	unsigned int modes;
+	size_t size;
+	size_t length;
+	double min_time;
+	uint8_t *data;
+	int opt;
+	int ret;
+
+	name = NULL;
+	format = OUTPUT_FORMAT_TEXT;
+	modes = FEED_MODE_BLOCK | FEED_MODE_BYTE;
+	size = DEFAULT_DATA_SIZE;
+	min_time = DEFAULT_MIN_TIME;
+	ret = LIBSWO_OK;
+
+	while ((opt = getopt(argc, argv, "w:f:s:t:o:plh")) != -1) {
+		switch (opt) {
+		case 'w':
+			name = optarg;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "block")) {
+				modes = FEED_MODE_BLOCK;
+			} else if (!strcmp(optarg, "byte")) {
+				modes = FEED_MODE_BYTE;
+			} else if (!strcmp(optarg, "all")) {
+				modes = FEED_MODE_BLOCK | FEED_MODE_BYTE;
+			} else {
+				fprintf(stderr, "Invalid feed mode: %s.\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			min_time = strtod(optarg, NULL);
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text")) {
+				format = OUTPUT_FORMAT_TEXT;
+			} else if (!strcmp(optarg, "csv")) {
+				format = OUTPUT_FORMAT_CSV;
+			} else if (!strcmp(optarg, "json")) {
+				format = OUTPUT_FORMAT_JSON;
+			} else {
+				fprintf(stderr, "Invalid output format: %s.\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'p':
+			use_perf = true;
+			break;
+		case 'l':
+			show_workloads();
+			return EXIT_SUCCESS;
+		case 'h':
+			show_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			show_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!size) {
+		fprintf(stderr, "Invalid trace data size.\n");
+		return EXIT_FAILURE;
+	}
+
+	data = malloc(size);
+
+	if (!data) {
+		fprintf(stderr, "Failed to allocate trace data buffer.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (use_perf && !perf_open(&perf)) {
+		fprintf(stderr, "Hardware performance counters are not "
+			"available.\n");
+		use_perf = false;
+	}
+
+	for (workload = workloads; workload->name; workload++) {
+		if (name && strcmp(name, workload->name))
+			continue;
+
+		length = workload->generate(data, size, SEED);
+		result.workload = workload->name;
+
+		if (modes & FEED_MODE_BLOCK) {
+			ret = run(&result, data, length, FEED_MODE_BLOCK,
+				min_time);
+
+			if (ret != LIBSWO_OK)
+				break;
+
+			print_result(&result, format);
+		}
+
+		if (modes & FEED_MODE_BYTE) {
+			ret = run(&result, data, length, FEED_MODE_BYTE,
+				min_time);
+
+			if (ret != LIBSWO_OK)
+				break;
+
+			print_result(&result, format);
+		}
+	}
+
+	free(data);
+
+	if (use_perf)
+		perf_close(&perf);
+
+	if (format == OUTPUT_FORMAT_JSON)
+		printf("%s\n]\n", num_results ? "" : "[");
+
+	if (ret != LIBSWO_OK) {
+		fprintf(stderr, "Benchmark failed: %s.\n",
+			libswo_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	if (name && !num_results) {
+		fprintf(stderr, "Unknown workload: %s.\n", name);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
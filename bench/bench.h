@@ -0,0 +1,77 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSWO_BENCH_BENCH_H
+#define LIBSWO_BENCH_BENCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Synthetic workload. */
+struct workload {
+	/** Name of the workload. */
+	const char *name;
+	/** Short description of the workload. */
+	const char *description;
+	/**
+	 * Generate trace data.
+	 *
+	 * Fills the buffer with complete packets and returns the number of
+	 * bytes generated, which may be less than the buffer size.
+	 */
+	size_t (*generate)(uint8_t *buffer, size_t size, uint32_t seed);
+};
+
+/** Hardware performance counters. */
+enum perf_counter {
+	/** CPU cycles. */
+	PERF_COUNTER_CYCLES = 0,
+	/** Retired instructions. */
+	PERF_COUNTER_INSTRUCTIONS = 1,
+	/** Mispredicted branch instructions. */
+	PERF_COUNTER_BRANCH_MISSES = 2,
+	/** Level 1 data cache read misses. */
+	PERF_COUNTER_L1D_MISSES = 3,
+	/** Last level cache misses. */
+	PERF_COUNTER_LLC_MISSES = 4,
+	/** Number of hardware performance counters. */
+	NUM_PERF_COUNTERS = 5
+};
+
+/** Set of hardware performance counters. */
+struct perf_counters {
+	/** File descriptors of the counters, or -1 if not available. */
+	int fd[NUM_PERF_COUNTERS];
+};
+
+/*--- perf.c ----------------------------------------------------------------*/
+
+extern const char *perf_counter_names[NUM_PERF_COUNTERS];
+
+unsigned int perf_open(struct perf_counters *perf);
+void perf_close(struct perf_counters *perf);
+void perf_start(struct perf_counters *perf);
+unsigned int perf_stop(struct perf_counters *perf,
+		uint64_t values[NUM_PERF_COUNTERS]);
+
+/*--- workload.c ------------------------------------------------------------*/
+
+extern const struct workload workloads[];
+
+#endif /* LIBSWO_BENCH_BENCH_H */
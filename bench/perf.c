@@ -0,0 +1,244 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "bench.h"
+
+/**
+ * @file
+ *
+ * Hardware performance counters.
+ */
+
+const char *perf_counter_names[NUM_PERF_COUNTERS] = {
+	"cycles",
+	"instructions",
+	"branch_misses",
+	"l1d_misses",
+	"llc_misses"
+};
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+/* Data layout for PERF_FORMAT_TOTAL_TIME_ENABLED and *_RUNNING. */
+struct read_format {
+	uint64_t value;
+	uint64_t time_enabled;
+	uint64_t time_running;
+};
+
+static void init_attr(struct perf_event_attr *attr, enum perf_counter counter)
+{
+	memset(attr, 0, sizeof(*attr));
+
+	attr->size = sizeof(*attr);
+	attr->disabled = 1;
+	attr->exclude_kernel = 1;
+	attr->exclude_hv = 1;
+	attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | \
+		PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	switch (counter) {
+	case PERF_COUNTER_CYCLES:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PERF_COUNTER_INSTRUCTIONS:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case PERF_COUNTER_BRANCH_MISSES:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	case PERF_COUNTER_L1D_MISSES:
+		attr->type = PERF_TYPE_HW_CACHE;
+		attr->config = PERF_COUNT_HW_CACHE_L1D | \
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case PERF_COUNTER_LLC_MISSES:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Open the hardware performance counters of the calling thread.
+ *
+ * Counters which are not supported by the system, or which cannot be used
+ * due to insufficient permissions, are skipped.
+ *
+ * @param[out] perf Performance counters.
+ *
+ * @return Number of available counters.
+ */
+unsigned int perf_open(struct perf_counters *perf)
+{
+	struct perf_event_attr attr;
+	unsigned int i;
+	unsigned int num;
+
+	num = 0;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+		init_attr(&attr, i);
+		perf->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+
+		if (perf->fd[i] >= 0)
+			num++;
+	}
+
+	return num;
+}
+
+/**
+ * Close the hardware performance counters.
+ *
+ * @param[in,out] perf Performance counters.
+ */
+void perf_close(struct perf_counters *perf)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+		if (perf->fd[i] >= 0)
+			close(perf->fd[i]);
+
+		perf->fd[i] = -1;
+	}
+}
+
+/**
+ * Reset and start the hardware performance counters.
+ *
+ * @param[in,out] perf Performance counters.
+ */
+void perf_start(struct perf_counters *perf)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+		if (perf->fd[i] < 0)
+			continue;
+
+		ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/**
+ * Stop the hardware performance counters and read their values.
+ *
+ * If the kernel multiplexed a counter, its value is scaled to the time it was
+ * enabled.
+ *
+ * @param[in,out] perf Performance counters.
+ * @param[out] values Counter values.
+ *
+ * @return Bitmask of counters with valid values, see #perf_counter.
+ */
+unsigned int perf_stop(struct perf_counters *perf,
+		uint64_t values[NUM_PERF_COUNTERS])
+{
+	struct read_format data;
+	unsigned int i;
+	unsigned int valid;
+
+	valid = 0;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+		values[i] = 0;
+
+		if (perf->fd[i] < 0)
+			continue;
+
+		ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+		if (read(perf->fd[i], &data, sizeof(data)) != sizeof(data))
+			continue;
+
+		if (!data.time_running)
+			continue;
+
+		if (data.time_running < data.time_enabled)
+			values[i] = (double)data.value * data.time_enabled / \
+				data.time_running;
+		else
+			values[i] = data.value;
+
+		valid |= (1 << i);
+	}
+
+	return valid;
+}
+
+#else /* HAVE_LINUX_PERF_EVENT_H */
+
+unsigned int perf_open(struct perf_counters *perf)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++)
+		perf->fd[i] = -1;
+
+	return 0;
+}
+
+void perf_close(struct perf_counters *perf)
+{
+	(void)perf;
+}
+
+void perf_start(struct perf_counters *perf)
+{
+	(void)perf;
+}
+
+unsigned int perf_stop(struct perf_counters *perf,
+		uint64_t values[NUM_PERF_COUNTERS])
+{
+	unsigned int i;
+
+	(void)perf;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++)
+		values[i] = 0;
+
+	return 0;
+}
+
+#endif /* HAVE_LINUX_PERF_EVENT_H */
@@ -0,0 +1,334 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "bench.h"
+
+/**
+ * @file
+ *
+ * Synthetic workload generators.
+ */
+
+/** Generator state. */
+struct generator {
+	/** Output buffer. */
+	uint8_t *buffer;
+	/** Size of the output buffer in bytes. */
+	size_t size;
+	/** Number of bytes generated so far. */
+	size_t length;
+	/** State of the pseudo-random number generator. */
+	uint32_t state;
+};
+
+static void generator_init(struct generator *gen, uint8_t *buffer,
+		size_t size, uint32_t seed)
+{
+	gen->buffer = buffer;
+	gen->size = size;
+	gen->length = 0;
+	gen->state = seed ? seed : 1;
+}
+
+/* Xorshift pseudo-random number generator. */
+static uint32_t rand32(struct generator *gen)
+{
+	gen->state ^= gen->state << 13;
+	gen->state ^= gen->state >> 17;
+	gen->state ^= gen->state << 5;
+
+	return gen->state;
+}
+
+/* Return true with a probability of percent / 100. */
+static bool chance(struct generator *gen, unsigned int percent)
+{
+	return (rand32(gen) % 100) < percent;
+}
+
+static bool emit(struct generator *gen, const uint8_t *data, size_t length)
+{
+	if (gen->length + length > gen->size)
+		return false;
+
+	memcpy(gen->buffer + gen->length, data, length);
+	gen->length += length;
+
+	return true;
+}
+
+/* Emit an instrumentation or hardware source packet. */
+static bool emit_source(struct generator *gen, bool hw, uint8_t address,
+		size_t size, uint32_t value)
+{
+	uint8_t tmp[5];
+	size_t i;
+
+	tmp[0] = (address << 3) | (hw ? 0x04 : 0x00);
+	tmp[0] |= (size == 4) ? 3 : size;
+
+	for (i = 0; i < size; i++)
+		tmp[1 + i] = value >> (i * 8);
+
+	return emit(gen, tmp, size + 1);
+}
+
+/*
+ * Emit a packet with a payload that uses continuation bits. If min_size is
+ * larger than the size required to encode the value, continuation bits are
+ * set accordingly.
+ */
+static bool emit_cond(struct generator *gen, uint8_t header, uint32_t value,
+		size_t min_size)
+{
+	uint8_t tmp[5];
+	size_t i;
+
+	tmp[0] = header;
+
+	for (i = 0; i < 3; i++) {
+		tmp[1 + i] = (value >> (i * 7)) & 0x7f;
+
+		if (!(value >> ((i + 1) * 7)) && i + 1 >= min_size)
+			return emit(gen, tmp, i + 2);
+
+		tmp[1 + i] |= 0x80;
+	}
+
+	tmp[4] = value >> 21;
+
+	return emit(gen, tmp, 5);
+}
+
+static bool emit_sync(struct generator *gen)
+{
+	const uint8_t tmp[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x80};
+
+	return emit(gen, tmp, sizeof(tmp));
+}
+
+static bool emit_lts(struct generator *gen, uint32_t value)
+{
+	uint8_t header;
+
+	/* Use the short form for small values, except 0 and 7. */
+	if (value > 0 && value < 7) {
+		header = value << 4;
+		return emit(gen, &header, 1);
+	}
+
+	return emit_cond(gen, 0xc0, value & 0xfffffff, 1);
+}
+
+static bool emit_exctrace(struct generator *gen, uint16_t exception,
+		uint8_t function)
+{
+	return emit_source(gen, true, 1, 2,
+		(exception & 0x1ff) | ((function & 0x3) << 12));
+}
+
+static bool emit_pc_sample(struct generator *gen)
+{
+	if (chance(gen, 5))
+		return emit_source(gen, true, 2, 1, 0);
+
+	return emit_source(gen, true, 2, 4, 0x08000000 | (rand32(gen) & 0xfffe));
+}
+
+static size_t generate_itm(uint8_t *buffer, size_t size, uint32_t seed,
+		size_t payload_size)
+{
+	struct generator gen;
+
+	generator_init(&gen, buffer, size, seed);
+
+	while (emit_source(&gen, false, rand32(&gen) % 32, payload_size,
+			rand32(&gen)));
+
+	return gen.length;
+}
+
+static size_t generate_itm8(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	return generate_itm(buffer, size, seed, 1);
+}
+
+static size_t generate_itm16(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	return generate_itm(buffer, size, seed, 2);
+}
+
+static size_t generate_itm32(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	return generate_itm(buffer, size, seed, 4);
+}
+
+static size_t generate_pc_sample(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	struct generator gen;
+
+	generator_init(&gen, buffer, size, seed);
+
+	while (emit_pc_sample(&gen));
+
+	return gen.length;
+}
+
+static size_t generate_exctrace(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	struct generator gen;
+	uint16_t exception;
+
+	generator_init(&gen, buffer, size, seed);
+
+	/* Nested interrupt storm with enter, exit and return sequences. */
+	while (true) {
+		exception = 16 + rand32(&gen) % 64;
+
+		if (!emit_exctrace(&gen, exception, 1))
+			break;
+
+		if (!emit_exctrace(&gen, exception, 2))
+			break;
+
+		if (!emit_exctrace(&gen, rand32(&gen) % 16, 3))
+			break;
+	}
+
+	return gen.length;
+}
+
+static size_t generate_timestamps(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	struct generator gen;
+	unsigned int i;
+	bool ret;
+
+	generator_init(&gen, buffer, size, seed);
+
+	for (i = 0; ; i++) {
+		if (!emit_source(&gen, false, 0, 4, rand32(&gen)))
+			break;
+
+		if (i % 4 == 0)
+			ret = emit_lts(&gen, 1 + rand32(&gen) % 6);
+		else
+			ret = emit_lts(&gen, rand32(&gen) % (1 << (i % 28)));
+
+		if (!ret)
+			break;
+
+		if (i % 64 == 0) {
+			if (!emit_cond(&gen, 0x94, rand32(&gen) & 0x03ffffff,
+					1))
+				break;
+		}
+
+		if (i % 1024 == 0) {
+			if (!emit_cond(&gen, 0xb4, rand32(&gen) & 0x3fffff, 4))
+				break;
+		}
+	}
+
+	return gen.length;
+}
+
+static size_t generate_corrupted(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	struct generator gen;
+	uint8_t tmp;
+	bool ret;
+
+	generator_init(&gen, buffer, size, seed);
+
+	while (true) {
+		if (chance(&gen, 30)) {
+			tmp = rand32(&gen);
+			ret = emit(&gen, &tmp, 1);
+		} else if (chance(&gen, 50)) {
+			ret = emit_source(&gen, false, rand32(&gen) % 32, 4,
+				rand32(&gen));
+		} else {
+			ret = emit_pc_sample(&gen);
+		}
+
+		if (!ret)
+			break;
+	}
+
+	return gen.length;
+}
+
+static size_t generate_mixed(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	struct generator gen;
+	unsigned int tmp;
+	bool ret;
+
+	generator_init(&gen, buffer, size, seed);
+
+	if (!emit_sync(&gen))
+		return gen.length;
+
+	while (true) {
+		tmp = rand32(&gen) % 100;
+
+		if (tmp < 40)
+			ret = emit_source(&gen, false, 0, 1, rand32(&gen));
+		else if (tmp < 60)
+			ret = emit_source(&gen, false, 1 + rand32(&gen) % 4, 4,
+				rand32(&gen));
+		else if (tmp < 75)
+			ret = emit_pc_sample(&gen);
+		else if (tmp < 85)
+			ret = emit_exctrace(&gen, 16 + rand32(&gen) % 64,
+				1 + rand32(&gen) % 3);
+		else if (tmp < 95)
+			ret = emit_lts(&gen, rand32(&gen) % 4096);
+		else if (tmp < 99)
+			ret = emit_source(&gen, true, 8 + rand32(&gen) % 8, 4,
+				rand32(&gen));
+		else
+			ret = emit(&gen, (const uint8_t *)"\x70", 1);
+
+		if (!ret)
+			break;
+	}
+
+	return gen.length;
+}
+
+const struct workload workloads[] = {
+	{"itm8", "1-byte instrumentation packets", &generate_itm8},
+	{"itm16", "2-byte instrumentation packets", &generate_itm16},
+	{"itm32", "4-byte instrumentation packets", &generate_itm32},
+	{"pc-sample", "DWT periodic PC samples", &generate_pc_sample},
+	{"exctrace", "DWT exception trace storm", &generate_exctrace},
+	{"timestamps", "Instrumentation with local and global timestamps",
+		&generate_timestamps},
+	{"corrupted", "Valid packets interleaved with random bytes",
+		&generate_corrupted},
+	{"mixed", "Realistic mix of ITM, DWT and timestamp packets",
+		&generate_mixed},
+	{NULL, NULL, NULL}
+};
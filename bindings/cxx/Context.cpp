@@ -18,13 +18,22 @@
  */
 
 #include <stdio.h>
+#include <algorithm>
 
 #include "libswocxx.h"
 
 namespace libswo
 {
 
-Context::Context(size_t buffer_size)
+Context::Context(size_t buffer_size) :
+	_buffer_size(buffer_size),
+	_queue_size(0),
+	_policy(OVERFLOW_BLOCK),
+	_running(false),
+	_stopping(false),
+	_busy(false),
+	_error(LIBSWO_OK),
+	_num_dropped(0)
 {
 	int ret;
 
@@ -34,7 +43,15 @@ Context::Context(size_t buffer_size)
 		throw Error(ret);
 }
 
-Context::Context(uint8_t *buffer, size_t buffer_size)
+Context::Context(uint8_t *buffer, size_t buffer_size) :
+	_buffer_size(buffer_size),
+	_queue_size(0),
+	_policy(OVERFLOW_BLOCK),
+	_running(false),
+	_stopping(false),
+	_busy(false),
+	_error(LIBSWO_OK),
+	_num_dropped(0)
 {
 	int ret;
 
@@ -46,6 +63,13 @@ Context::Context(uint8_t *buffer, size_t buffer_size)
 
 Context::~Context(void)
 {
+	if (is_running()) {
+		try {
+			stop();
+		} catch (...) {
+		}
+	}
+
 	libswo_exit(_context);
 }
 
@@ -155,22 +179,61 @@ void Context::set_log_callback(LogCallback callback, void *user_data)
 		throw Error(ret);
 }
 
+/*
+ * In asynchronous mode, the trace data is copied and handed over to the
+ * worker, see start().
+ */
 void Context::feed(const uint8_t *buffer, size_t length)
 {
 	int ret;
 
+	if (is_running()) {
+		enqueue(vector<uint8_t>(buffer, buffer + length));
+		return;
+	}
+
 	ret = libswo_feed(_context, buffer, length);
 
 	if (ret != LIBSWO_OK)
 		throw Error(ret);
 }
 
+/*
+ * In asynchronous mode, the ownership of the trace data is transferred to the
+ * worker without copying it, see start().
+ */
+void Context::feed(vector<uint8_t> &&data)
+{
+	int ret;
+
+	if (is_running()) {
+		enqueue(std::move(data));
+		return;
+	}
+
+	ret = libswo_feed(_context, data.data(), data.size());
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+}
+
+/*
+ * Invoke a decoder callback function with a packet object on the stack to
+ * avoid a memory allocation for each packet.
+ */
+template<class T>
+static int invoke_callback(const DecoderCallbackHelper *helper,
+		const union libswo_packet *packet)
+{
+	T tmp(packet);
+
+	return helper->callback(tmp, helper->user_data);
+}
+
 static int packet_callback(struct libswo_context *ctx,
 		const union libswo_packet *packet, void *user_data)
 {
-	int ret;
 	DecoderCallbackHelper *helper;
-	Packet *tmp;
 
 	(void)ctx;
 
@@ -178,64 +241,53 @@ static int packet_callback(struct libswo_context *ctx,
 
 	switch (packet->type) {
 	case LIBSWO_PACKET_TYPE_SYNC:
-		tmp = new Synchronization(packet);
-		break;
+		return invoke_callback<Synchronization>(helper, packet);
 	case LIBSWO_PACKET_TYPE_OVERFLOW:
-		tmp = new Overflow(packet);
-		break;
+		return invoke_callback<Overflow>(helper, packet);
 	case LIBSWO_PACKET_TYPE_LTS:
-		tmp = new LocalTimestamp(packet);
-		break;
+		return invoke_callback<LocalTimestamp>(helper, packet);
 	case LIBSWO_PACKET_TYPE_GTS1:
-		tmp = new GlobalTimestamp1(packet);
-		break;
+		return invoke_callback<GlobalTimestamp1>(helper, packet);
 	case LIBSWO_PACKET_TYPE_GTS2:
-		tmp = new GlobalTimestamp2(packet);
-		break;
+		return invoke_callback<GlobalTimestamp2>(helper, packet);
 	case LIBSWO_PACKET_TYPE_EXT:
-		tmp = new Extension(packet);
-		break;
+		return invoke_callback<Extension>(helper, packet);
 	case LIBSWO_PACKET_TYPE_INST:
-		tmp = new Instrumentation(packet);
-		break;
+		return invoke_callback<Instrumentation>(helper, packet);
 	case LIBSWO_PACKET_TYPE_HW:
-		tmp = new Hardware(packet);
-		break;
+		return invoke_callback<Hardware>(helper, packet);
 	case LIBSWO_PACKET_TYPE_UNKNOWN:
-		tmp = new Unknown(packet);
-		break;
+		return invoke_callback<Unknown>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
-		tmp = new EventCounter(packet);
-		break;
+		return invoke_callback<EventCounter>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
-		tmp = new ExceptionTrace(packet);
-		break;
+		return invoke_callback<ExceptionTrace>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
-		tmp = new PCSample(packet);
-		break;
+		return invoke_callback<PCSample>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
-		tmp = new PCValue(packet);
-		break;
+		return invoke_callback<PCValue>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
-		tmp = new AddressOffset(packet);
-		break;
+		return invoke_callback<AddressOffset>(helper, packet);
 	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
-		tmp = new DataValue(packet);
-		break;
+		return invoke_callback<DataValue>(helper, packet);
 	default:
-		return LIBSWO_ERR;
-	}
+		/* User-defined packets carry the hardware source packet. */
+		if (packet->type < LIBSWO_PACKET_TYPE_USER || \
+				packet->type > LIBSWO_PACKET_TYPE_USER_MAX)
+			return LIBSWO_ERR;
 
-	ret = helper->callback(*tmp, helper->user_data);
-	delete tmp;
-
-	return ret;
+		return invoke_callback<Hardware>(helper, packet);
+	}
 }
 
 void Context::decode(uint32_t flags)
 {
 	int ret;
 
+	/* Trace data is decoded by the worker in asynchronous mode. */
+	if (is_running())
+		throw Error(LIBSWO_ERR);
+
 	ret = libswo_decode(_context, flags);
 
 	if (ret != LIBSWO_OK)
@@ -259,4 +311,345 @@ void Context::set_callback(DecoderCallback callback, void *user_data)
 		throw Error(ret);
 }
 
+/*
+ * Set a callback function which is invoked with the packets of libswo rather
+ * than with packet objects, for example by language bindings.
+ */
+void Context::set_native_callback(libswo_decoder_callback callback,
+		void *user_data)
+{
+	int ret;
+
+	ret = libswo_set_callback(_context, callback, user_data);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+}
+
+void Context::set_type_callback(enum PacketType type,
+		DecoderCallback callback, void *user_data)
+{
+	int ret;
+	DecoderCallbackHelper *helper;
+
+	if (type > LIBSWO_PACKET_TYPE_USER_MAX)
+		throw Error(LIBSWO_ERR_ARG);
+
+	helper = &_type_callbacks[type];
+
+	if (callback) {
+		helper->callback = callback;
+		helper->user_data = user_data;
+		ret = libswo_set_type_callback(_context,
+			static_cast<enum libswo_packet_type>(type),
+			&packet_callback, helper);
+	} else {
+		ret = libswo_set_type_callback(_context,
+			static_cast<enum libswo_packet_type>(type), NULL, NULL);
+	}
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+}
+
+/**
+ * Add a subscriber.
+ *
+ * @param[in] callback Callback function.
+ * @param[in] user_data User data to be passed to the callback function.
+ * @param[in] types Bitmask of packet types to be delivered, where bit n
+ *                  corresponds to the packet type with value n.
+ * @param[in] ports Bitmask of instrumentation ports whose packets are
+ *                  delivered.
+ *
+ * @return Identifier of the subscriber.
+ */
+unsigned int Context::subscribe(DecoderCallback callback, void *user_data,
+		uint32_t types, uint32_t ports)
+{
+	int ret;
+	unsigned int i;
+	unsigned int id;
+	struct libswo_filter filter;
+
+	if (!callback)
+		throw Error(LIBSWO_ERR_ARG);
+
+	filter.types = types;
+	filter.ports = ports;
+
+	/*
+	 * The subscriber identifier is not known before the subscriber is
+	 * added. Use the first unused helper, the C library assigns the first
+	 * unused identifier as well.
+	 */
+	for (i = 0; i < LIBSWO_MAX_SUBSCRIBERS; i++) {
+		if (!_subscribers[i].callback)
+			break;
+	}
+
+	if (i == LIBSWO_MAX_SUBSCRIBERS)
+		throw Error(LIBSWO_ERR);
+
+	ret = libswo_subscribe(_context, &filter, &packet_callback,
+		&_subscribers[i], &id);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+
+	/* Subscribers were added bypassing the C++ bindings. */
+	if (id != i) {
+		libswo_unsubscribe(_context, id);
+		throw Error(LIBSWO_ERR);
+	}
+
+	_subscribers[id].callback = callback;
+	_subscribers[id].user_data = user_data;
+
+	return id;
+}
+
+void Context::unsubscribe(unsigned int id)
+{
+	int ret;
+
+	ret = libswo_unsubscribe(_context, id);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+
+	_subscribers[id].callback = NULL;
+	_subscribers[id].user_data = NULL;
+}
+
+/**
+ * Start asynchronous decoding.
+ *
+ * A worker thread is spawned which decodes all trace data passed to feed().
+ * Afterwards, feed() only enqueues the trace data and the callback functions
+ * are invoked on the worker thread. Callback functions must not be changed
+ * while the worker is running.
+ *
+ * A callback function which returns false does not stop the worker. Decoding
+ * is resumed with the next packet as soon as the worker needs space in the
+ * buffer for more trace data. Use stop() to stop asynchronous decoding.
+ *
+ * @param[in] queue_size Maximum number of pending trace data buffers.
+ * @param[in] policy Determines how feed() behaves if the queue is full. Note
+ *                   that dropping trace data breaks the packet stream until
+ *                   the decoder is in sync again.
+ */
+void Context::start(size_t queue_size, enum OverflowPolicy policy)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	if (!queue_size)
+		throw Error(LIBSWO_ERR_ARG);
+
+	if (_running)
+		throw Error(LIBSWO_ERR);
+
+	_queue_size = queue_size;
+	_policy = policy;
+	_stopping = false;
+	_busy = false;
+	_error = LIBSWO_OK;
+	_num_dropped = 0;
+
+	_worker = thread(&Context::run, this);
+	_running.store(true, memory_order_release);
+}
+
+/**
+ * Wait until all enqueued trace data is decoded.
+ */
+void Context::drain(void)
+{
+	unique_lock<mutex> lock(_mutex);
+
+	if (!_running)
+		return;
+
+	_space_cv.wait(lock, [this] {
+		return (_queue.empty() && !_busy) || _error != LIBSWO_OK;
+	});
+
+	if (_error != LIBSWO_OK)
+		throw Error(_error);
+}
+
+/**
+ * Stop asynchronous decoding.
+ *
+ * All enqueued trace data is decoded before the worker terminates. Remaining
+ * incomplete packets are kept in the buffer and can be decoded with decode(),
+ * for example at the end of the stream.
+ */
+void Context::stop(void)
+{
+	int ret;
+
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		if (!_running)
+			return;
+
+		_stopping = true;
+		_data_cv.notify_one();
+	}
+
+	_worker.join();
+
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		ret = _error;
+		_running.store(false, memory_order_release);
+		_queue.clear();
+	}
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+}
+
+bool Context::is_running(void) const
+{
+	return _running.load(memory_order_acquire);
+}
+
+/**
+ * Get the number of trace data buffers which were dropped due to a full
+ * queue since asynchronous decoding was started.
+ */
+size_t Context::get_num_dropped(void) const
+{
+	lock_guard<mutex> lock(_mutex);
+
+	return _num_dropped;
+}
+
+void Context::enqueue(vector<uint8_t> &&data)
+{
+	unique_lock<mutex> lock(_mutex);
+
+	if (_error != LIBSWO_OK)
+		throw Error(_error);
+
+	if (data.empty())
+		return;
+
+	if (_queue.size() >= _queue_size) {
+		switch (_policy) {
+		case OVERFLOW_BLOCK:
+			_space_cv.wait(lock, [this] {
+				return _queue.size() < _queue_size || \
+					_error != LIBSWO_OK;
+			});
+
+			if (_error != LIBSWO_OK)
+				throw Error(_error);
+
+			break;
+		case OVERFLOW_DROP_NEWEST:
+			_num_dropped++;
+			return;
+		case OVERFLOW_DROP_OLDEST:
+			_queue.pop_front();
+			_num_dropped++;
+			break;
+		default:
+			throw Error(LIBSWO_ERR);
+		}
+	}
+
+	_queue.push_back(std::move(data));
+	_data_cv.notify_one();
+}
+
+/*
+ * Feed and decode trace data in chunks which fit into the buffer of the
+ * context.
+ *
+ * If a callback function stopped decoding, complete packets are left in the
+ * buffer and the next chunk may not fit anymore. In this case, decoding is
+ * resumed until there is enough space. Each resumption decodes at least one
+ * packet, the number of attempts is therefore bounded by the buffer size.
+ */
+int Context::decode_chunk(const vector<uint8_t> &data)
+{
+	int ret;
+	size_t offset;
+	size_t tmp;
+	size_t attempts;
+
+	for (offset = 0; offset < data.size(); offset += tmp) {
+		tmp = std::min(data.size() - offset,
+			std::max(_buffer_size / 2, (size_t)1));
+
+		for (attempts = 0; attempts <= _buffer_size; attempts++) {
+			ret = libswo_feed(_context, &data[offset], tmp);
+
+			if (ret == LIBSWO_OK)
+				break;
+
+			ret = libswo_decode(_context, 0);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+
+			ret = LIBSWO_ERR;
+		}
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		ret = libswo_decode(_context, 0);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	return LIBSWO_OK;
+}
+
+void Context::run(void)
+{
+	vector<uint8_t> data;
+	int ret;
+
+	while (true) {
+		{
+			unique_lock<mutex> lock(_mutex);
+
+			_busy = false;
+			_space_cv.notify_all();
+
+			_data_cv.wait(lock, [this] {
+				return !_queue.empty() || _stopping;
+			});
+
+			if (_queue.empty())
+				break;
+
+			data = std::move(_queue.front());
+			_queue.pop_front();
+			_busy = true;
+			_space_cv.notify_all();
+		}
+
+		ret = decode_chunk(data);
+
+		if (ret != LIBSWO_OK) {
+			lock_guard<mutex> lock(_mutex);
+
+			_error = ret;
+			_busy = false;
+			_queue.clear();
+			_space_cv.notify_all();
+			break;
+		}
+	}
+}
+
 }
@@ -0,0 +1,405 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "libswocxx.h"
+
+namespace libswo
+{
+
+/* Number of packet types which can be counted by count_by_type(). */
+#define NUM_PACKET_TYPES	(LIBSWO_PACKET_TYPE_USER_MAX + 1)
+
+/* Minimal average packet size used to estimate the number of packets. */
+#define MIN_AVG_PACKET_SIZE	4
+
+/*
+ * Maximum number of rows reserved up front for the expected number of packets.
+ * Larger inputs rely on the geometric growth of the columns.
+ */
+#define MAX_RESERVE		(1024 * 1024)
+
+PacketColumns::PacketColumns(void) :
+	timestamp(0)
+{
+}
+
+size_t PacketColumns::size(void) const
+{
+	return types.size();
+}
+
+void PacketColumns::reserve(size_t capacity)
+{
+	types.reserve(capacity);
+	timestamps.reserve(capacity);
+	addresses.reserve(capacity);
+	values.reserve(capacity);
+	dwt.reserve(capacity);
+}
+
+void PacketColumns::clear(void)
+{
+	types.clear();
+	timestamps.clear();
+	addresses.clear();
+	values.clear();
+	dwt.clear();
+}
+
+PacketTable::PacketTable(size_t capacity, size_t buffer_size) :
+	_chunk_size(buffer_size / 2)
+{
+	int ret;
+
+	if (!_chunk_size)
+		throw Error(LIBSWO_ERR_ARG);
+
+	ret = libswo_init(&_context, NULL, buffer_size);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+
+	ret = libswo_set_callback(_context, &PacketTable::packet_callback,
+		this);
+
+	if (ret != LIBSWO_OK) {
+		libswo_exit(_context);
+		throw Error(ret);
+	}
+
+	reserve(capacity);
+}
+
+PacketTable::~PacketTable(void)
+{
+	libswo_exit(_context);
+}
+
+size_t PacketTable::size(void) const
+{
+	return _columns.size();
+}
+
+size_t PacketTable::capacity(void) const
+{
+	return _columns.types.capacity();
+}
+
+void PacketTable::reserve(size_t capacity)
+{
+	_columns.reserve(capacity);
+}
+
+void PacketTable::clear(void)
+{
+	_columns.clear();
+	_columns.timestamp = 0;
+}
+
+/*
+ * Exchange the rows of the table with the given columns, for example to take
+ * over the decoded packets without copying them.
+ */
+void PacketTable::swap(PacketColumns &columns)
+{
+	std::swap(_columns, columns);
+}
+
+int PacketTable::packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+
+	((PacketTable *)user_data)->_columns.append(packet);
+
+	return true;
+}
+
+void PacketColumns::append(const union libswo_packet *packet)
+{
+	uint8_t address;
+	uint32_t value;
+	uint32_t dwt_value;
+
+	address = 0;
+	value = 0;
+	dwt_value = 0;
+
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_LTS:
+		timestamp += packet->lts.value;
+		value = packet->lts.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		value = packet->gts1.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		value = packet->gts2.value;
+		break;
+	case LIBSWO_PACKET_TYPE_EXT:
+		value = packet->ext.value;
+		break;
+	case LIBSWO_PACKET_TYPE_INST:
+		address = packet->inst.address;
+		value = packet->inst.value;
+		break;
+	case LIBSWO_PACKET_TYPE_HW:
+		address = packet->hw.address;
+		value = packet->hw.value;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		address = packet->evtcnt.address;
+		value = packet->evtcnt.value;
+		dwt_value = packet->evtcnt.payload[0];
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		address = packet->exctrace.address;
+		value = packet->exctrace.value;
+		dwt_value = packet->exctrace.exception | \
+			(packet->exctrace.function << 16);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		address = packet->pc_sample.address;
+		value = packet->pc_sample.pc;
+		dwt_value = packet->pc_sample.sleep;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		address = packet->pc_value.address;
+		value = packet->pc_value.pc;
+		dwt_value = packet->pc_value.cmpn;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		address = packet->addr_offset.address;
+		value = packet->addr_offset.offset;
+		dwt_value = packet->addr_offset.cmpn;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		address = packet->data_value.address;
+		value = packet->data_value.data_value;
+		dwt_value = packet->data_value.cmpn | \
+			(packet->data_value.wnr << 8);
+		break;
+	default:
+		/* User-defined hardware source packets. */
+		if (packet->type >= LIBSWO_PACKET_TYPE_USER && \
+				packet->type <= LIBSWO_PACKET_TYPE_USER_MAX) {
+			address = packet->hw.address;
+			value = packet->hw.value;
+		}
+
+		break;
+	}
+
+	types.push_back(packet->type);
+	timestamps.push_back(timestamp);
+	addresses.push_back(address);
+	values.push_back(value);
+	dwt.push_back(dwt_value);
+}
+
+void PacketTable::decode(const uint8_t *data, size_t length, uint32_t flags)
+{
+	int ret;
+	size_t tmp;
+	size_t required;
+
+	/*
+	 * Reserve space for the expected number of packets up front but keep
+	 * the growth geometric to amortize the cost of subsequent calls.
+	 */
+	required = size() + std::min<size_t>(length / MIN_AVG_PACKET_SIZE,
+		MAX_RESERVE);
+
+	if (required > capacity())
+		reserve(std::max(required, 2 * capacity()));
+
+	while (length > 0) {
+		tmp = std::min(length, _chunk_size);
+
+		ret = libswo_feed(_context, data, tmp);
+
+		if (ret != LIBSWO_OK)
+			throw Error(ret);
+
+		ret = libswo_decode(_context, 0);
+
+		if (ret != LIBSWO_OK)
+			throw Error(ret);
+
+		data += tmp;
+		length -= tmp;
+	}
+
+	if (flags & DF_EOS) {
+		ret = libswo_decode(_context, LIBSWO_DF_EOS);
+
+		if (ret != LIBSWO_OK)
+			throw Error(ret);
+	}
+}
+
+void PacketTable::decode_file(const string &filename)
+{
+	FILE *file;
+	long length;
+	size_t num;
+	vector<uint8_t> buffer(_chunk_size);
+
+	file = fopen(filename.c_str(), "rb");
+
+	if (!file)
+		throw Error(LIBSWO_ERR_ARG);
+
+	if (!fseek(file, 0, SEEK_END)) {
+		length = ftell(file);
+
+		if (length > 0)
+			reserve(size() + std::min<size_t>(
+				length / MIN_AVG_PACKET_SIZE,
+				MAX_RESERVE));
+
+		rewind(file);
+	}
+
+	try {
+		while ((num = fread(&buffer[0], 1, buffer.size(), file)) > 0)
+			decode(&buffer[0], num, 0);
+
+		if (ferror(file))
+			throw Error(LIBSWO_ERR);
+
+		decode(NULL, 0, DF_EOS);
+	} catch (...) {
+		fclose(file);
+		throw;
+	}
+
+	fclose(file);
+}
+
+const vector<uint8_t> &PacketTable::get_types(void) const
+{
+	return _columns.types;
+}
+
+const vector<uint64_t> &PacketTable::get_timestamps(void) const
+{
+	return _columns.timestamps;
+}
+
+const vector<uint8_t> &PacketTable::get_addresses(void) const
+{
+	return _columns.addresses;
+}
+
+const vector<uint32_t> &PacketTable::get_values(void) const
+{
+	return _columns.values;
+}
+
+const vector<uint32_t> &PacketTable::get_dwt(void) const
+{
+	return _columns.dwt;
+}
+
+vector<size_t> PacketTable::count_by_type(void) const
+{
+	vector<size_t> counts(NUM_PACKET_TYPES, 0);
+	const uint8_t *types;
+	size_t i;
+	size_t n;
+
+	types = _columns.types.data();
+	n = _columns.size();
+
+	for (i = 0; i < n; i++) {
+		if (types[i] < NUM_PACKET_TYPES)
+			counts[types[i]]++;
+	}
+
+	return counts;
+}
+
+vector<size_t> PacketTable::histogram(enum PacketType type, unsigned int shift,
+		size_t num_bins) const
+{
+	vector<size_t> bins(num_bins, 0);
+	const uint8_t *types;
+	const uint32_t *values;
+	size_t i;
+	size_t n;
+	size_t bin;
+
+	if (!num_bins || shift >= 32)
+		throw Error(LIBSWO_ERR_ARG);
+
+	types = _columns.types.data();
+	values = _columns.values.data();
+	n = _columns.size();
+
+	for (i = 0; i < n; i++) {
+		bin = std::min((size_t)(values[i] >> shift), num_bins - 1);
+		bins[bin] += (types[i] == type);
+	}
+
+	return bins;
+}
+
+vector<size_t> PacketTable::select_type(enum PacketType type) const
+{
+	vector<size_t> indices;
+	const uint8_t *types;
+	size_t i;
+	size_t n;
+
+	types = _columns.types.data();
+	n = _columns.size();
+
+	for (i = 0; i < n; i++) {
+		if (types[i] == type)
+			indices.push_back(i);
+	}
+
+	return indices;
+}
+
+vector<size_t> PacketTable::select_port(uint8_t port) const
+{
+	vector<size_t> indices;
+	const uint8_t *types;
+	const uint8_t *addresses;
+	size_t i;
+	size_t n;
+
+	types = _columns.types.data();
+	addresses = _columns.addresses.data();
+	n = _columns.size();
+
+	for (i = 0; i < n; i++) {
+		if (types[i] == LIBSWO_PACKET_TYPE_INST && addresses[i] == port)
+			indices.push_back(i);
+	}
+
+	return indices;
+}
+
+}
@@ -0,0 +1,717 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "libswocxx.h"
+
+/* Number of polls of an empty or full queue before a stage goes to sleep. */
+#define SPIN_COUNT	128
+
+namespace libswo
+{
+
+static uint64_t get_time(void)
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Single-producer/single-consumer ring queue of batches between two
+ * consecutive stages.
+ *
+ * Both sides poll the queue for a while before they go to sleep. A sleeping
+ * side is woken up by the other side as soon as the queue changes.
+ */
+class Pipeline::Queue
+{
+public:
+	Queue(size_t size);
+
+	bool push(Batch &batch);
+	bool pop(Batch &batch);
+	void wait_data(void);
+	void wait_space(void);
+
+	size_t size(void) const;
+	size_t capacity(void) const;
+private:
+	void notify(void);
+	void wait(bool data);
+
+	vector<Batch> _slots;
+	atomic<size_t> _head;
+	atomic<size_t> _tail;
+	atomic<unsigned int> _waiters;
+	mutex _mutex;
+	condition_variable _cv;
+};
+
+class Pipeline::Stage
+{
+public:
+	Stage(const string &name);
+	virtual ~Stage(void);
+
+	/* Returns false to drop the batch. */
+	virtual bool process(Batch &batch) = 0;
+
+	string name;
+	atomic<uint64_t> batches;
+	atomic<uint64_t> bytes;
+	atomic<uint64_t> packets;
+	atomic<uint64_t> busy_time;
+	atomic<uint64_t> idle_waits;
+	atomic<uint64_t> stalls;
+	atomic<int> error;
+};
+
+class Pipeline::FunctionStage : public Pipeline::Stage
+{
+public:
+	FunctionStage(const string &name, StageFunction function,
+		void *user_data);
+
+	bool process(Batch &batch);
+private:
+	StageFunction _function;
+	void *_user_data;
+};
+
+/*
+ * Decodes the trace data of each batch into packets. Incomplete packets at
+ * the end of a batch are completed with the trace data of the next batch.
+ */
+class Pipeline::DecodeStage : public Pipeline::Stage
+{
+public:
+	DecodeStage(size_t buffer_size);
+	~DecodeStage(void);
+
+	bool process(Batch &batch);
+private:
+	static int callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data);
+
+	struct libswo_context *_context;
+	size_t _chunk_size;
+	Batch *_batch;
+};
+
+/*
+ * Assigns each packet the sum of all local timestamp values up to and
+ * including the packet.
+ */
+class Pipeline::TimestampStage : public Pipeline::Stage
+{
+public:
+	TimestampStage(void);
+
+	bool process(Batch &batch);
+private:
+	uint64_t _time;
+};
+
+Batch::Batch(void) :
+	eos(false)
+{
+}
+
+Batch::Batch(vector<uint8_t> &&data) :
+	data(std::move(data)),
+	eos(false)
+{
+}
+
+Pipeline::Queue::Queue(size_t size) :
+	_slots(size),
+	_head(0),
+	_tail(0),
+	_waiters(0)
+{
+}
+
+bool Pipeline::Queue::push(Batch &batch)
+{
+	size_t tail;
+
+	tail = _tail.load(memory_order_relaxed);
+
+	if (tail - _head.load(memory_order_acquire) == _slots.size())
+		return false;
+
+	_slots[tail % _slots.size()] = std::move(batch);
+	_tail.store(tail + 1, memory_order_release);
+	notify();
+
+	return true;
+}
+
+bool Pipeline::Queue::pop(Batch &batch)
+{
+	size_t head;
+
+	head = _head.load(memory_order_relaxed);
+
+	if (head == _tail.load(memory_order_acquire))
+		return false;
+
+	batch = std::move(_slots[head % _slots.size()]);
+	_head.store(head + 1, memory_order_release);
+	notify();
+
+	return true;
+}
+
+void Pipeline::Queue::wait_data(void)
+{
+	wait(true);
+}
+
+void Pipeline::Queue::wait_space(void)
+{
+	wait(false);
+}
+
+size_t Pipeline::Queue::size(void) const
+{
+	return _tail.load(memory_order_acquire) - \
+		_head.load(memory_order_acquire);
+}
+
+size_t Pipeline::Queue::capacity(void) const
+{
+	return _slots.size();
+}
+
+void Pipeline::Queue::notify(void)
+{
+	/*
+	 * The barrier pairs with the increment of the number of waiters and
+	 * ensures that either the waiting side sees the new position or this
+	 * side sees the waiter.
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (_waiters.load(memory_order_relaxed) > 0) {
+		lock_guard<mutex> lock(_mutex);
+		_cv.notify_all();
+	}
+}
+
+void Pipeline::Queue::wait(bool data)
+{
+	unsigned int i;
+
+	auto ready = [this, data] {
+		return data ? size() > 0 : size() < _slots.size();
+	};
+
+	for (i = 0; i < SPIN_COUNT; i++) {
+		if (ready())
+			return;
+
+		this_thread::yield();
+	}
+
+	unique_lock<mutex> lock(_mutex);
+
+	_waiters.fetch_add(1);
+	_cv.wait(lock, ready);
+	_waiters.fetch_sub(1);
+}
+
+Pipeline::Stage::Stage(const string &name) :
+	name(name),
+	batches(0),
+	bytes(0),
+	packets(0),
+	busy_time(0),
+	idle_waits(0),
+	stalls(0),
+	error(LIBSWO_OK)
+{
+}
+
+Pipeline::Stage::~Stage(void)
+{
+}
+
+Pipeline::FunctionStage::FunctionStage(const string &name,
+		StageFunction function, void *user_data) :
+	Stage(name),
+	_function(function),
+	_user_data(user_data)
+{
+}
+
+bool Pipeline::FunctionStage::process(Batch &batch)
+{
+	return _function(batch, _user_data);
+}
+
+Pipeline::DecodeStage::DecodeStage(size_t buffer_size) :
+	Stage("decode"),
+	_chunk_size(buffer_size / 2),
+	_batch(NULL)
+{
+	int ret;
+
+	if (!_chunk_size)
+		throw Error(LIBSWO_ERR_ARG);
+
+	ret = libswo_init(&_context, NULL, buffer_size);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+
+	ret = libswo_set_callback(_context, &DecodeStage::callback, this);
+
+	if (ret != LIBSWO_OK) {
+		libswo_exit(_context);
+		throw Error(ret);
+	}
+}
+
+Pipeline::DecodeStage::~DecodeStage(void)
+{
+	libswo_exit(_context);
+}
+
+int Pipeline::DecodeStage::callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	DecodeStage *stage;
+
+	(void)ctx;
+
+	stage = (DecodeStage *)user_data;
+	stage->_batch->packets.push_back(*packet);
+
+	return true;
+}
+
+bool Pipeline::DecodeStage::process(Batch &batch)
+{
+	int ret;
+	size_t offset;
+	size_t tmp;
+
+	_batch = &batch;
+	ret = LIBSWO_OK;
+
+	for (offset = 0; offset < batch.data.size(); offset += tmp) {
+		tmp = std::min(batch.data.size() - offset, _chunk_size);
+		ret = libswo_feed(_context, &batch.data[offset], tmp);
+
+		if (ret != LIBSWO_OK)
+			break;
+
+		ret = libswo_decode(_context, 0);
+
+		if (ret != LIBSWO_OK)
+			break;
+	}
+
+	if (ret == LIBSWO_OK && batch.eos)
+		ret = libswo_decode(_context, LIBSWO_DF_EOS);
+
+	_batch = NULL;
+
+	if (ret != LIBSWO_OK) {
+		error = ret;
+		return false;
+	}
+
+	return true;
+}
+
+Pipeline::TimestampStage::TimestampStage(void) :
+	Stage("timestamp"),
+	_time(0)
+{
+}
+
+bool Pipeline::TimestampStage::process(Batch &batch)
+{
+	size_t i;
+
+	batch.timestamps.resize(batch.packets.size());
+
+	for (i = 0; i < batch.packets.size(); i++) {
+		if (batch.packets[i].type == LIBSWO_PACKET_TYPE_LTS)
+			_time += batch.packets[i].lts.value;
+
+		batch.timestamps[i] = _time;
+	}
+
+	return true;
+}
+
+/**
+ * Create a pipeline.
+ *
+ * A pipeline consists of stages which process batches of trace data in
+ * order. Each stage runs on its own thread and is connected to its
+ * predecessor by a bounded lock-free queue. If a stage is slower than its
+ * predecessor, the queue fills up and the predecessor is throttled, down to
+ * push().
+ *
+ * @param[in] queue_size Capacity of each queue in batches.
+ */
+Pipeline::Pipeline(size_t queue_size) :
+	_queue_size(queue_size),
+	_running(false),
+	_start_time(0),
+	_stop_time(0)
+{
+	if (!queue_size)
+		throw Error(LIBSWO_ERR_ARG);
+}
+
+Pipeline::~Pipeline(void)
+{
+	size_t i;
+
+	if (_running) {
+		try {
+			stop();
+		} catch (...) {
+		}
+	}
+
+	for (i = 0; i < _stages.size(); i++) {
+		delete _stages[i];
+		delete _queues[i];
+	}
+}
+
+void Pipeline::add(Stage *stage)
+{
+	if (_running) {
+		delete stage;
+		throw Error(LIBSWO_ERR);
+	}
+
+	_stages.push_back(stage);
+	_queues.push_back(new Queue(_queue_size));
+}
+
+/**
+ * Append a stage with a user-defined function.
+ *
+ * The function is invoked on the thread of the stage for each batch. It may
+ * modify the batch and returns false to drop it. The batch which indicates
+ * the end of the stream is never dropped.
+ *
+ * To fail, the function throws an Error. The batch is dropped and the error
+ * code is reported by stop().
+ *
+ * @param[in] name Name of the stage.
+ * @param[in] function Stage function.
+ * @param[in] user_data User data to be passed to the stage function.
+ */
+void Pipeline::add_stage(const string &name, StageFunction function,
+		void *user_data)
+{
+	if (!function)
+		throw Error(LIBSWO_ERR_ARG);
+
+	add(new FunctionStage(name, function, user_data));
+}
+
+/**
+ * Append a stage which decodes the trace data of each batch into packets.
+ *
+ * @param[in] buffer_size Buffer size of the decoder context.
+ */
+void Pipeline::add_decode_stage(size_t buffer_size)
+{
+	add(new DecodeStage(buffer_size));
+}
+
+/**
+ * Append a stage which reconstructs the timestamp of each decoded packet
+ * from local timestamp packets.
+ */
+void Pipeline::add_timestamp_stage(void)
+{
+	add(new TimestampStage());
+}
+
+/**
+ * Start the pipeline.
+ *
+ * @param[in] pin Determines whether the thread of each stage is pinned to its
+ *                own processor core. Only supported on Linux.
+ */
+void Pipeline::start(bool pin)
+{
+	size_t i;
+	unsigned int num_cores;
+
+	if (_running || _stages.empty())
+		throw Error(LIBSWO_ERR);
+
+	for (i = 0; i < _stages.size(); i++)
+		_stages[i]->error = LIBSWO_OK;
+
+	num_cores = std::max(thread::hardware_concurrency(), 1U);
+	_threads.reserve(_stages.size());
+	_start_time = get_time();
+
+	for (i = 0; i < _stages.size(); i++) {
+		try {
+			_threads.emplace_back(&Pipeline::run, this, i);
+		} catch (...) {
+			abort_start();
+			throw;
+		}
+
+#ifdef __linux__
+		if (pin) {
+			cpu_set_t set;
+
+			CPU_ZERO(&set);
+			CPU_SET(i % num_cores, &set);
+			pthread_setaffinity_np(_threads[i].native_handle(),
+				sizeof(set), &set);
+		}
+#else
+		(void)pin;
+		(void)num_cores;
+#endif
+	}
+
+	_running = true;
+}
+
+/*
+ * Terminate the threads which were already started if the pipeline could not
+ * be started completely. The end of the stream passes through the running
+ * stages and is removed from the queues afterwards.
+ */
+void Pipeline::abort_start(void)
+{
+	Batch batch;
+	size_t i;
+
+	if (!_threads.empty()) {
+		batch.eos = true;
+
+		while (!_queues[0]->push(batch))
+			_queues[0]->wait_space();
+	}
+
+	for (i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+
+	_threads.clear();
+
+	for (i = 0; i < _queues.size(); i++) {
+		while (_queues[i]->pop(batch))
+			;
+	}
+
+	_start_time = 0;
+}
+
+/**
+ * Pass a batch of trace data to the first stage.
+ *
+ * Blocks while the queue of the first stage is full.
+ *
+ * @param[in,out] batch Batch. The ownership is transferred to the pipeline.
+ */
+void Pipeline::push(Batch &&batch)
+{
+	if (!_running)
+		throw Error(LIBSWO_ERR);
+
+	while (!_queues[0]->push(batch))
+		_queues[0]->wait_space();
+}
+
+/**
+ * Pass a batch of trace data to the first stage without blocking.
+ *
+ * @param[in,out] batch Batch. The ownership is only transferred to the
+ *                      pipeline on success.
+ *
+ * @return False if the queue of the first stage is full, true otherwise.
+ */
+bool Pipeline::try_push(Batch &&batch)
+{
+	if (!_running)
+		throw Error(LIBSWO_ERR);
+
+	return _queues[0]->push(batch);
+}
+
+/**
+ * Stop the pipeline.
+ *
+ * The end of the stream is signaled to all stages and the function returns
+ * once all batches passed through the pipeline.
+ *
+ * If one or more stages failed, an error with the error code of the first
+ * failed stage is thrown. The error codes of all stages are available with
+ * get_stats() until the pipeline is started again.
+ */
+void Pipeline::stop(void)
+{
+	Batch batch;
+	size_t i;
+	int ret;
+	int tmp;
+
+	if (!_running)
+		return;
+
+	batch.eos = true;
+	push(std::move(batch));
+
+	for (i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+
+	_threads.clear();
+	_stop_time = get_time();
+	_running = false;
+
+	ret = LIBSWO_OK;
+
+	for (i = 0; i < _stages.size(); i++) {
+		tmp = _stages[i]->error;
+
+		if (tmp != LIBSWO_OK && ret == LIBSWO_OK)
+			ret = tmp;
+	}
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+}
+
+void Pipeline::run(size_t index)
+{
+	Stage *stage;
+	Queue *input;
+	Queue *output;
+	Batch batch;
+	uint64_t start;
+	bool keep;
+	bool eos;
+
+	stage = _stages[index];
+	input = _queues[index];
+	output = (index + 1 < _queues.size()) ? _queues[index + 1] : NULL;
+
+	while (true) {
+		if (!input->pop(batch)) {
+			stage->idle_waits++;
+			input->wait_data();
+			continue;
+		}
+
+		eos = batch.eos;
+		stage->bytes += batch.data.size();
+
+		start = get_time();
+
+		/* A failed stage drops the batch but keeps running. */
+		try {
+			keep = stage->process(batch);
+		} catch (const Error &error) {
+			stage->error = error.code;
+			keep = false;
+		}
+
+		stage->busy_time += get_time() - start;
+
+		stage->batches++;
+		stage->packets += batch.packets.size();
+
+		if (output && (keep || eos)) {
+			batch.eos = eos;
+
+			while (!output->push(batch)) {
+				stage->stalls++;
+				output->wait_space();
+			}
+		}
+
+		batch = Batch();
+
+		if (eos)
+			break;
+	}
+}
+
+/**
+ * Get the statistics of all stages.
+ *
+ * The throughput of a stage is the number of bytes or packets divided by the
+ * elapsed time, see get_elapsed_time().
+ */
+vector<StageStats> Pipeline::get_stats(void) const
+{
+	vector<StageStats> stats;
+	StageStats tmp;
+	size_t i;
+
+	for (i = 0; i < _stages.size(); i++) {
+		tmp.name = _stages[i]->name;
+		tmp.batches = _stages[i]->batches;
+		tmp.bytes = _stages[i]->bytes;
+		tmp.packets = _stages[i]->packets;
+		tmp.busy_time = _stages[i]->busy_time;
+		tmp.idle_waits = _stages[i]->idle_waits;
+		tmp.stalls = _stages[i]->stalls;
+		tmp.error = _stages[i]->error;
+		tmp.queue_depth = _queues[i]->size();
+		tmp.queue_size = _queues[i]->capacity();
+		stats.push_back(tmp);
+	}
+
+	return stats;
+}
+
+/**
+ * Get the time since the pipeline was started in nanoseconds, or the total
+ * running time if the pipeline is stopped.
+ */
+uint64_t Pipeline::get_elapsed_time(void) const
+{
+	if (!_start_time)
+		return 0;
+
+	if (_running)
+		return get_time() - _start_time;
+
+	return _stop_time - _start_time;
+}
+
+}
@@ -0,0 +1,575 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "libswocxx.h"
+
+namespace libswo
+{
+
+/*
+ * Decoder stream.
+ *
+ * Trace data is handed over from the producer to the worker through a
+ * single-producer/single-consumer queue of chunks.
+ */
+class Runtime::Stream
+{
+public:
+	Stream(libswo_decoder_callback callback, void *user_data,
+		size_t buffer_size, size_t queue_size);
+	~Stream(void);
+
+	bool push(vector<uint8_t> &data);
+	bool pop(vector<uint8_t> &data);
+	void decode(const vector<uint8_t> &data);
+	StreamStats get_stats(void) const;
+
+	Worker *worker;
+private:
+	struct libswo_context *_context;
+	size_t _chunk_size;
+	vector<vector<uint8_t> > _slots;
+	atomic<size_t> _head;
+	atomic<size_t> _tail;
+	atomic<uint64_t> _bytes;
+	atomic<uint64_t> _dropped;
+	atomic<uint64_t> _errors;
+	atomic<int> _error;
+};
+
+/*
+ * Worker thread.
+ *
+ * Each stream is assigned to exactly one worker such that its context and
+ * callback are only ever used by a single thread.
+ */
+class Runtime::Worker
+{
+public:
+	Worker(void);
+	~Worker(void);
+
+	size_t get_num_streams(void) const;
+	vector<Stream *> get_streams(void);
+
+	void add(Stream *stream);
+	void remove(Stream *stream);
+	void notify(void);
+	void flush(void);
+	void stop(void);
+private:
+	void run(void);
+
+	thread _thread;
+	mutex _mutex;
+	condition_variable _cv;
+	condition_variable _ack_cv;
+	vector<Stream *> _streams;
+	atomic<unsigned int> _generation;
+	unsigned int _acked;
+	atomic<bool> _pending;
+	atomic<bool> _stop;
+	bool _idle;
+};
+
+Runtime::Stream::Stream(libswo_decoder_callback callback, void *user_data,
+		size_t buffer_size, size_t queue_size) :
+	worker(NULL),
+	_chunk_size(buffer_size / 2),
+	_slots(queue_size),
+	_head(0),
+	_tail(0),
+	_bytes(0),
+	_dropped(0),
+	_errors(0),
+	_error(LIBSWO_OK)
+{
+	int ret;
+
+	if (!_chunk_size || !queue_size)
+		throw Error(LIBSWO_ERR_ARG);
+
+	ret = libswo_init(&_context, NULL, buffer_size);
+
+	if (ret != LIBSWO_OK)
+		throw Error(ret);
+
+	ret = libswo_set_callback(_context, callback, user_data);
+
+	if (ret != LIBSWO_OK) {
+		libswo_exit(_context);
+		throw Error(ret);
+	}
+}
+
+Runtime::Stream::~Stream(void)
+{
+	libswo_exit(_context);
+}
+
+bool Runtime::Stream::push(vector<uint8_t> &data)
+{
+	size_t head;
+	size_t tail;
+
+	tail = _tail.load(memory_order_relaxed);
+	head = _head.load(memory_order_acquire);
+
+	if (tail - head == _slots.size())
+		return false;
+
+	_slots[tail % _slots.size()] = std::move(data);
+	_tail.store(tail + 1, memory_order_release);
+
+	return true;
+}
+
+bool Runtime::Stream::pop(vector<uint8_t> &data)
+{
+	size_t head;
+	size_t tail;
+
+	head = _head.load(memory_order_relaxed);
+	tail = _tail.load(memory_order_acquire);
+
+	if (head == tail)
+		return false;
+
+	data = std::move(_slots[head % _slots.size()]);
+	_head.store(head + 1, memory_order_release);
+
+	return true;
+}
+
+/*
+ * Decode a chunk of trace data. If feeding or decoding fails, the remaining
+ * data of the chunk is dropped and the error is recorded.
+ *
+ * If the callback function stopped decoding, complete packets are left in the
+ * buffer and the next part of the chunk may not fit anymore. In this case,
+ * decoding is resumed until there is enough space. Each resumption decodes at
+ * least one packet, the number of attempts is therefore bounded by the buffer
+ * size.
+ */
+void Runtime::Stream::decode(const vector<uint8_t> &data)
+{
+	size_t offset;
+	size_t tmp;
+	size_t attempts;
+	int ret;
+
+	ret = LIBSWO_OK;
+
+	for (offset = 0; offset < data.size(); offset += tmp) {
+		tmp = std::min(data.size() - offset, _chunk_size);
+
+		for (attempts = 0; attempts <= 2 * _chunk_size; attempts++) {
+			ret = libswo_feed(_context, &data[offset], tmp);
+
+			if (ret == LIBSWO_OK)
+				break;
+
+			ret = libswo_decode(_context, 0);
+
+			if (ret != LIBSWO_OK)
+				break;
+
+			ret = LIBSWO_ERR;
+		}
+
+		if (ret != LIBSWO_OK)
+			break;
+
+		_bytes.fetch_add(tmp, memory_order_relaxed);
+		ret = libswo_decode(_context, 0);
+
+		if (ret != LIBSWO_OK) {
+			offset += tmp;
+			break;
+		}
+	}
+
+	if (offset >= data.size())
+		return;
+
+	_dropped.fetch_add(data.size() - offset, memory_order_relaxed);
+	_errors.fetch_add(1, memory_order_relaxed);
+	_error.store(ret, memory_order_relaxed);
+}
+
+StreamStats Runtime::Stream::get_stats(void) const
+{
+	StreamStats stats;
+
+	stats.bytes = _bytes.load(memory_order_relaxed);
+	stats.dropped = _dropped.load(memory_order_relaxed);
+	stats.errors = _errors.load(memory_order_relaxed);
+	stats.error = _error.load(memory_order_relaxed);
+
+	return stats;
+}
+
+Runtime::Worker::Worker(void) :
+	_generation(0),
+	_acked(0),
+	_pending(false),
+	_stop(false),
+	_idle(false)
+{
+	_thread = thread(&Runtime::Worker::run, this);
+}
+
+Runtime::Worker::~Worker(void)
+{
+	stop();
+}
+
+size_t Runtime::Worker::get_num_streams(void) const
+{
+	return _streams.size();
+}
+
+vector<Runtime::Stream *> Runtime::Worker::get_streams(void)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	return _streams;
+}
+
+void Runtime::Worker::add(Stream *stream)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	stream->worker = this;
+	_streams.push_back(stream);
+	_generation++;
+	_cv.notify_one();
+}
+
+void Runtime::Worker::remove(Stream *stream)
+{
+	unique_lock<mutex> lock(_mutex);
+	vector<Stream *>::iterator it;
+
+	/* Waiting for the worker itself would never return. */
+	if (this_thread::get_id() == _thread.get_id())
+		throw Error(LIBSWO_ERR_ARG);
+
+	it = std::find(_streams.begin(), _streams.end(), stream);
+
+	if (it == _streams.end())
+		throw Error(LIBSWO_ERR_ARG);
+
+	_streams.erase(it);
+	_generation++;
+	_cv.notify_one();
+
+	/*
+	 * Wait until the worker picked up the new stream list. Afterwards, the
+	 * stream is not used by the worker anymore.
+	 */
+	_ack_cv.wait(lock, [this] {
+		return _acked == _generation || _stop;
+	});
+}
+
+void Runtime::Worker::notify(void)
+{
+	/* Only wake up the worker if it may be going to sleep. */
+	if (!_pending.exchange(true)) {
+		lock_guard<mutex> lock(_mutex);
+		_cv.notify_one();
+	}
+}
+
+void Runtime::Worker::flush(void)
+{
+	unique_lock<mutex> lock(_mutex);
+
+	_ack_cv.wait(lock, [this] {
+		return (_idle && !_pending && _acked == _generation) || _stop;
+	});
+}
+
+void Runtime::Worker::stop(void)
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		_stop = true;
+		_cv.notify_one();
+		_ack_cv.notify_all();
+	}
+
+	if (_thread.joinable())
+		_thread.join();
+}
+
+void Runtime::Worker::run(void)
+{
+	vector<Stream *> streams;
+	vector<uint8_t> data;
+	unsigned int generation;
+	size_t i;
+	bool busy;
+
+	generation = 0;
+
+	while (!_stop) {
+		if (_generation != generation) {
+			lock_guard<mutex> lock(_mutex);
+
+			streams = _streams;
+			generation = _generation;
+			_acked = generation;
+			_ack_cv.notify_all();
+		}
+
+		_pending = false;
+		busy = false;
+
+		/* Process one chunk per stream and round for fairness. */
+		for (i = 0; i < streams.size(); i++) {
+			if (!streams[i]->pop(data))
+				continue;
+
+			streams[i]->decode(data);
+			busy = true;
+		}
+
+		if (busy)
+			continue;
+
+		unique_lock<mutex> lock(_mutex);
+
+		if (_generation != generation)
+			continue;
+
+		_idle = true;
+		_ack_cv.notify_all();
+
+		_cv.wait(lock, [this, generation] {
+			return _pending || _stop || _generation != generation;
+		});
+
+		_idle = false;
+	}
+}
+
+/**
+ * Create a multi-stream decoding runtime.
+ *
+ * @param[in] num_workers Number of worker threads, or 0 to use one worker
+ *                        per hardware thread.
+ * @param[in] queue_size Maximum number of pending chunks of trace data per
+ *                       stream.
+ */
+Runtime::Runtime(unsigned int num_workers, size_t queue_size) :
+	_queue_size(queue_size)
+{
+	unsigned int i;
+
+	if (!queue_size)
+		throw Error(LIBSWO_ERR_ARG);
+
+	if (!num_workers)
+		num_workers = std::max(thread::hardware_concurrency(), 1U);
+
+	try {
+		for (i = 0; i < num_workers; i++)
+			_workers.push_back(new Worker());
+	} catch (...) {
+		for (i = 0; i < _workers.size(); i++)
+			delete _workers[i];
+
+		throw;
+	}
+}
+
+/**
+ * Destroy the runtime.
+ *
+ * All workers are stopped and all remaining streams are removed. Pending
+ * trace data is discarded, use flush() beforehand to decode it.
+ */
+Runtime::~Runtime(void)
+{
+	vector<Stream *> streams;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < _workers.size(); i++) {
+		_workers[i]->stop();
+		streams = _workers[i]->get_streams();
+
+		for (j = 0; j < streams.size(); j++)
+			delete streams[j];
+
+		delete _workers[i];
+	}
+}
+
+unsigned int Runtime::get_num_workers(void) const
+{
+	return _workers.size();
+}
+
+/**
+ * Add a stream.
+ *
+ * The stream is assigned to the worker with the least number of streams. The
+ * callback function is always invoked on this worker thread and therefore
+ * never concurrently for the same stream.
+ *
+ * A callback function which returns false does not stop the stream. Decoding
+ * is resumed with the next packet as soon as the stream needs space in the
+ * buffer for more trace data.
+ *
+ * @param[in] callback Decoder callback function.
+ * @param[in] user_data User data to be passed to the callback function.
+ * @param[in] buffer_size Buffer size of the stream's decoder context.
+ *
+ * @return Handle of the new stream.
+ */
+Runtime::Stream *Runtime::add_stream(libswo_decoder_callback callback,
+		void *user_data, size_t buffer_size)
+{
+	lock_guard<mutex> lock(_mutex);
+	Worker *worker;
+	Stream *stream;
+	size_t i;
+
+	worker = _workers[0];
+
+	for (i = 1; i < _workers.size(); i++) {
+		if (_workers[i]->get_num_streams() < worker->get_num_streams())
+			worker = _workers[i];
+	}
+
+	stream = new Stream(callback, user_data, buffer_size, _queue_size);
+	worker->add(stream);
+
+	return stream;
+}
+
+/**
+ * Remove a stream.
+ *
+ * Pending trace data of the stream is discarded. Once this function returns,
+ * the callback function of the stream is not invoked anymore.
+ *
+ * @note This function must not be called from a callback function of a stream
+ *       which is assigned to the same worker.
+ *
+ * @param[in] stream Stream to remove.
+ */
+void Runtime::remove_stream(Stream *stream)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	if (!stream || !stream->worker)
+		throw Error(LIBSWO_ERR_ARG);
+
+	stream->worker->remove(stream);
+	delete stream;
+}
+
+/**
+ * Hand over trace data to a stream.
+ *
+ * This function never waits for the worker. Only a single thread may feed a
+ * particular stream at a time.
+ *
+ * @param[in] stream Stream.
+ * @param[in] data Trace data.
+ * @param[in] length Number of bytes.
+ *
+ * @return False if the queue of the stream is full and the trace data was not
+ *         accepted, true otherwise.
+ */
+bool Runtime::feed(Stream *stream, const uint8_t *data, size_t length)
+{
+	vector<uint8_t> tmp(data, data + length);
+
+	return feed(stream, std::move(tmp));
+}
+
+/**
+ * Hand over trace data to a stream without copying it.
+ *
+ * @param[in] stream Stream.
+ * @param[in,out] data Trace data. On success, the ownership of the data is
+ *                     transferred to the stream and the vector is left empty.
+ *
+ * @return False if the queue of the stream is full and the trace data was not
+ *         accepted, true otherwise.
+ */
+bool Runtime::feed(Stream *stream, vector<uint8_t> &&data)
+{
+	if (!stream || !stream->worker)
+		throw Error(LIBSWO_ERR_ARG);
+
+	if (data.empty())
+		return true;
+
+	if (!stream->push(data))
+		return false;
+
+	stream->worker->notify();
+
+	return true;
+}
+
+/**
+ * Get the statistics of a stream.
+ *
+ * If feeding or decoding a chunk of trace data fails, for example because the
+ * callback function returned an error, the remaining data of the chunk is
+ * dropped. Use flush() beforehand to include all trace data handed over so
+ * far.
+ *
+ * @param[in] stream Stream.
+ *
+ * @return Statistics of the stream.
+ */
+StreamStats Runtime::get_stats(const Stream *stream) const
+{
+	if (!stream || !stream->worker)
+		throw Error(LIBSWO_ERR_ARG);
+
+	return stream->get_stats();
+}
+
+/**
+ * Wait until all trace data handed over so far is decoded.
+ */
+void Runtime::flush(void)
+{
+	size_t i;
+
+	for (i = 0; i < _workers.size(); i++)
+		_workers[i]->flush();
+}
+
+}
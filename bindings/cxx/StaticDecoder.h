@@ -0,0 +1,497 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSWOCXX_STATIC_DECODER_H
+#define LIBSWOCXX_STATIC_DECODER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "libswocxx.h"
+
+namespace libswo
+{
+
+/*
+ * Bitmask of packet types to be used as template argument of StaticDecoder,
+ * for example PacketTypeMask<PACKET_TYPE_INST, PACKET_TYPE_DWT_PC_SAMPLE>.
+ */
+template<enum PacketType... Types>
+struct PacketTypeMask;
+
+template<>
+struct PacketTypeMask<>
+{
+	static const uint32_t value = 0;
+};
+
+template<enum PacketType Type, enum PacketType... Types>
+struct PacketTypeMask<Type, Types...>
+{
+	static const uint32_t value = (UINT32_C(1) << Type) | \
+		PacketTypeMask<Types...>::value;
+};
+
+/*
+ * Decoder which is specialized at compile-time for a fixed set of packet
+ * types.
+ *
+ * The decoder operates on a contiguous buffer and produces the same packets
+ * as libswo_decode() for all enabled packet types. Packets of all other types
+ * are skipped without decoding their fields. The handler is invoked as
+ * handler(const union libswo_packet &) and must return a value with the same
+ * meaning as the return value of a libswo_decoder_callback.
+ */
+template<uint32_t Types, class Handler>
+class StaticDecoder
+{
+public:
+	StaticDecoder(Handler &handler) :
+		_handler(handler)
+	{
+		memset(&_packet, 0, sizeof(_packet));
+	}
+
+	/*
+	 * Decode the given trace data and return the number of bytes consumed.
+	 *
+	 * Incomplete packets at the end of the buffer are not consumed unless
+	 * DF_EOS is given, in which case they are reported as unknown data.
+	 * Decoding stops after a packet for which the handler returned false.
+	 */
+	size_t decode(const uint8_t *data, size_t length, uint32_t flags = 0)
+	{
+		size_t offset;
+		size_t tmp;
+		int ret;
+
+		offset = 0;
+
+		while (offset < length) {
+			tmp = decode_packet(data + offset, length - offset);
+
+			if (!tmp)
+				break;
+
+			if (enabled(_packet.type)) {
+				if (_packet.type != LIBSWO_PACKET_TYPE_SYNC)
+					memcpy(_packet.any.data, data + offset,
+						_packet.any.size);
+
+				ret = _handler(_packet);
+			} else {
+				ret = true;
+			}
+
+			offset += tmp;
+
+			if (ret < 0)
+				throw Error(LIBSWO_ERR);
+			else if (!ret)
+				return offset;
+		}
+
+		if (!(flags & DF_EOS))
+			return offset;
+
+		_packet.type = LIBSWO_PACKET_TYPE_UNKNOWN;
+
+		while (offset < length) {
+			tmp = length - offset;
+
+			if (tmp > sizeof(_packet.any.data))
+				tmp = sizeof(_packet.any.data);
+
+			_packet.unknown.size = tmp;
+			memcpy(_packet.unknown.data, data + offset, tmp);
+			offset += tmp;
+
+			if (!enabled(LIBSWO_PACKET_TYPE_UNKNOWN))
+				continue;
+
+			ret = _handler(_packet);
+
+			if (ret < 0)
+				throw Error(LIBSWO_ERR);
+			else if (!ret)
+				break;
+		}
+
+		return offset;
+	}
+private:
+	static bool enabled(unsigned int type)
+	{
+		return (Types >> type) & 1;
+	}
+
+	static bool any_enabled(uint32_t mask)
+	{
+		return Types & mask;
+	}
+
+	/*
+	 * Length of a payload with continuation bits, or 0 if the payload is
+	 * incomplete. This mirrors decode_cond_payload() in decoder.c.
+	 */
+	static size_t cond_payload(const uint8_t *data, size_t length,
+			uint32_t *value)
+	{
+		unsigned int i;
+		uint32_t tmp;
+
+		tmp = 0;
+
+		for (i = 0; i < LIBSWO_MAX_PAYLOAD_SIZE - 1; i++) {
+			if (1 + i >= length)
+				return 0;
+
+			tmp |= (data[1 + i] & ~0x80) << (i * 7);
+
+			if (!(data[1 + i] & 0x80)) {
+				*value = tmp;
+				return i + 1;
+			}
+		}
+
+		if (1 + i >= length)
+			return 0;
+
+		*value = tmp | (data[1 + i] << (i * 7));
+
+		return i + 1;
+	}
+
+	static uint32_t payload_value(const uint8_t *data, size_t size)
+	{
+		uint32_t tmp;
+		size_t i;
+
+		tmp = 0;
+
+		for (i = 0; i < size; i++)
+			tmp |= data[i] << (i * 8);
+
+		return tmp;
+	}
+
+	void unknown(size_t size)
+	{
+		_packet.type = LIBSWO_PACKET_TYPE_UNKNOWN;
+		_packet.unknown.size = size;
+	}
+
+	/*
+	 * Decode a single packet into _packet and return its length in bytes,
+	 * or 0 if the packet is incomplete. Fields of disabled packet types are
+	 * not decoded.
+	 */
+	size_t decode_packet(const uint8_t *data, size_t length)
+	{
+		uint8_t header;
+		uint32_t value;
+		size_t n;
+
+		header = data[0];
+
+		if (header == 0x00)
+			return decode_sync(data, length);
+
+		if (header == 0x70) {
+			_packet.type = LIBSWO_PACKET_TYPE_OVERFLOW;
+			_packet.of.size = 1;
+			return 1;
+		}
+
+		if (!(header & ~0x70)) {
+			_packet.type = LIBSWO_PACKET_TYPE_LTS;
+			_packet.lts.size = 1;
+
+			if (enabled(LIBSWO_PACKET_TYPE_LTS)) {
+				_packet.lts.value = (header & 0x70) >> 4;
+				_packet.lts.relation = LIBSWO_LTS_REL_SYNC;
+			}
+
+			return 1;
+		}
+
+		if ((header & ~0x30) == 0xc0) {
+			n = cond_payload(data, length, &value);
+
+			if (!n)
+				return 0;
+
+			_packet.type = LIBSWO_PACKET_TYPE_LTS;
+			_packet.lts.size = n + 1;
+
+			if (enabled(LIBSWO_PACKET_TYPE_LTS)) {
+				_packet.lts.value = value & 0xfffffff;
+				_packet.lts.relation = static_cast<
+					enum libswo_lts_relation>(
+					(header & 0x30) >> 4);
+			}
+
+			return n + 1;
+		}
+
+		if ((header & 0x0b) == 0x08) {
+			n = 0;
+			value = 0;
+
+			if (header & 0x80) {
+				n = cond_payload(data, length, &value);
+
+				if (!n)
+					return 0;
+			}
+
+			_packet.type = LIBSWO_PACKET_TYPE_EXT;
+			_packet.ext.size = n + 1;
+
+			if (enabled(LIBSWO_PACKET_TYPE_EXT)) {
+				_packet.ext.value = ((header & 0x70) >> 4) | \
+					(value << 3);
+
+				if (header & 0x04)
+					_packet.ext.source = LIBSWO_EXT_SRC_HW;
+				else
+					_packet.ext.source = LIBSWO_EXT_SRC_ITM;
+			}
+
+			return n + 1;
+		}
+
+		if ((header & 0xdf) == 0x94) {
+			n = cond_payload(data, length, &value);
+
+			if (!n)
+				return 0;
+
+			if (header & 0x20)
+				return decode_gts2(value, n);
+
+			_packet.type = LIBSWO_PACKET_TYPE_GTS1;
+			_packet.gts1.size = n + 1;
+
+			if (enabled(LIBSWO_PACKET_TYPE_GTS1)) {
+				_packet.gts1.value = value & 0x03ffffff;
+				_packet.gts1.clkch = value & 0x4000000;
+				_packet.gts1.wrap = value & 0x8000000;
+			}
+
+			return n + 1;
+		}
+
+		if (header & 0x03) {
+			n = 1 << ((header & 0x03) - 1);
+
+			if (n + 1 > length)
+				return 0;
+
+			if (header & 0x04)
+				decode_hw(data, n);
+			else
+				decode_inst(data, n);
+
+			return n + 1;
+		}
+
+		unknown(1);
+
+		return 1;
+	}
+
+	size_t decode_sync(const uint8_t *data, size_t length)
+	{
+		size_t i;
+		size_t j;
+		size_t num_bits;
+
+		num_bits = 8;
+
+		for (i = 0; ; i++) {
+			if (1 + i >= length)
+				return 0;
+
+			if (data[1 + i])
+				break;
+
+			num_bits += 8;
+		}
+
+		for (j = 0; j < 8; j++, num_bits++)
+			if (data[1 + i] & (1 << j))
+				break;
+
+		if (num_bits < 47) {
+			unknown(i + 1);
+			return i + 1;
+		}
+
+		_packet.type = LIBSWO_PACKET_TYPE_SYNC;
+		_packet.sync.size = num_bits + 1;
+
+		return (num_bits + 1 + 7) / 8;
+	}
+
+	size_t decode_gts2(uint32_t value, size_t n)
+	{
+		if (n != 4) {
+			unknown(1);
+			return 1;
+		}
+
+		_packet.type = LIBSWO_PACKET_TYPE_GTS2;
+		_packet.gts2.size = n + 1;
+
+		if (enabled(LIBSWO_PACKET_TYPE_GTS2))
+			_packet.gts2.value = value & 0x3fffff;
+
+		return n + 1;
+	}
+
+	void decode_inst(const uint8_t *data, size_t n)
+	{
+		_packet.type = LIBSWO_PACKET_TYPE_INST;
+		_packet.inst.size = n + 1;
+
+		if (!enabled(LIBSWO_PACKET_TYPE_INST))
+			return;
+
+		memcpy(_packet.inst.payload, data + 1, n);
+		_packet.inst.address = data[0] >> 3;
+		_packet.inst.value = payload_value(data + 1, n);
+	}
+
+	void decode_hw(const uint8_t *data, size_t n)
+	{
+		uint8_t address;
+
+		/*
+		 * Only packet types and sizes are required for skipping if
+		 * neither hardware source packets nor any of the DWT packets
+		 * are enabled.
+		 */
+		if (!any_enabled(HW_MASK)) {
+			_packet.type = LIBSWO_PACKET_TYPE_HW;
+			_packet.hw.size = n + 1;
+			return;
+		}
+
+		address = data[0] >> 3;
+
+		_packet.hw.type = LIBSWO_PACKET_TYPE_HW;
+		_packet.hw.size = n + 1;
+		_packet.hw.address = address;
+		memcpy(_packet.hw.payload, data + 1, n);
+		_packet.hw.value = payload_value(data + 1, n);
+
+		/*
+		 * Classification of a DWT packet type is only required if that
+		 * type or generic hardware source packets are enabled. In the
+		 * latter case, the packet must not be reported as generic
+		 * hardware source packet if it is a valid DWT packet.
+		 */
+		if (address == 0) {
+			if (dwt_enabled(LIBSWO_PACKET_TYPE_DWT_EVTCNT) &&
+					n + 1 == 2) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_EVTCNT;
+				_packet.evtcnt.cpi = data[1] & 0x01;
+				_packet.evtcnt.exc = data[1] & 0x02;
+				_packet.evtcnt.sleep = data[1] & 0x04;
+				_packet.evtcnt.lsu = data[1] & 0x08;
+				_packet.evtcnt.fold = data[1] & 0x10;
+				_packet.evtcnt.cyc = data[1] & 0x20;
+			}
+		} else if (address == 1) {
+			if (dwt_enabled(LIBSWO_PACKET_TYPE_DWT_EXCTRACE) &&
+					n + 1 == 3) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_EXCTRACE;
+				_packet.exctrace.exception = data[1] | \
+					((data[2] & 0x01) << 8);
+				_packet.exctrace.function = static_cast<
+					enum libswo_exctrace_function>(
+					(data[2] & 0x30) >> 4);
+			}
+		} else if (address == 2) {
+			if (!dwt_enabled(LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE))
+				return;
+
+			if (n + 1 == 2 && !_packet.hw.value) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE;
+				_packet.pc_sample.sleep = true;
+				_packet.pc_sample.pc = 0;
+			} else if (n + 1 == 5) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE;
+				_packet.pc_sample.sleep = false;
+				_packet.pc_sample.pc = _packet.hw.value;
+			}
+		} else if ((address & 0x19) == 0x08) {
+			if (dwt_enabled(LIBSWO_PACKET_TYPE_DWT_PC_VALUE) &&
+					n + 1 == 5) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_PC_VALUE;
+				_packet.pc_value.cmpn = (address & 0x06) >> 1;
+				_packet.pc_value.pc = _packet.hw.value;
+			}
+		} else if ((address & 0x19) == 0x09) {
+			if (dwt_enabled(LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET) &&
+					n + 1 == 3) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET;
+				_packet.addr_offset.cmpn = (address & 0x06) >> 1;
+				_packet.addr_offset.offset = _packet.hw.value;
+			}
+		} else if ((address & 0x18) == 0x10) {
+			if (dwt_enabled(LIBSWO_PACKET_TYPE_DWT_DATA_VALUE)) {
+				_packet.type = LIBSWO_PACKET_TYPE_DWT_DATA_VALUE;
+				_packet.data_value.wnr = address & 0x01;
+				_packet.data_value.cmpn = (address & 0x06) >> 1;
+				_packet.data_value.data_value = _packet.hw.value;
+			}
+		}
+	}
+
+	/*
+	 * A DWT packet must be classified if its type is enabled, or if generic
+	 * hardware source packets are enabled. In the latter case the packet
+	 * is classified but skipped if its DWT type is disabled.
+	 */
+	static bool dwt_enabled(enum libswo_packet_type type)
+	{
+		if (enabled(type))
+			return true;
+
+		if (enabled(LIBSWO_PACKET_TYPE_HW))
+			return true;
+
+		return false;
+	}
+
+	static const uint32_t HW_MASK = \
+		PacketTypeMask<PACKET_TYPE_HW, PACKET_TYPE_DWT_EVTCNT,
+			PACKET_TYPE_DWT_EXCTRACE, PACKET_TYPE_DWT_PC_SAMPLE,
+			PACKET_TYPE_DWT_PC_VALUE, PACKET_TYPE_DWT_ADDR_OFFSET,
+			PACKET_TYPE_DWT_DATA_VALUE>::value;
+
+	Handler &_handler;
+	union libswo_packet _packet;
+};
+
+}
+
+#endif /* LIBSWOCXX_STATIC_DECODER_H */
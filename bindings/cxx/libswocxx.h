@@ -24,6 +24,11 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 #include <libswo/libswo.h>
 
@@ -81,6 +86,13 @@ enum DecoderFlags {
 	DF_EOS = LIBSWO_DF_EOS
 };
 
+enum OverflowPolicy {
+	OVERFLOW_BLOCK,
+	OVERFLOW_DROP_NEWEST,
+	OVERFLOW_DROP_OLDEST,
+	OVERFLOW_ERROR
+};
+
 class LIBSWO_API Error : public exception
 {
 public:
@@ -296,6 +308,12 @@ public:
 class LIBSWO_PRIV DecoderCallbackHelper
 {
 public:
+	DecoderCallbackHelper(void) :
+		callback(NULL),
+		user_data(NULL)
+	{
+	}
+
 	DecoderCallback callback;
 	void *user_data;
 };
@@ -322,13 +340,227 @@ public:
 	void set_log_callback(LogCallback callback, void *user_data = NULL);
 
 	void set_callback(DecoderCallback callback, void *user_data = NULL);
+	void set_type_callback(enum PacketType type, DecoderCallback callback,
+		void *user_data = NULL);
+
+	unsigned int subscribe(DecoderCallback callback, void *user_data = NULL,
+		uint32_t types = UINT32_MAX, uint32_t ports = UINT32_MAX);
+	void unsubscribe(unsigned int id);
 
 	void feed(const uint8_t *data, size_t length);
+	void feed(vector<uint8_t> &&data);
 	void decode(uint32_t flags = 0);
+
+	void start(size_t queue_size = 64,
+		enum OverflowPolicy policy = OVERFLOW_BLOCK);
+	void drain(void);
+	void stop(void);
+	bool is_running(void) const;
+	size_t get_num_dropped(void) const;
+protected:
+	void set_native_callback(libswo_decoder_callback callback,
+		void *user_data);
 private:
+	int decode_chunk(const vector<uint8_t> &data);
+	void enqueue(vector<uint8_t> &&data);
+	void run(void);
+
 	struct libswo_context *_context;
 	DecoderCallbackHelper _decoder_callback;
+	DecoderCallbackHelper _type_callbacks[LIBSWO_PACKET_TYPE_USER_MAX + 1];
+	DecoderCallbackHelper _subscribers[LIBSWO_MAX_SUBSCRIBERS];
 	LogCallbackHelper _log_callback;
+	size_t _buffer_size;
+
+	thread _worker;
+	mutable mutex _mutex;
+	condition_variable _data_cv;
+	condition_variable _space_cv;
+	deque<vector<uint8_t> > _queue;
+	size_t _queue_size;
+	enum OverflowPolicy _policy;
+	atomic<bool> _running;
+	bool _stopping;
+	bool _busy;
+	int _error;
+	size_t _num_dropped;
+};
+
+class LIBSWO_API PacketColumns
+{
+public:
+	PacketColumns(void);
+
+	size_t size(void) const;
+	void reserve(size_t capacity);
+	void clear(void);
+	void append(const union libswo_packet *packet);
+
+	vector<uint8_t> types;
+	/* Accumulated local timestamp of each packet. */
+	vector<uint64_t> timestamps;
+	vector<uint8_t> addresses;
+	vector<uint32_t> values;
+	vector<uint32_t> dwt;
+	/* Accumulated local timestamp, not affected by clear(). */
+	uint64_t timestamp;
+};
+
+class LIBSWO_API PacketTable
+{
+public:
+	PacketTable(size_t capacity = 0, size_t buffer_size = 65536);
+	~PacketTable(void);
+
+	size_t size(void) const;
+	size_t capacity(void) const;
+	void reserve(size_t capacity);
+	void clear(void);
+	void swap(PacketColumns &columns);
+
+	void decode(const uint8_t *data, size_t length,
+		uint32_t flags = DF_EOS);
+	void decode_file(const string &filename);
+
+	const vector<uint8_t> &get_types(void) const;
+	const vector<uint64_t> &get_timestamps(void) const;
+	const vector<uint8_t> &get_addresses(void) const;
+	const vector<uint32_t> &get_values(void) const;
+	const vector<uint32_t> &get_dwt(void) const;
+
+	vector<size_t> count_by_type(void) const;
+	vector<size_t> histogram(enum PacketType type, unsigned int shift,
+		size_t num_bins) const;
+	vector<size_t> select_type(enum PacketType type) const;
+	vector<size_t> select_port(uint8_t port) const;
+private:
+	PacketTable(const PacketTable &);
+	PacketTable &operator=(const PacketTable &);
+
+	static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data);
+
+	struct libswo_context *_context;
+	size_t _chunk_size;
+	PacketColumns _columns;
+};
+
+struct StreamStats
+{
+	/* Number of bytes handed over to the decoder. */
+	uint64_t bytes;
+	/* Number of bytes dropped due to errors. */
+	uint64_t dropped;
+	/* Number of errors. */
+	uint64_t errors;
+	/* Error code of the last error, or LIBSWO_OK if none. */
+	int error;
+};
+
+class LIBSWO_API Runtime
+{
+public:
+	class Stream;
+
+	Runtime(unsigned int num_workers = 0, size_t queue_size = 256);
+	~Runtime(void);
+
+	unsigned int get_num_workers(void) const;
+
+	Stream *add_stream(libswo_decoder_callback callback,
+		void *user_data = NULL, size_t buffer_size = 65536);
+	void remove_stream(Stream *stream);
+
+	bool feed(Stream *stream, const uint8_t *data, size_t length);
+	bool feed(Stream *stream, vector<uint8_t> &&data);
+	StreamStats get_stats(const Stream *stream) const;
+	void flush(void);
+private:
+	class Worker;
+
+	Runtime(const Runtime &);
+	Runtime &operator=(const Runtime &);
+
+	vector<Worker *> _workers;
+	size_t _queue_size;
+	mutex _mutex;
+};
+
+class LIBSWO_API Batch
+{
+public:
+	Batch(void);
+	Batch(vector<uint8_t> &&data);
+
+	/* Raw or deframed trace data. */
+	vector<uint8_t> data;
+	/* Decoded packets. */
+	vector<union libswo_packet> packets;
+	/* Reconstructed timestamp of each packet. */
+	vector<uint64_t> timestamps;
+	/* Indicates the end of the stream. */
+	bool eos;
+};
+
+typedef bool (*StageFunction)(Batch &batch, void *user_data);
+
+struct StageStats
+{
+	string name;
+	uint64_t batches;
+	uint64_t bytes;
+	uint64_t packets;
+	/* Time spent processing batches in nanoseconds. */
+	uint64_t busy_time;
+	/* Number of times the stage waited for input. */
+	uint64_t idle_waits;
+	/* Number of times the stage waited for space in its output queue. */
+	uint64_t stalls;
+	size_t queue_depth;
+	size_t queue_size;
+	/* Error code of the stage, or LIBSWO_OK if it did not fail. */
+	int error;
+};
+
+class LIBSWO_API Pipeline
+{
+public:
+	Pipeline(size_t queue_size = 64);
+	~Pipeline(void);
+
+	void add_stage(const string &name, StageFunction function,
+		void *user_data = NULL);
+	void add_decode_stage(size_t buffer_size = 65536);
+	void add_timestamp_stage(void);
+
+	void start(bool pin = false);
+	void push(Batch &&batch);
+	bool try_push(Batch &&batch);
+	void stop(void);
+
+	vector<StageStats> get_stats(void) const;
+	uint64_t get_elapsed_time(void) const;
+private:
+	class Queue;
+	class Stage;
+	class FunctionStage;
+	class DecodeStage;
+	class TimestampStage;
+
+	Pipeline(const Pipeline &);
+	Pipeline &operator=(const Pipeline &);
+
+	void add(Stage *stage);
+	void abort_start(void);
+	void run(size_t index);
+
+	size_t _queue_size;
+	vector<Stage *> _stages;
+	vector<Queue *> _queues;
+	vector<thread> _threads;
+	bool _running;
+	uint64_t _start_time;
+	uint64_t _stop_time;
 };
 
 class LIBSWO_API Version {
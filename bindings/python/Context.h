@@ -32,9 +32,28 @@ public:
 
 	void set_callback(PyObject *callback);
 	void set_log_callback(PyObject *callback);
+
+	void set_column_batch_callback(PyObject *callback, size_t batch_size);
+
+	void decode(uint32_t flags = 0);
+	void decode_fd(int fd);
+	void decode_path(const std::string &path);
+	PyObject *decode_columns(PyObject *data);
+	PyObject *decode_file_columns(const std::string &filename);
 private:
+	static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data);
+	static int batch_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data);
+	int flush_batch(void);
+
 	PyObject *_py_callback;
 	PyObject *_py_log_callback;
+	PyObject *_py_batch_callback;
+	size_t _batch_size;
+	size_t _chunk_size;
+	bool _stopped;
+	libswo::PacketColumns _batch;
 };
 
 #endif /* LIBSWO_BINDINGS_PYTHON_CONTEXT_H */
@@ -0,0 +1,115 @@
+##
+## This file is part of the libswo project.
+##
+## Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+##
+## This program is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+
+"""
+asyncio integration for swopy.
+
+Example:
+
+	reader, writer = await asyncio.open_connection('localhost', 2332)
+
+	async for packet in PacketStream(reader):
+		print(packet)
+"""
+
+import asyncio
+import collections
+
+from .swopy import Context, DF_EOS
+
+class PacketStream(object):
+	"""
+	Asynchronous iterator over the packets decoded from an async byte source.
+
+	The source is either an object with a read() coroutine, for example an
+	asyncio.StreamReader, or an asynchronous iterable of bytes objects. The
+	trace data is decoded in an executor without holding the global
+	interpreter lock, so decoding never stalls the event loop.
+
+	If batch_size is given, the iterator yields batches of up to batch_size
+	packets in the same format as Context.decode_to_array(). Otherwise, it
+	yields single packet objects.
+	"""
+
+	def __init__(self, source, batch_size=None, chunk_size=65536,
+			executor=None):
+		if chunk_size <= 0:
+			raise ValueError('chunk_size must be positive')
+
+		self._source = source
+		self._chunk_size = chunk_size
+		self._executor = executor
+		self._pending = collections.deque()
+		self._eos = False
+
+		if hasattr(source, 'read'):
+			self._iterator = None
+		else:
+			self._iterator = source.__aiter__()
+
+		# Leave enough space for an incomplete packet from the previous
+		# chunk.
+		self._context = Context(2 * chunk_size)
+
+		if batch_size:
+			self._context.set_batch_callback(self._pending.append,
+				batch_size)
+		else:
+			self._context.set_callback(self._pending.append)
+
+	@property
+	def context(self):
+		"""Decoder context, for example to adjust the log level."""
+		return self._context
+
+	def __aiter__(self):
+		return self
+
+	async def _read(self):
+		if self._iterator is None:
+			return await self._source.read(self._chunk_size)
+
+		try:
+			return await self._iterator.__anext__()
+		except StopAsyncIteration:
+			return b''
+
+	def _decode(self, data):
+		if not data:
+			self._context.decode(DF_EOS)
+			return
+
+		for i in range(0, len(data), self._chunk_size):
+			self._context.feed(data[i:i + self._chunk_size])
+			self._context.decode()
+
+	async def __anext__(self):
+		loop = asyncio.get_running_loop()
+
+		while not self._pending:
+			if self._eos:
+				raise StopAsyncIteration
+
+			data = await self._read()
+			self._eos = not data
+
+			await loop.run_in_executor(self._executor, self._decode,
+				data)
+
+		return self._pending.popleft()
@@ -57,7 +57,58 @@ static int swig_exception_code(int code)
 }
 %}
 
-%rename(__str__) libswo::Packet::to_string;
+/*
+ * Packets are passed to Python as owned packet objects which are created by
+ * packet_object(). Do not wrap the packet classes of the C++ bindings, the
+ * packet object types use the same names instead.
+ */
+%ignore libswo::Packet;
+%ignore libswo::PayloadPacket;
+%ignore libswo::Unknown;
+%ignore libswo::Synchronization;
+%ignore libswo::Overflow;
+%ignore libswo::LocalTimestamp;
+%ignore libswo::GlobalTimestamp1;
+%ignore libswo::GlobalTimestamp2;
+%ignore libswo::Extension;
+%ignore libswo::Instrumentation;
+%ignore libswo::Hardware;
+%ignore libswo::EventCounter;
+%ignore libswo::ExceptionTrace;
+%ignore libswo::PCSample;
+%ignore libswo::PCValue;
+%ignore libswo::AddressOffset;
+%ignore libswo::DataValue;
+
+/*
+ * The runtime and the pipeline invoke native callback functions on their
+ * worker threads.
+ */
+%ignore libswo::Runtime;
+%ignore libswo::Pipeline;
+%ignore libswo::Batch;
+%ignore libswo::StageStats;
+%ignore libswo::StreamStats;
+
+/* Packet columns are passed to Python as arrays. */
+%ignore libswo::PacketColumns;
+%ignore libswo::PacketTable::swap;
+
+/*
+ * Asynchronous decoding invokes the callback functions on a worker thread
+ * which needs the GIL, use the asyncio integration instead.
+ */
+%ignore libswo::Context::feed(vector<uint8_t> &&);
+%ignore libswo::Context::start;
+%ignore libswo::Context::drain;
+%ignore libswo::Context::stop;
+%ignore libswo::Context::is_running;
+%ignore libswo::Context::get_num_dropped;
+
+/* Type callbacks and subscribers take native callback functions only. */
+%ignore libswo::Context::set_type_callback;
+%ignore libswo::Context::subscribe;
+%ignore libswo::Context::unsubscribe;
 
 %pybuffer_binary(const uint8_t *data, size_t length)
 void libswo::Context::feed(const uint8_t *data, size_t length);
@@ -82,23 +133,70 @@ void libswo::Context::feed(const uint8_t *data, size_t length);
 %rename libswo::Context _Context;
 
 %{
+#include <algorithm>
+#include <memory>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "Context.h"
 
+/* Default number of packets delivered to a batch callback at once. */
+#define DEFAULT_BATCH_SIZE	4096
+
+/* Size of the buffer used to read trace data from a file in bytes. */
+#define READ_BUFFER_SIZE	(1024 * 1024)
+
+#ifndef O_BINARY
+#define O_BINARY		0
+#endif
+
+/*
+ * Release the global interpreter lock (GIL) for the lifetime of the object.
+ * Code which runs without the GIL must not touch any Python object and must
+ * use PyGILState_Ensure() to call back into Python.
+ */
+class ReleaseGIL
+{
+public:
+	ReleaseGIL(void)
+	{
+		_state = PyEval_SaveThread();
+	}
+
+	~ReleaseGIL(void)
+	{
+		PyEval_RestoreThread(_state);
+	}
+private:
+	PyThreadState *_state;
+};
+
 Context::Context(size_t buffer_size) :
 	libswo::Context(buffer_size)
 {
 	_py_callback = NULL;
 	_py_log_callback = NULL;
+	_py_batch_callback = NULL;
+	_batch_size = DEFAULT_BATCH_SIZE;
+	_stopped = false;
+
+	/*
+	 * Feed at most half of the buffer at once to leave enough space for
+	 * an incomplete packet from the previous chunk.
+	 */
+	_chunk_size = std::max(buffer_size / 2, (size_t)1);
 }
 
 Context::~Context(void)
 {
 	Py_XDECREF(_py_callback);
 	Py_XDECREF(_py_log_callback);
+	Py_XDECREF(_py_batch_callback);
 }
 
-static int log_callback(libswo::LogLevel level, const std::string &message,
-		void *user_data)
+static int call_log_callback(libswo::LogLevel level,
+		const std::string &message, void *user_data)
 {
 	int ret;
 	PyObject *level_obj;
@@ -141,6 +239,19 @@ static int log_callback(libswo::LogLevel level, const std::string &message,
 	return ret;
 }
 
+static int log_callback(libswo::LogLevel level, const std::string &message,
+		void *user_data)
+{
+	int ret;
+	PyGILState_STATE state;
+
+	state = PyGILState_Ensure();
+	ret = call_log_callback(level, message, user_data);
+	PyGILState_Release(state);
+
+	return ret;
+}
+
 void Context::set_log_callback(PyObject *callback)
 {
 	if (!PyCallable_Check(callback))
@@ -155,75 +266,331 @@ void Context::set_log_callback(PyObject *callback)
 		(void *)_py_log_callback);
 }
 
-static PyObject *packet_object(const libswo::Packet &packet)
+/* Maximum number of fields of a packet object. */
+#define MAX_PACKET_FIELDS	12
+
+/** @cond PRIVATE */
+#define FIELD(name, doc)	{(char *)name, (char *)doc}
+
+#define PACKET_FIELDS \
+	FIELD("type", "packet type"), \
+	FIELD("size", "packet size")
+
+#define PAYLOAD_PACKET_FIELDS \
+	PACKET_FIELDS, \
+	FIELD("data", "packet data")
+
+#define HW_PACKET_FIELDS \
+	PAYLOAD_PACKET_FIELDS, \
+	FIELD("address", "address"), \
+	FIELD("payload", "payload"), \
+	FIELD("value", "integer representation of the payload")
+
+#define FIELDS_END		{NULL, NULL}
+/** @endcond */
+
+static PyStructSequence_Field unknown_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELDS_END
+};
+
+static PyStructSequence_Field sync_fields[] = {
+	PACKET_FIELDS,
+	FIELDS_END
+};
+
+static PyStructSequence_Field of_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELDS_END
+};
+
+static PyStructSequence_Field lts_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELD("relation", "local timestamp relation"),
+	FIELD("value", "local timestamp value"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field gts1_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELD("value", "low-order bits of the global timestamp value"),
+	FIELD("clkch", "clock change flag"),
+	FIELD("wrap", "wrap flag"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field gts2_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELD("value", "high-order bits of the global timestamp value"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field ext_fields[] = {
+	PAYLOAD_PACKET_FIELDS,
+	FIELD("source", "extension source"),
+	FIELD("value", "extension information"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field inst_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELDS_END
+};
+
+static PyStructSequence_Field hw_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELDS_END
+};
+
+static PyStructSequence_Field evtcnt_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("cpi", "CPICNT wrap flag"),
+	FIELD("exc", "EXCCNT wrap flag"),
+	FIELD("sleep", "SLEEPCNT wrap flag"),
+	FIELD("lsu", "LSUCNT wrap flag"),
+	FIELD("fold", "FOLDCNT wrap flag"),
+	FIELD("cyc", "CYCCNT wrap flag"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field exctrace_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("exception", "exception number"),
+	FIELD("function", "exception trace function"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field pc_sample_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("sleep", "sleep flag"),
+	FIELD("pc", "program counter value"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field pc_value_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("comparator", "comparator number"),
+	FIELD("pc", "program counter value"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field addr_offset_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("comparator", "comparator number"),
+	FIELD("offset", "address offset"),
+	FIELDS_END
+};
+
+static PyStructSequence_Field data_value_fields[] = {
+	HW_PACKET_FIELDS,
+	FIELD("wnr", "write access flag"),
+	FIELD("comparator", "comparator number"),
+	FIELD("data_value", "data value"),
+	FIELDS_END
+};
+
+/*
+ * Packet object types, indexed by packet type. The names are the same as the
+ * ones of the corresponding packet classes of the C++ bindings.
+ */
+static struct {
+	enum libswo_packet_type type;
+	PyStructSequence_Desc desc;
+} packet_descs[] = {
+	{LIBSWO_PACKET_TYPE_UNKNOWN,
+		{(char *)"swopy.Unknown", NULL, unknown_fields, 0}},
+	{LIBSWO_PACKET_TYPE_SYNC,
+		{(char *)"swopy.Synchronization", NULL, sync_fields, 0}},
+	{LIBSWO_PACKET_TYPE_OVERFLOW,
+		{(char *)"swopy.Overflow", NULL, of_fields, 0}},
+	{LIBSWO_PACKET_TYPE_LTS,
+		{(char *)"swopy.LocalTimestamp", NULL, lts_fields, 0}},
+	{LIBSWO_PACKET_TYPE_GTS1,
+		{(char *)"swopy.GlobalTimestamp1", NULL, gts1_fields, 0}},
+	{LIBSWO_PACKET_TYPE_GTS2,
+		{(char *)"swopy.GlobalTimestamp2", NULL, gts2_fields, 0}},
+	{LIBSWO_PACKET_TYPE_EXT,
+		{(char *)"swopy.Extension", NULL, ext_fields, 0}},
+	{LIBSWO_PACKET_TYPE_INST,
+		{(char *)"swopy.Instrumentation", NULL, inst_fields, 0}},
+	{LIBSWO_PACKET_TYPE_HW,
+		{(char *)"swopy.Hardware", NULL, hw_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_EVTCNT,
+		{(char *)"swopy.EventCounter", NULL, evtcnt_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_EXCTRACE,
+		{(char *)"swopy.ExceptionTrace", NULL, exctrace_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE,
+		{(char *)"swopy.PCSample", NULL, pc_sample_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_PC_VALUE,
+		{(char *)"swopy.PCValue", NULL, pc_value_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET,
+		{(char *)"swopy.AddressOffset", NULL, addr_offset_fields, 0}},
+	{LIBSWO_PACKET_TYPE_DWT_DATA_VALUE,
+		{(char *)"swopy.DataValue", NULL, data_value_fields, 0}}
+};
+
+static PyTypeObject *packet_types[LIBSWO_PACKET_TYPE_DWT_DATA_VALUE + 1];
+
+/*
+ * Create the packet object types and add them to the given module dictionary.
+ */
+static int init_packet_types(PyObject *dict)
+{
+	size_t i;
+	unsigned int n;
+	const char *name;
+	PyTypeObject *type;
+
+	for (i = 0; i < sizeof(packet_descs) / sizeof(packet_descs[0]); i++) {
+		for (n = 0; packet_descs[i].desc.fields[n].name; n++);
+
+		packet_descs[i].desc.n_in_sequence = n;
+		type = PyStructSequence_NewType(&packet_descs[i].desc);
+
+		if (!type)
+			return -1;
+
+		packet_types[packet_descs[i].type] = type;
+
+		name = strchr(packet_descs[i].desc.name, '.') + 1;
+
+		if (PyDict_SetItemString(dict, name, (PyObject *)type) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *bytes_object(const void *data, size_t size)
+{
+	return PyBytes_FromStringAndSize((const char *)data, size);
+}
+
+/*
+ * Create an owned packet object with all fields populated. Packet objects are
+ * independent of the decoder and can be stored safely.
+ */
+static PyObject *packet_object(const union libswo_packet *packet)
 {
 	PyObject *ret;
-	void *tmp;
+	PyObject *values[MAX_PACKET_FIELDS];
+	enum libswo_packet_type type;
+	size_t i;
+	size_t n;
 
-	tmp = (void *)&packet;
+	type = packet->type;
 
-	switch (packet.get_type()) {
-	case libswo::PACKET_TYPE_UNKNOWN:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__Unknown, 0);
-		break;
-	case libswo::PACKET_TYPE_SYNC:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__Synchronization, 0);
-		break;
-	case libswo::PACKET_TYPE_OVERFLOW:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__Overflow, 0);
-		break;
-	case libswo::PACKET_TYPE_LTS:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__LocalTimestamp, 0);
+	/*
+	 * Packets of user-defined types are decoded from hardware source
+	 * packets and therefore passed as hardware source packets.
+	 */
+	if (type >= LIBSWO_PACKET_TYPE_USER && \
+			type <= LIBSWO_PACKET_TYPE_USER_MAX)
+		type = LIBSWO_PACKET_TYPE_HW;
+
+	if ((size_t)type >= sizeof(packet_types) / \
+			sizeof(packet_types[0]) || !packet_types[type])
+		return NULL;
+
+	n = 0;
+	values[n++] = PyLong_FromUnsignedLong(packet->type);
+	values[n++] = PyLong_FromSize_t(packet->any.size);
+
+	if (packet->type != LIBSWO_PACKET_TYPE_SYNC)
+		values[n++] = bytes_object(packet->any.data,
+			packet->any.size);
+
+	switch (type) {
+	case LIBSWO_PACKET_TYPE_LTS:
+		values[n++] = PyLong_FromUnsignedLong(packet->lts.relation);
+		values[n++] = PyLong_FromUnsignedLong(packet->lts.value);
 		break;
-	case libswo::PACKET_TYPE_GTS1:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__GlobalTimestamp1, 0);
+	case LIBSWO_PACKET_TYPE_GTS1:
+		values[n++] = PyLong_FromUnsignedLong(packet->gts1.value);
+		values[n++] = PyBool_FromLong(packet->gts1.clkch);
+		values[n++] = PyBool_FromLong(packet->gts1.wrap);
 		break;
-	case libswo::PACKET_TYPE_GTS2:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__GlobalTimestamp2, 0);
+	case LIBSWO_PACKET_TYPE_GTS2:
+		values[n++] = PyLong_FromUnsignedLong(packet->gts2.value);
 		break;
-	case libswo::PACKET_TYPE_EXT:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__Extension, 0);
+	case LIBSWO_PACKET_TYPE_EXT:
+		values[n++] = PyLong_FromUnsignedLong(packet->ext.source);
+		values[n++] = PyLong_FromUnsignedLong(packet->ext.value);
 		break;
-	case libswo::PACKET_TYPE_INST:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__Instrumentation, 0);
+	case LIBSWO_PACKET_TYPE_INST:
+	case LIBSWO_PACKET_TYPE_HW:
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		values[n++] = PyLong_FromUnsignedLong(packet->hw.address);
+		values[n++] = bytes_object(packet->hw.payload,
+			packet->hw.size - 1);
+		values[n++] = PyLong_FromUnsignedLong(packet->hw.value);
 		break;
-	case libswo::PACKET_TYPE_HW:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__Hardware, 0);
+	default:
 		break;
-	case libswo::PACKET_TYPE_DWT_EVTCNT:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__EventCounter,
-			0);
+	}
+
+	switch (type) {
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		values[n++] = PyBool_FromLong(packet->evtcnt.cpi);
+		values[n++] = PyBool_FromLong(packet->evtcnt.exc);
+		values[n++] = PyBool_FromLong(packet->evtcnt.sleep);
+		values[n++] = PyBool_FromLong(packet->evtcnt.lsu);
+		values[n++] = PyBool_FromLong(packet->evtcnt.fold);
+		values[n++] = PyBool_FromLong(packet->evtcnt.cyc);
 		break;
-	case libswo::PACKET_TYPE_DWT_EXCTRACE:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__ExceptionTrace, 0);
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->exctrace.exception);
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->exctrace.function);
 		break;
-	case libswo::PACKET_TYPE_DWT_PC_SAMPLE:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__PCSample, 0);
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		values[n++] = PyBool_FromLong(packet->pc_sample.sleep);
+		values[n++] = PyLong_FromUnsignedLong(packet->pc_sample.pc);
 		break;
-	case libswo::PACKET_TYPE_DWT_PC_VALUE:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__PCValue, 0);
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		values[n++] = PyLong_FromUnsignedLong(packet->pc_value.cmpn);
+		values[n++] = PyLong_FromUnsignedLong(packet->pc_value.pc);
 		break;
-	case libswo::PACKET_TYPE_DWT_ADDR_OFFSET:
-		ret = SWIG_NewPointerObj(tmp,
-			SWIGTYPE_p_libswo__AddressOffset, 0);
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->addr_offset.cmpn);
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->addr_offset.offset);
 		break;
-	case libswo::PACKET_TYPE_DWT_DATA_VALUE:
-		ret = SWIG_NewPointerObj(tmp, SWIGTYPE_p_libswo__DataValue, 0);
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		values[n++] = PyBool_FromLong(packet->data_value.wnr);
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->data_value.cmpn);
+		values[n++] = PyLong_FromUnsignedLong(
+			packet->data_value.data_value);
 		break;
 	default:
-		ret = NULL;
+		break;
+	}
+
+	ret = PyStructSequence_New(packet_types[type]);
+
+	for (i = 0; i < n; i++) {
+		if (!values[i] || !ret) {
+			Py_XDECREF(ret);
+			ret = NULL;
+			Py_XDECREF(values[i]);
+		} else {
+			PyStructSequence_SET_ITEM(ret, i, values[i]);
+		}
 	}
 
 	return ret;
 }
 
-static int packet_callback(const libswo::Packet &packet, void *user_data)
+static int call_packet_callback(const union libswo_packet *packet,
+		void *user_data)
 {
 	int ret;
 	PyObject *res;
@@ -232,8 +599,11 @@ static int packet_callback(const libswo::Packet &packet, void *user_data)
 	obj = packet_object(packet);
 
 	if (!obj) {
-		PyErr_Format(PyExc_ValueError, "decoder callback invoked with "
-			"invalid packet type: %i", packet.get_type());
+		if (!PyErr_Occurred())
+			PyErr_Format(PyExc_ValueError, "decoder callback "
+				"invoked with invalid packet type: %i",
+				packet->type);
+
 		PyErr_Print();
 		return LIBSWO_ERR;
 	}
@@ -262,10 +632,35 @@ static int packet_callback(const libswo::Packet &packet, void *user_data)
 	return ret;
 }
 
+/*
+ * Invoked without the GIL during decoding, see Context::decode().
+ */
+int Context::packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	int ret;
+	Context *context;
+	PyGILState_STATE state;
+
+	(void)ctx;
+
+	context = (Context *)user_data;
+
+	state = PyGILState_Ensure();
+	ret = call_packet_callback(packet, context->_py_callback);
+	PyGILState_Release(state);
+
+	if (!ret)
+		context->_stopped = true;
+
+	return ret;
+}
+
 void Context::set_callback(PyObject *callback)
 {
 	if (callback == Py_None) {
 		Py_XDECREF(_py_callback);
+		_py_callback = NULL;
 		libswo::Context::set_callback(NULL, NULL);
 		return;
 	}
@@ -273,12 +668,397 @@ void Context::set_callback(PyObject *callback)
 	if (!PyCallable_Check(callback))
 		throw libswo::Error(LIBSWO_ERR_ARG);
 
+	/*
+	 * Packet objects are created directly from the decoded packets rather
+	 * than from the packet classes of the C++ bindings.
+	 */
+	set_native_callback(&Context::packet_callback, this);
+
 	Py_XDECREF(_py_callback);
 
 	_py_callback = callback;
 	Py_INCREF(_py_callback);
+}
+
+/*
+ * Column of decoded packets which is exposed to Python through the buffer
+ * protocol without copying. All columns of a table share the ownership of
+ * their storage.
+ */
+struct ColumnObject {
+	PyObject_HEAD
+	std::shared_ptr<libswo::PacketColumns> *owner;
+	const void *data;
+	Py_ssize_t length;
+	Py_ssize_t itemsize;
+	const char *format;
+};
+
+static int column_getbuffer(PyObject *self, Py_buffer *view, int flags)
+{
+	ColumnObject *column;
+
+	column = (ColumnObject *)self;
+
+	if (flags & PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "column is read-only");
+		view->obj = NULL;
+		return -1;
+	}
 
-	libswo::Context::set_callback(&packet_callback, (void *)_py_callback);
+	view->obj = self;
+	Py_INCREF(self);
+
+	view->buf = (void *)column->data;
+	view->len = column->length * column->itemsize;
+	view->readonly = 1;
+	view->itemsize = column->itemsize;
+	view->format = NULL;
+	view->ndim = 1;
+	view->shape = NULL;
+	view->strides = NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	if (flags & PyBUF_FORMAT)
+		view->format = (char *)column->format;
+
+	if (flags & PyBUF_ND)
+		view->shape = &column->length;
+
+	if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES)
+		view->strides = &column->itemsize;
+
+	return 0;
+}
+
+static void column_dealloc(PyObject *self)
+{
+	delete ((ColumnObject *)self)->owner;
+	PyObject_Del(self);
+}
+
+static PyBufferProcs column_buffer_procs;
+
+static PyTypeObject column_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+static int init_column_type(void)
+{
+	column_buffer_procs.bf_getbuffer = &column_getbuffer;
+
+	column_type.tp_name = "swopy.Column";
+	column_type.tp_doc = "Column of decoded packets";
+	column_type.tp_basicsize = sizeof(ColumnObject);
+	column_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	column_type.tp_dealloc = &column_dealloc;
+	column_type.tp_as_buffer = &column_buffer_procs;
+
+	return PyType_Ready(&column_type);
+}
+
+template<class T>
+static PyObject *column_object(
+		const std::shared_ptr<libswo::PacketColumns> &owner,
+		const std::vector<T> &column, const char *format)
+{
+	static const T empty = 0;
+	ColumnObject *ret;
+
+	ret = PyObject_New(ColumnObject, &column_type);
+
+	if (!ret)
+		return NULL;
+
+	ret->owner = new std::shared_ptr<libswo::PacketColumns>(owner);
+	ret->data = column.empty() ? &empty : column.data();
+	ret->length = column.size();
+	ret->itemsize = sizeof(T);
+	ret->format = format;
+
+	return (PyObject *)ret;
+}
+
+/*
+ * Take over the rows of the given packet columns and return them as tuple of
+ * column objects. The order and element formats must match _PACKET_COLUMNS.
+ * The accumulated timestamp of the columns is not changed.
+ */
+static PyObject *table_columns(libswo::PacketColumns &columns)
+{
+	std::shared_ptr<libswo::PacketColumns> owner;
+	PyObject *ret;
+	PyObject *tmp[5];
+	size_t i;
+
+	owner = std::make_shared<libswo::PacketColumns>();
+	owner->types.swap(columns.types);
+	owner->timestamps.swap(columns.timestamps);
+	owner->addresses.swap(columns.addresses);
+	owner->values.swap(columns.values);
+	owner->dwt.swap(columns.dwt);
+
+	tmp[0] = column_object(owner, owner->types, "B");
+	tmp[1] = column_object(owner, owner->timestamps, "Q");
+	tmp[2] = column_object(owner, owner->addresses, "B");
+	tmp[3] = column_object(owner, owner->values, "I");
+	tmp[4] = column_object(owner, owner->dwt, "I");
+
+	ret = PyTuple_New(5);
+
+	for (i = 0; i < 5; i++) {
+		if (!tmp[i] || !ret) {
+			Py_XDECREF(ret);
+			ret = NULL;
+			Py_XDECREF(tmp[i]);
+		} else {
+			PyTuple_SET_ITEM(ret, i, tmp[i]);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Buffer view of a Python object. The view keeps the memory of the object
+ * valid and unchanged, for example while the GIL is released. The view must
+ * be released with the GIL held.
+ */
+class BufferView
+{
+public:
+	BufferView(PyObject *obj)
+	{
+		if (PyObject_GetBuffer(obj, &_view, PyBUF_SIMPLE) < 0)
+			throw libswo::Error(LIBSWO_ERR_ARG);
+	}
+
+	~BufferView(void)
+	{
+		PyBuffer_Release(&_view);
+	}
+
+	const uint8_t *data(void) const
+	{
+		return (const uint8_t *)_view.buf;
+	}
+
+	size_t size(void) const
+	{
+		return _view.len;
+	}
+private:
+	Py_buffer _view;
+};
+
+/*
+ * The bulk decoders use a packet table of their own such that they neither
+ * interfere with the trace data fed into the context nor allocate a decoder
+ * unless they are used.
+ */
+PyObject *Context::decode_columns(PyObject *data)
+{
+	libswo::PacketColumns columns;
+	BufferView view(data);
+
+	{
+		ReleaseGIL release;
+		libswo::PacketTable table(0, 2 * _chunk_size);
+
+		table.decode(view.data(), view.size());
+		table.swap(columns);
+	}
+
+	return table_columns(columns);
+}
+
+PyObject *Context::decode_file_columns(const std::string &filename)
+{
+	libswo::PacketColumns columns;
+
+	{
+		ReleaseGIL release;
+		libswo::PacketTable table(0, 2 * _chunk_size);
+
+		table.decode_file(filename);
+		table.swap(columns);
+	}
+
+	return table_columns(columns);
+}
+
+/*
+ * Deliver all packets collected since the last invocation to the batch
+ * callback function. The GIL is acquired for the duration of the call.
+ */
+int Context::flush_batch(void)
+{
+	int ret;
+	PyGILState_STATE state;
+	PyObject *columns;
+	PyObject *res;
+
+	if (!_batch.size() || !_py_batch_callback)
+		return true;
+
+	state = PyGILState_Ensure();
+
+	columns = table_columns(_batch);
+	_batch.reserve(_batch_size);
+
+	if (!columns) {
+		PyErr_Print();
+		PyGILState_Release(state);
+		return LIBSWO_ERR;
+	}
+
+	res = PyObject_CallFunctionObjArgs(_py_batch_callback, columns, NULL);
+	Py_DECREF(columns);
+
+	if (!res) {
+		PyErr_Print();
+		PyGILState_Release(state);
+		return LIBSWO_ERR;
+	}
+
+	if (res == Py_None || res == Py_True) {
+		ret = 1;
+	} else if (res == Py_False) {
+		ret = 0;
+	} else {
+		PyErr_SetString(PyExc_TypeError, "batch callback function "
+			"neither returned a boolean value nor None");
+		PyErr_Print();
+		ret = LIBSWO_ERR;
+	}
+
+	Py_DECREF(res);
+	PyGILState_Release(state);
+
+	return ret;
+}
+
+int Context::batch_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	int ret;
+	Context *context;
+
+	(void)ctx;
+
+	context = (Context *)user_data;
+	context->_batch.append(packet);
+
+	if (context->_batch.size() < context->_batch_size)
+		return true;
+
+	ret = context->flush_batch();
+
+	if (!ret)
+		context->_stopped = true;
+
+	return ret;
+}
+
+void Context::set_column_batch_callback(PyObject *callback,
+		size_t batch_size)
+{
+	if (!PyCallable_Check(callback) || !batch_size)
+		throw libswo::Error(LIBSWO_ERR_ARG);
+
+	set_native_callback(&Context::batch_callback, this);
+
+	Py_XDECREF(_py_batch_callback);
+
+	_py_batch_callback = callback;
+	Py_INCREF(_py_batch_callback);
+
+	_batch_size = batch_size;
+	_batch.reserve(batch_size);
+}
+
+void Context::decode(uint32_t flags)
+{
+	int ret;
+
+	{
+		ReleaseGIL release;
+
+		libswo::Context::decode(flags);
+	}
+
+	ret = flush_batch();
+
+	if (ret < 0)
+		throw libswo::Error(ret);
+}
+
+/*
+ * Decode all trace data from a file descriptor until the end of file is
+ * reached or a callback function stops decoding. The data is read and
+ * decoded without the GIL, only the decoded packets are passed to Python.
+ */
+void Context::decode_fd(int fd)
+{
+	int ret;
+	ssize_t num;
+	size_t offset;
+	size_t tmp;
+	std::vector<uint8_t> buffer(READ_BUFFER_SIZE);
+
+	_stopped = false;
+
+	{
+		ReleaseGIL release;
+
+		while (!_stopped) {
+			num = read(fd, &buffer[0], buffer.size());
+
+			if (num < 0 && errno == EINTR)
+				continue;
+
+			if (num < 0)
+				throw libswo::Error(LIBSWO_ERR);
+
+			if (!num)
+				break;
+
+			for (offset = 0; offset < (size_t)num && !_stopped;
+					offset += tmp) {
+				tmp = std::min(num - offset, _chunk_size);
+				feed(&buffer[offset], tmp);
+				libswo::Context::decode(0);
+			}
+		}
+
+		if (!_stopped)
+			libswo::Context::decode(LIBSWO_DF_EOS);
+	}
+
+	ret = flush_batch();
+
+	if (ret < 0)
+		throw libswo::Error(ret);
+}
+
+void Context::decode_path(const std::string &path)
+{
+	int fd;
+
+	fd = open(path.c_str(), O_RDONLY | O_BINARY);
+
+	if (fd < 0)
+		throw libswo::Error(LIBSWO_ERR_ARG);
+
+	try {
+		decode_fd(fd);
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+
+	close(fd);
 }
 %}
 
@@ -288,3 +1068,92 @@ void Context::set_callback(PyObject *callback)
 
 %include "libswocxx.h"
 %include "Context.h"
+
+%pythoncode %{
+try:
+	import numpy
+except ImportError:
+	numpy = None
+
+# Name and NumPy data type of each packet table column.
+_PACKET_COLUMNS = (
+	('type', 'u1'),
+	('timestamp', 'u8'),
+	('address', 'u1'),
+	('value', 'u4'),
+	('dwt', 'u4')
+)
+
+def _packet_array(columns):
+	if numpy is None:
+		return dict((name, memoryview(column))
+			for (name, _), column in zip(_PACKET_COLUMNS, columns))
+
+	# The columns are wrapped without copying them and interleaved into the
+	# rows of the structured array in a single copy.
+	return numpy.rec.fromarrays([numpy.frombuffer(column, dtype=dtype)
+		for (_, dtype), column in zip(_PACKET_COLUMNS, columns)],
+		dtype=list(_PACKET_COLUMNS))
+
+def _decode_to_array(self, data):
+	"""
+	Decode trace data and return all packets as NumPy structured array with
+	the fields type, timestamp, address, value and dwt. If NumPy is not
+	available, a dict of memoryview columns with the same names is returned
+	instead.
+	"""
+	return _packet_array(self.decode_columns(data))
+
+def _decode_file_to_array(self, filename):
+	"""
+	Decode a trace data file and return all packets in the same format as
+	decode_to_array().
+	"""
+	return _packet_array(self.decode_file_columns(filename))
+
+def _set_batch_callback(self, callback, batch_size=4096):
+	"""
+	Set a callback function which is invoked with batches of up to
+	batch_size packets in the same format as returned by decode_to_array().
+	Packets are decoded without holding the global interpreter lock, which
+	is only acquired to deliver a batch. The remaining packets are delivered
+	at the end of each decode() call.
+
+	The batch callback replaces the callback set by set_callback() and vice
+	versa.
+	"""
+	self.set_column_batch_callback(
+		lambda columns: callback(_packet_array(columns)), batch_size)
+
+Context.decode_to_array = _decode_to_array
+Context.decode_file_to_array = _decode_file_to_array
+Context.set_batch_callback = _set_batch_callback
+
+Unknown = _swopy.Unknown
+Synchronization = _swopy.Synchronization
+Overflow = _swopy.Overflow
+LocalTimestamp = _swopy.LocalTimestamp
+GlobalTimestamp1 = _swopy.GlobalTimestamp1
+GlobalTimestamp2 = _swopy.GlobalTimestamp2
+Extension = _swopy.Extension
+Instrumentation = _swopy.Instrumentation
+Hardware = _swopy.Hardware
+EventCounter = _swopy.EventCounter
+ExceptionTrace = _swopy.ExceptionTrace
+PCSample = _swopy.PCSample
+PCValue = _swopy.PCValue
+AddressOffset = _swopy.AddressOffset
+DataValue = _swopy.DataValue
+%}
+
+%init %{
+#if PY_VERSION_HEX < 0x03070000
+	PyEval_InitThreads();
+#endif
+
+	if (init_packet_types(d) < 0)
+		return NULL;
+
+	if (init_column_type() < 0)
+		return NULL;
+%}
@@ -28,23 +28,46 @@
  * Internal buffer functions.
  */
 
+/*
+ * The buffer is a single-producer/single-consumer ring buffer. The write
+ * position and the number of bytes fed are only modified by the producer, the
+ * read position and the number of bytes consumed only by the consumer. The
+ * byte counters are published with release semantics such that the producer
+ * and the consumer can access the buffer concurrently without locking.
+ */
+
 /**
- * Write data into the buffer.
+ * Get the number of bytes in the buffer.
  *
- * @param[in,out] ctx libswo context.
- * @param[in] buffer Buffer to write data from.
- * @param[in] length Number of bytes to write.
+ * Must only be called by the consumer.
  *
- * @retval true Success.
- * @retval false Not enough space left to write the requested number of bytes.
+ * @param[in] ctx libswo context.
+ *
+ * @return Number of bytes available for reading.
  */
-LIBSWO_PRIV bool buffer_write(struct libswo_context *ctx,
-		const uint8_t *buffer, size_t length)
+LIBSWO_PRIV size_t buffer_available(const struct libswo_context *ctx)
 {
-	size_t tmp;
+	return ATOMIC_LOAD(&ctx->bytes_fed) - ctx->bytes_consumed;
+}
 
-	if (ctx->bytes_available + length > ctx->size)
-		return false;
+/**
+ * Get the free space of the buffer.
+ *
+ * Must only be called by the producer.
+ *
+ * @param[in] ctx libswo context.
+ *
+ * @return Number of bytes available for writing.
+ */
+LIBSWO_PRIV size_t buffer_space(const struct libswo_context *ctx)
+{
+	return ctx->size - (ctx->bytes_fed - ATOMIC_LOAD(&ctx->bytes_consumed));
+}
+
+static void write_segment(struct libswo_context *ctx, const uint8_t *buffer,
+		size_t length)
+{
+	size_t tmp;
 
 	if (ctx->write_pos + length > ctx->size) {
 		tmp = ctx->size - ctx->write_pos;
@@ -55,15 +78,36 @@ LIBSWO_PRIV bool buffer_write(struct libswo_context *ctx,
 		memcpy(ctx->buffer + ctx->write_pos, buffer, length);
 		ctx->write_pos += length;
 	}
+}
+
+/**
+ * Write data from multiple buffers into the buffer.
+ *
+ * The data is published to the consumer at once after all buffers are
+ * written. The caller must ensure that enough space is left in the buffer,
+ * see buffer_space(). Must only be called by the producer.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] iov Buffers to write data from.
+ * @param[in] iovcnt Number of buffers.
+ * @param[in] length Total number of bytes to write.
+ */
+LIBSWO_PRIV void buffer_write(struct libswo_context *ctx,
+		const struct libswo_iovec *iov, size_t iovcnt, size_t length)
+{
+	size_t i;
 
-	ctx->bytes_available += length;
+	for (i = 0; i < iovcnt; i++)
+		write_segment(ctx, iov[i].iov_base, iov[i].iov_len);
 
-	return true;
+	ATOMIC_STORE(&ctx->bytes_fed, ctx->bytes_fed + length);
 }
 
 /**
  * Peek data from the buffer.
  *
+ * Must only be called by the consumer.
+ *
  * @param[in] ctx libswo context.
  * @param[out] buffer Buffer to store peeked data into. Its content is
  *                    undefined on failure.
@@ -78,7 +122,7 @@ LIBSWO_PRIV bool buffer_peek(const struct libswo_context *ctx, uint8_t *buffer,
 {
 	size_t tmp;
 
-	if (length + offset > ctx->bytes_available)
+	if (length + offset > buffer_available(ctx))
 		return false;
 
 	if (ctx->read_pos + offset > ctx->size) {
@@ -98,6 +142,8 @@ LIBSWO_PRIV bool buffer_peek(const struct libswo_context *ctx, uint8_t *buffer,
 /**
  * Read data from the buffer.
  *
+ * Must only be called by the consumer.
+ *
  * @param[in] ctx libswo context.
  * @param[out] buffer Buffer to store read data into. Its content is undefined
  *                    on failure.
@@ -110,31 +156,17 @@ LIBSWO_PRIV bool buffer_peek(const struct libswo_context *ctx, uint8_t *buffer,
 LIBSWO_PRIV bool buffer_read(struct libswo_context *ctx, uint8_t *buffer,
 		size_t length, size_t offset)
 {
-	size_t tmp;
-
-	if (length + offset > ctx->bytes_available)
+	if (!buffer_peek(ctx, buffer, length, offset))
 		return false;
 
-	if (ctx->read_pos + offset > ctx->size) {
-		tmp = ctx->read_pos + offset - ctx->size;
-		memcpy(buffer, ctx->buffer + tmp, length);
-	} else if (ctx->read_pos + offset + length > ctx->size) {
-		tmp = ctx->size - ctx->read_pos - offset;
-		memcpy(buffer, ctx->buffer + ctx->read_pos + offset, tmp);
-		memcpy(buffer + tmp, ctx->buffer, length - tmp);
-	} else {
-		memcpy(buffer, ctx->buffer + ctx->read_pos + offset, length);
-	}
-
-	ctx->bytes_available -= length;
-	ctx->read_pos = (ctx->read_pos + length) % ctx->size;
-
-	return true;
+	return buffer_remove(ctx, length);
 }
 
 /**
  * Remove data from the buffer.
  *
+ * Must only be called by the consumer.
+ *
  * @param[in,out] ctx libswo context.
  * @param[in] length Number of bytes to remove.
  *
@@ -143,11 +175,11 @@ LIBSWO_PRIV bool buffer_read(struct libswo_context *ctx, uint8_t *buffer,
  */
 LIBSWO_PRIV bool buffer_remove(struct libswo_context *ctx, size_t length)
 {
-	if (length > ctx->bytes_available)
+	if (length > buffer_available(ctx))
 		return false;
 
-	ctx->bytes_available -= length;
 	ctx->read_pos = (ctx->read_pos + length) % ctx->size;
+	ATOMIC_STORE(&ctx->bytes_consumed, ctx->bytes_consumed + length);
 
 	return true;
 }
@@ -155,11 +187,11 @@ LIBSWO_PRIV bool buffer_remove(struct libswo_context *ctx, size_t length)
 /**
  * Flush the buffer.
  *
+ * All data in the buffer is discarded. Must only be called by the consumer.
+ *
  * @param[in,out] ctx libswo context.
  */
 LIBSWO_PRIV void buffer_flush(struct libswo_context *ctx)
 {
-	ctx->bytes_available = 0;
-	ctx->read_pos = 0;
-	ctx->write_pos = 0;
+	buffer_remove(ctx, buffer_available(ctx));
 }
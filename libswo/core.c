@@ -29,6 +29,77 @@
  * Core library functions.
  */
 
+/* Ensure that LIBSWO_CONTEXT_SIZE is sufficient for a context. */
+typedef char context_size_check[
+	sizeof(struct libswo_context) <= LIBSWO_CONTEXT_SIZE ? 1 : -1];
+
+static void *default_alloc(size_t size, void *user_data)
+{
+	(void)user_data;
+
+	return malloc(size);
+}
+
+static void default_dealloc(void *ptr, void *user_data)
+{
+	(void)user_data;
+
+	free(ptr);
+}
+
+static const struct libswo_allocator default_allocator = {
+	.alloc = &default_alloc,
+	.dealloc = &default_dealloc,
+	.user_data = NULL
+};
+
+static int init_context(struct libswo_context *context, uint8_t *buffer,
+		size_t buffer_size)
+{
+	int ret;
+
+	/* Show error and warning messages by default. */
+	context->log_level = LIBSWO_LOG_LEVEL_WARNING;
+
+	context->log_callback = &log_vprintf;
+	context->log_cb_user_data = NULL;
+
+	ret = libswo_log_set_domain(context, LIBSWO_LOG_DOMAIN_DEFAULT);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	context->callback = NULL;
+	context->cb_user_data = NULL;
+	memset(context->type_callbacks, 0, sizeof(context->type_callbacks));
+
+	memset(context->hw_decoders, 0, sizeof(context->hw_decoders));
+	dwt_init(context);
+
+	subscribers_init(context);
+
+	memset(&context->packet, 0, sizeof(union libswo_packet));
+
+	context->buffer = buffer;
+	context->size = buffer_size;
+	context->read_pos = 0;
+	context->write_pos = 0;
+	context->bytes_fed = 0;
+	context->bytes_consumed = 0;
+
+	context->wait_callback = NULL;
+	context->notify_callback = NULL;
+	context->wait_cb_user_data = NULL;
+	context->waiting = false;
+
+	context->stats_enabled = false;
+	memset(&context->stats, 0, sizeof(struct libswo_stats));
+
+	host_time_init(context);
+
+	return LIBSWO_OK;
+}
+
 /**
  * Initialize libswo.
  *
@@ -46,6 +117,34 @@
  */
 LIBSWO_API int libswo_init(struct libswo_context **ctx, uint8_t *buffer,
 		size_t buffer_size)
+{
+	return libswo_init_allocator(ctx, buffer, buffer_size, NULL);
+}
+
+/**
+ * Initialize libswo with a custom memory allocator.
+ *
+ * The allocator is used for the context and, if no buffer is given, for the
+ * buffer. Afterwards, libswo does not allocate memory until libswo_exit() is
+ * called.
+ *
+ * @param[out] ctx Newly allocated libswo context on success, and undefined on
+ *                 failure.
+ * @param[in] buffer Buffer to be used for buffering trace data, or NULL to
+ *                   allocate a new buffer with the given size.
+ * @param[in] buffer_size Size of the buffer in bytes.
+ * @param[in] allocator Memory allocator, or NULL to use malloc() and free().
+ *                      The allocator structure is copied.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ * @retval LIBSWO_ERR_MALLOC Memory allocation error.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_init_allocator(struct libswo_context **ctx,
+		uint8_t *buffer, size_t buffer_size,
+		const struct libswo_allocator *allocator)
 {
 	int ret;
 	struct libswo_context *context;
@@ -53,46 +152,96 @@ LIBSWO_API int libswo_init(struct libswo_context **ctx, uint8_t *buffer,
 	if (!ctx || !buffer_size)
 		return LIBSWO_ERR_ARG;
 
-	context = malloc(sizeof(struct libswo_context));
+	if (!allocator)
+		allocator = &default_allocator;
 
-	if (!context)
-		return LIBSWO_ERR_MALLOC;
+	if (!allocator->alloc || !allocator->dealloc)
+		return LIBSWO_ERR_ARG;
 
-	/* Show error and warning messages by default. */
-	context->log_level = LIBSWO_LOG_LEVEL_WARNING;
+	context = allocator->alloc(sizeof(struct libswo_context),
+		allocator->user_data);
 
-	context->log_callback = &log_vprintf;
-	context->log_cb_user_data = NULL;
+	if (!context)
+		return LIBSWO_ERR_MALLOC;
 
-	ret = libswo_log_set_domain(context, LIBSWO_LOG_DOMAIN_DEFAULT);
-
-	if (ret != LIBSWO_OK) {
-		free(context);
-		return ret;
-	}
+	context->allocator = *allocator;
+	context->free_context = true;
 
 	if (buffer) {
 		context->free_buffer = false;
 	} else {
 		context->free_buffer = true;
-		buffer = malloc(buffer_size);
+		buffer = allocator->alloc(buffer_size, allocator->user_data);
 	}
 
 	if (!buffer) {
-		free(context);
+		allocator->dealloc(context, allocator->user_data);
 		return LIBSWO_ERR_MALLOC;
 	}
 
-	context->callback = NULL;
-	context->cb_user_data = NULL;
+	ret = init_context(context, buffer, buffer_size);
 
-	memset(&context->packet, 0, sizeof(union libswo_packet));
+	/*
+	 * Do not use libswo_exit() because the context may be only partially
+	 * initialized.
+	 */
+	if (ret != LIBSWO_OK) {
+		if (context->free_buffer)
+			allocator->dealloc(buffer, allocator->user_data);
 
-	context->buffer = buffer;
-	context->size = buffer_size;
-	context->read_pos = 0;
-	context->write_pos = 0;
-	context->bytes_available = 0;
+		allocator->dealloc(context, allocator->user_data);
+		return ret;
+	}
+
+	*ctx = context;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Initialize libswo without memory allocation.
+ *
+ * The context is placed into the given storage, which must be at least
+ * #LIBSWO_CONTEXT_SIZE bytes in size and aligned to #LIBSWO_CONTEXT_ALIGN
+ * bytes. The storage and the buffer must remain valid until libswo_exit() is
+ * called. libswo does not allocate any memory for such a context.
+ *
+ * @param[out] ctx Initialized libswo context on success, and undefined on
+ *                 failure.
+ * @param[in] storage Storage for the context.
+ * @param[in] storage_size Size of the storage in bytes.
+ * @param[in] buffer Buffer to be used for buffering trace data.
+ * @param[in] buffer_size Size of the buffer in bytes.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_init_static(struct libswo_context **ctx, void *storage,
+		size_t storage_size, uint8_t *buffer, size_t buffer_size)
+{
+	int ret;
+	struct libswo_context *context;
+
+	if (!ctx || !storage || !buffer || !buffer_size)
+		return LIBSWO_ERR_ARG;
+
+	if (storage_size < sizeof(struct libswo_context))
+		return LIBSWO_ERR_ARG;
+
+	if ((uintptr_t)storage % LIBSWO_CONTEXT_ALIGN)
+		return LIBSWO_ERR_ARG;
+
+	context = storage;
+	context->allocator = default_allocator;
+	context->free_context = false;
+	context->free_buffer = false;
+
+	ret = init_context(context, buffer, buffer_size);
+
+	if (ret != LIBSWO_OK)
+		return ret;
 
 	*ctx = context;
 
@@ -115,9 +264,10 @@ LIBSWO_API int libswo_exit(struct libswo_context *ctx)
 		return LIBSWO_ERR_ARG;
 
 	if (ctx->free_buffer)
-		free(ctx->buffer);
+		ctx->allocator.dealloc(ctx->buffer, ctx->allocator.user_data);
 
-	free(ctx);
+	if (ctx->free_context)
+		ctx->allocator.dealloc(ctx, ctx->allocator.user_data);
 
 	return LIBSWO_OK;
 }
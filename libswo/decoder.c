@@ -416,10 +416,30 @@ static bool decode_inst_packet(struct libswo_context *ctx, uint8_t header)
 	return true;
 }
 
+/*
+ * Determine whether a hardware source decoder may return packets of the given
+ * type. Core packet types and reserved values are not allowed.
+ */
+static bool is_hw_packet_type(unsigned int type)
+{
+	if (type == LIBSWO_PACKET_TYPE_HW)
+		return true;
+
+	if (type >= LIBSWO_PACKET_TYPE_DWT_EVTCNT && \
+			type <= LIBSWO_PACKET_TYPE_DWT_DATA_VALUE)
+		return true;
+
+	return type >= LIBSWO_PACKET_TYPE_USER && \
+		type <= LIBSWO_PACKET_TYPE_USER_MAX;
+}
+
 static bool decode_hw_packet(struct libswo_context *ctx, uint8_t header)
 {
 	uint8_t payload_size;
 	struct libswo_packet_hw hw;
+	const struct hw_decoder *decoder;
+	uint64_t start;
+	bool ret;
 
 	payload_size = 1 << ((header & SRC_SIZE_MASK) - 1);
 
@@ -434,7 +454,29 @@ static bool decode_hw_packet(struct libswo_context *ctx, uint8_t header)
 	hw.address = (header & SRC_ADDR_MASK) >> SRC_ADDR_OFFSET;
 	hw.value = decode_payload(hw.payload, payload_size);
 
-	if (!dwt_decode_packet(ctx, &hw)) {
+	decoder = &ctx->hw_decoders[hw.address];
+	ret = false;
+
+	if (decoder->decoder) {
+		start = STATS_BEGIN(ctx);
+		ret = decoder->decoder(ctx, &hw, &ctx->packet,
+			decoder->user_data);
+		STATS_END(ctx, LIBSWO_STATS_STAGE_DWT, start);
+	}
+
+	if (ret && !is_hw_packet_type(ctx->packet.type)) {
+		log_warn(ctx, "Hardware source decoder for address %u returned "
+			"invalid packet type %u.", hw.address,
+			(unsigned int)ctx->packet.type);
+		ctx->packet.type = LIBSWO_PACKET_TYPE_UNKNOWN;
+		ctx->packet.unknown.size = hw.size;
+		return true;
+	}
+
+	if (ret) {
+		/* The size determines the number of bytes to be removed. */
+		ctx->packet.hw.size = hw.size;
+	} else {
 		log_dbg(ctx, "Hardware source packet decoded.");
 		ctx->packet.hw = hw;
 	}
@@ -451,31 +493,80 @@ static bool handle_unknown_header(struct libswo_context *ctx, uint8_t header)
 	return true;
 }
 
+/*
+ * Determine whether the current packet is delivered to any callback function.
+ */
+static bool packet_wanted(const struct libswo_context *ctx)
+{
+	if (ctx->type_callbacks[ctx->packet.type].callback || ctx->callback)
+		return true;
+
+	return ctx->num_subscribers > 0 && subscribers_interested(ctx);
+}
+
+/*
+ * Pass the current packet to the callback function of its packet type, or the
+ * decoder callback function if there is none, and to the subscribers.
+ */
+static int invoke_callbacks(struct libswo_context *ctx)
+{
+	int ret;
+	uint64_t start;
+	const struct type_callback *entry;
+
+	start = STATS_BEGIN(ctx);
+	entry = &ctx->type_callbacks[ctx->packet.type];
+
+	if (entry->callback)
+		ret = entry->callback(ctx, &ctx->packet, entry->user_data);
+	else if (ctx->callback)
+		ret = ctx->callback(ctx, &ctx->packet, ctx->cb_user_data);
+	else
+		ret = true;
+
+	if (ret > 0 && ctx->num_subscribers > 0)
+		ret = subscribers_dispatch(ctx);
+
+	STATS_END(ctx, LIBSWO_STATS_STAGE_CALLBACK, start);
+
+	return ret;
+}
+
 static int handle_eos(struct libswo_context *ctx)
 {
 	int ret;
 	size_t tmp;
+	uint64_t start;
 
 	log_dbg(ctx, "Treating %zu remaining bytes as unknown data.",
-		ctx->bytes_available);
+		buffer_available(ctx));
 
 	ctx->packet.type = LIBSWO_PACKET_TYPE_UNKNOWN;
 
-	while (ctx->bytes_available > 0) {
-		tmp = MIN(sizeof(ctx->packet.any.data), ctx->bytes_available);
+	while (buffer_available(ctx) > 0) {
+		tmp = MIN(sizeof(ctx->packet.any.data), buffer_available(ctx));
 
 		ctx->packet.unknown.size = tmp;
+
+		PROBE3(packet, ctx, LIBSWO_PACKET_TYPE_UNKNOWN, tmp);
+		PROBE2(unknown, ctx, tmp);
+
+		if (ATOMIC_LOAD(&ctx->host_time_enabled))
+			host_time_update(ctx, tmp);
+
+		start = STATS_BEGIN(ctx);
 		buffer_read(ctx, ctx->packet.unknown.data, tmp, 0);
+		STATS_END(ctx, LIBSWO_STATS_STAGE_COPY, start);
 
-		if (ctx->callback)
-			ret = ctx->callback(ctx, &ctx->packet,
-				ctx->cb_user_data);
+		if (packet_wanted(ctx))
+			ret = invoke_callbacks(ctx);
 		else
 			ret = true;
 
 		if (ret < 0) {
 			return ret;
 		} else if (!ret) {
+			PROBE1(callback_stop, ctx);
 			log_dbg(ctx, "Decoding stopped by callback function.");
 			return LIBSWO_OK;
 		}
@@ -488,16 +579,39 @@ static int handle_packet(struct libswo_context *ctx)
 {
 	int ret;
 	size_t tmp;
+	uint64_t start;
+	bool wanted;
+
+	wanted = packet_wanted(ctx);
 
 	if (ctx->packet.type == LIBSWO_PACKET_TYPE_SYNC) {
 		tmp = (ctx->packet.sync.size + 7) / 8;
 	} else {
 		tmp = ctx->packet.any.size;
-		buffer_peek(ctx, ctx->packet.any.data, tmp, 0);
+
+		/* Skip the copy of the raw data if nobody sees the packet. */
+		if (wanted) {
+			start = STATS_BEGIN(ctx);
+			buffer_peek(ctx, ctx->packet.any.data, tmp, 0);
+			STATS_END(ctx, LIBSWO_STATS_STAGE_COPY, start);
+		}
 	}
 
-	if (ctx->callback)
-		ret = ctx->callback(ctx, &ctx->packet, ctx->cb_user_data);
+	PROBE3(packet, ctx, ctx->packet.type, tmp);
+
+	if (ctx->packet.type == LIBSWO_PACKET_TYPE_OVERFLOW)
+		PROBE1(overflow, ctx);
+	else if (ctx->packet.type == LIBSWO_PACKET_TYPE_UNKNOWN)
+		PROBE2(unknown, ctx, tmp);
+
+	if (ctx->packet.type == LIBSWO_PACKET_TYPE_LTS)
+		ctx->target_time += ctx->packet.lts.value;
+
+	if (ATOMIC_LOAD(&ctx->host_time_enabled))
+		host_time_update(ctx, tmp);
+
+	if (wanted)
+		ret = invoke_callbacks(ctx);
 	else
 		ret = true;
 
@@ -509,6 +623,12 @@ static int handle_packet(struct libswo_context *ctx)
 /**
  * Feed the decoder with trace data.
  *
+ * The decoder can be fed by one thread, the producer, while another thread,
+ * the consumer, decodes the trace data with libswo_decode() at the same time
+ * without any locking. Only a single producer and a single consumer are
+ * supported, all other functions must not be called concurrently. Use
+ * libswo_set_wait_callbacks() to let the consumer wait for trace data.
+ *
  * @param[in,out] ctx libswo context.
  * @param[in] buffer Buffer with trace data to feed the decoder with.
  * @param[in] length Number of bytes to feed.
@@ -522,20 +642,65 @@ static int handle_packet(struct libswo_context *ctx)
 LIBSWO_API int libswo_feed(struct libswo_context *ctx, const uint8_t *buffer,
 		size_t length)
 {
-	if (!ctx || !buffer)
+	return libswo_feed_timestamp(ctx, buffer, length, 0);
+}
+
+/**
+ * Feed the decoder with trace data and its host timestamp.
+ *
+ * The host timestamp is assigned to all packets whose last byte is contained
+ * in the trace data. It is available within the decoder callback function via
+ * libswo_get_packet_host_time() and is used to collect feed-to-callback
+ * latency statistics and to fit the clock model.
+ *
+ * Once trace data with a host timestamp was fed, trace data fed with
+ * libswo_feed() is tracked as trace data without host timestamp.
+ *
+ * See libswo_feed() for concurrent feeding and decoding.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] buffer Buffer with trace data to feed the decoder with.
+ * @param[in] length Number of bytes to feed.
+ * @param[in] timestamp Host timestamp of the trace data in nanoseconds, or 0
+ *                      if not available. Use libswo_get_host_time() to obtain
+ *                      host timestamps.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR Other error conditions.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_feed_timestamp(struct libswo_context *ctx,
+		const uint8_t *buffer, size_t length, uint64_t timestamp)
+{
+	struct libswo_iovec iov;
+
+	if (!buffer)
 		return LIBSWO_ERR_ARG;
 
-	if (buffer_write(ctx, buffer, length))
-		return LIBSWO_OK;
+	iov.iov_base = buffer;
+	iov.iov_len = length;
 
-	return LIBSWO_ERR;
+	return libswo_feedv(ctx, &iov, 1, timestamp);
 }
 
 /**
- * Decode the trace data.
+ * Feed the decoder with trace data from multiple buffers.
+ *
+ * The trace data of all buffers is fed at once in the given order, which is
+ * equivalent to, but cheaper than, feeding the buffers one by one with the
+ * same host timestamp. Either all or none of the trace data is fed.
+ *
+ * See libswo_feed() for concurrent feeding and decoding and
+ * libswo_feed_timestamp() for host timestamps.
  *
  * @param[in,out] ctx libswo context.
- * @param[in] flags Decoder flags, see #libswo_decoder_flags for a description.
+ * @param[in] iov Buffers with trace data to feed the decoder with. Buffers may
+ *                be empty.
+ * @param[in] iovcnt Number of buffers.
+ * @param[in] timestamp Host timestamp of the trace data in nanoseconds, or 0
+ *                      if not available.
  *
  * @retval LIBSWO_OK Success.
  * @retval LIBSWO_ERR Other error conditions.
@@ -543,20 +708,83 @@ LIBSWO_API int libswo_feed(struct libswo_context *ctx, const uint8_t *buffer,
  *
  * @since 0.1.0
  */
-LIBSWO_API int libswo_decode(struct libswo_context *ctx, uint32_t flags)
+LIBSWO_API int libswo_feedv(struct libswo_context *ctx,
+		const struct libswo_iovec *iov, size_t iovcnt,
+		uint64_t timestamp)
+{
+	uint64_t start;
+	size_t length;
+	size_t i;
+
+	if (!ctx || (!iov && iovcnt > 0))
+		return LIBSWO_ERR_ARG;
+
+	length = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_base && iov[i].iov_len > 0)
+			return LIBSWO_ERR_ARG;
+
+		/* Saturate the length such that it cannot overflow. */
+		length += MIN(iov[i].iov_len, SIZE_MAX - length);
+	}
+
+	PROBE2(feed_entry, ctx, length);
+
+	if (length > buffer_space(ctx)) {
+		PROBE3(feed_exit, ctx, length, LIBSWO_ERR);
+		return LIBSWO_ERR;
+	}
+
+	/*
+	 * Record the host timestamp first such that it is available as soon as
+	 * the consumer sees the trace data.
+	 */
+	host_time_push(ctx, ctx->bytes_fed + length, timestamp);
+
+	start = STATS_BEGIN(ctx);
+	buffer_write(ctx, iov, iovcnt, length);
+	STATS_END(ctx, LIBSWO_STATS_STAGE_BUFFER_WRITE, start);
+
+	/*
+	 * Wake up the consumer if it is about to wait. The barrier pairs with
+	 * the one in libswo_decode() and ensures that either the consumer sees
+	 * the trace data or the producer sees the consumer waiting.
+	 */
+	if (ctx->notify_callback) {
+		ATOMIC_FENCE();
+
+		if (ATOMIC_LOAD(&ctx->waiting))
+			ctx->notify_callback(ctx, ctx->wait_cb_user_data);
+	}
+
+	PROBE3(feed_exit, ctx, length, LIBSWO_OK);
+
+	return LIBSWO_OK;
+}
+
+/*
+ * Decode all complete packets in the buffer.
+ *
+ * Returns a negative error code on failure, 0 if decoding was stopped by the
+ * callback function and 1 if no complete packet is left in the buffer.
+ */
+static int decode_packets(struct libswo_context *ctx)
 {
 	int ret;
 	uint8_t header;
 	int packet_type;
-
-	if (!ctx)
-		return LIBSWO_ERR_ARG;
+	uint64_t start;
 
 	while (true) {
 		if (!buffer_peek(ctx, &header, 1, 0))
 			break;
 
+		start = STATS_BEGIN(ctx);
 		packet_type = decode_packet_type(header);
+		STATS_END(ctx, LIBSWO_STATS_STAGE_HEADER, start);
+
+		start = STATS_BEGIN(ctx);
 
 		switch (packet_type) {
 		case LIBSWO_PACKET_TYPE_SYNC:
@@ -592,6 +820,8 @@ LIBSWO_API int libswo_decode(struct libswo_context *ctx, uint32_t flags)
 			return LIBSWO_ERR;
 		}
 
+		STATS_END(ctx, LIBSWO_STATS_STAGE_PAYLOAD, start);
+
 		if (!ret)
 			break;
 
@@ -600,15 +830,81 @@ LIBSWO_API int libswo_decode(struct libswo_context *ctx, uint32_t flags)
 		if (ret < 0) {
 			return LIBSWO_ERR;
 		} else if (!ret) {
+			PROBE1(callback_stop, ctx);
 			log_dbg(ctx, "Decoding stopped by callback function.");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Decode the trace data.
+ *
+ * If #LIBSWO_DF_WAIT is set, the wait callback function is invoked whenever
+ * no complete packet is left in the buffer. Decoding continues until either
+ * the decoder callback function or the wait callback function stops it. In
+ * the latter case, the trace data is treated as end of stream if
+ * #LIBSWO_DF_EOS is set.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] flags Decoder flags, see #libswo_decoder_flags for a description.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR Other error conditions.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_decode(struct libswo_context *ctx, uint32_t flags)
+{
+	int ret;
+
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	if ((flags & LIBSWO_DF_WAIT) && !ctx->wait_callback)
+		return LIBSWO_ERR_ARG;
+
+	while (true) {
+		ret = decode_packets(ctx);
+
+		if (ret < 0) {
+			ATOMIC_STORE(&ctx->waiting, false);
+			return LIBSWO_ERR;
+		} else if (!ret) {
+			ATOMIC_STORE(&ctx->waiting, false);
 			return LIBSWO_OK;
 		}
+
+		if (!(flags & LIBSWO_DF_WAIT))
+			break;
+
+		/*
+		 * Announce the wait and decode once more before actually waiting.
+		 * Trace data fed after the barrier triggers the notify callback
+		 * function, see libswo_feed_timestamp().
+		 */
+		if (!ctx->waiting) {
+			ATOMIC_STORE(&ctx->waiting, true);
+			ATOMIC_FENCE();
+			continue;
+		}
+
+		ret = ctx->wait_callback(ctx, ctx->wait_cb_user_data);
+		ATOMIC_STORE(&ctx->waiting, false);
+
+		if (ret < 0)
+			return LIBSWO_ERR;
+		else if (!ret)
+			break;
 	}
 
 	if (flags & LIBSWO_DF_EOS) {
 		log_dbg(ctx, "End of stream reached.");
 
-		if (ctx->bytes_available > 0) {
+		if (buffer_available(ctx) > 0) {
 			if (handle_eos(ctx) < 0)
 				return LIBSWO_ERR;
 		}
@@ -641,3 +937,117 @@ LIBSWO_API int libswo_set_callback(struct libswo_context *ctx,
 
 	return LIBSWO_OK;
 }
+
+/**
+ * Set the callback function of a packet type.
+ *
+ * Packets of the given type are passed to this callback function instead of
+ * the decoder callback function, see libswo_set_callback(). Packets which are
+ * neither passed to a callback function nor to a subscriber are skipped
+ * without copying their raw data.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] type Packet type, including the user-defined packet types from
+ *                 #LIBSWO_PACKET_TYPE_USER to #LIBSWO_PACKET_TYPE_USER_MAX.
+ * @param[in] callback Callback function to be used, or NULL to pass packets of
+ *                     the given type to the decoder callback function again.
+ * @param[in] user_data User data to be passed to the callback function.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid argument.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_set_type_callback(struct libswo_context *ctx,
+		enum libswo_packet_type type, libswo_decoder_callback callback,
+		void *user_data)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	if (type > LIBSWO_PACKET_TYPE_HW && \
+			type < LIBSWO_PACKET_TYPE_DWT_EVTCNT)
+		return LIBSWO_ERR_ARG;
+
+	if (type > LIBSWO_PACKET_TYPE_DWT_DATA_VALUE && \
+			type < LIBSWO_PACKET_TYPE_USER)
+		return LIBSWO_ERR_ARG;
+
+	if (type > LIBSWO_PACKET_TYPE_USER_MAX)
+		return LIBSWO_ERR_ARG;
+
+	ctx->type_callbacks[type].callback = callback;
+	ctx->type_callbacks[type].user_data = user_data;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Set the wait and notify callback functions.
+ *
+ * The callback functions allow the consumer to sleep while it waits for trace
+ * data, see #LIBSWO_DF_WAIT. The wait callback function is invoked by
+ * libswo_decode() and blocks until it is woken up by the notify callback
+ * function, which is invoked by the producer within libswo_feed() whenever
+ * the consumer may be waiting. A wake-up must not get lost if the notify
+ * callback function is invoked before the wait callback function blocks, for
+ * example by using a semaphore or an eventfd. Spurious wake-ups are allowed.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] wait Wait callback function, or NULL to disable waiting.
+ * @param[in] notify Notify callback function, or NULL.
+ * @param[in] user_data User data to be passed to the callback functions.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid argument.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_set_wait_callbacks(struct libswo_context *ctx,
+		libswo_wait_callback wait, libswo_notify_callback notify,
+		void *user_data)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	ctx->wait_callback = wait;
+	ctx->notify_callback = notify;
+	ctx->wait_cb_user_data = user_data;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Set the decoder of a hardware source address.
+ *
+ * Hardware source packets with the given address are passed to the decoder
+ * function, which turns them into packets of a specific type. On
+ * initialization, the Data Watchpoint and Trace (DWT) decoders are installed
+ * for the addresses used by the DWT unit. Hardware source packets which are
+ * not decoded are passed on as packets of type #LIBSWO_PACKET_TYPE_HW.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] address Hardware source address.
+ * @param[in] decoder Decoder function to be used, or NULL to pass packets with
+ *                    the given address on as hardware source packets.
+ * @param[in] user_data User data to be passed to the decoder function.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid argument.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_set_hw_decoder(struct libswo_context *ctx,
+		uint8_t address, libswo_hw_decoder decoder, void *user_data)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	if (address >= LIBSWO_MAX_SOURCE_ADDRESS)
+		return LIBSWO_ERR_ARG;
+
+	ctx->hw_decoders[address].decoder = decoder;
+	ctx->hw_decoders[address].user_data = user_data;
+
+	return LIBSWO_OK;
+}
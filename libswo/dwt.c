@@ -106,8 +106,9 @@
 /* Data trace data value packet header. */
 #define DATA_VALUE_HEADER	0x10
 
-static bool decode_evtcnt_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_evtcnt_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
 	if (hw->size != EVTCNT_SIZE) {
 		log_warn(ctx, "Event counter packet with invalid size of %zu "
@@ -115,23 +116,26 @@ static bool decode_evtcnt_packet(struct libswo_context *ctx,
 		return false;
 	}
 
-	ctx->packet.hw = *hw;
-	ctx->packet.evtcnt.type = LIBSWO_PACKET_TYPE_DWT_EVTCNT;
+	(void)user_data;
 
-	ctx->packet.evtcnt.cpi = hw->payload[0] & EVTCNT_CPI_MASK;
-	ctx->packet.evtcnt.exc = hw->payload[0] & EVTCNT_EXC_MASK;
-	ctx->packet.evtcnt.sleep = hw->payload[0] & EVTCNT_SLEEP_MASK;
-	ctx->packet.evtcnt.lsu = hw->payload[0] & EVTCNT_LSU_MASK;
-	ctx->packet.evtcnt.fold = hw->payload[0] & EVTCNT_FOLD_MASK;
-	ctx->packet.evtcnt.cyc = hw->payload[0] & EVTCNT_CYC_MASK;
+	packet->hw = *hw;
+	packet->evtcnt.type = LIBSWO_PACKET_TYPE_DWT_EVTCNT;
+
+	packet->evtcnt.cpi = hw->payload[0] & EVTCNT_CPI_MASK;
+	packet->evtcnt.exc = hw->payload[0] & EVTCNT_EXC_MASK;
+	packet->evtcnt.sleep = hw->payload[0] & EVTCNT_SLEEP_MASK;
+	packet->evtcnt.lsu = hw->payload[0] & EVTCNT_LSU_MASK;
+	packet->evtcnt.fold = hw->payload[0] & EVTCNT_FOLD_MASK;
+	packet->evtcnt.cyc = hw->payload[0] & EVTCNT_CYC_MASK;
 
 	log_dbg(ctx, "Event counter packet decoded.");
 
 	return true;
 }
 
-static bool decode_exctrace_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_exctrace_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
 	uint16_t exception;
 	uint8_t tmp;
@@ -142,26 +146,31 @@ static bool decode_exctrace_packet(struct libswo_context *ctx,
 		return false;
 	}
 
-	ctx->packet.hw = *hw;
-	ctx->packet.type = LIBSWO_PACKET_TYPE_DWT_EXCTRACE;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_DWT_EXCTRACE;
 
 	exception = hw->payload[0];
 	exception |= (hw->payload[1] & EXCTRACE_EX_MASK) << EXCTRACE_EX_OFFSET;
 	tmp = (hw->payload[1] & EXCTRACE_FN_MASK) >> EXCTRACE_FN_OFFSET;
 
-	ctx->packet.exctrace.exception = exception;
-	ctx->packet.exctrace.function = tmp;
+	packet->exctrace.exception = exception;
+	packet->exctrace.function = tmp;
 
 	log_dbg(ctx, "Exception trace packet decoded.");
 
 	return true;
 }
 
-static bool decode_pc_sample_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_pc_sample_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
-	ctx->packet.hw = *hw;
-	ctx->packet.type = LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE;
 
 	if (hw->size == PC_SAMPLE_SLEEP_SIZE) {
 		if (hw->value > 0) {
@@ -170,10 +179,10 @@ static bool decode_pc_sample_packet(struct libswo_context *ctx,
 			return false;
 		}
 
-		ctx->packet.pc_sample.sleep = true;
+		packet->pc_sample.sleep = true;
 		log_dbg(ctx, "Periodic PC sleep packet decoded.");
 	} else if (hw->size == PC_SAMPLE_SIZE) {
-		ctx->packet.pc_sample.sleep = false;
+		packet->pc_sample.sleep = false;
 		log_dbg(ctx, "Periodic PC sample packet decoded.");
 	} else {
 		log_warn(ctx, "Periodic PC sample packet with invalid size of "
@@ -181,13 +190,14 @@ static bool decode_pc_sample_packet(struct libswo_context *ctx,
 		return false;
 	}
 
-	ctx->packet.pc_sample.pc = hw->value;
+	packet->pc_sample.pc = hw->value;
 
 	return true;
 }
 
-static bool decode_pc_value_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_pc_value_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
 	if (hw->size != PC_VALUE_SIZE) {
 		log_warn(ctx, "Data trace PC value packet with invalid size "
@@ -195,19 +205,22 @@ static bool decode_pc_value_packet(struct libswo_context *ctx,
 		return false;
 	}
 
-	ctx->packet.hw = *hw;
-	ctx->packet.type = LIBSWO_PACKET_TYPE_DWT_PC_VALUE;
+	(void)user_data;
 
-	ctx->packet.pc_value.cmpn = (hw->address & CMPN_MASK) >> CMPN_OFFSET;
-	ctx->packet.pc_value.pc = hw->value;
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_DWT_PC_VALUE;
+
+	packet->pc_value.cmpn = (hw->address & CMPN_MASK) >> CMPN_OFFSET;
+	packet->pc_value.pc = hw->value;
 
 	log_dbg(ctx, "Data trace PC value packet decoded.");
 
 	return true;
 }
 
-static bool decode_address_offset_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_address_offset_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
 	if (hw->size != ADDR_OFFSET_SIZE) {
 		log_warn(ctx, "Data trace address offset packet with invalid "
@@ -215,57 +228,67 @@ static bool decode_address_offset_packet(struct libswo_context *ctx,
 		return false;
 	}
 
-	ctx->packet.hw = *hw;
-	ctx->packet.type = LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET;
 
-	ctx->packet.addr_offset.cmpn = (hw->address & CMPN_MASK) >> \
+	packet->addr_offset.cmpn = (hw->address & CMPN_MASK) >> \
 		CMPN_OFFSET;
-	ctx->packet.addr_offset.offset = hw->value;
+	packet->addr_offset.offset = hw->value;
 
 	log_dbg(ctx, "Data trace address offset packet decoded.");
 
 	return true;
 }
 
-static bool decode_data_value_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+static int decode_data_value_packet(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
 {
-	ctx->packet.hw = *hw;
-	ctx->packet.type = LIBSWO_PACKET_TYPE_DWT_DATA_VALUE;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_DWT_DATA_VALUE;
 
-	ctx->packet.data_value.wnr = hw->address & WNR_MASK;
-	ctx->packet.data_value.cmpn = (hw->address & CMPN_MASK) >> CMPN_OFFSET;
-	ctx->packet.data_value.data_value = hw->value;
+	packet->data_value.wnr = hw->address & WNR_MASK;
+	packet->data_value.cmpn = (hw->address & CMPN_MASK) >> CMPN_OFFSET;
+	packet->data_value.data_value = hw->value;
 
 	log_dbg(ctx, "Data trace data value packet decoded.");
 
 	return true;
 }
 
+static void set_decoder(struct libswo_context *ctx, uint8_t address,
+		libswo_hw_decoder decoder)
+{
+	ctx->hw_decoders[address].decoder = decoder;
+	ctx->hw_decoders[address].user_data = NULL;
+}
+
 /**
- * Decode hardware packet as Data Watchpoint and Trace (DWT) packet.
+ * Install the Data Watchpoint and Trace (DWT) packet decoders.
  *
  * @param[in,out] ctx libswo context.
- * @param[in] hw Hardware packet.
- *
- * @retval true Packet decoded successfully.
- * @retval false Packet could not be decoded.
  */
-LIBSWO_PRIV bool dwt_decode_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw)
+LIBSWO_PRIV void dwt_init(struct libswo_context *ctx)
 {
-	if (hw->address == EVTCNT_ID)
-		return decode_evtcnt_packet(ctx, hw);
-	else if (hw->address == EXCTRACE_ID)
-		return decode_exctrace_packet(ctx, hw);
-	else if (hw->address == PC_SAMPLE_ID)
-		return decode_pc_sample_packet(ctx, hw);
-	else if ((hw->address & PC_VALUE_HEADER_MASK) == PC_VALUE_HEADER)
-		return decode_pc_value_packet(ctx, hw);
-	else if ((hw->address & ADDR_OFFSET_HEADER_MASK) == ADDR_OFFSET_HEADER)
-		return decode_address_offset_packet(ctx, hw);
-	else if ((hw->address & DATA_VALUE_HEADER_MASK) == DATA_VALUE_HEADER)
-		return decode_data_value_packet(ctx, hw);
-
-	return false;
+	uint8_t address;
+
+	set_decoder(ctx, EVTCNT_ID, &decode_evtcnt_packet);
+	set_decoder(ctx, EXCTRACE_ID, &decode_exctrace_packet);
+	set_decoder(ctx, PC_SAMPLE_ID, &decode_pc_sample_packet);
+
+	for (address = 0; address < LIBSWO_MAX_SOURCE_ADDRESS; address++) {
+		if ((address & PC_VALUE_HEADER_MASK) == PC_VALUE_HEADER)
+			set_decoder(ctx, address, &decode_pc_value_packet);
+		else if ((address & ADDR_OFFSET_HEADER_MASK) ==
+				ADDR_OFFSET_HEADER)
+			set_decoder(ctx, address,
+				&decode_address_offset_packet);
+		else if ((address & DATA_VALUE_HEADER_MASK) ==
+				DATA_VALUE_HEADER)
+			set_decoder(ctx, address, &decode_data_value_packet);
+	}
 }
@@ -0,0 +1,695 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Encoder functions.
+ */
+
+/** @cond PRIVATE */
+/** Minimal size of a synchronization packet in bits. */
+#define SYNC_MIN_SIZE		48
+
+/** Overflow packet header. */
+#define OVERFLOW_HEADER		0x70
+
+/** Local timestamp (LTS1) packet header. */
+#define LTS1_HEADER		0xc0
+
+/** Offset of the relation information of a local timestamp (LTS1) packet. */
+#define LTS1_TC_OFFSET		4
+
+/** Maximal timestamp value of a local timestamp (LTS1) packet. */
+#define LTS1_TS_MAX		0xfffffff
+
+/** Offset of the timestamp of local timestamp (LTS2) packet. */
+#define LTS2_TS_OFFSET		4
+
+/** Minimal timestamp value of a local timestamp (LTS2) packet. */
+#define LTS2_TS_MIN		1
+
+/** Maximal timestamp value of a local timestamp (LTS2) packet. */
+#define LTS2_TS_MAX		6
+
+/** Global timestamp (GTS1) packet header. */
+#define GTS1_HEADER		0x94
+
+/** Maximal timestamp value of a global timestamp (GTS1) packet. */
+#define GTS1_TS_MAX		0x03ffffff
+
+/** Bitmask for the clkch bit of a global timestamp (GTS1) packet. */
+#define GTS1_CLKCH_MASK		0x4000000
+
+/** Bitmask for the wrap bit of a global timestamp (GTS1) packet. */
+#define GTS1_WRAP_MASK		0x8000000
+
+/** Global timestamp (GTS2) packet header. */
+#define GTS2_HEADER		0xb4
+
+/** Size of a global timestamp (GTS2) packet in bytes. */
+#define GTS2_SIZE		5
+
+/** Maximal timestamp value of a global timestamp (GTS2) packet. */
+#define GTS2_TS_MAX		0x3fffff
+
+/** Extension packet header. */
+#define EXT_HEADER		0x08
+
+/** Bitmask for the source bit of an extension packet. */
+#define EXT_SRC_MASK		0x04
+
+/** Bitmask for the extension information of an extension packet header. */
+#define EXT_TS_MASK		0x70
+
+/** Offset of the extension information of an extension packet header. */
+#define EXT_TS_OFFSET		4
+
+/** Number of extension information bits in an extension packet header. */
+#define EXT_TS_BITS		3
+
+/** Bitmask for the type of a source packet. */
+#define SRC_TYPE_MASK		0x04
+
+/** Offset of the address of a source packet. */
+#define SRC_ADDR_OFFSET		3
+
+/** Event counter packet discriminator ID. */
+#define EVTCNT_ID		0
+
+/** Size of an event counter packet in bytes. */
+#define EVTCNT_SIZE		2
+
+/** Exception trace packet discriminator ID. */
+#define EXCTRACE_ID		1
+
+/** Size of an exception trace packet in bytes. */
+#define EXCTRACE_SIZE		3
+
+/** Maximal exception number of an exception trace packet. */
+#define EXCTRACE_EX_MAX		0x1ff
+
+/** Offset of the function of an exception trace packet. */
+#define EXCTRACE_FN_OFFSET	4
+
+/** Periodic PC sample packet discriminator ID. */
+#define PC_SAMPLE_ID		2
+
+/** Size of a periodic PC sleep packet in bytes. */
+#define PC_SAMPLE_SLEEP_SIZE	2
+
+/** Size of a periodic PC sample packet in bytes. */
+#define PC_SAMPLE_SIZE		5
+
+/** Maximal comparator number of a data trace packet. */
+#define CMPN_MAX		3
+
+/** Offset of the comparator number of a data trace packet. */
+#define CMPN_OFFSET		1
+
+/** Data trace PC value packet discriminator ID. */
+#define PC_VALUE_ID		0x08
+
+/** Size of a data trace PC value packet in bytes. */
+#define PC_VALUE_SIZE		5
+
+/** Data trace address offset packet discriminator ID. */
+#define ADDR_OFFSET_ID		0x09
+
+/** Size of a data trace address offset packet in bytes. */
+#define ADDR_OFFSET_SIZE	3
+
+/** Data trace data value packet discriminator ID. */
+#define DATA_VALUE_ID		0x10
+
+/** Bitmask for the continuation bit. */
+#define C_MASK			0x80
+/** @endcond */
+
+/*
+ * Return the minimal number of payload bytes required to encode the value
+ * with continuation bits, or 0 if the value cannot be encoded.
+ */
+static size_t cond_payload_size(uint32_t value)
+{
+	if (value < (1 << 7))
+		return 1;
+	else if (value < (1 << 14))
+		return 2;
+	else if (value < (1 << 21))
+		return 3;
+	else if (value < (1 << 29))
+		return 4;
+
+	return 0;
+}
+
+/*
+ * Return the number of payload bytes for a packet with continuation bits.
+ *
+ * If size is zero, the minimal number of payload bytes is used. Otherwise,
+ * size is the packet size including the header and must be large enough to
+ * hold the value.
+ */
+static size_t cond_packet_payload_size(size_t size, uint32_t value)
+{
+	size_t min_size;
+
+	min_size = cond_payload_size(value);
+
+	if (!min_size)
+		return 0;
+
+	if (!size)
+		return min_size;
+
+	if (size - 1 < min_size || size - 1 > LIBSWO_MAX_PAYLOAD_SIZE)
+		return 0;
+
+	return size - 1;
+}
+
+static void encode_cond_payload(uint8_t *buffer, uint32_t value, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size - 1; i++) {
+		buffer[i] = (value & ~C_MASK) | C_MASK;
+		value >>= 7;
+	}
+
+	buffer[i] = value;
+}
+
+/*
+ * Return the number of payload bytes for a source packet, or 0 if the value
+ * does not fit into the packet.
+ */
+static size_t src_payload_size(size_t size, uint32_t value)
+{
+	if (!size) {
+		if (value <= 0xff)
+			return 1;
+		else if (value <= 0xffff)
+			return 2;
+
+		return 4;
+	}
+
+	if (size == 2 && value <= 0xff)
+		return 1;
+	else if (size == 3 && value <= 0xffff)
+		return 2;
+	else if (size == 5)
+		return 4;
+
+	return 0;
+}
+
+static void encode_src_packet(uint8_t *buffer, bool hw, uint8_t address,
+		uint32_t value, size_t payload_size)
+{
+	size_t i;
+
+	buffer[0] = address << SRC_ADDR_OFFSET;
+	buffer[0] |= (payload_size == 4) ? 3 : payload_size;
+
+	if (hw)
+		buffer[0] |= SRC_TYPE_MASK;
+
+	for (i = 0; i < payload_size; i++)
+		buffer[1 + i] = value >> (i * 8);
+}
+
+static size_t encode_sync_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_sync *sync)
+{
+	size_t size;
+	size_t length;
+
+	size = sync->size ? sync->size : SYNC_MIN_SIZE;
+
+	if (size < SYNC_MIN_SIZE)
+		return 0;
+
+	/* The packet consists of (size - 1) zero bits followed by a one bit. */
+	length = (size - 1) / 8 + 1;
+
+	if (length <= buffer_size) {
+		memset(buffer, 0x00, length - 1);
+		buffer[length - 1] = 1 << ((size - 1) % 8);
+	}
+
+	return length;
+}
+
+static size_t encode_lts_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_lts *lts)
+{
+	size_t payload_size;
+
+	if (lts->relation > LIBSWO_LTS_REL_BOTH || lts->value > LTS1_TS_MAX)
+		return 0;
+
+	if (lts->size == 1 || (!lts->size && lts->value >= LTS2_TS_MIN && \
+			lts->value <= LTS2_TS_MAX && \
+			lts->relation == LIBSWO_LTS_REL_SYNC)) {
+		if (lts->value < LTS2_TS_MIN || lts->value > LTS2_TS_MAX || \
+				lts->relation != LIBSWO_LTS_REL_SYNC)
+			return 0;
+
+		if (buffer_size >= 1)
+			buffer[0] = lts->value << LTS2_TS_OFFSET;
+
+		return 1;
+	}
+
+	payload_size = cond_packet_payload_size(lts->size, lts->value);
+
+	if (!payload_size)
+		return 0;
+
+	if (payload_size + 1 <= buffer_size) {
+		buffer[0] = LTS1_HEADER | (lts->relation << LTS1_TC_OFFSET);
+		encode_cond_payload(buffer + 1, lts->value, payload_size);
+	}
+
+	return payload_size + 1;
+}
+
+static size_t encode_gts1_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_gts1 *gts1)
+{
+	size_t payload_size;
+	uint32_t value;
+
+	if (gts1->value > GTS1_TS_MAX)
+		return 0;
+
+	value = gts1->value;
+
+	if (gts1->clkch)
+		value |= GTS1_CLKCH_MASK;
+
+	if (gts1->wrap)
+		value |= GTS1_WRAP_MASK;
+
+	payload_size = cond_packet_payload_size(gts1->size, value);
+
+	if (!payload_size)
+		return 0;
+
+	if (payload_size + 1 <= buffer_size) {
+		buffer[0] = GTS1_HEADER;
+		encode_cond_payload(buffer + 1, value, payload_size);
+	}
+
+	return payload_size + 1;
+}
+
+static size_t encode_gts2_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_gts2 *gts2)
+{
+	if (gts2->value > GTS2_TS_MAX)
+		return 0;
+
+	if (gts2->size && gts2->size != GTS2_SIZE)
+		return 0;
+
+	if (GTS2_SIZE <= buffer_size) {
+		buffer[0] = GTS2_HEADER;
+		encode_cond_payload(buffer + 1, gts2->value, GTS2_SIZE - 1);
+	}
+
+	return GTS2_SIZE;
+}
+
+static size_t encode_ext_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_ext *ext)
+{
+	size_t payload_size;
+	uint32_t value;
+
+	if (ext->source > LIBSWO_EXT_SRC_HW)
+		return 0;
+
+	value = ext->value >> EXT_TS_BITS;
+
+	if (ext->size == 1 || (!ext->size && !value)) {
+		if (value)
+			return 0;
+
+		payload_size = 0;
+	} else {
+		payload_size = cond_packet_payload_size(ext->size, value);
+
+		if (!payload_size)
+			return 0;
+	}
+
+	if (payload_size + 1 > buffer_size)
+		return payload_size + 1;
+
+	buffer[0] = EXT_HEADER;
+	buffer[0] |= (ext->value << EXT_TS_OFFSET) & EXT_TS_MASK;
+
+	if (ext->source == LIBSWO_EXT_SRC_HW)
+		buffer[0] |= EXT_SRC_MASK;
+
+	if (payload_size > 0) {
+		buffer[0] |= C_MASK;
+		encode_cond_payload(buffer + 1, value, payload_size);
+	}
+
+	return payload_size + 1;
+}
+
+static size_t encode_src(uint8_t *buffer, size_t buffer_size, bool hw,
+		uint8_t address, uint32_t value, size_t size)
+{
+	size_t payload_size;
+
+	if (address >= LIBSWO_MAX_SOURCE_ADDRESS)
+		return 0;
+
+	payload_size = src_payload_size(size, value);
+
+	if (!payload_size)
+		return 0;
+
+	if (payload_size + 1 <= buffer_size)
+		encode_src_packet(buffer, hw, address, value, payload_size);
+
+	return payload_size + 1;
+}
+
+static size_t encode_evtcnt_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_evtcnt *evtcnt)
+{
+	uint8_t value;
+
+	if (evtcnt->size && evtcnt->size != EVTCNT_SIZE)
+		return 0;
+
+	value = evtcnt->cpi << 0;
+	value |= evtcnt->exc << 1;
+	value |= evtcnt->sleep << 2;
+	value |= evtcnt->lsu << 3;
+	value |= evtcnt->fold << 4;
+	value |= evtcnt->cyc << 5;
+
+	return encode_src(buffer, buffer_size, true, EVTCNT_ID, value,
+		EVTCNT_SIZE);
+}
+
+static size_t encode_exctrace_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_exctrace *exctrace)
+{
+	uint16_t value;
+
+	if (exctrace->size && exctrace->size != EXCTRACE_SIZE)
+		return 0;
+
+	if (exctrace->exception > EXCTRACE_EX_MAX || \
+			exctrace->function > LIBSWO_EXCTRACE_FUNC_RETURN)
+		return 0;
+
+	value = exctrace->exception;
+	value |= exctrace->function << (EXCTRACE_FN_OFFSET + 8);
+
+	return encode_src(buffer, buffer_size, true, EXCTRACE_ID, value,
+		EXCTRACE_SIZE);
+}
+
+static size_t encode_pc_sample_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_pc_sample *pc_sample)
+{
+	if (pc_sample->sleep) {
+		if (pc_sample->pc > 0)
+			return 0;
+
+		if (pc_sample->size && pc_sample->size != PC_SAMPLE_SLEEP_SIZE)
+			return 0;
+
+		return encode_src(buffer, buffer_size, true, PC_SAMPLE_ID, 0,
+			PC_SAMPLE_SLEEP_SIZE);
+	}
+
+	if (pc_sample->size && pc_sample->size != PC_SAMPLE_SIZE)
+		return 0;
+
+	return encode_src(buffer, buffer_size, true, PC_SAMPLE_ID,
+		pc_sample->pc, PC_SAMPLE_SIZE);
+}
+
+static size_t encode_pc_value_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_pc_value *pc_value)
+{
+	if (pc_value->cmpn > CMPN_MAX)
+		return 0;
+
+	if (pc_value->size && pc_value->size != PC_VALUE_SIZE)
+		return 0;
+
+	return encode_src(buffer, buffer_size, true,
+		PC_VALUE_ID | (pc_value->cmpn << CMPN_OFFSET), pc_value->pc,
+		PC_VALUE_SIZE);
+}
+
+static size_t encode_addr_offset_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_addr_offset *addr_offset)
+{
+	if (addr_offset->cmpn > CMPN_MAX)
+		return 0;
+
+	if (addr_offset->size && addr_offset->size != ADDR_OFFSET_SIZE)
+		return 0;
+
+	return encode_src(buffer, buffer_size, true,
+		ADDR_OFFSET_ID | (addr_offset->cmpn << CMPN_OFFSET),
+		addr_offset->offset, ADDR_OFFSET_SIZE);
+}
+
+static size_t encode_data_value_packet(uint8_t *buffer, size_t buffer_size,
+		const struct libswo_packet_dwt_data_value *data_value)
+{
+	uint8_t address;
+
+	if (data_value->cmpn > CMPN_MAX)
+		return 0;
+
+	address = DATA_VALUE_ID | (data_value->cmpn << CMPN_OFFSET);
+
+	if (data_value->wnr)
+		address |= 1;
+
+	return encode_src(buffer, buffer_size, true, address,
+		data_value->data_value, data_value->size);
+}
+
+/**
+ * Encode a packet.
+ *
+ * The packet is serialized such that decoding the resulting data yields the
+ * same packet again.
+ *
+ * The size field of the packet selects the encoding if the packet type
+ * supports more than one, for example a local timestamp packet with a
+ * non-minimal number of payload bytes. Decoded packets are therefore encoded
+ * byte-exact. If the size field is zero, the most compact encoding for the
+ * packet is used.
+ *
+ * For hardware source packets and all DWT packets, only the type specific
+ * fields are used, the raw payload fields are ignored. Reserved and invalid
+ * trailing bits which are discarded by the decoder are not reproduced.
+ * Unknown data packets are encoded by copying their raw data.
+ *
+ * @param[out] buffer Buffer to store the encoded packet in. May be NULL if
+ *                    @p buffer_size is zero.
+ * @param[in] buffer_size Size of the buffer in bytes.
+ * @param[in] packet Packet to encode.
+ * @param[out] length Number of bytes written on success. If the buffer is
+ *                    too small, the number of bytes required to encode the
+ *                    packet.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR Buffer too small, nothing was written.
+ * @retval LIBSWO_ERR_ARG Invalid arguments or packet which cannot be encoded.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_encode_packet(uint8_t *buffer, size_t buffer_size,
+		const union libswo_packet *packet, size_t *length)
+{
+	size_t tmp;
+
+	if ((!buffer && buffer_size > 0) || !packet || !length)
+		return LIBSWO_ERR_ARG;
+
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+		tmp = packet->unknown.size;
+
+		if (tmp > sizeof(packet->unknown.data))
+			tmp = 0;
+		else if (tmp <= buffer_size)
+			memcpy(buffer, packet->unknown.data, tmp);
+		break;
+	case LIBSWO_PACKET_TYPE_SYNC:
+		tmp = encode_sync_packet(buffer, buffer_size, &packet->sync);
+		break;
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+		tmp = 1;
+
+		if (packet->of.size > 1)
+			tmp = 0;
+		else if (buffer_size >= 1)
+			buffer[0] = OVERFLOW_HEADER;
+		break;
+	case LIBSWO_PACKET_TYPE_LTS:
+		tmp = encode_lts_packet(buffer, buffer_size, &packet->lts);
+		break;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		tmp = encode_gts1_packet(buffer, buffer_size, &packet->gts1);
+		break;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		tmp = encode_gts2_packet(buffer, buffer_size, &packet->gts2);
+		break;
+	case LIBSWO_PACKET_TYPE_EXT:
+		tmp = encode_ext_packet(buffer, buffer_size, &packet->ext);
+		break;
+	case LIBSWO_PACKET_TYPE_INST:
+		tmp = encode_src(buffer, buffer_size, false,
+			packet->inst.address, packet->inst.value,
+			packet->inst.size);
+		break;
+	case LIBSWO_PACKET_TYPE_HW:
+		tmp = encode_src(buffer, buffer_size, true, packet->hw.address,
+			packet->hw.value, packet->hw.size);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		tmp = encode_evtcnt_packet(buffer, buffer_size,
+			&packet->evtcnt);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		tmp = encode_exctrace_packet(buffer, buffer_size,
+			&packet->exctrace);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		tmp = encode_pc_sample_packet(buffer, buffer_size,
+			&packet->pc_sample);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		tmp = encode_pc_value_packet(buffer, buffer_size,
+			&packet->pc_value);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		tmp = encode_addr_offset_packet(buffer, buffer_size,
+			&packet->addr_offset);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		tmp = encode_data_value_packet(buffer, buffer_size,
+			&packet->data_value);
+		break;
+	default:
+		if (packet->type >= LIBSWO_PACKET_TYPE_USER && \
+				packet->type <= LIBSWO_PACKET_TYPE_USER_MAX)
+			tmp = encode_src(buffer, buffer_size, true,
+				packet->hw.address, packet->hw.value,
+				packet->hw.size);
+		else
+			tmp = 0;
+		break;
+	}
+
+	if (!tmp)
+		return LIBSWO_ERR_ARG;
+
+	*length = tmp;
+
+	if (tmp > buffer_size)
+		return LIBSWO_ERR;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Encode multiple packets.
+ *
+ * Packets are encoded one after another until either all packets are encoded
+ * or the buffer is full. See libswo_encode_packet() for details.
+ *
+ * @param[out] buffer Buffer to store the encoded packets in.
+ * @param[in] buffer_size Size of the buffer in bytes.
+ * @param[in] packets Packets to encode.
+ * @param[in] num_packets Number of packets to encode.
+ * @param[out] num_encoded Number of packets which were encoded.
+ * @param[out] length Number of bytes written.
+ *
+ * @retval LIBSWO_OK Success. Less than @p num_packets packets are encoded if
+ *                   the buffer is full.
+ * @retval LIBSWO_ERR_ARG Invalid arguments or packet which cannot be encoded.
+ *                        @p num_encoded and @p length refer to the packets
+ *                        preceding the invalid packet.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_encode_packets(uint8_t *buffer, size_t buffer_size,
+		const union libswo_packet *packets, size_t num_packets,
+		size_t *num_encoded, size_t *length)
+{
+	int ret;
+	size_t i;
+	size_t tmp;
+	size_t offset;
+
+	if ((!buffer && buffer_size > 0) || (!packets && num_packets > 0))
+		return LIBSWO_ERR_ARG;
+
+	if (!num_encoded || !length)
+		return LIBSWO_ERR_ARG;
+
+	offset = 0;
+	ret = LIBSWO_OK;
+
+	for (i = 0; i < num_packets; i++) {
+		ret = libswo_encode_packet(buffer + offset,
+			buffer_size - offset, &packets[i], &tmp);
+
+		if (ret != LIBSWO_OK)
+			break;
+
+		offset += tmp;
+	}
+
+	*num_encoded = i;
+	*length = offset;
+
+	if (ret == LIBSWO_ERR)
+		return LIBSWO_OK;
+
+	return ret;
+}
@@ -0,0 +1,365 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Host timestamp correlation.
+ */
+
+/**
+ * Initialize host timestamp tracking.
+ *
+ * @param[in,out] ctx libswo context.
+ */
+LIBSWO_PRIV void host_time_init(struct libswo_context *ctx)
+{
+	ctx->host_time_enabled = false;
+	ctx->host_time_head = 0;
+	ctx->host_time_tail = 0;
+	ctx->packet_host_time = 0;
+	ctx->target_time = 0;
+
+	ctx->clock_origin[0] = 0;
+	ctx->clock_origin[1] = 0;
+	ctx->clock_samples = 0;
+	ctx->clock_mean[0] = 0;
+	ctx->clock_mean[1] = 0;
+	ctx->clock_m2 = 0;
+	ctx->clock_cov = 0;
+
+	libswo_latency_reset(ctx);
+}
+
+/**
+ * Record the host timestamp of a trace data chunk.
+ *
+ * Must be called by the producer before the chunk is written into the buffer.
+ * If the queue is full, the chunk is merged with the previous one and inherits
+ * its host timestamp. Latencies of such chunks are therefore overestimated
+ * rather than underestimated.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] end Stream position of the end of the chunk in bytes.
+ * @param[in] timestamp Host timestamp of the chunk, or 0 if none.
+ */
+LIBSWO_PRIV void host_time_push(struct libswo_context *ctx, uint64_t end,
+		uint64_t timestamp)
+{
+	struct host_time_chunk *chunk;
+	size_t count;
+	size_t index;
+
+	if (timestamp && !ctx->host_time_enabled)
+		ATOMIC_STORE(&ctx->host_time_enabled, true);
+
+	if (!ctx->host_time_enabled)
+		return;
+
+	count = ctx->host_time_tail - ATOMIC_LOAD(&ctx->host_time_head);
+
+	if (count > 0) {
+		index = (ctx->host_time_tail - 1) % HOST_TIME_QUEUE_SIZE;
+		chunk = &ctx->host_times[index];
+
+		if (chunk->timestamp == timestamp || \
+				count == HOST_TIME_QUEUE_SIZE) {
+			ATOMIC_STORE(&chunk->end, end);
+			return;
+		}
+	}
+
+	chunk = &ctx->host_times[ctx->host_time_tail % HOST_TIME_QUEUE_SIZE];
+	chunk->end = end;
+	chunk->timestamp = timestamp;
+
+	ATOMIC_STORE(&ctx->host_time_tail, ctx->host_time_tail + 1);
+}
+
+static size_t get_bucket(uint64_t latency)
+{
+	size_t bucket;
+
+	if (!latency)
+		return 0;
+
+#ifdef __GNUC__
+	bucket = 64 - __builtin_clzll(latency);
+#else
+	for (bucket = 0; latency > 0; bucket++)
+		latency >>= 1;
+#endif
+
+	return MIN(bucket, LIBSWO_LATENCY_NUM_BUCKETS - 1);
+}
+
+static void update_latency(struct libswo_context *ctx, uint64_t now)
+{
+	struct libswo_latency *latency;
+	uint64_t tmp;
+
+	latency = &ctx->latency;
+	tmp = (now > ctx->packet_host_time) ? now - ctx->packet_host_time : 0;
+
+	if (!latency->count || tmp < latency->min)
+		latency->min = tmp;
+
+	if (tmp > latency->max)
+		latency->max = tmp;
+
+	latency->count++;
+	latency->sum += tmp;
+	latency->buckets[get_bucket(tmp)]++;
+}
+
+/*
+ * Add a sample to the clock model. The linear regression is updated online
+ * with the sample relative to the first sample in order to retain precision.
+ */
+static void update_clock_model(struct libswo_context *ctx)
+{
+	double x;
+	double y;
+	double dx;
+
+	if (!ctx->clock_samples) {
+		ctx->clock_origin[0] = ctx->target_time;
+		ctx->clock_origin[1] = ctx->packet_host_time;
+	}
+
+	x = (double)(ctx->target_time - ctx->clock_origin[0]);
+	y = (double)(int64_t)(ctx->packet_host_time - ctx->clock_origin[1]);
+
+	ctx->clock_samples++;
+
+	dx = x - ctx->clock_mean[0];
+	ctx->clock_mean[0] += dx / ctx->clock_samples;
+	ctx->clock_mean[1] += (y - ctx->clock_mean[1]) / ctx->clock_samples;
+	ctx->clock_m2 += dx * (x - ctx->clock_mean[0]);
+	ctx->clock_cov += dx * (y - ctx->clock_mean[1]);
+}
+
+/**
+ * Update the host timestamp of the current packet.
+ *
+ * Must be called right before the decoder callback function is invoked.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] length Length of the current packet in bytes.
+ */
+LIBSWO_PRIV void host_time_update(struct libswo_context *ctx, size_t length)
+{
+	struct host_time_chunk *chunk;
+	size_t tail;
+	uint64_t end;
+
+	/* Stream position of the end of the current packet. */
+	end = ctx->bytes_consumed + length;
+	tail = ATOMIC_LOAD(&ctx->host_time_tail);
+	chunk = NULL;
+
+	while (ctx->host_time_head != tail) {
+		chunk = &ctx->host_times[ctx->host_time_head % \
+			HOST_TIME_QUEUE_SIZE];
+
+		if (ATOMIC_LOAD(&chunk->end) >= end)
+			break;
+
+		ATOMIC_STORE(&ctx->host_time_head, ctx->host_time_head + 1);
+		chunk = NULL;
+	}
+
+	ctx->packet_host_time = chunk ? chunk->timestamp : 0;
+
+	if (!ctx->packet_host_time)
+		return;
+
+	update_latency(ctx, libswo_get_host_time());
+
+	if (ctx->packet.type == LIBSWO_PACKET_TYPE_LTS)
+		update_clock_model(ctx);
+}
+
+/**
+ * Get the current host time.
+ *
+ * Use this function to obtain host timestamps for libswo_feed_timestamp().
+ *
+ * @return Current time of a monotonic clock in nanoseconds.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API uint64_t libswo_get_host_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get the host timestamp of the current packet.
+ *
+ * This is the host timestamp of the trace data chunk which contains the last
+ * byte of the packet, see libswo_feed_timestamp(). This function is intended
+ * to be used within the decoder callback function.
+ *
+ * @param[in] ctx libswo context.
+ * @param[out] timestamp Host timestamp in nanoseconds.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR No host timestamp available for the current packet.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_get_packet_host_time(const struct libswo_context *ctx,
+		uint64_t *timestamp)
+{
+	if (!ctx || !timestamp)
+		return LIBSWO_ERR_ARG;
+
+	if (!ctx->packet_host_time)
+		return LIBSWO_ERR;
+
+	*timestamp = ctx->packet_host_time;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Get the target time.
+ *
+ * The target time is the sum of the values of all decoded local timestamp
+ * packets. It is used as the target time base for the clock model, see
+ * libswo_clock_model_get().
+ *
+ * @param[in] ctx libswo context.
+ * @param[out] timestamp Target time in timestamp ticks.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_get_target_time(const struct libswo_context *ctx,
+		uint64_t *timestamp)
+{
+	if (!ctx || !timestamp)
+		return LIBSWO_ERR_ARG;
+
+	*timestamp = ctx->target_time;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Get the feed-to-callback latency statistics.
+ *
+ * The latency of a packet is the time between its host timestamp and the
+ * invocation of the decoder callback function. Only packets with a host
+ * timestamp are taken into account.
+ *
+ * @param[in] ctx libswo context.
+ * @param[out] latency Latency statistics.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_latency_get(const struct libswo_context *ctx,
+		struct libswo_latency *latency)
+{
+	if (!ctx || !latency)
+		return LIBSWO_ERR_ARG;
+
+	*latency = ctx->latency;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Reset the feed-to-callback latency statistics.
+ *
+ * @param[in,out] ctx libswo context.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_latency_reset(struct libswo_context *ctx)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	memset(&ctx->latency, 0, sizeof(ctx->latency));
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Get the clock model.
+ *
+ * The clock model is a least squares fit which maps the target time, see
+ * libswo_get_target_time(), to the host time. Each local timestamp packet with
+ * a host timestamp contributes one sample. Local timestamp packets without a
+ * host timestamp advance the target time but do not contribute a sample.
+ *
+ * @param[in] ctx libswo context.
+ * @param[out] model Clock model.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR Not enough samples to fit the model.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_clock_model_get(const struct libswo_context *ctx,
+		struct libswo_clock_model *model)
+{
+	double slope;
+	double offset;
+
+	if (!ctx || !model)
+		return LIBSWO_ERR_ARG;
+
+	if (ctx->clock_samples < 2 || ctx->clock_m2 <= 0)
+		return LIBSWO_ERR;
+
+	slope = ctx->clock_cov / ctx->clock_m2;
+	offset = ctx->clock_mean[1] - slope * ctx->clock_mean[0];
+
+	model->num_samples = ctx->clock_samples;
+	model->slope = slope;
+	model->offset = ctx->clock_origin[1] + offset - \
+		slope * ctx->clock_origin[0];
+
+	return LIBSWO_OK;
+}
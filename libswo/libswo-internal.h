@@ -20,6 +20,10 @@
 #ifndef LIBSWO_LIBSWO_INTERNAL_H
 #define LIBSWO_LIBSWO_INTERNAL_H
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -34,6 +38,59 @@
 /** Calculate the minimum of two numeric values. */
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/*
+ * Memory accesses to context fields which are shared between the producer,
+ * which feeds trace data, and the consumer, which decodes it. See
+ * libswo_feed() for details.
+ */
+
+/** Load a shared field with acquire semantics. */
+#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+/** Store a shared field with release semantics. */
+#define ATOMIC_STORE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+/** Full memory barrier. */
+#define ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/** Maximum number of trace data chunks with pending host timestamps. */
+#define HOST_TIME_QUEUE_SIZE	64
+
+/** Host timestamp of a trace data chunk. */
+struct host_time_chunk {
+	/** Stream position of the end of the chunk in bytes. */
+	uint64_t end;
+	/** Host timestamp of the chunk, or 0 if none. */
+	uint64_t timestamp;
+};
+
+/** Number of packet types, including user-defined ones. */
+#define NUM_PACKET_TYPES	(LIBSWO_PACKET_TYPE_USER_MAX + 1)
+
+/** Callback function of a packet type. */
+struct type_callback {
+	/** Callback function, or NULL if none. */
+	libswo_decoder_callback callback;
+	/** User data to be passed to the callback function. */
+	void *user_data;
+};
+
+/** Decoder of a hardware source address. */
+struct hw_decoder {
+	/** Decoder function, or NULL if none. */
+	libswo_hw_decoder decoder;
+	/** User data to be passed to the decoder function. */
+	void *user_data;
+};
+
+/** Subscriber of decoded packets. */
+struct subscriber {
+	/** Callback function, or NULL if the entry is unused. */
+	libswo_decoder_callback callback;
+	/** User data to be passed to the callback function. */
+	void *user_data;
+	/** Packet filter. */
+	struct libswo_filter filter;
+};
+
 struct libswo_context {
 	/** Current log level. */
 	enum libswo_log_level log_level;
@@ -43,10 +100,29 @@ struct libswo_context {
 	void *log_cb_user_data;
 	/** Log domain. */
 	char log_domain[LIBSWO_LOG_DOMAIN_MAX_LENGTH + 1];
+	/** Memory allocator. */
+	struct libswo_allocator allocator;
+	/**
+	 * Indicates whether the context was allocated during initialization
+	 * and must be free'ed on shutdown.
+	 */
+	bool free_context;
 	/** Decoder callback function. */
 	libswo_decoder_callback callback;
 	/** User data to be passed to the decoder callback function. */
 	void *cb_user_data;
+	/** Callback functions for each packet type. */
+	struct type_callback type_callbacks[NUM_PACKET_TYPES];
+	/** Decoders for each hardware source address. */
+	struct hw_decoder hw_decoders[LIBSWO_MAX_SOURCE_ADDRESS];
+	/** Subscribers. */
+	struct subscriber subscribers[LIBSWO_MAX_SUBSCRIBERS];
+	/** Number of subscribers. */
+	size_t num_subscribers;
+	/** Bitmask of subscribers for each packet type. */
+	uint32_t dispatch[NUM_PACKET_TYPES];
+	/** Bitmask of subscribers for each instrumentation port. */
+	uint32_t inst_dispatch[LIBSWO_MAX_SOURCE_ADDRESS];
 	/** Last decoded packet. */
 	union libswo_packet packet;
 	/** Buffer. */
@@ -58,18 +134,202 @@ struct libswo_context {
 	 * must be free'ed on shutdown.
 	 */
 	bool free_buffer;
-	/** Current read position of the buffer. */
+	/** Current read position of the buffer, owned by the consumer. */
 	size_t read_pos;
-	/** Current write position of the buffer. */
+	/** Current write position of the buffer, owned by the producer. */
 	size_t write_pos;
-	/** Number of bytes in the buffer. */
-	size_t bytes_available;
+	/** Total number of bytes fed into the decoder, owned by the producer. */
+	uint64_t bytes_fed;
+	/** Total number of bytes removed from the buffer, owned by the consumer. */
+	uint64_t bytes_consumed;
+	/** Wait callback function. */
+	libswo_wait_callback wait_callback;
+	/** Notify callback function. */
+	libswo_notify_callback notify_callback;
+	/** User data to be passed to the wait and notify callback functions. */
+	void *wait_cb_user_data;
+	/** Indicates whether the consumer is about to wait for trace data. */
+	bool waiting;
+	/** Indicates whether decoder statistics are collected. */
+	bool stats_enabled;
+	/** Decoder statistics. */
+	struct libswo_stats stats;
+	/** Indicates whether host timestamps are tracked. */
+	bool host_time_enabled;
+	/** Host timestamps of the trace data chunks in the buffer. */
+	struct host_time_chunk host_times[HOST_TIME_QUEUE_SIZE];
+	/** Number of entries removed from the queue, owned by the consumer. */
+	size_t host_time_head;
+	/** Number of entries added to the queue, owned by the producer. */
+	size_t host_time_tail;
+	/** Host timestamp of the current packet, or 0 if none. */
+	uint64_t packet_host_time;
+	/** Sum of all local timestamp values. */
+	uint64_t target_time;
+	/** Feed-to-callback latency statistics. */
+	struct libswo_latency latency;
+	/** Target and host time of the first clock model sample. */
+	uint64_t clock_origin[2];
+	/** Number of clock model samples. */
+	uint64_t clock_samples;
+	/** Mean of the target and host time relative to the origin. */
+	double clock_mean[2];
+	/** Sum of squared target time deviations. */
+	double clock_m2;
+	/** Sum of target and host time co-deviations. */
+	double clock_cov;
+};
+
+/** Number of runs used to detect the bit time of the line decoder. */
+#define LINE_TRAINING_RUNS	64
+
+/** Size of the staging buffer of the line decoder in bytes. */
+#define LINE_STAGING_SIZE	256
+
+/** Frame state of the line decoder. */
+enum line_state {
+	/** Waiting for the start of a frame. */
+	LINE_STATE_IDLE,
+	/** Receiving a frame. */
+	LINE_STATE_FRAME,
+	/** Waiting for the line to become idle after an error. */
+	LINE_STATE_ERROR
 };
 
+struct libswo_line {
+	/** Line encoding. */
+	enum libswo_line_encoding encoding;
+	/** Bitmask of the channel within a sample. */
+	uint8_t mask;
+	/** Sink function, or NULL if the trace data is discarded. */
+	libswo_line_sink sink;
+	/** User data to be passed to the sink function. */
+	void *user_data;
+	/** Indicates whether any sample was fed. */
+	bool started;
+	/** Indicates whether the current run started before the first sample. */
+	bool partial;
+	/** Current line level. */
+	bool level;
+	/** Length of the current run in samples. */
+	uint64_t run;
+	/**
+	 * Current length of a unit in samples, or 0 if not yet known. A unit is
+	 * a bit for NRZ and a half-bit for Manchester encoding.
+	 */
+	double unit;
+	/** Initial length of a unit in samples. */
+	double initial_unit;
+	/** Runs collected to detect the unit length. */
+	uint64_t training[LINE_TRAINING_RUNS];
+	/** Level of the first collected run. */
+	bool training_level;
+	/** Number of collected runs. */
+	size_t num_training;
+	/** Frame state. */
+	enum line_state state;
+	/** Number of units received of the current frame. */
+	unsigned int pos;
+	/** Level of the first half of the current Manchester bit. */
+	bool half;
+	/** Bits received of the current frame. */
+	uint16_t bits;
+	/** Number of decoded bytes. */
+	uint64_t num_bytes;
+	/** Number of framing and encoding errors. */
+	uint64_t num_errors;
+	/** Number of bytes in the staging buffer. */
+	size_t length;
+	/** Staging buffer. */
+	uint8_t data[LINE_STAGING_SIZE];
+};
+
+/** Size of a TPIU formatter frame in bytes. */
+#define TPIU_FRAME_SIZE		16
+
+/** Number of trace source IDs of the TPIU formatter. */
+#define TPIU_NUM_IDS		128
+
+/** Size of the staging buffer of a trace source in bytes. */
+#define TPIU_STAGING_SIZE	256
+
+/** Trace source of the TPIU deframer. */
+struct tpiu_source {
+	/** Sink function, or NULL if the trace data is discarded. */
+	libswo_tpiu_sink sink;
+	/** User data to be passed to the sink function. */
+	void *user_data;
+	/** Number of bytes in the staging buffer. */
+	size_t length;
+	/** Staging buffer. */
+	uint8_t data[TPIU_STAGING_SIZE];
+};
+
+struct libswo_tpiu {
+	/** Indicates whether the deframer is synchronized to the frames. */
+	bool synced;
+	/** Last four bytes of the stream used for synchronization. */
+	uint32_t sync;
+	/** Current trace source ID. */
+	uint8_t id;
+	/** Partial frame. */
+	uint8_t frame[TPIU_FRAME_SIZE];
+	/** Number of bytes in the partial frame. */
+	size_t frame_pos;
+	/** Bitmask of trace sources with pending data in the staging buffer. */
+	uint64_t pending[TPIU_NUM_IDS / 64];
+	/** Trace sources. */
+	struct tpiu_source sources[TPIU_NUM_IDS];
+};
+
+/*
+ * USDT probes of the libswo provider:
+ *
+ *  - feed_entry(ctx, length)
+ *  - feed_exit(ctx, length, ret)
+ *  - packet(ctx, type, size), where size is in bytes
+ *  - overflow(ctx)
+ *  - unknown(ctx, size)
+ *  - callback_stop(ctx)
+ */
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+/** USDT probe without arguments. */
+#define PROBE0(name) DTRACE_PROBE(libswo, name)
+/** USDT probe with one argument. */
+#define PROBE1(name, a) DTRACE_PROBE1(libswo, name, a)
+/** USDT probe with two arguments. */
+#define PROBE2(name, a, b) DTRACE_PROBE2(libswo, name, a, b)
+/** USDT probe with three arguments. */
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(libswo, name, a, b, c)
+#else
+#define PROBE0(name) do { } while (0)
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#ifdef ENABLE_STATS
+/** Get the start time of a decoder stage, or 0 if statistics are disabled. */
+#define STATS_BEGIN(ctx) ((ctx)->stats_enabled ? stats_get_time() : 0)
+
+/** Account the execution of a decoder stage. */
+#define STATS_END(ctx, stage, start) do { \
+		if ((ctx)->stats_enabled) \
+			stats_add((ctx), (stage), (start)); \
+	} while (0)
+#else
+#define STATS_BEGIN(ctx) ((uint64_t)0)
+#define STATS_END(ctx, stage, start) ((void)(start))
+#endif
+
 /*--- buffer.c --------------------------------------------------------------*/
 
-LIBSWO_PRIV bool buffer_write(struct libswo_context *ctx,
-		const uint8_t *buffer, size_t length);
+LIBSWO_PRIV size_t buffer_available(const struct libswo_context *ctx);
+LIBSWO_PRIV size_t buffer_space(const struct libswo_context *ctx);
+LIBSWO_PRIV void buffer_write(struct libswo_context *ctx,
+		const struct libswo_iovec *iov, size_t iovcnt, size_t length);
 LIBSWO_PRIV bool buffer_read(struct libswo_context *ctx, uint8_t *buffer,
 		size_t length, size_t offset);
 LIBSWO_PRIV bool buffer_peek(const struct libswo_context *ctx, uint8_t *buffer,
@@ -79,8 +339,14 @@ LIBSWO_PRIV void buffer_flush(struct libswo_context *ctx);
 
 /*--- dwt.c -----------------------------------------------------------------*/
 
-LIBSWO_PRIV bool dwt_decode_packet(struct libswo_context *ctx,
-		const struct libswo_packet_hw *hw);
+LIBSWO_PRIV void dwt_init(struct libswo_context *ctx);
+
+/*--- hosttime.c ------------------------------------------------------------*/
+
+LIBSWO_PRIV void host_time_init(struct libswo_context *ctx);
+LIBSWO_PRIV void host_time_push(struct libswo_context *ctx, uint64_t end,
+		uint64_t timestamp);
+LIBSWO_PRIV void host_time_update(struct libswo_context *ctx, size_t length);
 
 /*--- log.c -----------------------------------------------------------------*/
 
@@ -92,4 +358,16 @@ LIBSWO_PRIV void log_warn(struct libswo_context *ctx, const char *format, ...);
 LIBSWO_PRIV void log_info(struct libswo_context *ctx, const char *format, ...);
 LIBSWO_PRIV void log_dbg(struct libswo_context *ctx, const char *format, ...);
 
+/*--- stats.c ---------------------------------------------------------------*/
+
+LIBSWO_PRIV uint64_t stats_get_time(void);
+LIBSWO_PRIV void stats_add(struct libswo_context *ctx,
+		enum libswo_stats_stage stage, uint64_t start);
+
+/*--- subscriber.c ----------------------------------------------------------*/
+
+LIBSWO_PRIV void subscribers_init(struct libswo_context *ctx);
+LIBSWO_PRIV bool subscribers_interested(const struct libswo_context *ctx);
+LIBSWO_PRIV int subscribers_dispatch(struct libswo_context *ctx);
+
 #endif /* LIBSWO_LIBSWO_INTERNAL_H */
@@ -130,9 +130,40 @@ enum libswo_decoder_flags {
 	 * If this flag is set, the decoder treats all remaining and incomplete
 	 * packets as unknown data.
 	 */
-	LIBSWO_DF_EOS = (1 << 0)
+	LIBSWO_DF_EOS = (1 << 0),
+	/**
+	 * Wait for trace data instead of returning once no complete packet is
+	 * left.
+	 *
+	 * The wait callback function must be set, see
+	 * libswo_set_wait_callbacks().
+	 */
+	LIBSWO_DF_WAIT = (1 << 1)
 };
 
+/** Decoder stages for which statistics are collected. */
+enum libswo_stats_stage {
+	/** Writing of trace data into the buffer in libswo_feed(). */
+	LIBSWO_STATS_STAGE_BUFFER_WRITE = 0,
+	/** Classification of packet headers. */
+	LIBSWO_STATS_STAGE_HEADER = 1,
+	/**
+	 * Decoding of packet payloads.
+	 *
+	 * This includes the time spent in #LIBSWO_STATS_STAGE_DWT.
+	 */
+	LIBSWO_STATS_STAGE_PAYLOAD = 2,
+	/** Decoding of hardware source packets as DWT packets. */
+	LIBSWO_STATS_STAGE_DWT = 3,
+	/** Copying of the raw packet data. */
+	LIBSWO_STATS_STAGE_COPY = 4,
+	/** Execution of the decoder callback function. */
+	LIBSWO_STATS_STAGE_CALLBACK = 5
+};
+
+/** Number of decoder stages, see #libswo_stats_stage. */
+#define LIBSWO_STATS_NUM_STAGES		6
+
 /** Exception trace functions. */
 enum libswo_exctrace_function {
 	/** Reserved. */
@@ -151,6 +182,15 @@ enum libswo_exctrace_function {
 /** Maximum address of a source packet. */
 #define LIBSWO_MAX_SOURCE_ADDRESS	32
 
+/**
+ * First packet type available for hardware source packets decoded by a
+ * user-defined decoder, see libswo_set_hw_decoder().
+ */
+#define LIBSWO_PACKET_TYPE_USER		24
+
+/** Last packet type available for user-defined hardware source packets. */
+#define LIBSWO_PACKET_TYPE_USER_MAX	31
+
 /**
  * Common fields packet.
  *
@@ -476,6 +516,90 @@ union libswo_packet {
 	struct libswo_packet_dwt_data_value data_value;
 };
 
+/** Statistics of a decoder stage. */
+struct libswo_stats_counter {
+	/** Number of times the stage was executed. */
+	uint64_t calls;
+	/** Accumulated execution time of the stage in nanoseconds. */
+	uint64_t time;
+};
+
+/** Decoder statistics. */
+struct libswo_stats {
+	/** Statistics for each decoder stage, see #libswo_stats_stage. */
+	struct libswo_stats_counter stages[LIBSWO_STATS_NUM_STAGES];
+};
+
+/** Number of buckets of the latency histogram. */
+#define LIBSWO_LATENCY_NUM_BUCKETS	64
+
+/** Feed-to-callback latency statistics. */
+struct libswo_latency {
+	/** Number of packets. */
+	uint64_t count;
+	/** Minimal latency in nanoseconds. */
+	uint64_t min;
+	/** Maximal latency in nanoseconds. */
+	uint64_t max;
+	/** Sum of all latencies in nanoseconds. */
+	uint64_t sum;
+	/**
+	 * Latency histogram with logarithmic buckets.
+	 *
+	 * Bucket 0 counts latencies of 0 ns and bucket i > 0 counts latencies
+	 * in the range [2^(i - 1), 2^i) ns. The last bucket also counts all
+	 * larger latencies.
+	 */
+	uint64_t buckets[LIBSWO_LATENCY_NUM_BUCKETS];
+};
+
+/**
+ * Linear model which maps target time to host time.
+ *
+ * The host time in nanoseconds for a target time is given by
+ * offset + slope * target time.
+ */
+struct libswo_clock_model {
+	/** Number of samples the model is based on. */
+	uint64_t num_samples;
+	/** Host time in nanoseconds per target timestamp tick. */
+	double slope;
+	/** Host time in nanoseconds at target time 0. */
+	double offset;
+};
+
+/** Maximum number of subscribers per context. */
+#define LIBSWO_MAX_SUBSCRIBERS		32
+
+/** Bitmask of a packet type to be used in a subscriber filter. */
+#define LIBSWO_PACKET_TYPE_MASK(type)	(UINT32_C(1) << (type))
+
+/** Packet filter of a subscriber. */
+struct libswo_filter {
+	/**
+	 * Bitmask of packet types to be delivered, see
+	 * LIBSWO_PACKET_TYPE_MASK().
+	 */
+	uint32_t types;
+	/**
+	 * Bitmask of instrumentation ports whose packets are delivered, where
+	 * bit n corresponds to port n. Only applies to instrumentation packets.
+	 */
+	uint32_t ports;
+};
+
+/**
+ * Trace data buffer for scatter-gather feeding, see libswo_feedv().
+ *
+ * The layout matches struct iovec on POSIX systems.
+ */
+struct libswo_iovec {
+	/** Buffer with trace data. */
+	const void *iov_base;
+	/** Number of bytes in the buffer. */
+	size_t iov_len;
+};
+
 /**
  * @struct libswo_context
  *
@@ -483,6 +607,40 @@ union libswo_packet {
  */
 struct libswo_context;
 
+/**
+ * Size of the storage for a libswo context in bytes, see libswo_init_static().
+ */
+#define LIBSWO_CONTEXT_SIZE	5120
+
+/**
+ * Required alignment of the storage for a libswo context in bytes, see
+ * libswo_init_static().
+ */
+#define LIBSWO_CONTEXT_ALIGN	8
+
+/** Memory allocator. */
+struct libswo_allocator {
+	/**
+	 * Allocate a block of memory.
+	 *
+	 * @param[in] size Size of the block in bytes.
+	 * @param[in,out] user_data User data of the allocator.
+	 *
+	 * @return Pointer to the block suitably aligned for any type, or NULL
+	 *         on failure.
+	 */
+	void *(*alloc)(size_t size, void *user_data);
+	/**
+	 * Free a block of memory.
+	 *
+	 * @param[in] ptr Pointer to the block.
+	 * @param[in,out] user_data User data of the allocator.
+	 */
+	void (*dealloc)(void *ptr, void *user_data);
+	/** User data to be passed to the allocator functions. */
+	void *user_data;
+};
+
 /**
  * Decoder callback function type.
  *
@@ -496,6 +654,123 @@ struct libswo_context;
 typedef int (*libswo_decoder_callback)(struct libswo_context *ctx,
 		const union libswo_packet *packet, void *user_data);
 
+/** Line encodings of the Serial Wire Output (SWO). */
+enum libswo_line_encoding {
+	/** Non-return-to-zero (NRZ) encoding, i.e. UART with 8N1. */
+	LIBSWO_LINE_ENCODING_NRZ = 0,
+	/** Manchester encoding. */
+	LIBSWO_LINE_ENCODING_MANCHESTER = 1
+};
+
+/** Line decoder information. */
+struct libswo_line_info {
+	/**
+	 * Indicates whether the bit time is known, either detected or set
+	 * with libswo_line_set_bit_time().
+	 */
+	bool locked;
+	/** Current bit time in samples. */
+	double bit_time;
+	/** Bit timing drift relative to the initial bit time in ppm. */
+	double drift;
+	/** Number of decoded bytes. */
+	uint64_t num_bytes;
+	/** Number of framing and encoding errors. */
+	uint64_t num_errors;
+};
+
+/**
+ * @struct libswo_line
+ *
+ * Opaque structure representing a line decoder.
+ */
+struct libswo_line;
+
+/**
+ * Trace data sink function type of the line decoder.
+ *
+ * @param[in,out] line Line decoder.
+ * @param[in] data Decoded trace data.
+ * @param[in] length Number of bytes.
+ * @param[in,out] user_data User data passed to the sink function.
+ *
+ * @return #LIBSWO_OK on success, or a libswo error code on failure.
+ */
+typedef int (*libswo_line_sink)(struct libswo_line *line, const uint8_t *data,
+		size_t length, void *user_data);
+
+/**
+ * @struct libswo_tpiu
+ *
+ * Opaque structure representing a TPIU formatter frame deframer.
+ */
+struct libswo_tpiu;
+
+/** Smallest trace source ID of the TPIU formatter. */
+#define LIBSWO_TPIU_MIN_ID	0x01
+
+/** Largest trace source ID of the TPIU formatter. */
+#define LIBSWO_TPIU_MAX_ID	0x6f
+
+/**
+ * Trace data sink function type of the TPIU deframer.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ * @param[in] id Trace source ID.
+ * @param[in] data Trace data of the trace source.
+ * @param[in] length Number of bytes.
+ * @param[in,out] user_data User data passed to the sink function.
+ *
+ * @return #LIBSWO_OK on success, or a libswo error code on failure.
+ */
+typedef int (*libswo_tpiu_sink)(struct libswo_tpiu *tpiu, uint8_t id,
+		const uint8_t *data, size_t length, void *user_data);
+
+/**
+ * Hardware source decoder function type.
+ *
+ * A decoder either leaves the packet untouched or copies the hardware source
+ * packet into it, i.e. `packet->hw = *hw`, and sets the type of the packet
+ * afterwards. The type must be #LIBSWO_PACKET_TYPE_HW, one of the DWT packet
+ * types, or, for user-defined packets, in the range from
+ * #LIBSWO_PACKET_TYPE_USER to #LIBSWO_PACKET_TYPE_USER_MAX. Packets of any
+ * other type are passed on as packets of type #LIBSWO_PACKET_TYPE_UNKNOWN.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] hw Hardware source packet.
+ * @param[out] packet Decoded packet.
+ * @param[in,out] user_data User data passed to the decoder function.
+ *
+ * @retval true Packet decoded successfully.
+ * @retval false Packet could not be decoded and is passed on as hardware
+ *               source packet.
+ */
+typedef int (*libswo_hw_decoder)(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data);
+
+/**
+ * Wait callback function type.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in,out] user_data User data passed to the callback function.
+ *
+ * @retval >0 Continue decoding.
+ * @retval 0 Stop waiting for trace data.
+ * @retval <0 Error.
+ */
+typedef int (*libswo_wait_callback)(struct libswo_context *ctx,
+		void *user_data);
+
+/**
+ * Notify callback function type.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in,out] user_data User data passed to the callback function.
+ */
+typedef void (*libswo_notify_callback)(struct libswo_context *ctx,
+		void *user_data);
+
 /**
  * Log callback function type.
  *
@@ -530,21 +805,76 @@ typedef int (*libswo_log_callback)(struct libswo_context *ctx,
 
 LIBSWO_API int libswo_init(struct libswo_context **ctx, uint8_t *buffer,
 		size_t buffer_size);
+LIBSWO_API int libswo_init_allocator(struct libswo_context **ctx,
+		uint8_t *buffer, size_t buffer_size,
+		const struct libswo_allocator *allocator);
+LIBSWO_API int libswo_init_static(struct libswo_context **ctx, void *storage,
+		size_t storage_size, uint8_t *buffer, size_t buffer_size);
 LIBSWO_API int libswo_exit(struct libswo_context *ctx);
 
 /*--- decoder.c -------------------------------------------------------------*/
 
 LIBSWO_API int libswo_feed(struct libswo_context *ctx, const uint8_t *buffer,
 		size_t length);
+LIBSWO_API int libswo_feed_timestamp(struct libswo_context *ctx,
+		const uint8_t *buffer, size_t length, uint64_t timestamp);
+LIBSWO_API int libswo_feedv(struct libswo_context *ctx,
+		const struct libswo_iovec *iov, size_t iovcnt,
+		uint64_t timestamp);
 LIBSWO_API int libswo_decode(struct libswo_context *ctx, uint32_t flags);
 LIBSWO_API int libswo_set_callback(struct libswo_context *ctx,
 		libswo_decoder_callback callback, void *user_data);
+LIBSWO_API int libswo_set_type_callback(struct libswo_context *ctx,
+		enum libswo_packet_type type, libswo_decoder_callback callback,
+		void *user_data);
+LIBSWO_API int libswo_set_wait_callbacks(struct libswo_context *ctx,
+		libswo_wait_callback wait, libswo_notify_callback notify,
+		void *user_data);
+LIBSWO_API int libswo_set_hw_decoder(struct libswo_context *ctx,
+		uint8_t address, libswo_hw_decoder decoder, void *user_data);
+
+/*--- encoder.c -------------------------------------------------------------*/
+
+LIBSWO_API int libswo_encode_packet(uint8_t *buffer, size_t buffer_size,
+		const union libswo_packet *packet, size_t *length);
+LIBSWO_API int libswo_encode_packets(uint8_t *buffer, size_t buffer_size,
+		const union libswo_packet *packets, size_t num_packets,
+		size_t *num_encoded, size_t *length);
 
 /*--- error.c ---------------------------------------------------------------*/
 
 LIBSWO_API const char *libswo_strerror(int error_code);
 LIBSWO_API const char *libswo_strerror_name(int error_code);
 
+/*--- hosttime.c ------------------------------------------------------------*/
+
+LIBSWO_API uint64_t libswo_get_host_time(void);
+LIBSWO_API int libswo_get_packet_host_time(const struct libswo_context *ctx,
+		uint64_t *timestamp);
+LIBSWO_API int libswo_get_target_time(const struct libswo_context *ctx,
+		uint64_t *timestamp);
+LIBSWO_API int libswo_latency_get(const struct libswo_context *ctx,
+		struct libswo_latency *latency);
+LIBSWO_API int libswo_latency_reset(struct libswo_context *ctx);
+LIBSWO_API int libswo_clock_model_get(const struct libswo_context *ctx,
+		struct libswo_clock_model *model);
+
+/*--- line.c ----------------------------------------------------------------*/
+
+LIBSWO_API int libswo_line_init(struct libswo_line **line,
+		enum libswo_line_encoding encoding, unsigned int channel);
+LIBSWO_API int libswo_line_exit(struct libswo_line *line);
+LIBSWO_API int libswo_line_set_sink(struct libswo_line *line,
+		libswo_line_sink sink, void *user_data);
+LIBSWO_API int libswo_line_set_context(struct libswo_line *line,
+		struct libswo_context *ctx);
+LIBSWO_API int libswo_line_set_bit_time(struct libswo_line *line,
+		double bit_time);
+LIBSWO_API int libswo_line_feed(struct libswo_line *line,
+		const uint8_t *samples, size_t num_samples);
+LIBSWO_API int libswo_line_get_info(const struct libswo_line *line,
+		struct libswo_line_info *info);
+
 /*--- log.c -----------------------------------------------------------------*/
 
 LIBSWO_API int libswo_log_set_level(struct libswo_context *ctx,
@@ -557,6 +887,35 @@ LIBSWO_API int libswo_log_set_domain(struct libswo_context *ctx,
 		const char *domain);
 LIBSWO_API const char *libswo_log_get_domain(const struct libswo_context *ctx);
 
+/*--- stats.c ---------------------------------------------------------------*/
+
+LIBSWO_API int libswo_stats_enable(struct libswo_context *ctx, bool enable);
+LIBSWO_API int libswo_stats_get(const struct libswo_context *ctx,
+		struct libswo_stats *stats);
+LIBSWO_API int libswo_stats_reset(struct libswo_context *ctx);
+
+/*--- subscriber.c ----------------------------------------------------------*/
+
+LIBSWO_API int libswo_subscribe(struct libswo_context *ctx,
+		const struct libswo_filter *filter,
+		libswo_decoder_callback callback, void *user_data,
+		unsigned int *id);
+LIBSWO_API int libswo_unsubscribe(struct libswo_context *ctx,
+		unsigned int id);
+
+/*--- tpiu.c ----------------------------------------------------------------*/
+
+LIBSWO_API int libswo_tpiu_init(struct libswo_tpiu **tpiu);
+LIBSWO_API int libswo_tpiu_exit(struct libswo_tpiu *tpiu);
+LIBSWO_API int libswo_tpiu_set_sink(struct libswo_tpiu *tpiu, uint8_t id,
+		libswo_tpiu_sink sink, void *user_data);
+LIBSWO_API int libswo_tpiu_set_context(struct libswo_tpiu *tpiu, uint8_t id,
+		struct libswo_context *ctx);
+LIBSWO_API int libswo_tpiu_feed(struct libswo_tpiu *tpiu,
+		const uint8_t *buffer, size_t length);
+LIBSWO_API int libswo_tpiu_reset(struct libswo_tpiu *tpiu);
+LIBSWO_API bool libswo_tpiu_is_synced(const struct libswo_tpiu *tpiu);
+
 /*--- version.c -------------------------------------------------------------*/
 
 LIBSWO_API int libswo_version_package_get_major(void);
@@ -0,0 +1,667 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Line decoder for sampled Serial Wire Output (SWO) line levels.
+ */
+
+/*
+ * The line decoder operates on runs, i.e. the number of samples between two
+ * edges, which are converted into a number of units. A unit is a bit for NRZ
+ * and a half-bit for Manchester encoding.
+ *
+ * An NRZ frame starts with a low start bit, followed by 8 data bits with the
+ * least significant bit first and a high stop bit. The line is high while it
+ * is idle.
+ *
+ * A Manchester frame starts with a start bit of value 1, followed by 8 data
+ * bits with the least significant bit first. A bit of value 1 is high in the
+ * first and low in the second half, a bit of value 0 vice versa. The line is
+ * low while it is idle.
+ */
+
+/* Number of units of an NRZ frame. */
+#define NRZ_FRAME_UNITS		10
+
+/* Number of units of a Manchester frame. */
+#define MANCHESTER_FRAME_UNITS	18
+
+/* Minimum number of units of an idle Manchester line. */
+#define MANCHESTER_IDLE_UNITS	3
+
+/* Maximum number of units of a run used to track the unit length. */
+#define TRACKING_MAX_UNITS	8
+
+/* Number of iterations to refine the detected unit length. */
+#define DETECTION_ITERATIONS	4
+
+/* Weight of a single run when tracking the unit length. */
+#define TRACKING_GAIN		(1.0 / 64)
+
+/* Eight times the channel bitmask for word-at-a-time edge detection. */
+#define REPEAT_BYTE(x)		(UINT64_C(0x0101010101010101) * (x))
+
+static int flush(struct libswo_line *line)
+{
+	size_t length;
+
+	if (!line->length || !line->sink)
+		return LIBSWO_OK;
+
+	length = line->length;
+	line->length = 0;
+
+	return line->sink(line, line->data, length, line->user_data);
+}
+
+static int emit(struct libswo_line *line, uint8_t byte)
+{
+	int ret;
+
+	line->num_bytes++;
+
+	if (!line->sink)
+		return LIBSWO_OK;
+
+	if (line->length == LINE_STAGING_SIZE) {
+		ret = flush(line);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	line->data[line->length++] = byte;
+
+	return LIBSWO_OK;
+}
+
+static void frame_error(struct libswo_line *line)
+{
+	line->num_errors++;
+	line->state = LINE_STATE_ERROR;
+}
+
+static void track(struct libswo_line *line, uint64_t run, uint64_t units)
+{
+	if (units > TRACKING_MAX_UNITS)
+		return;
+
+	line->unit += ((double)run / units - line->unit) * TRACKING_GAIN;
+}
+
+static int nrz_run(struct libswo_line *line, bool level, uint64_t run,
+		uint64_t units)
+{
+	switch (line->state) {
+	case LINE_STATE_IDLE:
+		if (level)
+			return LIBSWO_OK;
+
+		line->state = LINE_STATE_FRAME;
+		line->pos = 0;
+		line->bits = 0;
+		break;
+	case LINE_STATE_ERROR:
+		if (level)
+			line->state = LINE_STATE_IDLE;
+
+		return LIBSWO_OK;
+	default:
+		break;
+	}
+
+	/* Only runs which end within the frame have a known length. */
+	if (line->pos + units < NRZ_FRAME_UNITS)
+		track(line, run, units);
+
+	while (units > 0) {
+		if (line->pos == NRZ_FRAME_UNITS - 1) {
+			if (!level) {
+				frame_error(line);
+				return LIBSWO_OK;
+			}
+
+			line->state = LINE_STATE_IDLE;
+
+			return emit(line, line->bits);
+		}
+
+		if (line->pos > 0)
+			line->bits |= level << (line->pos - 1);
+
+		line->pos++;
+		units--;
+	}
+
+	return LIBSWO_OK;
+}
+
+static int manchester_run(struct libswo_line *line, bool level, uint64_t run,
+		uint64_t units)
+{
+	int ret;
+
+	switch (line->state) {
+	case LINE_STATE_IDLE:
+		if (!level)
+			return LIBSWO_OK;
+
+		line->state = LINE_STATE_FRAME;
+		line->pos = 0;
+		line->bits = 0;
+		break;
+	case LINE_STATE_ERROR:
+		if (!level && units >= MANCHESTER_IDLE_UNITS)
+			line->state = LINE_STATE_IDLE;
+
+		return LIBSWO_OK;
+	default:
+		break;
+	}
+
+	if (line->pos + units < MANCHESTER_FRAME_UNITS)
+		track(line, run, units);
+
+	while (units > 0) {
+		if (!(line->pos & 1)) {
+			line->half = level;
+		} else if (line->half == level) {
+			frame_error(line);
+			return LIBSWO_OK;
+		} else if (line->pos > 1) {
+			line->bits |= line->half << ((line->pos - 3) / 2);
+		}
+
+		line->pos++;
+		units--;
+
+		if (line->pos < MANCHESTER_FRAME_UNITS)
+			continue;
+
+		ret = emit(line, line->bits);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		line->state = LINE_STATE_IDLE;
+
+		/* The remaining units of a high run start the next frame. */
+		if (!level || !units)
+			break;
+
+		line->state = LINE_STATE_FRAME;
+		line->pos = 0;
+		line->bits = 0;
+	}
+
+	return LIBSWO_OK;
+}
+
+static int decode_run(struct libswo_line *line, bool level, uint64_t run,
+		uint64_t units)
+{
+	if (line->encoding == LIBSWO_LINE_ENCODING_MANCHESTER)
+		return manchester_run(line, level, run, units);
+
+	return nrz_run(line, level, run, units);
+}
+
+/*
+ * Detect the unit length from the collected runs.
+ *
+ * The shortest runs are assumed to be a single unit long. Both edges of a run
+ * are quantized to samples, a run of a single unit is therefore either the
+ * shortest run or one sample longer. The mean of these runs is refined with
+ * the runs of up to TRACKING_MAX_UNITS units such that fractional unit lengths
+ * are detected accurately. At least two samples per unit are required to tell
+ * runs of one and two units apart.
+ */
+static int detect_unit(struct libswo_line *line)
+{
+	int ret;
+	uint64_t min;
+	uint64_t sum;
+	uint64_t units;
+	uint64_t count;
+	size_t i;
+	unsigned int j;
+	bool level;
+
+	min = line->training[0];
+
+	for (i = 1; i < line->num_training; i++)
+		min = MIN(min, line->training[i]);
+
+	sum = 0;
+	count = 0;
+
+	for (i = 0; i < line->num_training; i++) {
+		if (line->training[i] <= min + 1 || \
+				2 * line->training[i] < 3 * min) {
+			sum += line->training[i];
+			count++;
+		}
+	}
+
+	line->unit = (double)sum / count;
+
+	for (j = 0; j < DETECTION_ITERATIONS; j++) {
+		sum = 0;
+		count = 0;
+
+		for (i = 0; i < line->num_training; i++) {
+			units = line->training[i] / line->unit + 0.5;
+
+			if (!units || units > TRACKING_MAX_UNITS)
+				continue;
+
+			sum += line->training[i];
+			count += units;
+		}
+
+		line->unit = (double)sum / count;
+	}
+
+	line->initial_unit = line->unit;
+
+	/* Decode the collected runs. */
+	level = line->training_level;
+
+	for (i = 0; i < line->num_training; i++) {
+		ret = decode_run(line, level, line->training[i],
+			line->training[i] / line->unit + 0.5);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		level = !level;
+	}
+
+	line->num_training = 0;
+
+	return LIBSWO_OK;
+}
+
+static int process_run(struct libswo_line *line, bool level, uint64_t run)
+{
+	uint64_t units;
+
+	if (!line->unit) {
+		if (!line->num_training)
+			line->training_level = level;
+
+		line->training[line->num_training++] = run;
+
+		if (line->num_training < LINE_TRAINING_RUNS)
+			return LIBSWO_OK;
+
+		return detect_unit(line);
+	}
+
+	units = run / line->unit + 0.5;
+
+	/* Glitches are only tolerated outside of frames. */
+	if (!units) {
+		if (line->state == LINE_STATE_FRAME)
+			frame_error(line);
+
+		return LIBSWO_OK;
+	}
+
+	return decode_run(line, level, run, units);
+}
+
+/*
+ * Complete the current frame if the ongoing run already contains its end.
+ * Otherwise, the last frame before an idle line would only be decoded with
+ * the next edge.
+ */
+static int complete_frame(struct libswo_line *line)
+{
+	unsigned int units;
+
+	if (line->state != LINE_STATE_FRAME || line->partial || !line->unit)
+		return LIBSWO_OK;
+
+	if (line->encoding == LIBSWO_LINE_ENCODING_MANCHESTER) {
+		if (line->level)
+			return LIBSWO_OK;
+
+		units = MANCHESTER_FRAME_UNITS - line->pos;
+	} else {
+		if (!line->level)
+			return LIBSWO_OK;
+
+		units = NRZ_FRAME_UNITS - line->pos;
+	}
+
+	/* The last unit is sampled in its middle. */
+	if (line->run < (units - 0.5) * line->unit)
+		return LIBSWO_OK;
+
+	return decode_run(line, line->level, line->run, units);
+}
+
+static int context_sink(struct libswo_line *line, const uint8_t *data,
+		size_t length, void *user_data)
+{
+	int ret;
+	struct libswo_context *ctx;
+
+	(void)line;
+
+	ctx = (struct libswo_context *)user_data;
+	ret = libswo_feed(ctx, data, length);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	return libswo_decode(ctx, 0);
+}
+
+/**
+ * Create a line decoder.
+ *
+ * The line decoder recovers the trace data from the sampled line levels of the
+ * Serial Wire Output (SWO), for example captured with a logic analyzer.
+ *
+ * @param[out] line Newly allocated line decoder on success, and undefined on
+ *                  failure.
+ * @param[in] encoding Line encoding.
+ * @param[in] channel Channel of the SWO line, i.e. the bit within a sample
+ *                    between 0 and 7.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ * @retval LIBSWO_ERR_MALLOC Memory allocation error.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_init(struct libswo_line **line,
+		enum libswo_line_encoding encoding, unsigned int channel)
+{
+	struct libswo_line *tmp;
+
+	if (!line || channel > 7)
+		return LIBSWO_ERR_ARG;
+
+	if (encoding != LIBSWO_LINE_ENCODING_NRZ && \
+			encoding != LIBSWO_LINE_ENCODING_MANCHESTER)
+		return LIBSWO_ERR_ARG;
+
+	tmp = malloc(sizeof(struct libswo_line));
+
+	if (!tmp)
+		return LIBSWO_ERR_MALLOC;
+
+	tmp->encoding = encoding;
+	tmp->mask = 1 << channel;
+	tmp->sink = NULL;
+	tmp->user_data = NULL;
+	tmp->started = false;
+	tmp->partial = true;
+	tmp->level = false;
+	tmp->run = 0;
+	tmp->unit = 0;
+	tmp->initial_unit = 0;
+	tmp->num_training = 0;
+	tmp->state = LINE_STATE_IDLE;
+	tmp->num_bytes = 0;
+	tmp->num_errors = 0;
+	tmp->length = 0;
+
+	*line = tmp;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Destroy a line decoder.
+ *
+ * @param[in,out] line Line decoder.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_exit(struct libswo_line *line)
+{
+	if (!line)
+		return LIBSWO_ERR_ARG;
+
+	free(line);
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Set the sink function of the line decoder.
+ *
+ * @param[in,out] line Line decoder.
+ * @param[in] sink Sink function, or NULL to discard the decoded trace data.
+ * @param[in] user_data User data to be passed to the sink function.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_set_sink(struct libswo_line *line,
+		libswo_line_sink sink, void *user_data)
+{
+	if (!line)
+		return LIBSWO_ERR_ARG;
+
+	line->sink = sink;
+	line->user_data = user_data;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Decode the trace data of the line decoder with a libswo context.
+ *
+ * The decoded trace data is fed into the context and decoded with
+ * libswo_decode() right away. It is passed on in chunks of up to 256 bytes,
+ * the buffer of the context must therefore be at least 512 bytes in size.
+ *
+ * @param[in,out] line Line decoder.
+ * @param[in] ctx libswo context, or NULL to discard the decoded trace data.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_set_context(struct libswo_line *line,
+		struct libswo_context *ctx)
+{
+	if (!ctx)
+		return libswo_line_set_sink(line, NULL, NULL);
+
+	return libswo_line_set_sink(line, &context_sink, ctx);
+}
+
+/**
+ * Set the bit time of the line decoder.
+ *
+ * By default, the bit time is detected from the first runs of samples between
+ * two edges, where the shortest runs are assumed to be a single bit, or a
+ * half-bit for Manchester encoding, long. This holds for most trace data but
+ * not for example for a stream of zero bytes with NRZ encoding. Detection
+ * requires a bit time of at least 2 samples for NRZ and 4 samples for
+ * Manchester encoding, fractional bit times are supported. The bit time
+ * should be set before any samples are fed. It is tracked afterwards in order
+ * to follow clock drift, see libswo_line_get_info().
+ *
+ * @param[in,out] line Line decoder.
+ * @param[in] bit_time Bit time in samples, i.e. the sample rate divided by the
+ *                     baud rate, or 0 to detect it.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_set_bit_time(struct libswo_line *line,
+		double bit_time)
+{
+	if (!line || bit_time < 0)
+		return LIBSWO_ERR_ARG;
+
+	if (line->encoding == LIBSWO_LINE_ENCODING_MANCHESTER)
+		bit_time /= 2;
+
+	line->unit = bit_time;
+	line->initial_unit = bit_time;
+	line->num_training = 0;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Feed the line decoder with samples.
+ *
+ * Each sample is one byte where the bit of the configured channel represents
+ * the line level, i.e. the raw format of most logic analyzers with up to 8
+ * channels. The decoded trace data is passed to the sink function at the
+ * latest before this function returns.
+ *
+ * @param[in,out] line Line decoder.
+ * @param[in] samples Buffer with samples.
+ * @param[in] num_samples Number of samples.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ * @return Error code of the sink function on failure, in which case the
+ *         remaining samples are discarded.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_feed(struct libswo_line *line,
+		const uint8_t *samples, size_t num_samples)
+{
+	int ret;
+	uint64_t mask;
+	uint64_t level;
+	uint64_t tmp;
+	size_t i;
+
+	if (!line || (!samples && num_samples > 0))
+		return LIBSWO_ERR_ARG;
+
+	if (!num_samples)
+		return LIBSWO_OK;
+
+	if (!line->started) {
+		line->level = samples[0] & line->mask;
+		line->started = true;
+	}
+
+	mask = REPEAT_BYTE(line->mask);
+	i = 0;
+
+	while (true) {
+		level = line->level ? mask : 0;
+
+		/* Skip eight samples at once as long as there is no edge. */
+		while (i + 8 <= num_samples) {
+			memcpy(&tmp, samples + i, sizeof(tmp));
+
+			if ((tmp & mask) != level)
+				break;
+
+			i += 8;
+			line->run += 8;
+		}
+
+		while (i < num_samples && \
+				!!(samples[i] & line->mask) == line->level) {
+			i++;
+			line->run++;
+		}
+
+		if (i == num_samples)
+			break;
+
+		/* The first run started before the first sample and is ignored. */
+		if (line->partial) {
+			line->partial = false;
+		} else {
+			ret = process_run(line, line->level, line->run);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+		}
+
+		line->level = !line->level;
+		line->run = 0;
+	}
+
+	ret = complete_frame(line);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	return flush(line);
+}
+
+/**
+ * Get information about the line decoder.
+ *
+ * @param[in] line Line decoder.
+ * @param[out] info Line decoder information.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_line_get_info(const struct libswo_line *line,
+		struct libswo_line_info *info)
+{
+	if (!line || !info)
+		return LIBSWO_ERR_ARG;
+
+	info->locked = line->unit > 0;
+	info->bit_time = line->unit;
+	info->drift = 0;
+
+	if (line->encoding == LIBSWO_LINE_ENCODING_MANCHESTER)
+		info->bit_time *= 2;
+
+	if (info->locked)
+		info->drift = (line->unit / line->initial_unit - 1) * 1000000;
+
+	info->num_bytes = line->num_bytes;
+	info->num_errors = line->num_errors;
+
+	return LIBSWO_OK;
+}
@@ -0,0 +1,144 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Decoder statistics.
+ */
+
+#ifdef ENABLE_STATS
+/**
+ * Get the current time.
+ *
+ * @return Current time of a monotonic clock in nanoseconds.
+ */
+LIBSWO_PRIV uint64_t stats_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Account the execution of a decoder stage.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] stage Decoder stage.
+ * @param[in] start Start time of the stage as returned by STATS_BEGIN(), or 0
+ *                  if statistics were disabled when the stage started.
+ */
+LIBSWO_PRIV void stats_add(struct libswo_context *ctx,
+		enum libswo_stats_stage stage, uint64_t start)
+{
+	if (!start)
+		return;
+
+	ctx->stats.stages[stage].calls++;
+	ctx->stats.stages[stage].time += stats_get_time() - start;
+}
+#endif
+
+/**
+ * Enable or disable the collection of decoder statistics.
+ *
+ * Statistics are collected for each stage of the decoder, see
+ * #libswo_stats_stage. Collecting statistics adds a small overhead for each
+ * stage and packet. Statistics are disabled by default.
+ *
+ * @note This function is only functional if libswo was built with decoder
+ *       statistics support.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] enable Determines whether statistics are collected.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR libswo was built without decoder statistics support.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_stats_enable(struct libswo_context *ctx, bool enable)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+#ifdef ENABLE_STATS
+	ctx->stats_enabled = enable;
+
+	return LIBSWO_OK;
+#else
+	(void)enable;
+
+	return LIBSWO_ERR;
+#endif
+}
+
+/**
+ * Get the decoder statistics.
+ *
+ * @param[in] ctx libswo context.
+ * @param[out] stats Decoder statistics accumulated since initialization or
+ *                   the last reset.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_stats_get(const struct libswo_context *ctx,
+		struct libswo_stats *stats)
+{
+	if (!ctx || !stats)
+		return LIBSWO_ERR_ARG;
+
+	*stats = ctx->stats;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Reset the decoder statistics.
+ *
+ * @param[in,out] ctx libswo context.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_stats_reset(struct libswo_context *ctx)
+{
+	if (!ctx)
+		return LIBSWO_ERR_ARG;
+
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+
+	return LIBSWO_OK;
+}
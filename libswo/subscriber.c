@@ -0,0 +1,227 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Packet subscribers.
+ */
+
+/*
+ * Compile the filters of all subscribers into the dispatch tables such that
+ * the subscribers of a packet are found with a single lookup.
+ */
+static void compile_filters(struct libswo_context *ctx)
+{
+	const struct subscriber *sub;
+	uint32_t mask;
+	unsigned int i;
+	unsigned int j;
+
+	memset(ctx->dispatch, 0, sizeof(ctx->dispatch));
+	memset(ctx->inst_dispatch, 0, sizeof(ctx->inst_dispatch));
+
+	for (i = 0; i < LIBSWO_MAX_SUBSCRIBERS; i++) {
+		sub = &ctx->subscribers[i];
+
+		if (!sub->callback)
+			continue;
+
+		mask = UINT32_C(1) << i;
+
+		for (j = 0; j < NUM_PACKET_TYPES; j++) {
+			if (j == LIBSWO_PACKET_TYPE_INST)
+				continue;
+
+			if (sub->filter.types & LIBSWO_PACKET_TYPE_MASK(j))
+				ctx->dispatch[j] |= mask;
+		}
+
+		if (!(sub->filter.types & \
+				LIBSWO_PACKET_TYPE_MASK(LIBSWO_PACKET_TYPE_INST)))
+			continue;
+
+		for (j = 0; j < LIBSWO_MAX_SOURCE_ADDRESS; j++) {
+			if (sub->filter.ports & (UINT32_C(1) << j))
+				ctx->inst_dispatch[j] |= mask;
+		}
+	}
+}
+
+/**
+ * Initialize the subscribers.
+ *
+ * @param[in,out] ctx libswo context.
+ */
+LIBSWO_PRIV void subscribers_init(struct libswo_context *ctx)
+{
+	memset(ctx->subscribers, 0, sizeof(ctx->subscribers));
+	ctx->num_subscribers = 0;
+
+	compile_filters(ctx);
+}
+
+static uint32_t get_mask(const struct libswo_context *ctx)
+{
+	if (ctx->packet.type == LIBSWO_PACKET_TYPE_INST)
+		return ctx->inst_dispatch[ctx->packet.inst.address];
+
+	return ctx->dispatch[ctx->packet.type];
+}
+
+/**
+ * Determine whether any subscriber is interested in the current packet.
+ *
+ * @param[in] ctx libswo context.
+ *
+ * @return True if the packet matches the filter of at least one subscriber,
+ *         false otherwise.
+ */
+LIBSWO_PRIV bool subscribers_interested(const struct libswo_context *ctx)
+{
+	return get_mask(ctx) != 0;
+}
+
+/**
+ * Deliver the current packet to all interested subscribers.
+ *
+ * @param[in,out] ctx libswo context.
+ *
+ * @return Return value of the first subscriber which stopped decoding or
+ *         failed, or true if all subscribers returned true.
+ */
+LIBSWO_PRIV int subscribers_dispatch(struct libswo_context *ctx)
+{
+	const struct subscriber *sub;
+	uint32_t mask;
+	unsigned int i;
+	int ret;
+
+	mask = get_mask(ctx);
+
+	while (mask) {
+#ifdef __GNUC__
+		i = __builtin_ctz(mask);
+#else
+		for (i = 0; !(mask & (UINT32_C(1) << i)); i++)
+			;
+#endif
+		mask &= mask - 1;
+		sub = &ctx->subscribers[i];
+
+		/* The subscriber may have been removed by a previous one. */
+		if (!sub->callback)
+			continue;
+
+		ret = sub->callback(ctx, &ctx->packet, sub->user_data);
+
+		if (ret <= 0)
+			return ret;
+	}
+
+	return true;
+}
+
+/**
+ * Add a subscriber.
+ *
+ * A subscriber receives all decoded packets which match its filter. Each
+ * packet is decoded only once and delivered to the decoder callback function,
+ * see libswo_set_callback(), and afterwards to all interested subscribers.
+ * Decoding is stopped as soon as one of the callback functions returns false
+ * or a negative value.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] filter Packet filter.
+ * @param[in] callback Callback function.
+ * @param[in] user_data User data to be passed to the callback function.
+ * @param[out] id Identifier of the subscriber on success, and undefined on
+ *                failure.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR Maximum number of subscribers reached.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_subscribe(struct libswo_context *ctx,
+		const struct libswo_filter *filter,
+		libswo_decoder_callback callback, void *user_data,
+		unsigned int *id)
+{
+	struct subscriber *sub;
+	unsigned int i;
+
+	if (!ctx || !filter || !callback || !id)
+		return LIBSWO_ERR_ARG;
+
+	for (i = 0; i < LIBSWO_MAX_SUBSCRIBERS; i++) {
+		if (!ctx->subscribers[i].callback)
+			break;
+	}
+
+	if (i == LIBSWO_MAX_SUBSCRIBERS)
+		return LIBSWO_ERR;
+
+	sub = &ctx->subscribers[i];
+	sub->callback = callback;
+	sub->user_data = user_data;
+	sub->filter = *filter;
+
+	ctx->num_subscribers++;
+	compile_filters(ctx);
+
+	*id = i;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Remove a subscriber.
+ *
+ * @param[in,out] ctx libswo context.
+ * @param[in] id Identifier of the subscriber.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_unsubscribe(struct libswo_context *ctx, unsigned int id)
+{
+	if (!ctx || id >= LIBSWO_MAX_SUBSCRIBERS)
+		return LIBSWO_ERR_ARG;
+
+	if (!ctx->subscribers[id].callback)
+		return LIBSWO_ERR_ARG;
+
+	memset(&ctx->subscribers[id], 0, sizeof(struct subscriber));
+
+	ctx->num_subscribers--;
+	compile_filters(ctx);
+
+	return LIBSWO_OK;
+}
@@ -0,0 +1,504 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libswo.h"
+#include "libswo-internal.h"
+
+/**
+ * @file
+ *
+ * Trace Port Interface Unit (TPIU) formatter frame deframer.
+ */
+
+/*
+ * A formatter frame consists of 16 bytes. The bytes at even positions are
+ * either a trace source ID change, if bit 0 is set, or a data byte whose bit 0
+ * is stored in the last byte of the frame. The bytes at odd positions are
+ * always data bytes. For an ID change, the corresponding bit in the last byte
+ * indicates whether the new ID takes effect after the following data byte.
+ * Frames are aligned by frame synchronization packets, which are inserted
+ * between frames.
+ */
+
+/* Size of a frame synchronization packet in bytes. */
+#define FRAME_SYNC_SIZE		4
+
+/* Frame synchronization packet as little-endian value. */
+#define FRAME_SYNC		0x7fffffff
+
+/* Number of data bytes in a frame. */
+#define FRAME_DATA_SIZE		(TPIU_FRAME_SIZE - 1)
+
+static bool is_frame_sync(const uint8_t *buffer)
+{
+	return buffer[0] == 0xff && buffer[1] == 0xff && buffer[2] == 0xff && \
+		buffer[3] == 0x7f;
+}
+
+static int flush_source(struct libswo_tpiu *tpiu, uint8_t id)
+{
+	struct tpiu_source *source;
+	size_t length;
+
+	source = &tpiu->sources[id];
+	length = source->length;
+
+	source->length = 0;
+	tpiu->pending[id / 64] &= ~(UINT64_C(1) << (id % 64));
+
+	return source->sink(tpiu, id, source->data, length, source->user_data);
+}
+
+static int flush_sources(struct libswo_tpiu *tpiu)
+{
+	int ret;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < TPIU_NUM_IDS / 64; i++) {
+		while (tpiu->pending[i]) {
+			j = __builtin_ctzll(tpiu->pending[i]);
+			ret = flush_source(tpiu, i * 64 + j);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+		}
+	}
+
+	return LIBSWO_OK;
+}
+
+/*
+ * Get the staging buffer of a trace source with room for the given number of
+ * bytes, or NULL if the trace data of the source is discarded.
+ */
+static int reserve(struct libswo_tpiu *tpiu, uint8_t id, size_t length,
+		uint8_t **data)
+{
+	int ret;
+	struct tpiu_source *source;
+
+	source = &tpiu->sources[id];
+
+	if (!source->sink) {
+		*data = NULL;
+		return LIBSWO_OK;
+	}
+
+	if (source->length + length > TPIU_STAGING_SIZE) {
+		ret = flush_source(tpiu, id);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	*data = source->data + source->length;
+	source->length += length;
+	tpiu->pending[id / 64] |= UINT64_C(1) << (id % 64);
+
+	return LIBSWO_OK;
+}
+
+static int put_byte(struct libswo_tpiu *tpiu, uint8_t id, uint8_t byte)
+{
+	int ret;
+	uint8_t *data;
+
+	ret = reserve(tpiu, id, 1, &data);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	if (data)
+		*data = byte;
+
+	return LIBSWO_OK;
+}
+
+static int decode_frame_slow(struct libswo_tpiu *tpiu, const uint8_t *frame)
+{
+	int ret;
+	unsigned int i;
+	uint8_t aux;
+	uint8_t byte;
+	uint8_t id;
+
+	aux = frame[TPIU_FRAME_SIZE - 1];
+
+	for (i = 0; i < TPIU_FRAME_SIZE / 2; i++) {
+		byte = frame[2 * i];
+
+		if (byte & 0x01) {
+			id = byte >> 1;
+
+			/* No data byte follows the last ID change of a frame. */
+			if (i == TPIU_FRAME_SIZE / 2 - 1) {
+				tpiu->id = id;
+				break;
+			}
+
+			if (aux & (1 << i)) {
+				ret = put_byte(tpiu, tpiu->id, frame[2 * i + 1]);
+				tpiu->id = id;
+			} else {
+				tpiu->id = id;
+				ret = put_byte(tpiu, tpiu->id, frame[2 * i + 1]);
+			}
+		} else {
+			byte |= (aux >> i) & 0x01;
+			ret = put_byte(tpiu, tpiu->id, byte);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+
+			if (i == TPIU_FRAME_SIZE / 2 - 1)
+				break;
+
+			ret = put_byte(tpiu, tpiu->id, frame[2 * i + 1]);
+		}
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	return LIBSWO_OK;
+}
+
+static int decode_frame(struct libswo_tpiu *tpiu, const uint8_t *frame)
+{
+	int ret;
+	unsigned int i;
+	uint8_t aux;
+	uint8_t tmp;
+	uint8_t *data;
+
+	tmp = 0;
+
+	for (i = 0; i < TPIU_FRAME_SIZE; i += 2)
+		tmp |= frame[i];
+
+	if (tmp & 0x01)
+		return decode_frame_slow(tpiu, frame);
+
+	/*
+	 * Fast path for frames without ID change, which is the common case.
+	 * All data bytes belong to the current trace source and are copied
+	 * into its staging buffer at once.
+	 */
+	ret = reserve(tpiu, tpiu->id, FRAME_DATA_SIZE, &data);
+
+	if (ret != LIBSWO_OK || !data)
+		return ret;
+
+	aux = frame[TPIU_FRAME_SIZE - 1];
+
+	for (i = 0; i < FRAME_DATA_SIZE / 2; i++) {
+		data[2 * i] = frame[2 * i] | ((aux >> i) & 0x01);
+		data[2 * i + 1] = frame[2 * i + 1];
+	}
+
+	data[FRAME_DATA_SIZE - 1] = frame[FRAME_DATA_SIZE - 1] | (aux >> 7);
+
+	return LIBSWO_OK;
+}
+
+static int context_sink(struct libswo_tpiu *tpiu, uint8_t id,
+		const uint8_t *data, size_t length, void *user_data)
+{
+	int ret;
+	struct libswo_context *ctx;
+
+	(void)tpiu;
+	(void)id;
+
+	ctx = (struct libswo_context *)user_data;
+	ret = libswo_feed(ctx, data, length);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	return libswo_decode(ctx, 0);
+}
+
+/**
+ * Create a TPIU formatter frame deframer.
+ *
+ * The deframer splits the output of the TPIU formatter into the trace data of
+ * the individual trace sources, for example the Instrumentation Trace
+ * Macrocells (ITM) of multiple cores.
+ *
+ * @param[out] tpiu Newly allocated TPIU deframer on success, and undefined on
+ *                  failure.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ * @retval LIBSWO_ERR_MALLOC Memory allocation error.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_init(struct libswo_tpiu **tpiu)
+{
+	struct libswo_tpiu *tmp;
+	unsigned int i;
+
+	if (!tpiu)
+		return LIBSWO_ERR_ARG;
+
+	tmp = malloc(sizeof(struct libswo_tpiu));
+
+	if (!tmp)
+		return LIBSWO_ERR_MALLOC;
+
+	for (i = 0; i < TPIU_NUM_IDS; i++) {
+		tmp->sources[i].sink = NULL;
+		tmp->sources[i].user_data = NULL;
+	}
+
+	libswo_tpiu_reset(tmp);
+	*tpiu = tmp;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Destroy a TPIU deframer.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_exit(struct libswo_tpiu *tpiu)
+{
+	if (!tpiu)
+		return LIBSWO_ERR_ARG;
+
+	free(tpiu);
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Set the sink function of a trace source.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ * @param[in] id Trace source ID between #LIBSWO_TPIU_MIN_ID and
+ *               #LIBSWO_TPIU_MAX_ID.
+ * @param[in] sink Sink function, or NULL to discard the trace data of the
+ *                 trace source.
+ * @param[in] user_data User data to be passed to the sink function.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_set_sink(struct libswo_tpiu *tpiu, uint8_t id,
+		libswo_tpiu_sink sink, void *user_data)
+{
+	int ret;
+
+	if (!tpiu)
+		return LIBSWO_ERR_ARG;
+
+	if (id < LIBSWO_TPIU_MIN_ID || id > LIBSWO_TPIU_MAX_ID)
+		return LIBSWO_ERR_ARG;
+
+	/* Deliver staged trace data to the previous sink function. */
+	if (tpiu->sources[id].length > 0) {
+		ret = flush_source(tpiu, id);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+	}
+
+	tpiu->sources[id].sink = sink;
+	tpiu->sources[id].user_data = user_data;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Decode the trace data of a trace source with a libswo context.
+ *
+ * The trace data is fed into the context and decoded with libswo_decode()
+ * right away. It is passed on in chunks of up to 256 bytes, the buffer of the
+ * context must therefore be at least 512 bytes in size.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ * @param[in] id Trace source ID between #LIBSWO_TPIU_MIN_ID and
+ *               #LIBSWO_TPIU_MAX_ID.
+ * @param[in] ctx libswo context, or NULL to discard the trace data of the
+ *                trace source.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_set_context(struct libswo_tpiu *tpiu, uint8_t id,
+		struct libswo_context *ctx)
+{
+	if (!ctx)
+		return libswo_tpiu_set_sink(tpiu, id, NULL, NULL);
+
+	return libswo_tpiu_set_sink(tpiu, id, &context_sink, ctx);
+}
+
+/**
+ * Feed the TPIU deframer with formatter output.
+ *
+ * Trace data is discarded until the first frame synchronization packet. The
+ * trace data of each trace source is passed to its sink function in as few
+ * calls as possible, at the latest before this function returns.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ * @param[in] buffer Buffer with formatter output.
+ * @param[in] length Number of bytes.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ * @return Error code of a sink function on failure, in which case the
+ *         remaining formatter output is discarded.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_feed(struct libswo_tpiu *tpiu,
+		const uint8_t *buffer, size_t length)
+{
+	int ret;
+	size_t tmp;
+
+	if (!tpiu || (!buffer && length > 0))
+		return LIBSWO_ERR_ARG;
+
+	while (length > 0) {
+		if (!tpiu->synced) {
+			tpiu->sync = (tpiu->sync >> 8) | ((uint32_t)*buffer << 24);
+			buffer++;
+			length--;
+
+			if (tpiu->sync == FRAME_SYNC) {
+				tpiu->synced = true;
+				tpiu->frame_pos = 0;
+			}
+
+			continue;
+		}
+
+		/* Decode complete frames directly from the buffer. */
+		if (!tpiu->frame_pos && length >= TPIU_FRAME_SIZE) {
+			if (is_frame_sync(buffer)) {
+				buffer += FRAME_SYNC_SIZE;
+				length -= FRAME_SYNC_SIZE;
+				continue;
+			}
+
+			ret = decode_frame(tpiu, buffer);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+
+			buffer += TPIU_FRAME_SIZE;
+			length -= TPIU_FRAME_SIZE;
+			continue;
+		}
+
+		tmp = MIN(length, TPIU_FRAME_SIZE - tpiu->frame_pos);
+		memcpy(tpiu->frame + tpiu->frame_pos, buffer, tmp);
+		tpiu->frame_pos += tmp;
+		buffer += tmp;
+		length -= tmp;
+
+		if (tpiu->frame_pos >= FRAME_SYNC_SIZE && \
+				is_frame_sync(tpiu->frame)) {
+			tpiu->frame_pos -= FRAME_SYNC_SIZE;
+			memmove(tpiu->frame, tpiu->frame + FRAME_SYNC_SIZE,
+				tpiu->frame_pos);
+			continue;
+		}
+
+		if (tpiu->frame_pos == TPIU_FRAME_SIZE) {
+			tpiu->frame_pos = 0;
+			ret = decode_frame(tpiu, tpiu->frame);
+
+			if (ret != LIBSWO_OK)
+				return ret;
+		}
+	}
+
+	return flush_sources(tpiu);
+}
+
+/**
+ * Reset the TPIU deframer.
+ *
+ * The deframer loses synchronization and discards all trace data which was
+ * not passed to a sink function yet. The sink functions are retained.
+ *
+ * @param[in,out] tpiu TPIU deframer.
+ *
+ * @retval LIBSWO_OK Success.
+ * @retval LIBSWO_ERR_ARG Invalid arguments.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API int libswo_tpiu_reset(struct libswo_tpiu *tpiu)
+{
+	unsigned int i;
+
+	if (!tpiu)
+		return LIBSWO_ERR_ARG;
+
+	tpiu->synced = false;
+	tpiu->sync = 0;
+	tpiu->id = 0;
+	tpiu->frame_pos = 0;
+
+	memset(tpiu->pending, 0, sizeof(tpiu->pending));
+
+	for (i = 0; i < TPIU_NUM_IDS; i++)
+		tpiu->sources[i].length = 0;
+
+	return LIBSWO_OK;
+}
+
+/**
+ * Get the synchronization state of the TPIU deframer.
+ *
+ * @param[in] tpiu TPIU deframer.
+ *
+ * @return True if the deframer is synchronized to the frames, false otherwise.
+ *
+ * @since 0.1.0
+ */
+LIBSWO_API bool libswo_tpiu_is_synced(const struct libswo_tpiu *tpiu)
+{
+	if (!tpiu)
+		return false;
+
+	return tpiu->synced;
+}
@@ -0,0 +1,275 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of concurrent feeding and decoding.
+ *
+ * Random packets are encoded and fed by the main thread with libswo_feed() and
+ * libswo_feedv() in chunks of random sizes while another thread decodes them
+ * with #LIBSWO_DF_WAIT. The consumer sleeps in the wait callback function
+ * until it is woken up by the notify callback function. The buffer is small
+ * such that it wraps around frequently and the producer has to wait for free
+ * space. The decoded packets must match the original packets.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		50
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Size of the decoder buffer in bytes. */
+#define DECODER_BUFFER_SIZE	64
+
+/* Maximum size of a chunk of trace data in bytes. */
+#define MAX_CHUNK_SIZE		(DECODER_BUFFER_SIZE / 2)
+
+/* Maximum number of buffers per libswo_feedv() call. */
+#define MAX_IOVCNT		4
+
+struct consumer {
+	struct libswo_context *ctx;
+	union libswo_packet packets[NUM_PACKETS];
+	size_t num_packets;
+	sem_t sem;
+	pthread_mutex_t mutex;
+	/* Indicates whether all trace data was fed. */
+	bool done;
+	/* Indicates whether the consumer decoded after all data was fed. */
+	bool drained;
+	int ret;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct consumer *consumer;
+
+	(void)ctx;
+
+	consumer = (struct consumer *)user_data;
+
+	if (consumer->num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	consumer->packets[consumer->num_packets++] = *packet;
+
+	return true;
+}
+
+static int wait_callback(struct libswo_context *ctx, void *user_data)
+{
+	struct consumer *consumer;
+	bool done;
+
+	(void)ctx;
+
+	consumer = (struct consumer *)user_data;
+
+	pthread_mutex_lock(&consumer->mutex);
+	done = consumer->done;
+	pthread_mutex_unlock(&consumer->mutex);
+
+	/*
+	 * Trace data may have been fed after the last attempt to decode, stop
+	 * only after decoding once more.
+	 */
+	if (done) {
+		if (consumer->drained)
+			return 0;
+
+		consumer->drained = true;
+		return 1;
+	}
+
+	sem_wait(&consumer->sem);
+
+	return 1;
+}
+
+static void notify_callback(struct libswo_context *ctx, void *user_data)
+{
+	(void)ctx;
+
+	sem_post(&((struct consumer *)user_data)->sem);
+}
+
+static void *consumer_thread(void *arg)
+{
+	struct consumer *consumer;
+
+	consumer = (struct consumer *)arg;
+	consumer->ret = libswo_decode(consumer->ctx,
+		LIBSWO_DF_WAIT | LIBSWO_DF_EOS);
+
+	return NULL;
+}
+
+/* Feed a chunk of trace data, split into several buffers at random. */
+static int feed_chunk(struct libswo_context *ctx, const uint8_t *data,
+		size_t length)
+{
+	struct libswo_iovec iov[MAX_IOVCNT];
+	size_t iovcnt;
+	size_t tmp;
+
+	if (rng() % 2)
+		return libswo_feed(ctx, data, length);
+
+	iovcnt = 1 + rng() % MAX_IOVCNT;
+
+	for (tmp = 0; tmp < iovcnt - 1; tmp++) {
+		iov[tmp].iov_base = data;
+		iov[tmp].iov_len = rng() % (length + 1);
+
+		data += iov[tmp].iov_len;
+		length -= iov[tmp].iov_len;
+	}
+
+	iov[tmp].iov_base = data;
+	iov[tmp].iov_len = length;
+
+	return libswo_feedv(ctx, iov, iovcnt, 0);
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	static struct consumer consumer;
+	uint8_t buffer[BUFFER_SIZE];
+	pthread_t thread;
+	size_t num_encoded;
+	size_t length;
+	size_t offset;
+	size_t tmp;
+	size_t i;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), packets,
+		NUM_PACKETS, &num_encoded, &length);
+
+	if (ret != LIBSWO_OK || num_encoded != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: packet %zu not encoded: %s.\n",
+			seed, num_encoded, libswo_strerror_name(ret));
+		return false;
+	}
+
+	ret = libswo_init(&consumer.ctx, NULL, DECODER_BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	consumer.num_packets = 0;
+	consumer.done = false;
+	consumer.drained = false;
+	consumer.ret = LIBSWO_OK;
+	sem_init(&consumer.sem, 0, 0);
+	pthread_mutex_init(&consumer.mutex, NULL);
+
+	libswo_set_callback(consumer.ctx, &packet_callback, &consumer);
+	libswo_set_wait_callbacks(consumer.ctx, &wait_callback,
+		&notify_callback, &consumer);
+
+	if (pthread_create(&thread, NULL, &consumer_thread, &consumer)) {
+		libswo_exit(consumer.ctx);
+		return false;
+	}
+
+	for (offset = 0; offset < length; offset += tmp) {
+		tmp = 1 + rng() % MAX_CHUNK_SIZE;
+
+		if (tmp > length - offset)
+			tmp = length - offset;
+
+		/* Wait for the consumer to free enough space. */
+		while ((ret = feed_chunk(consumer.ctx, buffer + offset,
+				tmp)) == LIBSWO_ERR)
+			sched_yield();
+
+		if (ret != LIBSWO_OK)
+			break;
+	}
+
+	pthread_mutex_lock(&consumer.mutex);
+	consumer.done = true;
+	pthread_mutex_unlock(&consumer.mutex);
+	sem_post(&consumer.sem);
+
+	pthread_join(thread, NULL);
+	libswo_exit(consumer.ctx);
+	sem_destroy(&consumer.sem);
+	pthread_mutex_destroy(&consumer.mutex);
+
+	if (ret != LIBSWO_OK || consumer.ret != LIBSWO_OK || \
+			consumer.num_packets != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s, %s.\n",
+			seed, consumer.num_packets, libswo_strerror_name(ret),
+			libswo_strerror_name(consumer.ret));
+		return false;
+	}
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (packets[i].type == consumer.packets[i].type && \
+				(!packets[i].any.size || \
+				packets[i].any.size == \
+				consumer.packets[i].any.size) && \
+				packet_fields_equal(&packets[i],
+				&consumer.packets[i]))
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu of type %u differs.\n",
+			seed, i, packets[i].type);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
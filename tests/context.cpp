@@ -0,0 +1,391 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "libswocxx.h"
+
+/*
+ * Test of the asynchronous decoding of the context of the C++ bindings.
+ *
+ * Each chunk of trace data consists of a single instrumentation packet whose
+ * value identifies the chunk. The callback function blocks the worker on the
+ * first chunk such that the queue runs full and the overflow policies can be
+ * checked deterministically. Furthermore, errors of the callback function
+ * must be reported by the subsequent calls and stop() must decode all enqueued
+ * trace data.
+ */
+
+using namespace libswo;
+using std::vector;
+
+/* Size of the decoder buffer in bytes. */
+#define BUFFER_SIZE		64
+
+/* Maximum number of pending chunks. */
+#define QUEUE_SIZE		2
+
+/* Number of chunks fed while the queue is full. */
+#define NUM_OVERFLOW		2
+
+/* Number of chunks which are decoded before the worker is stopped. */
+#define NUM_CHUNKS		100
+
+/* Time to wait for feed() to block in milliseconds. */
+#define BLOCK_TIMEOUT		50
+
+/* Value of the packet for which the callback function fails. */
+#define NO_ERROR		UINT32_MAX
+
+struct receiver {
+	std::mutex mutex;
+	std::condition_variable cv;
+	vector<uint32_t> values;
+	/* Indicates whether the callback function blocks the worker. */
+	bool blocked;
+	uint32_t error_value;
+};
+
+static struct receiver receiver;
+
+static int packet_callback(const Packet &packet, void *user_data)
+{
+	struct receiver *receiver;
+	uint32_t value;
+
+	receiver = (struct receiver *)user_data;
+
+	if (packet.get_type() != PACKET_TYPE_INST)
+		return LIBSWO_ERR;
+
+	value = static_cast<const Instrumentation &>(packet).get_value();
+
+	std::unique_lock<std::mutex> lock(receiver->mutex);
+
+	receiver->values.push_back(value);
+	receiver->cv.notify_all();
+
+	receiver->cv.wait(lock, [receiver] {
+		return !receiver->blocked;
+	});
+
+	if (value == receiver->error_value)
+		return LIBSWO_ERR;
+
+	return true;
+}
+
+static void reset_receiver(bool blocked, uint32_t error_value)
+{
+	std::lock_guard<std::mutex> lock(receiver.mutex);
+
+	receiver.values.clear();
+	receiver.blocked = blocked;
+	receiver.error_value = error_value;
+}
+
+static void release_receiver(void)
+{
+	std::lock_guard<std::mutex> lock(receiver.mutex);
+
+	receiver.blocked = false;
+	receiver.cv.notify_all();
+}
+
+/* Wait until the callback function was invoked for the given packets. */
+static void wait_receiver(size_t num_packets)
+{
+	std::unique_lock<std::mutex> lock(receiver.mutex);
+
+	receiver.cv.wait(lock, [num_packets] {
+		return receiver.values.size() >= num_packets;
+	});
+}
+
+static bool check_values(const char *name, const vector<uint32_t> &expected)
+{
+	std::lock_guard<std::mutex> lock(receiver.mutex);
+	size_t i;
+
+	if (receiver.values == expected)
+		return true;
+
+	fprintf(stderr, "%s: received packets", name);
+
+	for (i = 0; i < receiver.values.size(); i++)
+		fprintf(stderr, " %u", receiver.values[i]);
+
+	fprintf(stderr, ".\n");
+
+	return false;
+}
+
+static vector<uint8_t> encode(uint32_t value)
+{
+	union libswo_packet packet;
+	uint8_t buffer[8];
+	size_t num_encoded;
+	size_t length;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = LIBSWO_PACKET_TYPE_INST;
+	packet.inst.size = 5;
+	packet.inst.address = 1;
+	packet.inst.value = value;
+
+	if (libswo_encode_packets(buffer, sizeof(buffer), &packet, 1,
+			&num_encoded, &length) != LIBSWO_OK)
+		throw Error(LIBSWO_ERR);
+
+	return vector<uint8_t>(buffer, buffer + length);
+}
+
+static void feed(Context &context, uint32_t value)
+{
+	context.feed(encode(value));
+}
+
+static bool check_policy(const char *name, enum OverflowPolicy policy,
+		const vector<uint32_t> &expected, size_t num_dropped)
+{
+	Context context(BUFFER_SIZE);
+	std::atomic<bool> fed(false);
+	std::thread feeder;
+	bool failed;
+	uint32_t i;
+
+	reset_receiver(true, NO_ERROR);
+	context.set_callback(&packet_callback, &receiver);
+	context.start(QUEUE_SIZE, policy);
+
+	/* Block the worker on the first chunk and fill the queue. */
+	feed(context, 0);
+	wait_receiver(1);
+
+	for (i = 1; i <= QUEUE_SIZE; i++)
+		feed(context, i);
+
+	failed = false;
+
+	switch (policy) {
+	case OVERFLOW_BLOCK:
+		feeder = std::thread([&context, &fed] {
+			for (uint32_t j = 1; j <= NUM_OVERFLOW; j++)
+				feed(context, QUEUE_SIZE + j);
+
+			fed = true;
+		});
+
+		std::this_thread::sleep_for(
+			std::chrono::milliseconds(BLOCK_TIMEOUT));
+
+		if (fed) {
+			fprintf(stderr, "%s: feed() did not block.\n", name);
+			failed = true;
+		}
+
+		break;
+	case OVERFLOW_ERROR:
+		for (i = 1; i <= NUM_OVERFLOW; i++) {
+			try {
+				feed(context, QUEUE_SIZE + i);
+				fprintf(stderr, "%s: feed() succeeded.\n",
+					name);
+				failed = true;
+			} catch (const Error &error) {
+				if (error.code == LIBSWO_ERR)
+					continue;
+
+				fprintf(stderr, "%s: feed() failed with %s.\n",
+					name, libswo_strerror_name(error.code));
+				failed = true;
+			}
+		}
+
+		break;
+	default:
+		for (i = 1; i <= NUM_OVERFLOW; i++)
+			feed(context, QUEUE_SIZE + i);
+
+		break;
+	}
+
+	release_receiver();
+
+	if (feeder.joinable())
+		feeder.join();
+
+	context.drain();
+
+	if (context.get_num_dropped() != num_dropped) {
+		fprintf(stderr, "%s: %zu chunks dropped instead of %zu.\n",
+			name, context.get_num_dropped(), num_dropped);
+		failed = true;
+	}
+
+	context.stop();
+
+	if (context.is_running()) {
+		fprintf(stderr, "%s: worker still running.\n", name);
+		failed = true;
+	}
+
+	return check_values(name, expected) && !failed;
+}
+
+static bool check_policies(void)
+{
+	/* The worker decodes chunk 0 while the queue holds chunks 1 and 2. */
+	if (!check_policy("Block", OVERFLOW_BLOCK, {0, 1, 2, 3, 4}, 0))
+		return false;
+
+	if (!check_policy("Drop newest", OVERFLOW_DROP_NEWEST, {0, 1, 2}, 2))
+		return false;
+
+	if (!check_policy("Drop oldest", OVERFLOW_DROP_OLDEST, {0, 3, 4}, 2))
+		return false;
+
+	if (!check_policy("Error", OVERFLOW_ERROR, {0, 1, 2}, 0))
+		return false;
+
+	return true;
+}
+
+/* Check that an error of the worker is reported by the subsequent calls. */
+static bool check_error(void)
+{
+	Context context(BUFFER_SIZE);
+	int ret;
+
+	reset_receiver(false, 1);
+	context.set_callback(&packet_callback, &receiver);
+	context.start(QUEUE_SIZE, OVERFLOW_BLOCK);
+
+	feed(context, 0);
+	feed(context, 1);
+
+	try {
+		context.drain();
+		ret = LIBSWO_OK;
+	} catch (const Error &error) {
+		ret = error.code;
+	}
+
+	if (ret != LIBSWO_ERR) {
+		fprintf(stderr, "Error: drain() returned %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	try {
+		feed(context, 2);
+		ret = LIBSWO_OK;
+	} catch (const Error &error) {
+		ret = error.code;
+	}
+
+	if (ret != LIBSWO_ERR) {
+		fprintf(stderr, "Error: feed() returned %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	try {
+		context.stop();
+		ret = LIBSWO_OK;
+	} catch (const Error &error) {
+		ret = error.code;
+	}
+
+	if (ret != LIBSWO_ERR || context.is_running()) {
+		fprintf(stderr, "Error: stop() returned %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	/* The context is usable again after the worker was stopped. */
+	feed(context, 3);
+	context.decode();
+
+	context.start(QUEUE_SIZE, OVERFLOW_BLOCK);
+	feed(context, 4);
+	context.drain();
+	context.stop();
+
+	return check_values("Error", {0, 1, 3, 4});
+}
+
+/*
+ * Check that stop() decodes all enqueued trace data and keeps incomplete
+ * packets in the buffer.
+ */
+static bool check_stop(void)
+{
+	Context context(BUFFER_SIZE);
+	vector<uint32_t> expected;
+	vector<uint8_t> data;
+	uint32_t i;
+
+	reset_receiver(false, NO_ERROR);
+	context.set_callback(&packet_callback, &receiver);
+
+	/* Nothing to wait for without worker. */
+	context.drain();
+
+	context.start(QUEUE_SIZE, OVERFLOW_BLOCK);
+
+	for (i = 0; i < NUM_CHUNKS; i++) {
+		feed(context, i);
+		expected.push_back(i);
+	}
+
+	data = encode(NUM_CHUNKS);
+	context.feed(&data[0], 2);
+	context.stop();
+
+	if (!check_values("Stop", expected))
+		return false;
+
+	context.feed(&data[2], data.size() - 2);
+	context.decode();
+	expected.push_back(NUM_CHUNKS);
+
+	return check_values("Stop", expected);
+}
+
+int main(void)
+{
+	try {
+		if (!check_policies() || !check_error() || !check_stop())
+			return EXIT_FAILURE;
+	} catch (const Error &error) {
+		fprintf(stderr, "Unexpected error: %s.\n", error.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Round-trip test of the packet encoder.
+ *
+ * Random packets of all types are encoded and decoded again with
+ * libswo_decode(). The decoded packets must match the original packets and
+ * must be encoded to the same data again. The packet sizes are chosen such
+ * that every size-selected encoding is used.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		500
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		256
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Number of packet types which are covered. */
+#define NUM_TYPES		(LIBSWO_PACKET_TYPE_DWT_DATA_VALUE + 1)
+
+/* Maximum packet size in bytes which is tracked for coverage. */
+#define MAX_SIZE		(1 + LIBSWO_MAX_PAYLOAD_SIZE)
+
+struct decoded {
+	union libswo_packet packets[NUM_PACKETS];
+	size_t num_packets;
+};
+
+/* Number of decoded packets per packet type and size. */
+static unsigned int coverage[NUM_TYPES][MAX_SIZE + 1];
+
+/* Number of decoded synchronization packets. */
+static unsigned int num_sync;
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct decoded *decoded;
+
+	(void)ctx;
+
+	decoded = (struct decoded *)user_data;
+
+	if (decoded->num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	decoded->packets[decoded->num_packets++] = *packet;
+
+	/* The size of synchronization packets is given in bits. */
+	if (packet->type == LIBSWO_PACKET_TYPE_SYNC)
+		num_sync++;
+	else if (packet->type < NUM_TYPES && packet->any.size <= MAX_SIZE)
+		coverage[packet->type][packet->any.size]++;
+
+	return true;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	static struct decoded decoded;
+	uint8_t buffer[BUFFER_SIZE];
+	uint8_t tmp[BUFFER_SIZE];
+	struct libswo_context *ctx;
+	size_t num_encoded;
+	size_t length;
+	size_t tmp_length;
+	size_t i;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), packets,
+		NUM_PACKETS, &num_encoded, &length);
+
+	if (ret != LIBSWO_OK || num_encoded != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: packet %zu not encoded: %s.\n",
+			seed, num_encoded, libswo_strerror_name(ret));
+		return false;
+	}
+
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	decoded.num_packets = 0;
+	libswo_set_callback(ctx, &packet_callback, &decoded);
+
+	ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK || decoded.num_packets != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s.\n",
+			seed, decoded.num_packets, libswo_strerror_name(ret));
+		return false;
+	}
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (packets[i].type == decoded.packets[i].type && \
+				(!packets[i].any.size || \
+				packets[i].any.size == \
+				decoded.packets[i].any.size) && \
+				packet_fields_equal(&packets[i],
+				&decoded.packets[i]))
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu of type %u differs.\n",
+			seed, i, packets[i].type);
+		return false;
+	}
+
+	ret = libswo_encode_packets(tmp, sizeof(tmp), decoded.packets,
+		NUM_PACKETS, &num_encoded, &tmp_length);
+
+	if (ret != LIBSWO_OK || tmp_length != length || \
+			memcmp(tmp, buffer, length)) {
+		fprintf(stderr, "Sequence %u: decoded packets not encoded "
+			"byte-exact.\n", seed);
+		return false;
+	}
+
+	return true;
+}
+
+/* Check that all size-selected encodings were decoded at least once. */
+static bool check_coverage(void)
+{
+	static const struct {
+		enum libswo_packet_type type;
+		size_t size;
+	} required[] = {
+		{LIBSWO_PACKET_TYPE_UNKNOWN, 1},
+		{LIBSWO_PACKET_TYPE_OVERFLOW, 1},
+		{LIBSWO_PACKET_TYPE_LTS, 1},
+		{LIBSWO_PACKET_TYPE_LTS, 2},
+		{LIBSWO_PACKET_TYPE_LTS, 3},
+		{LIBSWO_PACKET_TYPE_LTS, 4},
+		{LIBSWO_PACKET_TYPE_LTS, 5},
+		{LIBSWO_PACKET_TYPE_GTS1, 2},
+		{LIBSWO_PACKET_TYPE_GTS1, 3},
+		{LIBSWO_PACKET_TYPE_GTS1, 4},
+		{LIBSWO_PACKET_TYPE_GTS1, 5},
+		{LIBSWO_PACKET_TYPE_GTS2, 5},
+		{LIBSWO_PACKET_TYPE_EXT, 1},
+		{LIBSWO_PACKET_TYPE_EXT, 2},
+		{LIBSWO_PACKET_TYPE_EXT, 3},
+		{LIBSWO_PACKET_TYPE_EXT, 4},
+		{LIBSWO_PACKET_TYPE_EXT, 5},
+		{LIBSWO_PACKET_TYPE_INST, 2},
+		{LIBSWO_PACKET_TYPE_INST, 3},
+		{LIBSWO_PACKET_TYPE_INST, 5},
+		{LIBSWO_PACKET_TYPE_HW, 2},
+		{LIBSWO_PACKET_TYPE_HW, 3},
+		{LIBSWO_PACKET_TYPE_HW, 5},
+		{LIBSWO_PACKET_TYPE_DWT_EVTCNT, 2},
+		{LIBSWO_PACKET_TYPE_DWT_EXCTRACE, 3},
+		{LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE, 2},
+		{LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE, 5},
+		{LIBSWO_PACKET_TYPE_DWT_PC_VALUE, 5},
+		{LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET, 3},
+		{LIBSWO_PACKET_TYPE_DWT_DATA_VALUE, 2},
+		{LIBSWO_PACKET_TYPE_DWT_DATA_VALUE, 3},
+		{LIBSWO_PACKET_TYPE_DWT_DATA_VALUE, 5}
+	};
+	bool ret;
+	size_t i;
+
+	ret = true;
+
+	for (i = 0; i < sizeof(required) / sizeof(required[0]); i++) {
+		if (coverage[required[i].type][required[i].size])
+			continue;
+
+		fprintf(stderr, "No packet of type %u with size %zu.\n",
+			required[i].type, required[i].size);
+		ret = false;
+	}
+
+	if (!num_sync) {
+		fprintf(stderr, "No synchronization packet.\n");
+		ret = false;
+	}
+
+	return ret;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_coverage())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,267 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of feeding trace data from multiple buffers.
+ *
+ * Random packets are encoded and fed with libswo_feedv() in buffers of random
+ * sizes, such that packets are split across buffers and the decoder buffer
+ * wraps around within a single call. Empty buffers, with and without data
+ * pointer, and calls without buffers are mixed in. The decoded packets must
+ * match the original packets. Furthermore, invalid buffers and trace data
+ * which does not fit into the decoder buffer must be rejected without feeding
+ * any data.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		50
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Size of the decoder buffer in bytes. */
+#define DECODER_BUFFER_SIZE	64
+
+/* Maximum number of bytes per libswo_feedv() call. */
+#define MAX_FEED_SIZE		(DECODER_BUFFER_SIZE / 2)
+
+/* Maximum number of buffers per libswo_feedv() call. */
+#define MAX_IOVCNT		8
+
+struct sequence {
+	union libswo_packet packets[NUM_PACKETS];
+	size_t num_packets;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct sequence *sequence;
+
+	(void)ctx;
+
+	sequence = (struct sequence *)user_data;
+
+	if (sequence->num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	sequence->packets[sequence->num_packets++] = *packet;
+
+	return true;
+}
+
+/*
+ * Split the trace data into a random number of buffers of random sizes and
+ * return the number of bytes in the buffers. About half of the buffers are
+ * empty and an empty buffer has no data pointer at random. Without buffers,
+ * no trace data is fed.
+ */
+static size_t split(struct libswo_iovec *iov, size_t *iovcnt,
+		const uint8_t *data, size_t length)
+{
+	size_t total;
+	size_t i;
+
+	*iovcnt = rng() % (MAX_IOVCNT + 1);
+
+	if (!*iovcnt)
+		return 0;
+
+	total = length;
+
+	for (i = 0; i < *iovcnt - 1; i++) {
+		iov[i].iov_base = data;
+		iov[i].iov_len = (rng() % 2) ? rng() % (length + 1) : 0;
+
+		if (!iov[i].iov_len && rng() % 2)
+			iov[i].iov_base = NULL;
+
+		data += iov[i].iov_len;
+		length -= iov[i].iov_len;
+	}
+
+	iov[i].iov_base = data;
+	iov[i].iov_len = length;
+
+	return total;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	struct libswo_iovec iov[MAX_IOVCNT];
+	static struct sequence sequence;
+	uint8_t buffer[BUFFER_SIZE];
+	struct libswo_context *ctx;
+	size_t num_encoded;
+	size_t iovcnt;
+	size_t length;
+	size_t offset;
+	size_t tmp;
+	size_t i;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), packets,
+		NUM_PACKETS, &num_encoded, &length);
+
+	if (ret != LIBSWO_OK || num_encoded != NUM_PACKETS)
+		return false;
+
+	ret = libswo_init(&ctx, NULL, DECODER_BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	sequence.num_packets = 0;
+	libswo_set_callback(ctx, &packet_callback, &sequence);
+
+	for (offset = 0; offset < length && ret == LIBSWO_OK; offset += tmp) {
+		tmp = 1 + rng() % MAX_FEED_SIZE;
+
+		if (tmp > length - offset)
+			tmp = length - offset;
+
+		tmp = split(iov, &iovcnt, buffer + offset, tmp);
+		ret = libswo_feedv(ctx, iovcnt ? iov : NULL, iovcnt, 0);
+
+		if (ret == LIBSWO_OK)
+			ret = libswo_decode(ctx, 0);
+	}
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK || sequence.num_packets != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s.\n",
+			seed, sequence.num_packets, libswo_strerror_name(ret));
+		return false;
+	}
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (packets[i].type == sequence.packets[i].type && \
+				(!packets[i].any.size || \
+				packets[i].any.size == \
+				sequence.packets[i].any.size) && \
+				packet_fields_equal(&packets[i],
+				&sequence.packets[i]))
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu of type %u differs.\n",
+			seed, i, packets[i].type);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check that invalid calls are rejected and do not feed any trace data. Only
+ * the packet fed afterwards must be decoded.
+ */
+static bool check_arguments(void)
+{
+	static const uint8_t data[] = {0x01, 0x2a};
+	static struct sequence sequence;
+	struct libswo_iovec iov[3];
+	struct libswo_context *ctx;
+	bool ret;
+
+	if (libswo_init(&ctx, NULL, DECODER_BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	sequence.num_packets = 0;
+	libswo_set_callback(ctx, &packet_callback, &sequence);
+
+	iov[0].iov_base = data;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = NULL;
+	iov[1].iov_len = 1;
+	iov[2].iov_base = data + 1;
+	iov[2].iov_len = 1;
+
+	/* A buffer without data pointer but with data. */
+	ret = libswo_feedv(ctx, iov, 3, 0) == LIBSWO_ERR_ARG && \
+		libswo_feedv(ctx, NULL, 1, 0) == LIBSWO_ERR_ARG && \
+		libswo_feedv(NULL, iov, 1, 0) == LIBSWO_ERR_ARG && \
+		libswo_feedv(ctx, NULL, 0, 0) == LIBSWO_OK;
+
+	/* More data than fits into the decoder buffer, also on overflow. */
+	iov[1].iov_base = data;
+	iov[1].iov_len = DECODER_BUFFER_SIZE;
+
+	ret = ret && libswo_feedv(ctx, iov, 2, 0) == LIBSWO_ERR;
+
+	iov[0].iov_len = SIZE_MAX;
+	iov[1].iov_len = SIZE_MAX;
+
+	ret = ret && libswo_feedv(ctx, iov, 2, 0) == LIBSWO_ERR;
+
+	/* The instrumentation packet is split across buffers. */
+	iov[0].iov_len = 1;
+	iov[1].iov_len = 0;
+
+	ret = ret && libswo_feedv(ctx, iov, 3, 0) == LIBSWO_OK && \
+		libswo_decode(ctx, LIBSWO_DF_EOS) == LIBSWO_OK && \
+		sequence.num_packets == 1 && \
+		sequence.packets[0].type == LIBSWO_PACKET_TYPE_INST && \
+		sequence.packets[0].inst.value == data[1];
+
+	libswo_exit(ctx);
+
+	if (!ret)
+		fprintf(stderr, "Invalid buffers accepted, %zu packets "
+			"decoded.\n", sequence.num_packets);
+
+	return ret;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_arguments())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,404 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of the host timestamp correlation.
+ *
+ * Random packets are encoded and fed in random chunks with known host
+ * timestamps. Every local timestamp packet ends a chunk whose host timestamp
+ * is given by a linear function of the target time, or which has no host
+ * timestamp at all. The host timestamp of each packet, the target time and
+ * the fitted clock model must match. The host timestamps lie in the future
+ * such that all latencies are 0.
+ *
+ * Afterwards, single packets are fed with host timestamps in the past and
+ * the latency histogram must count them in the expected buckets.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		20
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Host time in nanoseconds per target timestamp tick of the clock. */
+#define CLOCK_SLOPE		15.625
+
+/* Distance of the host timestamps into the future in nanoseconds. */
+#define FUTURE			UINT64_C(1000000000000)
+
+/* Maximal absolute error of the fitted clock offset in nanoseconds. */
+#define MAX_OFFSET_ERROR	1.0
+
+/* Maximal relative error of the fitted clock slope. */
+#define MAX_SLOPE_ERROR		1e-9
+
+/* Range of latency histogram buckets which are checked. */
+#define FIRST_BUCKET		24
+#define LAST_BUCKET		30
+
+struct received {
+	/* Host timestamp of each packet, or 0 if none. */
+	uint64_t host_times[NUM_PACKETS];
+	size_t num_packets;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct received *received;
+	uint64_t timestamp;
+	int ret;
+
+	(void)packet;
+
+	received = (struct received *)user_data;
+
+	if (received->num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	ret = libswo_get_packet_host_time(ctx, &timestamp);
+
+	if (ret == LIBSWO_ERR)
+		timestamp = 0;
+	else if (ret != LIBSWO_OK || !timestamp)
+		return LIBSWO_ERR;
+
+	received->host_times[received->num_packets++] = timestamp;
+
+	return true;
+}
+
+/* Host timestamp of the given target time. */
+static uint64_t clock_host_time(uint64_t base, uint64_t target_time)
+{
+	return base + (uint64_t)(CLOCK_SLOPE * target_time + 0.5);
+}
+
+static bool check_sequence(unsigned int seed, uint64_t base)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	/* Stream position of the end of each packet. */
+	size_t ends[NUM_PACKETS];
+	uint64_t expected[NUM_PACKETS];
+	static struct received received;
+	uint8_t buffer[BUFFER_SIZE];
+	struct libswo_context *ctx;
+	struct libswo_latency latency;
+	struct libswo_clock_model model;
+	uint64_t target_time;
+	uint64_t timestamp;
+	uint64_t num_samples;
+	uint64_t num_timed;
+	size_t length;
+	size_t start;
+	size_t first;
+	size_t i;
+	size_t tmp;
+	double error[2];
+	int ret;
+
+	rng_seed(seed);
+	length = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		random_packet(&packets[i]);
+
+		ret = libswo_encode_packets(buffer + length,
+			sizeof(buffer) - length, &packets[i], 1, &tmp, &tmp);
+
+		if (ret != LIBSWO_OK) {
+			fprintf(stderr, "Sequence %u: packet %zu not encoded: "
+				"%s.\n", seed, i, libswo_strerror_name(ret));
+			return false;
+		}
+
+		length += tmp;
+		ends[i] = length;
+	}
+
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	received.num_packets = 0;
+	libswo_set_callback(ctx, &packet_callback, &received);
+
+	/*
+	 * Cut the trace data after each local timestamp packet and at random
+	 * positions, also within packets. The first chunk always has a host
+	 * timestamp such that host timestamp tracking is enabled from the
+	 * beginning.
+	 */
+	target_time = 0;
+	num_samples = 0;
+	num_timed = 0;
+	start = 0;
+	first = 0;
+
+	for (i = 0; i < NUM_PACKETS && ret == LIBSWO_OK; i++) {
+		if (packets[i].type == LIBSWO_PACKET_TYPE_LTS) {
+			target_time += packets[i].lts.value;
+			tmp = ends[i];
+		} else if (i == NUM_PACKETS - 1) {
+			tmp = length;
+		} else if (!(rng() % 4)) {
+			tmp = (i ? ends[i - 1] : 0) + rng() % \
+				(ends[i] - (i ? ends[i - 1] : 0) + 1);
+		} else {
+			continue;
+		}
+
+		if (tmp <= start)
+			continue;
+
+		if (start > 0 && !(rng() % 4))
+			timestamp = 0;
+		else if (packets[i].type == LIBSWO_PACKET_TYPE_LTS)
+			timestamp = clock_host_time(base, target_time);
+		else
+			timestamp = base + rng();
+
+		/* Packets whose last byte lies within the chunk. */
+		for (; first < NUM_PACKETS && ends[first] <= tmp; first++) {
+			expected[first] = timestamp;
+			num_timed += timestamp > 0;
+
+			if (timestamp && packets[first].type == \
+					LIBSWO_PACKET_TYPE_LTS)
+				num_samples++;
+		}
+
+		ret = libswo_feed_timestamp(ctx, buffer + start, tmp - start,
+			timestamp);
+
+		if (ret == LIBSWO_OK)
+			ret = libswo_decode(ctx, 0);
+
+		start = tmp;
+	}
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	if (ret != LIBSWO_OK || received.num_packets != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s.\n",
+			seed, received.num_packets, libswo_strerror_name(ret));
+		libswo_exit(ctx);
+		return false;
+	}
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (received.host_times[i] == expected[i])
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu has host timestamp "
+			"%llu instead of %llu.\n", seed, i,
+			(unsigned long long)received.host_times[i],
+			(unsigned long long)expected[i]);
+		libswo_exit(ctx);
+		return false;
+	}
+
+	libswo_get_target_time(ctx, &timestamp);
+
+	if (timestamp != target_time) {
+		fprintf(stderr, "Sequence %u: target time is %llu instead of "
+			"%llu.\n", seed, (unsigned long long)timestamp,
+			(unsigned long long)target_time);
+		libswo_exit(ctx);
+		return false;
+	}
+
+	libswo_latency_get(ctx, &latency);
+
+	if (latency.count != num_timed || latency.buckets[0] != num_timed || \
+			latency.max > 0 || latency.sum > 0) {
+		fprintf(stderr, "Sequence %u: %llu latencies instead of "
+			"%llu.\n", seed, (unsigned long long)latency.count,
+			(unsigned long long)num_timed);
+		libswo_exit(ctx);
+		return false;
+	}
+
+	ret = libswo_clock_model_get(ctx, &model);
+	libswo_exit(ctx);
+
+	/* Not enough samples with distinct target times to fit the model. */
+	if (ret == LIBSWO_ERR && num_samples < 2)
+		return true;
+
+	error[0] = model.slope / CLOCK_SLOPE - 1;
+	error[1] = model.offset - base;
+
+	if (ret != LIBSWO_OK || model.num_samples != num_samples || \
+			error[0] > MAX_SLOPE_ERROR || \
+			error[0] < -MAX_SLOPE_ERROR || \
+			error[1] > MAX_OFFSET_ERROR || \
+			error[1] < -MAX_OFFSET_ERROR) {
+		fprintf(stderr, "Sequence %u: clock model with %llu samples, "
+			"slope %f and offset %f instead of %llu samples, "
+			"slope %f and offset %llu: %s.\n", seed,
+			(unsigned long long)model.num_samples, model.slope,
+			model.offset, (unsigned long long)num_samples,
+			CLOCK_SLOPE, (unsigned long long)base,
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Feed single packets with host timestamps in the past such that the latency
+ * of each packet lies in the middle of a histogram bucket.
+ */
+static bool check_latency(void)
+{
+	union libswo_packet packet;
+	static struct received received;
+	uint8_t buffer[8];
+	struct libswo_context *ctx;
+	struct libswo_latency latency;
+	uint64_t expected[LIBSWO_LATENCY_NUM_BUCKETS];
+	uint64_t delay;
+	uint64_t count;
+	size_t length;
+	size_t i;
+	size_t j;
+	int ret;
+
+	packet.type = LIBSWO_PACKET_TYPE_INST;
+	packet.inst.size = 0;
+	packet.inst.address = 1;
+	packet.inst.value = 0x42;
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), &packet, 1, &i,
+		&length);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	received.num_packets = 0;
+	libswo_set_callback(ctx, &packet_callback, &received);
+
+	memset(expected, 0, sizeof(expected));
+	count = 0;
+
+	for (i = FIRST_BUCKET; i <= LAST_BUCKET && ret == LIBSWO_OK; i++) {
+		/* Latency of 1.5 * 2^(i - 1) ns. */
+		delay = UINT64_C(3) << (i - 2);
+
+		for (j = 0; j < i - FIRST_BUCKET + 1; j++) {
+			ret = libswo_feed_timestamp(ctx, buffer, length,
+				libswo_get_host_time() - delay);
+
+			if (ret == LIBSWO_OK)
+				ret = libswo_decode(ctx, 0);
+
+			expected[i]++;
+			count++;
+		}
+	}
+
+	/* Host timestamps in the future yield a latency of 0 ns. */
+	if (ret == LIBSWO_OK)
+		ret = libswo_feed_timestamp(ctx, buffer, length,
+			libswo_get_host_time() + FUTURE);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, 0);
+
+	expected[0]++;
+	count++;
+
+	if (ret != LIBSWO_OK || received.num_packets != count) {
+		fprintf(stderr, "Latency: %zu packets decoded: %s.\n",
+			received.num_packets, libswo_strerror_name(ret));
+		libswo_exit(ctx);
+		return false;
+	}
+
+	libswo_latency_get(ctx, &latency);
+
+	if (latency.count != count || latency.min != 0 || \
+			latency.max < (UINT64_C(3) << (LAST_BUCKET - 2)) || \
+			memcmp(latency.buckets, expected, sizeof(expected))) {
+		fprintf(stderr, "Latency: histogram mismatch.\n");
+
+		for (i = 0; i < LIBSWO_LATENCY_NUM_BUCKETS; i++) {
+			if (latency.buckets[i] != expected[i])
+				fprintf(stderr, "Bucket %zu: %llu instead of "
+					"%llu.\n", i,
+					(unsigned long long)latency.buckets[i],
+					(unsigned long long)expected[i]);
+		}
+
+		libswo_exit(ctx);
+		return false;
+	}
+
+	libswo_latency_reset(ctx);
+	libswo_latency_get(ctx, &latency);
+	libswo_exit(ctx);
+
+	if (latency.count || latency.max || latency.buckets[FIRST_BUCKET]) {
+		fprintf(stderr, "Latency: statistics not reset.\n");
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	uint64_t base;
+	unsigned int i;
+
+	base = libswo_get_host_time() + FUTURE;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i, base))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_latency())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of user-defined hardware source decoders.
+ *
+ * Random packets are encoded and decoded once with the default decoders and
+ * once with decoders registered for some of the addresses used by the DWT
+ * unit. A registered decoder must replace the DWT decoder of its address,
+ * a decoder which rejects a packet or was removed must yield hardware source
+ * packets, and packets of core or reserved types returned by a decoder must
+ * be passed on as unknown data.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		20
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Address decoded as user-defined packet, used by event counter packets. */
+#define USER_ADDRESS		0
+
+/* Address whose decoder rejects all packets, used by exception trace. */
+#define REJECT_ADDRESS		1
+
+/* Address whose decoder returns a core packet type, used by PC samples. */
+#define CORE_ADDRESS		2
+
+/* Address whose decoder is removed, used by address offset packets. */
+#define REMOVED_ADDRESS		9
+
+/* First address whose decoder returns a reserved packet type. */
+#define RESERVED_ADDRESS	16
+
+struct sequence {
+	union libswo_packet packets[NUM_PACKETS];
+	size_t num_packets;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct sequence *sequence;
+
+	(void)ctx;
+
+	sequence = (struct sequence *)user_data;
+
+	if (sequence->num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	sequence->packets[sequence->num_packets++] = *packet;
+
+	return true;
+}
+
+static int user_decoder(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
+{
+	(void)ctx;
+
+	(*(size_t *)user_data)++;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_USER;
+
+	return true;
+}
+
+static int reject_decoder(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
+{
+	(void)ctx;
+	(void)hw;
+	(void)packet;
+	(void)user_data;
+
+	return false;
+}
+
+static int core_decoder(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = LIBSWO_PACKET_TYPE_INST;
+
+	return true;
+}
+
+static int reserved_decoder(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
+{
+	static const unsigned int types[] = {
+		LIBSWO_PACKET_TYPE_HW + 1,
+		LIBSWO_PACKET_TYPE_DWT_EVTCNT - 1,
+		LIBSWO_PACKET_TYPE_DWT_DATA_VALUE + 1,
+		LIBSWO_PACKET_TYPE_USER - 1,
+		LIBSWO_PACKET_TYPE_USER_MAX + 1,
+		UINT8_MAX
+	};
+
+	(void)ctx;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = (enum libswo_packet_type)types[hw->address % \
+		(sizeof(types) / sizeof(types[0]))];
+
+	return true;
+}
+
+static int decode(struct sequence *sequence, const uint8_t *buffer,
+		size_t length, size_t *num_calls)
+{
+	struct libswo_context *ctx;
+	uint8_t address;
+	int ret;
+
+	sequence->num_packets = 0;
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return ret;
+
+	ret = libswo_set_callback(ctx, &packet_callback, sequence);
+
+	/* Invalid packet types are expected, do not log them. */
+	if (ret == LIBSWO_OK)
+		ret = libswo_log_set_level(ctx, LIBSWO_LOG_LEVEL_NONE);
+
+	if (num_calls && ret == LIBSWO_OK) {
+		libswo_set_hw_decoder(ctx, USER_ADDRESS, &user_decoder,
+			num_calls);
+		libswo_set_hw_decoder(ctx, REJECT_ADDRESS, &reject_decoder,
+			NULL);
+		libswo_set_hw_decoder(ctx, CORE_ADDRESS, &core_decoder, NULL);
+		libswo_set_hw_decoder(ctx, REMOVED_ADDRESS, NULL, NULL);
+
+		for (address = RESERVED_ADDRESS;
+				address < LIBSWO_PACKET_TYPE_USER; address++)
+			libswo_set_hw_decoder(ctx, address,
+				&reserved_decoder, NULL);
+	}
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	return ret;
+}
+
+/* Compute the expected packet from the packet decoded by default. */
+static size_t expected_packet(union libswo_packet *packet)
+{
+	if (packet->type < LIBSWO_PACKET_TYPE_DWT_EVTCNT || \
+			packet->type > LIBSWO_PACKET_TYPE_DWT_DATA_VALUE)
+		return 0;
+
+	if (packet->hw.address == USER_ADDRESS) {
+		packet->type = LIBSWO_PACKET_TYPE_USER;
+		return 1;
+	}
+
+	if (packet->hw.address == REJECT_ADDRESS || \
+			packet->hw.address == REMOVED_ADDRESS)
+		packet->type = LIBSWO_PACKET_TYPE_HW;
+	else if (packet->hw.address == CORE_ADDRESS || \
+			packet->hw.address >= RESERVED_ADDRESS)
+		packet->type = LIBSWO_PACKET_TYPE_UNKNOWN;
+
+	return 0;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	static struct sequence reference;
+	static struct sequence sequence;
+	uint8_t buffer[BUFFER_SIZE];
+	union libswo_packet *packet;
+	size_t num_expected;
+	size_t num_encoded;
+	size_t num_calls;
+	size_t length;
+	size_t i;
+	bool equal;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), packets,
+		NUM_PACKETS, &num_encoded, &length);
+
+	if (ret != LIBSWO_OK || num_encoded != NUM_PACKETS)
+		return false;
+
+	num_calls = 0;
+	ret = decode(&reference, buffer, length, NULL);
+
+	if (ret == LIBSWO_OK)
+		ret = decode(&sequence, buffer, length, &num_calls);
+
+	if (ret != LIBSWO_OK || reference.num_packets != NUM_PACKETS || \
+			sequence.num_packets != NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s.\n",
+			seed, sequence.num_packets, libswo_strerror_name(ret));
+		return false;
+	}
+
+	num_expected = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		packet = &reference.packets[i];
+		num_expected += expected_packet(packet);
+
+		/* User-defined packets carry the hardware source fields. */
+		if (packet->type == LIBSWO_PACKET_TYPE_USER)
+			equal = sequence.packets[i].hw.address == \
+				packet->hw.address && \
+				sequence.packets[i].hw.value == \
+				packet->hw.value;
+		else
+			equal = packet_fields_equal(&sequence.packets[i],
+				packet);
+
+		if (sequence.packets[i].type == packet->type && \
+				sequence.packets[i].any.size == \
+				packet->any.size && equal)
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu of type %u decoded as "
+			"type %u.\n", seed, i, packets[i].type,
+			sequence.packets[i].type);
+		return false;
+	}
+
+	if (num_calls != num_expected) {
+		fprintf(stderr, "Sequence %u: decoder called %zu times instead "
+			"of %zu.\n", seed, num_calls, num_expected);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_arguments(void)
+{
+	struct libswo_context *ctx;
+	bool ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	ret = libswo_set_hw_decoder(NULL, 0, &reject_decoder, NULL) == \
+		LIBSWO_ERR_ARG && libswo_set_hw_decoder(ctx,
+		LIBSWO_MAX_SOURCE_ADDRESS, &reject_decoder, NULL) == \
+		LIBSWO_ERR_ARG && libswo_set_hw_decoder(ctx,
+		LIBSWO_MAX_SOURCE_ADDRESS - 1, &reject_decoder, NULL) == \
+		LIBSWO_OK;
+
+	libswo_exit(ctx);
+
+	if (!ret)
+		fprintf(stderr, "Invalid addresses accepted.\n");
+
+	return ret;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_arguments())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of the initialization with a custom memory allocator and with static
+ * storage.
+ *
+ * A counting allocator fails each allocation once. Failed initializations must
+ * free all memory allocated so far and a context must free all its memory on
+ * exit. Storage which is misaligned or too small must be rejected without
+ * being touched. A context in static storage must work without any allocation.
+ */
+
+/* Number of packets decoded with each context. */
+#define NUM_PACKETS		256
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Size of the decoder buffer in bytes. */
+#define DECODER_BUFFER_SIZE	64
+
+/* Byte used to detect writes to rejected storage. */
+#define FILL_BYTE		0xa5
+
+struct allocator {
+	/* Number of successful allocations. */
+	size_t num_allocs;
+	size_t num_deallocs;
+	/* Number of allocations until one fails, or 0 if none fails. */
+	size_t fail_countdown;
+};
+
+static struct allocator counter;
+
+static uint8_t trace[BUFFER_SIZE];
+static size_t trace_length;
+
+static void *counting_alloc(size_t size, void *user_data)
+{
+	struct allocator *allocator;
+
+	allocator = (struct allocator *)user_data;
+
+	if (allocator->fail_countdown && !--allocator->fail_countdown)
+		return NULL;
+
+	allocator->num_allocs++;
+
+	return malloc(size);
+}
+
+static void counting_dealloc(void *ptr, void *user_data)
+{
+	((struct allocator *)user_data)->num_deallocs++;
+	free(ptr);
+}
+
+static const struct libswo_allocator allocator = {
+	.alloc = &counting_alloc,
+	.dealloc = &counting_dealloc,
+	.user_data = &counter
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)packet;
+
+	(*(size_t *)user_data)++;
+
+	return true;
+}
+
+/* Check that the context decodes all packets in chunks. */
+static bool check_decode(struct libswo_context *ctx)
+{
+	size_t num_packets;
+	size_t offset;
+	size_t tmp;
+	int ret;
+
+	num_packets = 0;
+	ret = libswo_set_callback(ctx, &packet_callback, &num_packets);
+
+	for (offset = 0; offset < trace_length && ret == LIBSWO_OK;
+			offset += tmp) {
+		tmp = 1 + rng() % (DECODER_BUFFER_SIZE / 2);
+
+		if (tmp > trace_length - offset)
+			tmp = trace_length - offset;
+
+		ret = libswo_feed(ctx, trace + offset, tmp);
+
+		if (ret == LIBSWO_OK)
+			ret = libswo_decode(ctx, 0);
+	}
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	if (ret != LIBSWO_OK || num_packets != NUM_PACKETS) {
+		fprintf(stderr, "%zu packets decoded: %s.\n", num_packets,
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check the initialization with the counting allocator, either with a given
+ * buffer or with a buffer allocated by the allocator.
+ */
+static bool check_allocator(const char *name, uint8_t *buffer,
+		size_t num_allocs)
+{
+	struct libswo_context *ctx;
+	size_t fail;
+	int ret;
+
+	/* Let each allocation fail once, then let all of them succeed. */
+	for (fail = 1; fail <= num_allocs + 1; fail++) {
+		memset(&counter, 0, sizeof(counter));
+		counter.fail_countdown = (fail <= num_allocs) ? fail : 0;
+
+		ret = libswo_init_allocator(&ctx, buffer, DECODER_BUFFER_SIZE,
+			&allocator);
+
+		if (fail <= num_allocs) {
+			if (ret == LIBSWO_ERR_MALLOC && \
+					counter.num_allocs == fail - 1 && \
+					counter.num_deallocs == fail - 1)
+				continue;
+
+			fprintf(stderr, "%s: allocation %zu failed: %s, %zu "
+				"allocations, %zu deallocations.\n", name, fail,
+				libswo_strerror_name(ret), counter.num_allocs,
+				counter.num_deallocs);
+			return false;
+		}
+
+		if (ret != LIBSWO_OK || counter.num_allocs != num_allocs) {
+			fprintf(stderr, "%s: initialization failed: %s, %zu "
+				"allocations.\n", name,
+				libswo_strerror_name(ret), counter.num_allocs);
+			return false;
+		}
+
+		/* No allocations after the initialization. */
+		if (!check_decode(ctx) || counter.num_allocs != num_allocs) {
+			libswo_exit(ctx);
+			return false;
+		}
+
+		libswo_exit(ctx);
+	}
+
+	if (counter.num_deallocs != num_allocs) {
+		fprintf(stderr, "%s: %zu of %zu allocations freed.\n", name,
+			counter.num_deallocs, num_allocs);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_allocator_arguments(void)
+{
+	struct libswo_allocator invalid;
+	struct libswo_context *ctx;
+
+	memset(&counter, 0, sizeof(counter));
+
+	invalid = allocator;
+	invalid.alloc = NULL;
+
+	if (libswo_init_allocator(&ctx, NULL, DECODER_BUFFER_SIZE,
+			&invalid) != LIBSWO_ERR_ARG)
+		return false;
+
+	invalid = allocator;
+	invalid.dealloc = NULL;
+
+	if (libswo_init_allocator(&ctx, NULL, DECODER_BUFFER_SIZE,
+			&invalid) != LIBSWO_ERR_ARG)
+		return false;
+
+	if (libswo_init_allocator(&ctx, NULL, 0, &allocator) != \
+			LIBSWO_ERR_ARG)
+		return false;
+
+	return !counter.num_allocs;
+}
+
+/* Check that the storage is rejected and left untouched. */
+static bool check_rejected(const char *name, uint8_t *storage,
+		size_t storage_size, uint8_t *buffer)
+{
+	struct libswo_context *ctx;
+	size_t i;
+	int ret;
+
+	memset(storage, FILL_BYTE, storage_size);
+	ret = libswo_init_static(&ctx, storage, storage_size, buffer,
+		DECODER_BUFFER_SIZE);
+
+	for (i = 0; i < storage_size; i++) {
+		if (storage[i] != FILL_BYTE)
+			break;
+	}
+
+	if (ret != LIBSWO_ERR_ARG || i < storage_size) {
+		fprintf(stderr, "%s: storage not rejected: %s.\n", name,
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_static(void)
+{
+	static uint64_t storage[LIBSWO_CONTEXT_SIZE / sizeof(uint64_t) + 1];
+	static uint8_t buffer[DECODER_BUFFER_SIZE];
+	struct libswo_context *ctx;
+	uint8_t *bytes;
+	int ret;
+
+	bytes = (uint8_t *)storage;
+
+	if (!check_rejected("Misaligned", bytes + 1, LIBSWO_CONTEXT_SIZE,
+			buffer) || !check_rejected("Too small", bytes,
+			LIBSWO_CONTEXT_ALIGN, buffer))
+		return false;
+
+	if (libswo_init_static(&ctx, NULL, LIBSWO_CONTEXT_SIZE, buffer,
+			DECODER_BUFFER_SIZE) != LIBSWO_ERR_ARG || \
+			libswo_init_static(&ctx, storage, LIBSWO_CONTEXT_SIZE,
+			NULL, DECODER_BUFFER_SIZE) != LIBSWO_ERR_ARG || \
+			libswo_init_static(&ctx, storage, LIBSWO_CONTEXT_SIZE,
+			buffer, 0) != LIBSWO_ERR_ARG) {
+		fprintf(stderr, "Static: invalid arguments accepted.\n");
+		return false;
+	}
+
+	/*
+	 * The allocator is not involved in any way. Freeing the storage or the
+	 * buffer on exit would abort the test.
+	 */
+	memset(&counter, 0, sizeof(counter));
+	ret = libswo_init_static(&ctx, storage, LIBSWO_CONTEXT_SIZE, buffer,
+		DECODER_BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK) {
+		fprintf(stderr, "Static: initialization failed: %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	if (!check_decode(ctx)) {
+		libswo_exit(ctx);
+		return false;
+	}
+
+	libswo_exit(ctx);
+
+	if (counter.num_allocs || counter.num_deallocs) {
+		fprintf(stderr, "Static: %zu allocations.\n",
+			counter.num_allocs);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	uint8_t buffer[DECODER_BUFFER_SIZE];
+	size_t num_encoded;
+	size_t i;
+
+	rng_seed(1);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	if (libswo_encode_packets(trace, sizeof(trace), packets, NUM_PACKETS,
+			&num_encoded, &trace_length) != LIBSWO_OK)
+		return EXIT_FAILURE;
+
+	/* The context and, if not given, the buffer are allocated. */
+	if (!check_allocator("Allocator", NULL, 2) || \
+			!check_allocator("Allocator with buffer", buffer, 1))
+		return EXIT_FAILURE;
+
+	if (!check_allocator_arguments()) {
+		fprintf(stderr, "Invalid allocator accepted.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!check_static())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Round-trip test of the line decoder.
+ *
+ * Random bytes are encoded into sampled line levels with NRZ and Manchester
+ * encoding for integer and fractional bit times, with a random sampling phase
+ * and random idle times between frames. The samples are fed in chunks of
+ * different sizes and the bit time is detected by the line decoder. The
+ * decoded bytes must match the original bytes.
+ */
+
+/* Number of bytes per test case. */
+#define NUM_BYTES		4096
+
+/* Maximum number of samples per test case. */
+#define MAX_SAMPLES		(2 * 1024 * 1024)
+
+/* Channel of the SWO line within a sample. */
+#define CHANNEL			3
+
+/* Maximum number of idle bits between two frames. */
+#define MAX_IDLE_BITS		3
+
+/* Maximum relative error of the detected bit time. */
+#define MAX_BIT_TIME_ERROR	0.01
+
+struct encoder {
+	uint8_t *samples;
+	size_t num_samples;
+	/* Bit time in samples. */
+	double bit_time;
+	/* Time of the next sample in bits. */
+	double time;
+	/* Time of the end of the signal in bits. */
+	double end;
+};
+
+struct received {
+	uint8_t data[NUM_BYTES];
+	size_t length;
+};
+
+/* Append the given line level for the given number of bits. */
+static void put_level(struct encoder *encoder, bool level, double bits)
+{
+	encoder->end += bits;
+
+	while (encoder->time < encoder->end) {
+		encoder->samples[encoder->num_samples++] = level << CHANNEL;
+		encoder->time += 1 / encoder->bit_time;
+	}
+}
+
+static void put_nrz(struct encoder *encoder, uint8_t byte)
+{
+	unsigned int i;
+
+	put_level(encoder, false, 1);
+
+	for (i = 0; i < 8; i++)
+		put_level(encoder, (byte >> i) & 1, 1);
+
+	put_level(encoder, true, 1 + rng() % (MAX_IDLE_BITS + 1));
+}
+
+static void put_manchester_bit(struct encoder *encoder, bool bit)
+{
+	put_level(encoder, bit, 0.5);
+	put_level(encoder, !bit, 0.5);
+}
+
+static void put_manchester(struct encoder *encoder, uint8_t byte)
+{
+	unsigned int i;
+
+	put_manchester_bit(encoder, true);
+
+	for (i = 0; i < 8; i++)
+		put_manchester_bit(encoder, (byte >> i) & 1);
+
+	put_level(encoder, false, rng() % (MAX_IDLE_BITS + 1));
+}
+
+static int sink(struct libswo_line *line, const uint8_t *data, size_t length,
+		void *user_data)
+{
+	struct received *received;
+
+	(void)line;
+
+	received = (struct received *)user_data;
+
+	if (received->length + length > NUM_BYTES)
+		return LIBSWO_ERR;
+
+	memcpy(received->data + received->length, data, length);
+	received->length += length;
+
+	return LIBSWO_OK;
+}
+
+static bool check(enum libswo_line_encoding encoding, double bit_time,
+		size_t chunk_size, uint8_t *samples)
+{
+	static uint8_t bytes[NUM_BYTES];
+	static struct received received;
+	struct libswo_line_info info;
+	struct libswo_line *line;
+	struct encoder encoder;
+	const char *name;
+	bool idle;
+	size_t offset;
+	size_t tmp;
+	size_t i;
+	int ret;
+
+	name = (encoding == LIBSWO_LINE_ENCODING_NRZ) ? "NRZ" : "Manchester";
+	idle = (encoding == LIBSWO_LINE_ENCODING_NRZ);
+
+	encoder.samples = samples;
+	encoder.num_samples = 0;
+	encoder.bit_time = bit_time;
+	encoder.time = (rng() % 1000) / 1000.0 / bit_time;
+	encoder.end = 0;
+
+	put_level(&encoder, idle, 4);
+
+	for (i = 0; i < NUM_BYTES; i++) {
+		bytes[i] = rng();
+
+		if (encoding == LIBSWO_LINE_ENCODING_NRZ)
+			put_nrz(&encoder, bytes[i]);
+		else
+			put_manchester(&encoder, bytes[i]);
+	}
+
+	put_level(&encoder, idle, 4);
+
+	if (libswo_line_init(&line, encoding, CHANNEL) != LIBSWO_OK)
+		return false;
+
+	received.length = 0;
+	libswo_line_set_sink(line, &sink, &received);
+
+	ret = LIBSWO_OK;
+
+	for (offset = 0; offset < encoder.num_samples; offset += tmp) {
+		tmp = encoder.num_samples - offset;
+		tmp = (tmp < chunk_size) ? tmp : chunk_size;
+
+		ret = libswo_line_feed(line, samples + offset, tmp);
+
+		if (ret != LIBSWO_OK)
+			break;
+	}
+
+	libswo_line_get_info(line, &info);
+	libswo_line_exit(line);
+
+	if (ret != LIBSWO_OK || info.num_errors || \
+			received.length != NUM_BYTES || \
+			memcmp(received.data, bytes, NUM_BYTES)) {
+		fprintf(stderr, "%s, bit time %.2f, chunk size %zu: %zu bytes "
+			"decoded with %lu errors, detected bit time %.3f.\n",
+			name, bit_time, chunk_size, received.length,
+			(unsigned long)info.num_errors, info.bit_time);
+		return false;
+	}
+
+	if (info.bit_time < bit_time * (1 - MAX_BIT_TIME_ERROR) || \
+			info.bit_time > bit_time * (1 + MAX_BIT_TIME_ERROR)) {
+		fprintf(stderr, "%s, bit time %.2f, chunk size %zu: detected "
+			"bit time %.3f.\n", name, bit_time, chunk_size,
+			info.bit_time);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	static const double nrz_bit_times[] = {
+		2, 3, 4, 4.3, 7.5, 10, 13.37
+	};
+	static const double manchester_bit_times[] = {
+		4, 4.3, 5.5, 8, 10.7, 16
+	};
+	static const size_t chunk_sizes[] = {
+		1, 7, 64, 4096, 1024 * 1024
+	};
+	uint8_t *samples;
+	bool ok;
+	size_t i;
+	size_t j;
+
+	samples = malloc(MAX_SAMPLES);
+
+	if (!samples)
+		return EXIT_FAILURE;
+
+	ok = true;
+	rng_seed(1);
+
+	for (i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+		for (j = 0; j < sizeof(nrz_bit_times) / \
+				sizeof(nrz_bit_times[0]); j++)
+			ok &= check(LIBSWO_LINE_ENCODING_NRZ, nrz_bit_times[j],
+				chunk_sizes[i], samples);
+
+		for (j = 0; j < sizeof(manchester_bit_times) / \
+				sizeof(manchester_bit_times[0]); j++)
+			ok &= check(LIBSWO_LINE_ENCODING_MANCHESTER,
+				manchester_bit_times[j], chunk_sizes[i],
+				samples);
+	}
+
+	free(samples);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,503 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "libswocxx.h"
+#include "test.h"
+
+/*
+ * Test of the packet table of the C++ bindings.
+ *
+ * Random packets are encoded and decoded into a packet table in chunks of
+ * different sizes. The rows must match the original packets, and counting,
+ * histograms and selections must match the values computed from the original
+ * packets. Furthermore, user-defined hardware source packets must be stored
+ * and counted like hardware source packets.
+ */
+
+using namespace libswo;
+using std::vector;
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		20
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		4096
+
+/* Size of the decoder buffer of the packet table in bytes. */
+#define TABLE_BUFFER_SIZE	1024
+
+/* Maximum number of rows reserved up front, see PacketTable.cpp. */
+#define MAX_RESERVE		(1024 * 1024)
+
+/* First hardware source address decoded as user-defined packet. */
+#define USER_ADDRESS		24
+
+/* Number of user-defined packet types. */
+#define NUM_USER_TYPES	\
+	(LIBSWO_PACKET_TYPE_USER_MAX - LIBSWO_PACKET_TYPE_USER + 1)
+
+struct row {
+	uint8_t type;
+	uint64_t timestamp;
+	uint8_t address;
+	uint32_t value;
+	uint32_t dwt;
+};
+
+static int reference_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+
+	((vector<union libswo_packet> *)user_data)->push_back(*packet);
+
+	return true;
+}
+
+static int columns_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+
+	((PacketColumns *)user_data)->append(packet);
+
+	return true;
+}
+
+/* Decode each hardware source address to its own user-defined packet type. */
+static int user_decoder(struct libswo_context *ctx,
+		const struct libswo_packet_hw *hw, union libswo_packet *packet,
+		void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	packet->hw = *hw;
+	packet->type = (enum libswo_packet_type)(LIBSWO_PACKET_TYPE_USER + \
+		hw->address - USER_ADDRESS);
+
+	return true;
+}
+
+/* Decode the trace data with libswo_decode() for the hardware source fields. */
+static bool decode_reference(const vector<uint8_t> &data,
+		vector<union libswo_packet> &packets)
+{
+	struct libswo_context *ctx;
+	int ret;
+
+	packets.clear();
+
+	if (libswo_init(&ctx, NULL, data.size() + 1) != LIBSWO_OK)
+		return false;
+
+	libswo_set_callback(ctx, &reference_callback, &packets);
+	ret = libswo_feed(ctx, data.data(), data.size());
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	return ret == LIBSWO_OK;
+}
+
+/*
+ * Compute the expected row of a packet from its original fields. Only the
+ * address and the raw value of event counter and exception trace packets are
+ * taken from the decoded packet.
+ */
+static struct row expected_row(const union libswo_packet *packet,
+		const union libswo_packet *decoded, uint64_t &timestamp)
+{
+	struct row row;
+
+	memset(&row, 0, sizeof(row));
+	row.type = packet->type;
+
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_LTS:
+		timestamp += packet->lts.value;
+		row.value = packet->lts.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		row.value = packet->gts1.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		row.value = packet->gts2.value;
+		break;
+	case LIBSWO_PACKET_TYPE_EXT:
+		row.value = packet->ext.value;
+		break;
+	case LIBSWO_PACKET_TYPE_INST:
+		row.address = packet->inst.address;
+		row.value = packet->inst.value;
+		break;
+	case LIBSWO_PACKET_TYPE_HW:
+		row.address = packet->hw.address;
+		row.value = packet->hw.value;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		row.address = decoded->hw.address;
+		row.value = decoded->hw.value;
+		row.dwt = packet->evtcnt.cpi | (packet->evtcnt.exc << 1) | \
+			(packet->evtcnt.sleep << 2) | \
+			(packet->evtcnt.lsu << 3) | \
+			(packet->evtcnt.fold << 4) | \
+			(packet->evtcnt.cyc << 5);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		row.address = decoded->hw.address;
+		row.value = decoded->hw.value;
+		row.dwt = packet->exctrace.exception | \
+			(packet->exctrace.function << 16);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		row.address = decoded->hw.address;
+		row.value = packet->pc_sample.pc;
+		row.dwt = packet->pc_sample.sleep;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		row.address = decoded->hw.address;
+		row.value = packet->pc_value.pc;
+		row.dwt = packet->pc_value.cmpn;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		row.address = decoded->hw.address;
+		row.value = packet->addr_offset.offset;
+		row.dwt = packet->addr_offset.cmpn;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		row.address = decoded->hw.address;
+		row.value = packet->data_value.data_value;
+		row.dwt = packet->data_value.cmpn | \
+			(packet->data_value.wnr << 8);
+		break;
+	default:
+		break;
+	}
+
+	row.timestamp = timestamp;
+
+	return row;
+}
+
+static bool check_rows(const PacketTable &table, size_t offset,
+		const vector<struct row> &rows, unsigned int seed)
+{
+	size_t i;
+
+	if (table.size() != offset + rows.size()) {
+		fprintf(stderr, "Sequence %u: %zu rows instead of %zu.\n", seed,
+			table.size(), offset + rows.size());
+		return false;
+	}
+
+	for (i = 0; i < rows.size(); i++) {
+		if (table.get_types()[offset + i] == rows[i].type && \
+				table.get_timestamps()[offset + i] == \
+				rows[i].timestamp && \
+				table.get_addresses()[offset + i] == \
+				rows[i].address && \
+				table.get_values()[offset + i] == \
+				rows[i].value && \
+				table.get_dwt()[offset + i] == rows[i].dwt)
+			continue;
+
+		fprintf(stderr, "Sequence %u: row %zu of type %u differs.\n",
+			seed, offset + i, rows[i].type);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_queries(const PacketTable &table,
+		const vector<struct row> &rows, unsigned int seed)
+{
+	vector<size_t> counts;
+	vector<size_t> bins(16, 0);
+	vector<size_t> clamped(4, 0);
+	vector<size_t> hw;
+	vector<size_t> ports[32];
+	size_t i;
+
+	counts.resize(table.count_by_type().size(), 0);
+
+	for (i = 0; i < rows.size(); i++) {
+		counts[rows[i].type]++;
+
+		if (rows[i].type == LIBSWO_PACKET_TYPE_INST) {
+			bins[rows[i].value >> 28]++;
+			clamped[std::min(rows[i].value >> 24, (uint32_t)3)]++;
+			ports[rows[i].address].push_back(i);
+		} else if (rows[i].type == LIBSWO_PACKET_TYPE_HW) {
+			hw.push_back(i);
+		}
+	}
+
+	if (counts.size() <= LIBSWO_PACKET_TYPE_DWT_DATA_VALUE || \
+			table.count_by_type() != counts) {
+		fprintf(stderr, "Sequence %u: packet counts differ.\n", seed);
+		return false;
+	}
+
+	if (table.histogram(PACKET_TYPE_INST, 28, 16) != bins || \
+			table.histogram(PACKET_TYPE_INST, 24, 4) != clamped) {
+		fprintf(stderr, "Sequence %u: histograms differ.\n", seed);
+		return false;
+	}
+
+	if (table.select_type(PACKET_TYPE_HW) != hw) {
+		fprintf(stderr, "Sequence %u: selected hardware source packets "
+			"differ.\n", seed);
+		return false;
+	}
+
+	for (i = 0; i < 32; i++) {
+		if (table.select_port(i) == ports[i])
+			continue;
+
+		fprintf(stderr, "Sequence %u: selected packets of port %zu "
+			"differ.\n", seed, i);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	vector<union libswo_packet> decoded;
+	vector<struct row> rows;
+	vector<uint8_t> data(NUM_PACKETS * 16);
+	PacketTable table(0, TABLE_BUFFER_SIZE);
+	PacketColumns columns;
+	uint64_t timestamp;
+	size_t num_encoded;
+	size_t length;
+	size_t offset;
+	size_t tmp;
+	size_t i;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	if (libswo_encode_packets(data.data(), data.size(), packets,
+			NUM_PACKETS, &num_encoded, &length) != LIBSWO_OK)
+		return false;
+
+	data.resize(length);
+
+	if (!decode_reference(data, decoded) || \
+			decoded.size() != NUM_PACKETS)
+		return false;
+
+	timestamp = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		rows.push_back(expected_row(&packets[i], &decoded[i],
+			timestamp));
+
+	/* Feed the data in random chunks which split packets. */
+	for (offset = 0; offset < length; offset += tmp) {
+		tmp = std::min(length - offset,
+			(size_t)(1 + rng() % TABLE_BUFFER_SIZE));
+		table.decode(data.data() + offset, tmp, 0);
+	}
+
+	table.decode(NULL, 0, DF_EOS);
+
+	if (!check_rows(table, 0, rows, seed) || \
+			!check_queries(table, rows, seed))
+		return false;
+
+	/* Further packets are appended and the timestamp keeps accumulating. */
+	table.decode(data.data(), length);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		rows[i].timestamp += timestamp;
+
+	if (!check_rows(table, NUM_PACKETS, rows, seed))
+		return false;
+
+	table.swap(columns);
+
+	if (table.size() || columns.size() != 2 * NUM_PACKETS) {
+		fprintf(stderr, "Sequence %u: rows not swapped.\n", seed);
+		return false;
+	}
+
+	/* Clearing the table resets the accumulated timestamp. */
+	table.swap(columns);
+	table.clear();
+	table.decode(data.data(), length);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		rows[i].timestamp -= timestamp;
+
+	return check_rows(table, 0, rows, seed);
+}
+
+static bool check_arguments(void)
+{
+	PacketTable table;
+
+	try {
+		table.histogram(PACKET_TYPE_INST, 0, 0);
+		fprintf(stderr, "Histogram without bins accepted.\n");
+		return false;
+	} catch (const Error &error) {
+	}
+
+	try {
+		table.histogram(PACKET_TYPE_INST, 32, 1);
+		fprintf(stderr, "Histogram with shift of 32 accepted.\n");
+		return false;
+	} catch (const Error &error) {
+	}
+
+	return true;
+}
+
+/*
+ * The number of rows reserved up front is capped for large inputs. A long run
+ * of zero bytes does not fit into the decoder buffer as synchronization packet
+ * such that decoding fails right after the rows were reserved.
+ */
+static bool check_reserve(void)
+{
+	vector<uint8_t> data(16 * 1024 * 1024, 0);
+	PacketTable table(0, TABLE_BUFFER_SIZE);
+
+	try {
+		table.decode(data.data(), data.size());
+	} catch (const Error &error) {
+	}
+
+	if (table.capacity() > MAX_RESERVE) {
+		fprintf(stderr, "%zu rows reserved for %zu bytes.\n",
+			table.capacity(), data.size());
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check that user-defined hardware source packets are stored with their
+ * address and value and that they are counted.
+ */
+static bool check_user_types(void)
+{
+	struct libswo_context *ctx;
+	union libswo_packet packet;
+	uint8_t data[NUM_USER_TYPES * 5];
+	PacketTable table(0, TABLE_BUFFER_SIZE);
+	PacketColumns columns;
+	vector<size_t> counts;
+	size_t length;
+	size_t tmp;
+	unsigned int i;
+	int ret;
+
+	length = 0;
+
+	for (i = 0; i < NUM_USER_TYPES; i++) {
+		memset(&packet, 0, sizeof(packet));
+		packet.type = LIBSWO_PACKET_TYPE_HW;
+		packet.hw.size = 5;
+		packet.hw.address = USER_ADDRESS + i;
+		packet.hw.value = 0x12345600 + i;
+
+		if (libswo_encode_packet(data + length, sizeof(data) - length,
+				&packet, &tmp) != LIBSWO_OK)
+			return false;
+
+		length += tmp;
+	}
+
+	if (libswo_init(&ctx, NULL, length + 1) != LIBSWO_OK)
+		return false;
+
+	ret = libswo_set_callback(ctx, &columns_callback, &columns);
+
+	for (i = 0; i < NUM_USER_TYPES && ret == LIBSWO_OK; i++)
+		ret = libswo_set_hw_decoder(ctx, USER_ADDRESS + i,
+			&user_decoder, NULL);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_feed(ctx, data, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	table.swap(columns);
+	counts = table.count_by_type();
+
+	if (table.size() != NUM_USER_TYPES || \
+			counts.size() != LIBSWO_PACKET_TYPE_USER_MAX + 1) {
+		fprintf(stderr, "User types: %zu rows, %zu types.\n",
+			table.size(), counts.size());
+		return false;
+	}
+
+	for (i = 0; i < NUM_USER_TYPES; i++) {
+		if (table.get_types()[i] == LIBSWO_PACKET_TYPE_USER + i && \
+				table.get_addresses()[i] == USER_ADDRESS + i && \
+				table.get_values()[i] == 0x12345600 + i && \
+				counts[LIBSWO_PACKET_TYPE_USER + i] == 1)
+			continue;
+
+		fprintf(stderr, "User types: row %u differs.\n", i);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_arguments() || !check_reserve() || \
+			!check_user_types())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
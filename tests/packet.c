@@ -0,0 +1,303 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Return a random value up to max. Values at the boundaries of the payload
+ * sizes are preferred.
+ */
+static uint32_t random_value(uint32_t max)
+{
+	static const uint32_t boundaries[] = {
+		0, 1, 0x7f, 0x80, 0xff, 0x100, 0x3fff, 0x4000, 0xffff,
+		0x10000, 0x1fffff, 0x200000, 0x1fffffff
+	};
+	uint32_t value;
+
+	if (rng() % 2)
+		value = boundaries[rng() % (sizeof(boundaries) / \
+			sizeof(boundaries[0]))];
+	else
+		value = rng();
+
+	return (max == UINT32_MAX) ? value : value % (max + 1);
+}
+
+/* Minimal size of a packet with continuation bits for the given value. */
+static size_t cond_size(uint32_t value)
+{
+	if (value < (1 << 7))
+		return 2;
+	else if (value < (1 << 14))
+		return 3;
+	else if (value < (1 << 21))
+		return 4;
+
+	return 5;
+}
+
+/*
+ * Return either 0 to select the most compact encoding, or a random packet
+ * size between the given minimal and maximal size.
+ */
+static size_t random_size(size_t min, size_t max)
+{
+	if (!(rng() % 4))
+		return 0;
+
+	return min + rng() % (max - min + 1);
+}
+
+/* Minimal size of a source packet for the given value. */
+static size_t src_size(uint32_t value)
+{
+	if (value <= 0xff)
+		return 2;
+	else if (value <= 0xffff)
+		return 3;
+
+	return 5;
+}
+
+/* Random source packet size which can hold the given value. */
+static size_t random_src_size(uint32_t value)
+{
+	static const size_t sizes[] = {2, 3, 5};
+	size_t size;
+
+	if (!(rng() % 4))
+		return 0;
+
+	do {
+		size = sizes[rng() % 3];
+	} while (size < src_size(value));
+
+	return size;
+}
+
+/*
+ * Generate a random packet of any type which can be encoded with
+ * libswo_encode_packet() and is decoded to the same fields again.
+ */
+void random_packet(union libswo_packet *packet)
+{
+	static const enum libswo_packet_type types[] = {
+		LIBSWO_PACKET_TYPE_UNKNOWN,
+		LIBSWO_PACKET_TYPE_SYNC,
+		LIBSWO_PACKET_TYPE_OVERFLOW,
+		LIBSWO_PACKET_TYPE_LTS,
+		LIBSWO_PACKET_TYPE_GTS1,
+		LIBSWO_PACKET_TYPE_GTS2,
+		LIBSWO_PACKET_TYPE_EXT,
+		LIBSWO_PACKET_TYPE_INST,
+		LIBSWO_PACKET_TYPE_HW,
+		LIBSWO_PACKET_TYPE_DWT_EVTCNT,
+		LIBSWO_PACKET_TYPE_DWT_EXCTRACE,
+		LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE,
+		LIBSWO_PACKET_TYPE_DWT_PC_VALUE,
+		LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET,
+		LIBSWO_PACKET_TYPE_DWT_DATA_VALUE
+	};
+	uint32_t value;
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type = types[rng() % (sizeof(types) / sizeof(types[0]))];
+
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+		/* Reserved headers which are decoded as unknown data. */
+		packet->unknown.size = 1;
+		packet->unknown.data[0] = (rng() % 2) ? 0x04 : 0x14;
+		break;
+	case LIBSWO_PACKET_TYPE_SYNC:
+		packet->sync.size = (rng() % 4) ? 48 + rng() % 24 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+		packet->of.size = rng() % 2;
+		break;
+	case LIBSWO_PACKET_TYPE_LTS:
+		if (rng() % 2) {
+			/* Single byte encoding (LTS2). */
+			packet->lts.relation = LIBSWO_LTS_REL_SYNC;
+			packet->lts.value = 1 + rng() % 6;
+			packet->lts.size = (rng() % 2) ? 1 : 0;
+			break;
+		}
+
+		packet->lts.relation = rng() % 4;
+		packet->lts.value = random_value(0xfffffff);
+
+		/* Small values are encoded as LTS2 unless a size is given. */
+		if (packet->lts.relation == LIBSWO_LTS_REL_SYNC && \
+				packet->lts.value >= 1 && packet->lts.value <= 6)
+			packet->lts.size = 2 + rng() % 4;
+		else
+			packet->lts.size = random_size(
+				cond_size(packet->lts.value), 5);
+		break;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		packet->gts1.value = random_value(0x3ffffff);
+		packet->gts1.clkch = rng() % 2;
+		packet->gts1.wrap = rng() % 2;
+
+		value = packet->gts1.value;
+		value |= packet->gts1.clkch ? 0x4000000 : 0;
+		value |= packet->gts1.wrap ? 0x8000000 : 0;
+
+		packet->gts1.size = random_size(cond_size(value), 5);
+		break;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		packet->gts2.value = random_value(0x3fffff);
+		packet->gts2.size = (rng() % 2) ? 5 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_EXT:
+		packet->ext.source = rng() % 2;
+
+		if (rng() % 4) {
+			packet->ext.value = random_value(UINT32_MAX);
+			packet->ext.size = random_size(
+				cond_size(packet->ext.value >> 3), 5);
+		} else {
+			packet->ext.value = rng() % 8;
+			packet->ext.size = random_size(1, 5);
+		}
+		break;
+	case LIBSWO_PACKET_TYPE_INST:
+		packet->inst.address = rng() % 32;
+		packet->inst.value = random_value(UINT32_MAX);
+		packet->inst.size = random_src_size(packet->inst.value);
+		break;
+	case LIBSWO_PACKET_TYPE_HW:
+		/* Addresses which are not used by DWT packets. */
+		packet->hw.address = 24 + rng() % 8;
+		packet->hw.value = random_value(UINT32_MAX);
+		packet->hw.size = random_src_size(packet->hw.value);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		packet->evtcnt.cpi = rng() % 2;
+		packet->evtcnt.exc = rng() % 2;
+		packet->evtcnt.sleep = rng() % 2;
+		packet->evtcnt.lsu = rng() % 2;
+		packet->evtcnt.fold = rng() % 2;
+		packet->evtcnt.cyc = rng() % 2;
+		packet->evtcnt.size = (rng() % 2) ? 2 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		packet->exctrace.exception = rng() % 0x200;
+		packet->exctrace.function = rng() % 4;
+		packet->exctrace.size = (rng() % 2) ? 3 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		packet->pc_sample.sleep = rng() % 2;
+
+		if (packet->pc_sample.sleep) {
+			packet->pc_sample.size = (rng() % 2) ? 2 : 0;
+		} else {
+			packet->pc_sample.pc = random_value(UINT32_MAX);
+			packet->pc_sample.size = (rng() % 2) ? 5 : 0;
+		}
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		packet->pc_value.cmpn = rng() % 4;
+		packet->pc_value.pc = random_value(UINT32_MAX);
+		packet->pc_value.size = (rng() % 2) ? 5 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		packet->addr_offset.cmpn = rng() % 4;
+		packet->addr_offset.offset = random_value(0xffff);
+		packet->addr_offset.size = (rng() % 2) ? 3 : 0;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		packet->data_value.wnr = rng() % 2;
+		packet->data_value.cmpn = rng() % 4;
+		packet->data_value.data_value = random_value(UINT32_MAX);
+		packet->data_value.size = random_src_size(
+			packet->data_value.data_value);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Compare the fields of two packets of the same type, except for the packet
+ * size.
+ */
+bool packet_fields_equal(const union libswo_packet *a,
+		const union libswo_packet *b)
+{
+	switch (a->type) {
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+		return !memcmp(a->unknown.data, b->unknown.data,
+			b->unknown.size);
+	case LIBSWO_PACKET_TYPE_SYNC:
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+		return true;
+	case LIBSWO_PACKET_TYPE_LTS:
+		return a->lts.relation == b->lts.relation && \
+			a->lts.value == b->lts.value;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		return a->gts1.value == b->gts1.value && \
+			a->gts1.clkch == b->gts1.clkch && \
+			a->gts1.wrap == b->gts1.wrap;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		return a->gts2.value == b->gts2.value;
+	case LIBSWO_PACKET_TYPE_EXT:
+		return a->ext.source == b->ext.source && \
+			a->ext.value == b->ext.value;
+	case LIBSWO_PACKET_TYPE_INST:
+		return a->inst.address == b->inst.address && \
+			a->inst.value == b->inst.value;
+	case LIBSWO_PACKET_TYPE_HW:
+		return a->hw.address == b->hw.address && \
+			a->hw.value == b->hw.value;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		return a->evtcnt.cpi == b->evtcnt.cpi && \
+			a->evtcnt.exc == b->evtcnt.exc && \
+			a->evtcnt.sleep == b->evtcnt.sleep && \
+			a->evtcnt.lsu == b->evtcnt.lsu && \
+			a->evtcnt.fold == b->evtcnt.fold && \
+			a->evtcnt.cyc == b->evtcnt.cyc;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		return a->exctrace.exception == b->exctrace.exception && \
+			a->exctrace.function == b->exctrace.function;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		return a->pc_sample.sleep == b->pc_sample.sleep && \
+			a->pc_sample.pc == b->pc_sample.pc;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		return a->pc_value.cmpn == b->pc_value.cmpn && \
+			a->pc_value.pc == b->pc_value.pc;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		return a->addr_offset.cmpn == b->addr_offset.cmpn && \
+			a->addr_offset.offset == b->addr_offset.offset;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		return a->data_value.wnr == b->data_value.wnr && \
+			a->data_value.cmpn == b->data_value.cmpn && \
+			a->data_value.data_value == b->data_value.data_value;
+	default:
+		return false;
+	}
+}
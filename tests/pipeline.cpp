@@ -0,0 +1,397 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "libswocxx.h"
+#include "test.h"
+
+/*
+ * Test of the pipeline of the C++ bindings.
+ *
+ * Random packets are encoded and pushed in batches of random sizes through an
+ * ingest stage, the decode stage, the timestamp stage and an analysis stage.
+ * The queues are small and the analysis stage blocks on the first batch until
+ * all preceding stages stalled. The analysis stage must receive the original
+ * packets with the accumulated local timestamps, and the statistics of each
+ * stage must match. Furthermore, a failing stage must be reported by stop().
+ */
+
+using namespace libswo;
+using std::vector;
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		5
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		4096
+
+/* Capacity of each queue in batches. */
+#define QUEUE_SIZE		2
+
+/* Maximum size of a batch in bytes. */
+#define MAX_BATCH_SIZE		64
+
+/* Buffer size of the decoder context of the decode stage in bytes. */
+#define DECODER_BUFFER_SIZE	64
+
+/* Maximum time to wait for the stages to stall in milliseconds. */
+#define STALL_TIMEOUT		5000
+
+/* Index of the batch for which the failing stage throws an error. */
+#define ERROR_BATCH		3
+
+struct analysis {
+	std::mutex mutex;
+	std::condition_variable cv;
+	/* Indicates whether the stage blocks on the first batch. */
+	bool blocked;
+	bool entered;
+	vector<union libswo_packet> packets;
+	vector<uint64_t> timestamps;
+	size_t num_batches;
+	uint64_t num_bytes;
+};
+
+static bool ingest_stage(Batch &batch, void *user_data)
+{
+	/* Only count the trace data, all batches are passed on. */
+	*(uint64_t *)user_data += batch.data.size();
+
+	return true;
+}
+
+static bool analysis_stage(Batch &batch, void *user_data)
+{
+	struct analysis *analysis;
+
+	analysis = (struct analysis *)user_data;
+
+	{
+		std::unique_lock<std::mutex> lock(analysis->mutex);
+
+		analysis->entered = true;
+		analysis->cv.notify_all();
+
+		analysis->cv.wait(lock, [analysis] {
+			return !analysis->blocked;
+		});
+	}
+
+	if (batch.timestamps.size() != batch.packets.size())
+		throw Error(LIBSWO_ERR);
+
+	analysis->packets.insert(analysis->packets.end(),
+		batch.packets.begin(), batch.packets.end());
+	analysis->timestamps.insert(analysis->timestamps.end(),
+		batch.timestamps.begin(), batch.timestamps.end());
+	analysis->num_batches++;
+	analysis->num_bytes += batch.data.size();
+
+	return true;
+}
+
+static bool failing_stage(Batch &batch, void *user_data)
+{
+	size_t *num_batches;
+
+	(void)batch;
+
+	num_batches = (size_t *)user_data;
+
+	if ((*num_batches)++ == ERROR_BATCH)
+		throw Error(LIBSWO_ERR_ARG);
+
+	return true;
+}
+
+/* Split the trace data into batches of random sizes. */
+static vector<Batch> split(const vector<uint8_t> &data)
+{
+	vector<Batch> batches;
+	size_t offset;
+	size_t tmp;
+
+	for (offset = 0; offset < data.size(); offset += tmp) {
+		tmp = std::min<size_t>(1 + rng() % MAX_BATCH_SIZE,
+			data.size() - offset);
+		batches.push_back(Batch(vector<uint8_t>(&data[offset],
+			&data[offset] + tmp)));
+	}
+
+	return batches;
+}
+
+/* Wait until all stages in front of the blocked analysis stage stalled. */
+static bool wait_stalls(Pipeline &pipeline, vector<Batch> &batches,
+		size_t &index)
+{
+	vector<StageStats> stats;
+	size_t i;
+	int timeout;
+
+	for (timeout = 0; timeout < STALL_TIMEOUT; timeout++) {
+		while (index < batches.size() && \
+				pipeline.try_push(std::move(batches[index])))
+			index++;
+
+		stats = pipeline.get_stats();
+
+		for (i = 0; i < stats.size() - 1; i++) {
+			if (!stats[i].stalls)
+				break;
+		}
+
+		if (i == stats.size() - 1)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return false;
+}
+
+static bool check_stats(const vector<StageStats> &stats, size_t num_batches,
+		uint64_t num_bytes, unsigned int seed)
+{
+	static const char *names[] = {
+		"ingest", "decode", "timestamp", "analysis"
+	};
+	size_t i;
+
+	if (stats.size() != 4) {
+		fprintf(stderr, "Sequence %u: %zu stages.\n", seed,
+			stats.size());
+		return false;
+	}
+
+	/*
+	 * The batch which indicates the end of the stream is counted. All
+	 * stages but the last one stalled while the analysis stage blocked.
+	 */
+	for (i = 0; i < stats.size(); i++) {
+		if (stats[i].name == names[i] && \
+				stats[i].batches == num_batches + 1 && \
+				stats[i].bytes == num_bytes && \
+				stats[i].packets == (i ? NUM_PACKETS : 0) && \
+				stats[i].queue_depth == 0 && \
+				stats[i].queue_size == QUEUE_SIZE && \
+				stats[i].error == LIBSWO_OK && \
+				(i == stats.size() - 1 || stats[i].stalls > 0))
+			continue;
+
+		fprintf(stderr, "Sequence %u: statistics of stage %s differ: "
+			"%llu batches, %llu bytes, %llu packets, %llu stalls, "
+			"queue %zu of %zu, %s.\n", seed, stats[i].name.c_str(),
+			(unsigned long long)stats[i].batches,
+			(unsigned long long)stats[i].bytes,
+			(unsigned long long)stats[i].packets,
+			(unsigned long long)stats[i].stalls,
+			stats[i].queue_depth, stats[i].queue_size,
+			libswo_strerror_name(stats[i].error));
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	union libswo_packet packets[NUM_PACKETS];
+	static struct analysis analysis;
+	uint8_t buffer[NUM_PACKETS * 16];
+	vector<Batch> batches;
+	uint64_t num_bytes;
+	uint64_t timestamp;
+	size_t num_encoded;
+	size_t length;
+	size_t index;
+	size_t i;
+	bool stalled;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	if (libswo_encode_packets(buffer, sizeof(buffer), packets,
+			NUM_PACKETS, &num_encoded, &length) != LIBSWO_OK)
+		return false;
+
+	batches = split(vector<uint8_t>(buffer, buffer + length));
+
+	analysis.blocked = true;
+	analysis.entered = false;
+	analysis.packets.clear();
+	analysis.timestamps.clear();
+	analysis.num_batches = 0;
+	analysis.num_bytes = 0;
+	num_bytes = 0;
+
+	Pipeline pipeline(QUEUE_SIZE);
+
+	pipeline.add_stage("ingest", &ingest_stage, &num_bytes);
+	pipeline.add_decode_stage(DECODER_BUFFER_SIZE);
+	pipeline.add_timestamp_stage();
+	pipeline.add_stage("analysis", &analysis_stage, &analysis);
+	pipeline.start();
+
+	/* Block the analysis stage on the first batch. */
+	pipeline.push(std::move(batches[0]));
+	index = 1;
+
+	{
+		std::unique_lock<std::mutex> lock(analysis.mutex);
+
+		analysis.cv.wait(lock, [] {
+			return analysis.entered;
+		});
+	}
+
+	stalled = wait_stalls(pipeline, batches, index);
+
+	{
+		std::lock_guard<std::mutex> lock(analysis.mutex);
+
+		analysis.blocked = false;
+		analysis.cv.notify_all();
+	}
+
+	for (; index < batches.size(); index++)
+		pipeline.push(std::move(batches[index]));
+
+	pipeline.stop();
+
+	if (!stalled) {
+		fprintf(stderr, "Sequence %u: stages did not stall.\n", seed);
+		return false;
+	}
+
+	if (analysis.packets.size() != NUM_PACKETS || \
+			analysis.num_batches != batches.size() + 1 || \
+			analysis.num_bytes != length || num_bytes != length) {
+		fprintf(stderr, "Sequence %u: %zu packets in %zu batches "
+			"analyzed.\n", seed, analysis.packets.size(),
+			analysis.num_batches);
+		return false;
+	}
+
+	timestamp = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (packets[i].type == LIBSWO_PACKET_TYPE_LTS)
+			timestamp += packets[i].lts.value;
+
+		if (packets[i].type == analysis.packets[i].type && \
+				(!packets[i].any.size || \
+				packets[i].any.size == \
+				analysis.packets[i].any.size) && \
+				packet_fields_equal(&packets[i],
+				&analysis.packets[i]) && \
+				analysis.timestamps[i] == timestamp)
+			continue;
+
+		fprintf(stderr, "Sequence %u: packet %zu of type %u differs.\n",
+			seed, i, packets[i].type);
+		return false;
+	}
+
+	return check_stats(pipeline.get_stats(), batches.size(), length, seed);
+}
+
+/* Check that stop() reports the error of a failing stage. */
+static bool check_error(void)
+{
+	Pipeline pipeline(QUEUE_SIZE);
+	vector<StageStats> stats;
+	size_t num_failing;
+	uint64_t num_bytes;
+	size_t i;
+	int ret;
+
+	num_failing = 0;
+	num_bytes = 0;
+
+	pipeline.add_stage("failing", &failing_stage, &num_failing);
+	pipeline.add_stage("counting", &ingest_stage, &num_bytes);
+	pipeline.start();
+
+	for (i = 0; i < 2 * ERROR_BATCH; i++)
+		pipeline.push(Batch(vector<uint8_t>(1, 0x70)));
+
+	try {
+		pipeline.stop();
+		ret = LIBSWO_OK;
+	} catch (const Error &error) {
+		ret = error.code;
+	}
+
+	stats = pipeline.get_stats();
+
+	/*
+	 * The failed batch is dropped, all other batches with one byte each
+	 * are passed on.
+	 */
+	if (ret != LIBSWO_ERR_ARG || stats[0].error != LIBSWO_ERR_ARG || \
+			stats[1].error != LIBSWO_OK || \
+			num_bytes != 2 * ERROR_BATCH - 1) {
+		fprintf(stderr, "Error: stop() reported %s, %llu batches "
+			"passed.\n", libswo_strerror_name(ret),
+			(unsigned long long)num_bytes);
+		return false;
+	}
+
+	/* The errors are reset when the pipeline is started again. */
+	pipeline.start();
+	pipeline.stop();
+
+	if (pipeline.get_stats()[0].error != LIBSWO_OK) {
+		fprintf(stderr, "Error: error not reset.\n");
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	try {
+		for (i = 1; i <= NUM_SEQUENCES; i++) {
+			if (!check_sequence(i))
+				return EXIT_FAILURE;
+		}
+
+		if (!check_error())
+			return EXIT_FAILURE;
+	} catch (const Error &error) {
+		fprintf(stderr, "Unexpected error: %s.\n", error.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "libswocxx.h"
+#include "test.h"
+
+/*
+ * Test of the multi-stream decoding runtime of the C++ bindings.
+ *
+ * Random packets are encoded for several streams which are distributed over
+ * several workers. The trace data is handed over in chunks of random sizes
+ * with a small queue such that the queues run full. Some streams are removed
+ * while trace data is still pending and the callback function of some
+ * streams stops decoding on every Nth packet. All streams must receive the
+ * original packets in order and no trace data must be dropped.
+ */
+
+using namespace libswo;
+using std::vector;
+
+/* Number of rounds with different random packet sequences. */
+#define NUM_ROUNDS		5
+
+/* Number of worker threads. */
+#define NUM_WORKERS		3
+
+/* Number of streams. */
+#define NUM_STREAMS		8
+
+/* Maximum number of pending chunks per stream. */
+#define QUEUE_SIZE		4
+
+/* Number of packets per stream. */
+#define NUM_PACKETS		2048
+
+/* Buffer size of the decoder context of each stream in bytes. */
+#define STREAM_BUFFER_SIZE	256
+
+/* Maximum size of a chunk handed over to a stream in bytes. */
+#define MAX_CHUNK_SIZE		(2 * STREAM_BUFFER_SIZE)
+
+struct stream {
+	Runtime::Stream *handle;
+	vector<union libswo_packet> packets;
+	/* Stream position of the end of each packet. */
+	vector<size_t> ends;
+	vector<uint8_t> data;
+	size_t offset;
+	vector<union libswo_packet> received;
+	/* Stop decoding on every Nth packet, or never if 0. */
+	unsigned int stop_interval;
+	/* Number of received packets at the time the stream was removed. */
+	size_t num_removed;
+	bool remove;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct stream *stream;
+
+	(void)ctx;
+
+	stream = (struct stream *)user_data;
+
+	if (stream->received.size() == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	stream->received.push_back(*packet);
+
+	if (stream->stop_interval && \
+			!(stream->received.size() % stream->stop_interval))
+		return false;
+
+	return true;
+}
+
+static bool encode(struct stream &stream)
+{
+	union libswo_packet packet;
+	uint8_t buffer[32];
+	size_t length;
+	size_t tmp;
+	size_t i;
+
+	stream.packets.clear();
+	stream.ends.clear();
+	stream.data.clear();
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		random_packet(&packet);
+
+		if (libswo_encode_packets(buffer, sizeof(buffer), &packet, 1,
+				&tmp, &length) != LIBSWO_OK)
+			return false;
+
+		stream.packets.push_back(packet);
+		stream.data.insert(stream.data.end(), buffer, buffer + length);
+		stream.ends.push_back(stream.data.size());
+	}
+
+	/*
+	 * Terminate the trace data with a packet which is not checked such
+	 * that the last packet of the sequence is complete without the end of
+	 * the stream.
+	 */
+	packet.type = LIBSWO_PACKET_TYPE_OVERFLOW;
+	packet.any.size = 0;
+
+	if (libswo_encode_packets(buffer, sizeof(buffer), &packet, 1, &tmp,
+			&length) != LIBSWO_OK)
+		return false;
+
+	stream.data.insert(stream.data.end(), buffer, buffer + length);
+
+	return true;
+}
+
+static bool check_packets(const struct stream &stream, size_t index,
+		unsigned int round)
+{
+	size_t i;
+
+	if (stream.received.size() > NUM_PACKETS) {
+		fprintf(stderr, "Round %u: stream %zu received %zu packets.\n",
+			round, index, stream.received.size());
+		return false;
+	}
+
+	for (i = 0; i < stream.received.size(); i++) {
+		if (stream.packets[i].type == stream.received[i].type && \
+				(!stream.packets[i].any.size || \
+				stream.packets[i].any.size == \
+				stream.received[i].any.size) && \
+				packet_fields_equal(&stream.packets[i],
+				&stream.received[i]))
+			continue;
+
+		fprintf(stderr, "Round %u: stream %zu: packet %zu of type %u "
+			"differs.\n", round, index, i, stream.packets[i].type);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_round(Runtime &runtime, unsigned int round)
+{
+	static struct stream streams[NUM_STREAMS];
+	struct stream *stream;
+	StreamStats stats;
+	size_t num_active;
+	size_t missing;
+	size_t length;
+	size_t i;
+	bool busy;
+
+	rng_seed(round);
+
+	for (i = 0; i < NUM_STREAMS; i++) {
+		if (!encode(streams[i]))
+			return false;
+
+		streams[i].offset = 0;
+		streams[i].received.clear();
+		streams[i].stop_interval = (i % 2) ? 3 + i : 0;
+		streams[i].remove = (i % 4) == 2;
+		streams[i].handle = runtime.add_stream(&packet_callback,
+			&streams[i], STREAM_BUFFER_SIZE);
+	}
+
+	num_active = NUM_STREAMS;
+
+	while (num_active > 0) {
+		busy = false;
+
+		for (i = 0; i < NUM_STREAMS; i++) {
+			stream = &streams[i];
+
+			if (!stream->handle || \
+					stream->offset == stream->data.size())
+				continue;
+
+			/* Remove the stream while trace data is pending. */
+			if (stream->remove && stream->offset > \
+					stream->data.size() / 2) {
+				runtime.remove_stream(stream->handle);
+				stream->handle = NULL;
+				stream->num_removed = stream->received.size();
+				num_active--;
+				continue;
+			}
+
+			length = std::min<size_t>(1 + rng() % MAX_CHUNK_SIZE,
+				stream->data.size() - stream->offset);
+
+			if (!runtime.feed(stream->handle,
+					&stream->data[stream->offset], length))
+				continue;
+
+			stream->offset += length;
+			busy = true;
+
+			if (stream->offset == stream->data.size())
+				num_active--;
+		}
+
+		if (!busy)
+			std::this_thread::yield();
+	}
+
+	runtime.flush();
+
+	for (i = 0; i < NUM_STREAMS; i++) {
+		stream = &streams[i];
+
+		if (!check_packets(*stream, i, round))
+			return false;
+
+		if (!stream->handle) {
+			if (stream->received.size() == stream->num_removed)
+				continue;
+
+			fprintf(stderr, "Round %u: stream %zu received packets "
+				"after its removal.\n", round, i);
+			return false;
+		}
+
+		stats = runtime.get_stats(stream->handle);
+
+		if (stats.bytes != stream->data.size() || stats.dropped || \
+				stats.errors || stats.error != LIBSWO_OK) {
+			fprintf(stderr, "Round %u: stream %zu decoded %llu "
+				"bytes, dropped %llu bytes with %llu errors: "
+				"%s.\n", round, i,
+				(unsigned long long)stats.bytes,
+				(unsigned long long)stats.dropped,
+				(unsigned long long)stats.errors,
+				libswo_strerror_name(stats.error));
+			return false;
+		}
+
+		/*
+		 * If the callback function stopped decoding, the remaining
+		 * packets are only decoded once more trace data arrives and
+		 * therefore fit into the buffer of the stream.
+		 */
+		if (!stream->received.empty())
+			missing = stream->data.size() - \
+				stream->ends[stream->received.size() - 1];
+		else
+			missing = stream->data.size();
+
+		if ((!stream->stop_interval && \
+				stream->received.size() != NUM_PACKETS) || \
+				missing > STREAM_BUFFER_SIZE) {
+			fprintf(stderr, "Round %u: stream %zu received only "
+				"%zu packets.\n", round, i,
+				stream->received.size());
+			return false;
+		}
+
+		runtime.remove_stream(stream->handle);
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	try {
+		Runtime runtime(NUM_WORKERS, QUEUE_SIZE);
+
+		for (i = 1; i <= NUM_ROUNDS; i++) {
+			if (!check_round(runtime, i))
+				return EXIT_FAILURE;
+		}
+	} catch (const Error &error) {
+		fprintf(stderr, "Runtime error: %s.\n", error.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
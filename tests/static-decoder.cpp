@@ -0,0 +1,272 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "StaticDecoder.h"
+#include "test.h"
+
+/*
+ * Differential test of StaticDecoder against libswo_decode().
+ *
+ * Random trace data is decoded with both decoders for different sets of
+ * enabled packet types and the resulting packets are compared field by field.
+ * Only the fields of the actual packet type are compared because the unused
+ * bytes of the packet union are not defined.
+ */
+
+using namespace libswo;
+using std::vector;
+
+/* Number of random streams per packet type set. */
+#define NUM_STREAMS	2000
+
+/* Maximum length of a random stream in bytes. */
+#define MAX_STREAM_SIZE	1024
+
+/*
+ * Generate random trace data. Runs of zero bytes are inserted from time to
+ * time such that synchronization packets occur as well.
+ */
+static void generate(vector<uint8_t> &data)
+{
+	size_t length;
+	size_t i;
+
+	length = rng() % MAX_STREAM_SIZE;
+	data.clear();
+
+	while (data.size() < length) {
+		if (rng() % 32) {
+			data.push_back(rng());
+			continue;
+		}
+
+		for (i = rng() % 8; i > 0; i--)
+			data.push_back(0x00);
+
+		data.push_back(1 << (rng() % 8));
+	}
+}
+
+static bool hw_equal(const struct libswo_packet_hw &a,
+		const struct libswo_packet_hw &b)
+{
+	return a.address == b.address && a.value == b.value && \
+		!memcmp(a.payload, b.payload, a.size - 1);
+}
+
+static bool equal(const union libswo_packet &a, const union libswo_packet &b)
+{
+	if (a.type != b.type || a.any.size != b.any.size)
+		return false;
+
+	/* The size of a synchronization packet is given in bits. */
+	if (a.type == LIBSWO_PACKET_TYPE_SYNC)
+		return true;
+
+	if (memcmp(a.any.data, b.any.data, a.any.size))
+		return false;
+
+	switch (a.type) {
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+		return true;
+	case LIBSWO_PACKET_TYPE_LTS:
+		return a.lts.relation == b.lts.relation && \
+			a.lts.value == b.lts.value;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		return a.gts1.value == b.gts1.value && \
+			a.gts1.clkch == b.gts1.clkch && \
+			a.gts1.wrap == b.gts1.wrap;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		return a.gts2.value == b.gts2.value;
+	case LIBSWO_PACKET_TYPE_EXT:
+		return a.ext.source == b.ext.source && \
+			a.ext.value == b.ext.value;
+	case LIBSWO_PACKET_TYPE_INST:
+		return a.inst.address == b.inst.address && \
+			a.inst.value == b.inst.value && \
+			!memcmp(a.inst.payload, b.inst.payload,
+			a.inst.size - 1);
+	case LIBSWO_PACKET_TYPE_HW:
+		return hw_equal(a.hw, b.hw);
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		return hw_equal(a.hw, b.hw) && \
+			a.evtcnt.cpi == b.evtcnt.cpi && \
+			a.evtcnt.exc == b.evtcnt.exc && \
+			a.evtcnt.sleep == b.evtcnt.sleep && \
+			a.evtcnt.lsu == b.evtcnt.lsu && \
+			a.evtcnt.fold == b.evtcnt.fold && \
+			a.evtcnt.cyc == b.evtcnt.cyc;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		return hw_equal(a.hw, b.hw) && \
+			a.exctrace.exception == b.exctrace.exception && \
+			a.exctrace.function == b.exctrace.function;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		return hw_equal(a.hw, b.hw) && \
+			a.pc_sample.sleep == b.pc_sample.sleep && \
+			a.pc_sample.pc == b.pc_sample.pc;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		return hw_equal(a.hw, b.hw) && \
+			a.pc_value.cmpn == b.pc_value.cmpn && \
+			a.pc_value.pc == b.pc_value.pc;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		return hw_equal(a.hw, b.hw) && \
+			a.addr_offset.cmpn == b.addr_offset.cmpn && \
+			a.addr_offset.offset == b.addr_offset.offset;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		return hw_equal(a.hw, b.hw) && \
+			a.data_value.wnr == b.data_value.wnr && \
+			a.data_value.cmpn == b.data_value.cmpn && \
+			a.data_value.data_value == b.data_value.data_value;
+	default:
+		return false;
+	}
+}
+
+struct Reference
+{
+	uint32_t types;
+	vector<union libswo_packet> packets;
+};
+
+static int reference_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	Reference *reference;
+
+	(void)ctx;
+
+	reference = (Reference *)user_data;
+
+	if ((reference->types >> packet->type) & 1)
+		reference->packets.push_back(*packet);
+
+	return true;
+}
+
+class Collector
+{
+public:
+	int operator()(const union libswo_packet &packet)
+	{
+		packets.push_back(packet);
+
+		return true;
+	}
+
+	vector<union libswo_packet> packets;
+};
+
+static bool decode_reference(const vector<uint8_t> &data, uint32_t types,
+		vector<union libswo_packet> &packets)
+{
+	struct libswo_context *ctx;
+	Reference reference;
+	int ret;
+
+	if (libswo_init(&ctx, NULL, 2 * MAX_STREAM_SIZE) != LIBSWO_OK)
+		return false;
+
+	libswo_log_set_level(ctx, LIBSWO_LOG_LEVEL_NONE);
+
+	reference.types = types;
+	libswo_set_callback(ctx, &reference_callback, &reference);
+
+	ret = libswo_feed(ctx, data.data(), data.size());
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+	packets.swap(reference.packets);
+
+	return ret == LIBSWO_OK;
+}
+
+template<uint32_t Types>
+static bool check(const char *name)
+{
+	vector<uint8_t> data;
+	vector<union libswo_packet> expected;
+	unsigned int i;
+	size_t j;
+
+	for (i = 0; i < NUM_STREAMS; i++) {
+		Collector collector;
+		StaticDecoder<Types, Collector> decoder(collector);
+
+		rng_seed(i + 1);
+		generate(data);
+
+		if (!decode_reference(data, Types, expected)) {
+			fprintf(stderr, "%s: libswo_decode() failed for stream "
+				"%u.\n", name, i);
+			return false;
+		}
+
+		if (decoder.decode(data.data(), data.size(), DF_EOS) != \
+				data.size()) {
+			fprintf(stderr, "%s: stream %u not consumed.\n", name,
+				i);
+			return false;
+		}
+
+		if (collector.packets.size() != expected.size()) {
+			fprintf(stderr, "%s: stream %u: %zu packets instead "
+				"of %zu.\n", name, i, collector.packets.size(),
+				expected.size());
+			return false;
+		}
+
+		for (j = 0; j < expected.size(); j++) {
+			if (equal(collector.packets[j], expected[j]))
+				continue;
+
+			fprintf(stderr, "%s: stream %u: packet %zu differs.\n",
+				name, i, j);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	bool ok;
+
+	ok = check<0xffffffff>("all");
+	ok &= check<PacketTypeMask<PACKET_TYPE_INST>::value>("inst");
+	ok &= check<PacketTypeMask<PACKET_TYPE_HW,
+		PACKET_TYPE_DWT_PC_SAMPLE>::value>("hw");
+	ok &= check<PacketTypeMask<PACKET_TYPE_DWT_EVTCNT,
+		PACKET_TYPE_DWT_EXCTRACE, PACKET_TYPE_DWT_PC_VALUE,
+		PACKET_TYPE_DWT_ADDR_OFFSET,
+		PACKET_TYPE_DWT_DATA_VALUE>::value>("dwt");
+	ok &= check<PacketTypeMask<PACKET_TYPE_UNKNOWN, PACKET_TYPE_SYNC,
+		PACKET_TYPE_OVERFLOW, PACKET_TYPE_LTS, PACKET_TYPE_GTS1,
+		PACKET_TYPE_GTS2, PACKET_TYPE_EXT>::value>("protocol");
+
+	return ok ? 0 : 1;
+}
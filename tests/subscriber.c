@@ -0,0 +1,346 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of the packet subscribers.
+ *
+ * Random packets are encoded and decoded with several subscribers with random
+ * filters. Each packet must be delivered to the decoder callback function
+ * first and afterwards to all subscribers whose filter matches, in the order
+ * of their identifiers. One subscriber removes another one and one subscriber
+ * removes itself within its callback function. Neither of them must receive
+ * packets afterwards.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		20
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Number of subscribers. */
+#define NUM_SUBSCRIBERS		8
+
+/* Subscriber which removes another subscriber. */
+#define REMOVING_SUBSCRIBER	0
+
+/* Subscriber which is removed by another subscriber, and the packet. */
+#define REMOVED_SUBSCRIBER	3
+#define REMOVED_PACKET		(NUM_PACKETS / 4)
+
+/* Subscriber which removes itself on the first packet from the given one. */
+#define SELF_SUBSCRIBER		5
+#define SELF_PACKET		(NUM_PACKETS / 2)
+
+/* Identifier of the decoder callback function in the event log. */
+#define DECODER_CALLBACK	UINT32_MAX
+
+/* Maximal number of events. */
+#define MAX_EVENTS		(NUM_PACKETS * (NUM_SUBSCRIBERS + 1))
+
+struct event {
+	/* Subscriber identifier or DECODER_CALLBACK. */
+	uint32_t id;
+	/* Index of the packet. */
+	size_t index;
+};
+
+struct subscriber {
+	struct libswo_filter filter;
+	unsigned int id;
+};
+
+static union libswo_packet packets[NUM_PACKETS];
+static struct subscriber subscribers[NUM_SUBSCRIBERS];
+static struct event events[MAX_EVENTS];
+static size_t num_events;
+static size_t num_packets;
+static bool mismatch;
+
+static int log_event(uint32_t id, const union libswo_packet *packet)
+{
+	size_t index;
+
+	if (!num_packets || num_events == MAX_EVENTS)
+		return LIBSWO_ERR;
+
+	index = num_packets - 1;
+
+	/* Make sure that each callback function sees the correct packet. */
+	if (packet->type != packets[index].type || \
+			!packet_fields_equal(packet, &packets[index]))
+		mismatch = true;
+
+	events[num_events].id = id;
+	events[num_events].index = index;
+	num_events++;
+
+	return true;
+}
+
+static int decoder_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	if (num_packets == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	num_packets++;
+
+	return log_event(DECODER_CALLBACK, packet);
+}
+
+static int subscriber_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct subscriber *sub;
+	int ret;
+
+	sub = (struct subscriber *)user_data;
+	ret = log_event(sub->id, packet);
+
+	if (ret <= 0)
+		return ret;
+
+	if (sub == &subscribers[REMOVING_SUBSCRIBER] && \
+			num_packets - 1 == REMOVED_PACKET)
+		ret = libswo_unsubscribe(ctx,
+			subscribers[REMOVED_SUBSCRIBER].id);
+	else if (sub == &subscribers[SELF_SUBSCRIBER] && \
+			num_packets - 1 >= SELF_PACKET)
+		ret = libswo_unsubscribe(ctx, sub->id);
+	else
+		ret = LIBSWO_OK;
+
+	return (ret == LIBSWO_OK) ? true : LIBSWO_ERR;
+}
+
+static bool filter_matches(const struct libswo_filter *filter,
+		const union libswo_packet *packet)
+{
+	if (!(filter->types & LIBSWO_PACKET_TYPE_MASK(packet->type)))
+		return false;
+
+	if (packet->type != LIBSWO_PACKET_TYPE_INST)
+		return true;
+
+	return filter->ports & (UINT32_C(1) << packet->inst.address);
+}
+
+/* Compute the expected events from the original packets. */
+static size_t expected_events(struct event *expected)
+{
+	bool active[NUM_SUBSCRIBERS];
+	size_t num;
+	size_t i;
+	size_t j;
+
+	for (j = 0; j < NUM_SUBSCRIBERS; j++)
+		active[j] = true;
+
+	num = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		expected[num].id = DECODER_CALLBACK;
+		expected[num].index = i;
+		num++;
+
+		for (j = 0; j < NUM_SUBSCRIBERS; j++) {
+			if (!active[j] || \
+					!filter_matches(&subscribers[j].filter,
+					&packets[i]))
+				continue;
+
+			expected[num].id = subscribers[j].id;
+			expected[num].index = i;
+			num++;
+
+			if (j == REMOVING_SUBSCRIBER && i == REMOVED_PACKET)
+				active[REMOVED_SUBSCRIBER] = false;
+			else if (j == SELF_SUBSCRIBER && i >= SELF_PACKET)
+				active[SELF_SUBSCRIBER] = false;
+		}
+	}
+
+	return num;
+}
+
+static bool check_sequence(unsigned int seed)
+{
+	static struct event expected[MAX_EVENTS];
+	uint8_t buffer[BUFFER_SIZE];
+	struct libswo_context *ctx;
+	size_t num_encoded;
+	size_t num_expected;
+	size_t length;
+	size_t i;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_PACKETS; i++)
+		random_packet(&packets[i]);
+
+	ret = libswo_encode_packets(buffer, sizeof(buffer), packets,
+		NUM_PACKETS, &num_encoded, &length);
+
+	if (ret != LIBSWO_OK || num_encoded != NUM_PACKETS)
+		return false;
+
+	ret = libswo_init(&ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK)
+		return false;
+
+	libswo_set_callback(ctx, &decoder_callback, NULL);
+
+	/*
+	 * The removing subscriber receives all packets such that the removal
+	 * happens on a known packet. One subscriber receives nothing.
+	 */
+	for (i = 0; i < NUM_SUBSCRIBERS && ret == LIBSWO_OK; i++) {
+		if (i == REMOVING_SUBSCRIBER) {
+			subscribers[i].filter.types = UINT32_MAX;
+			subscribers[i].filter.ports = UINT32_MAX;
+		} else if (i == NUM_SUBSCRIBERS - 1) {
+			subscribers[i].filter.types = 0;
+			subscribers[i].filter.ports = UINT32_MAX;
+		} else {
+			subscribers[i].filter.types = rng();
+			subscribers[i].filter.ports = rng();
+		}
+
+		ret = libswo_subscribe(ctx, &subscribers[i].filter,
+			&subscriber_callback, &subscribers[i],
+			&subscribers[i].id);
+
+		/* Identifiers are assigned in ascending order. */
+		if (ret == LIBSWO_OK && subscribers[i].id != i)
+			ret = LIBSWO_ERR;
+	}
+
+	num_events = 0;
+	num_packets = 0;
+	mismatch = false;
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK || num_packets != NUM_PACKETS || mismatch) {
+		fprintf(stderr, "Sequence %u: %zu packets decoded: %s.\n",
+			seed, num_packets, libswo_strerror_name(ret));
+		return false;
+	}
+
+	num_expected = expected_events(expected);
+
+	for (i = 0; i < num_events && i < num_expected; i++) {
+		if (events[i].id == expected[i].id && \
+				events[i].index == expected[i].index)
+			continue;
+
+		break;
+	}
+
+	if (i < num_events || i < num_expected) {
+		fprintf(stderr, "Sequence %u: event %zu of %zu differs.\n",
+			seed, i, num_expected);
+		return false;
+	}
+
+	return true;
+}
+
+/* Check the identifiers and the maximum number of subscribers. */
+static bool check_limits(void)
+{
+	struct libswo_context *ctx;
+	struct libswo_filter filter;
+	unsigned int id;
+	unsigned int i;
+	bool ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	filter.types = UINT32_MAX;
+	filter.ports = UINT32_MAX;
+	ret = true;
+
+	for (i = 0; i < LIBSWO_MAX_SUBSCRIBERS; i++) {
+		if (libswo_subscribe(ctx, &filter, &subscriber_callback, NULL,
+				&id) != LIBSWO_OK || id != i)
+			ret = false;
+	}
+
+	if (libswo_subscribe(ctx, &filter, &subscriber_callback, NULL,
+			&id) != LIBSWO_ERR)
+		ret = false;
+
+	/* The lowest free identifier is reused. */
+	if (libswo_unsubscribe(ctx, 3) != LIBSWO_OK || \
+			libswo_unsubscribe(ctx, 3) != LIBSWO_ERR_ARG || \
+			libswo_unsubscribe(ctx, LIBSWO_MAX_SUBSCRIBERS) != \
+			LIBSWO_ERR_ARG || \
+			libswo_subscribe(ctx, &filter, &subscriber_callback,
+			NULL, &id) != LIBSWO_OK || id != 3)
+		ret = false;
+
+	libswo_exit(ctx);
+
+	if (!ret)
+		fprintf(stderr, "Subscriber identifiers differ.\n");
+
+	return ret;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		if (!check_sequence(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_limits())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+##
+## This file is part of the libswo project.
+##
+## Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+##
+## This program is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+
+"""
+Smoke test of the Python bindings.
+
+Instrumentation packets with known values are decoded with packet callbacks,
+batch callbacks, the bulk decoders, file decoding and the asyncio
+integration. The module is imported from the build directory given by the
+SWOPY_BUILDDIR environment variable.
+"""
+
+import asyncio
+import glob
+import os
+import struct
+import sys
+import tempfile
+
+for path in glob.glob(os.path.join(os.environ['SWOPY_BUILDDIR'], 'build',
+		'lib*')):
+	sys.path.insert(0, path)
+
+import swopy
+import swopy.aio
+
+try:
+	import numpy
+except ImportError:
+	numpy = None
+
+# Number of instrumentation packets.
+NUM_PACKETS = 10000
+
+def packet_value(index):
+	return (index * 2654435761) & 0xffffffff
+
+def packet_address(index):
+	return index % 32
+
+def trace_data():
+	data = bytearray()
+
+	for i in range(NUM_PACKETS):
+		# Instrumentation packet with a payload of 4 bytes.
+		data.append((packet_address(i) << 3) | 0x03)
+		data += struct.pack('<I', packet_value(i))
+
+	return bytes(data)
+
+def check_packets(name, packets):
+	if len(packets) != NUM_PACKETS:
+		sys.exit('%s: %u packets instead of %u.' % (name, len(packets),
+			NUM_PACKETS))
+
+	for i, packet in enumerate(packets):
+		if not isinstance(packet, swopy.Instrumentation) or \
+				packet.type != swopy.PACKET_TYPE_INST or \
+				packet.address != packet_address(i) or \
+				packet.value != packet_value(i):
+			sys.exit('%s: packet %u differs: %r.' % (name, i, packet))
+
+def check_columns(name, columns):
+	if numpy is None:
+		types = list(columns['type'])
+		addresses = list(columns['address'])
+		values = list(columns['value'])
+	else:
+		if columns.dtype.names != ('type', 'timestamp', 'address',
+				'value', 'dwt'):
+			sys.exit('%s: no structured array.' % name)
+
+		types = columns['type'].tolist()
+		addresses = columns['address'].tolist()
+		values = columns['value'].tolist()
+
+	if types != [swopy.PACKET_TYPE_INST] * NUM_PACKETS or \
+			addresses != [packet_address(i) for i in range(NUM_PACKETS)] or \
+			values != [packet_value(i) for i in range(NUM_PACKETS)]:
+		sys.exit('%s: columns differ.' % name)
+
+def concatenate(batches):
+	if numpy is None:
+		return dict((name, [value for batch in batches
+			for value in batch[name]])
+			for name in ('type', 'address', 'value'))
+
+	return numpy.concatenate(batches)
+
+def check_callback(data):
+	packets = []
+	context = swopy.Context(2 * len(data))
+	context.set_callback(packets.append)
+	context.feed(data)
+	context.decode(swopy.DF_EOS)
+
+	check_packets('callback', packets)
+
+def check_batch_callback(data):
+	batches = []
+	context = swopy.Context(2 * len(data))
+	context.set_batch_callback(batches.append, 1000)
+	context.feed(data)
+	context.decode(swopy.DF_EOS)
+
+	if len(batches) != NUM_PACKETS // 1000:
+		sys.exit('%u batches delivered.' % len(batches))
+
+	check_columns('batch callback', concatenate(batches))
+
+def check_files(data):
+	context = swopy.Context(8192)
+
+	with tempfile.NamedTemporaryFile(suffix='.swo') as file:
+		file.write(data)
+		file.flush()
+
+		check_columns('decode_file_to_array()',
+			context.decode_file_to_array(file.name))
+
+		packets = []
+		context.set_callback(packets.append)
+		context.decode_path(file.name)
+		check_packets('decode_path()', packets)
+
+async def chunks(data):
+	for i in range(0, len(data), 1000):
+		yield data[i:i + 1000]
+
+async def stream_packets(data):
+	return [packet async for packet in swopy.aio.PacketStream(chunks(data),
+		chunk_size=4096)]
+
+def main():
+	data = trace_data()
+	context = swopy.Context(8192)
+
+	check_columns('decode_to_array()', context.decode_to_array(data))
+	check_columns('decode_to_array() with bytearray',
+		context.decode_to_array(bytearray(data)))
+	check_callback(data)
+	check_batch_callback(data)
+	check_files(data)
+	check_packets('PacketStream', asyncio.run(stream_packets(data)))
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,452 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <libswo/libswo.h>
+
+/*
+ * Loopback test of the TCP ingest server.
+ *
+ * The server is started with binary records. Stand-in sources send
+ * instrumentation packets with consecutive values, one client reads all
+ * records right away and another client does not read until all sources are
+ * finished. Both clients must account for every packet, either as a record
+ * or as reported lost packet, and the slow client must lose packets. The
+ * throughput with clients connected is written to the log.
+ */
+
+/* Number of stand-in sources. */
+#define NUM_SOURCES		4
+
+/* Number of packets per source. */
+#define NUM_PACKETS		200000
+
+/* Address of the packet which is used to check that clients are connected. */
+#define PROBE_ADDRESS		31
+
+/* Size of a binary record in bytes, see tools/swoserver.c. */
+#define RECORD_SIZE		8
+
+/* Record type to report lost packets. */
+#define RECORD_DROPPED		0xff
+
+/* Receive buffer size of the slow client in bytes. */
+#define SLOW_BUFFER_SIZE	4096
+
+/* Timeout in milliseconds. */
+#define TIMEOUT			30000
+
+/* Timeout for the packet which checks that clients are connected. */
+#define PROBE_TIMEOUT		500
+
+struct client {
+	int fd;
+	uint8_t buffer[64 * 1024];
+	size_t length;
+	uint64_t num_records;
+	uint64_t num_dropped;
+	uint32_t next_value[NUM_SOURCES];
+	bool probed;
+	bool valid;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t get_le32(const uint8_t *buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | \
+		((uint32_t)buffer[3] << 24);
+}
+
+static int get_free_port(void)
+{
+	struct sockaddr_in addr;
+	socklen_t length;
+	int port;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	length = sizeof(addr);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || \
+			getsockname(fd, (struct sockaddr *)&addr, &length) < 0)
+		port = -1;
+	else
+		port = ntohs(addr.sin_port);
+
+	close(fd);
+
+	return port;
+}
+
+/* Connect to the server, which may not be listening yet. */
+static int connect_server(int port, int buffer_size)
+{
+	const struct timespec delay = {0, 50000000};
+	struct sockaddr_in addr;
+	unsigned int i;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	for (i = 0; i < 100; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (fd < 0)
+			return -1;
+
+		if (buffer_size > 0)
+			setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size,
+				sizeof(buffer_size));
+
+		if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			return fd;
+
+		close(fd);
+		nanosleep(&delay, NULL);
+	}
+
+	return -1;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t length)
+{
+	ssize_t ret;
+
+	while (length > 0) {
+		ret = write(fd, data, length);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return false;
+
+		data += ret;
+		length -= ret;
+	}
+
+	return true;
+}
+
+/* Send instrumentation packets with consecutive values. */
+static bool send_packets(int port, uint8_t address, uint32_t num_packets)
+{
+	uint8_t buffer[4096];
+	union libswo_packet packet;
+	size_t length;
+	size_t tmp;
+	uint32_t i;
+	bool ret;
+	int fd;
+
+	fd = connect_server(port, 0);
+
+	if (fd < 0)
+		return false;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = LIBSWO_PACKET_TYPE_INST;
+	packet.inst.address = address;
+	length = 0;
+	ret = true;
+
+	for (i = 0; i < num_packets && ret; i++) {
+		packet.inst.value = i;
+
+		if (libswo_encode_packet(buffer + length,
+				sizeof(buffer) - length, &packet, &tmp) != \
+				LIBSWO_OK) {
+			ret = write_all(fd, buffer, length);
+			length = 0;
+			i--;
+			continue;
+		}
+
+		length += tmp;
+	}
+
+	if (ret)
+		ret = write_all(fd, buffer, length);
+
+	close(fd);
+
+	return ret;
+}
+
+static void handle_record(struct client *client, const uint8_t *record)
+{
+	uint32_t value;
+	uint8_t address;
+
+	value = get_le32(record + 4);
+
+	if (record[1] == RECORD_DROPPED) {
+		client->num_dropped += value;
+		return;
+	}
+
+	address = record[3];
+
+	if (record[1] != LIBSWO_PACKET_TYPE_INST) {
+		client->valid = false;
+		return;
+	}
+
+	if (address == PROBE_ADDRESS) {
+		client->probed = true;
+		return;
+	}
+
+	/* Packets may be lost but never reordered or duplicated. */
+	if (address >= NUM_SOURCES || value < client->next_value[address]) {
+		client->valid = false;
+		return;
+	}
+
+	client->next_value[address] = value + 1;
+	client->num_records++;
+}
+
+/*
+ * Read the pending records of a client. Returns false if the connection was
+ * closed.
+ */
+static bool read_records(struct client *client)
+{
+	ssize_t ret;
+	size_t i;
+
+	ret = read(client->fd, client->buffer + client->length,
+		sizeof(client->buffer) - client->length);
+
+	if (ret < 0 && errno == EINTR)
+		return true;
+
+	if (ret <= 0)
+		return false;
+
+	client->length += ret;
+
+	for (i = 0; i + RECORD_SIZE <= client->length; i += RECORD_SIZE)
+		handle_record(client, client->buffer + i);
+
+	client->length -= i;
+	memmove(client->buffer, client->buffer + i, client->length);
+
+	return true;
+}
+
+static bool is_complete(const struct client *client)
+{
+	return client->num_records + client->num_dropped >= \
+		(uint64_t)NUM_SOURCES * NUM_PACKETS;
+}
+
+/* Read the records of a client until the given condition is met. */
+static bool wait_client(struct client *client,
+		bool (*done)(const struct client *client), uint64_t timeout)
+{
+	struct pollfd pfd;
+	uint64_t deadline;
+
+	deadline = get_time() + timeout;
+
+	while (!done(client)) {
+		if (get_time() > deadline)
+			return false;
+
+		pfd.fd = client->fd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		if (!read_records(client))
+			return false;
+	}
+
+	return true;
+}
+
+static bool is_probed(const struct client *client)
+{
+	return client->probed;
+}
+
+static void init_client(struct client *client, int fd)
+{
+	memset(client, 0, sizeof(*client));
+	client->fd = fd;
+	client->valid = true;
+}
+
+static bool check_client(const struct client *client, const char *name,
+		bool complete)
+{
+	fprintf(stderr, "%s client: %llu packets received, %llu packets "
+		"dropped.\n", name, (unsigned long long)client->num_records,
+		(unsigned long long)client->num_dropped);
+
+	if (!complete || !client->valid || \
+			client->num_records + client->num_dropped != \
+			(uint64_t)NUM_SOURCES * NUM_PACKETS) {
+		fprintf(stderr, "%s client: packets not accounted for.\n",
+			name);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	static struct client fast;
+	static struct client slow;
+	char source_address[32];
+	char client_address[32];
+	pid_t sources[NUM_SOURCES];
+	pid_t server;
+	uint64_t start;
+	uint64_t elapsed;
+	unsigned int i;
+	int source_port;
+	int client_port;
+	int status;
+	bool complete;
+	bool ok;
+
+	source_port = get_free_port();
+	client_port = get_free_port();
+
+	if (source_port < 0 || client_port < 0)
+		return EXIT_FAILURE;
+
+	snprintf(source_address, sizeof(source_address), "127.0.0.1:%d",
+		source_port);
+	snprintf(client_address, sizeof(client_address), "127.0.0.1:%d",
+		client_port);
+
+	server = fork();
+
+	if (server < 0)
+		return EXIT_FAILURE;
+
+	if (!server) {
+		execl(SWOSERVER, SWOSERVER, "-b", "-l", source_address, "-p",
+			client_address, (char *)NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	ok = false;
+	init_client(&fast, connect_server(client_port, 0));
+	init_client(&slow, connect_server(client_port, SLOW_BUFFER_SIZE));
+
+	if (fast.fd < 0 || slow.fd < 0)
+		goto out;
+
+	/* Wait until the server sends packets to both clients. */
+	for (i = 0; !fast.probed || !slow.probed; i++) {
+		if (i * PROBE_TIMEOUT > TIMEOUT || \
+				!send_packets(source_port, PROBE_ADDRESS, 1))
+			goto out;
+
+		wait_client(&fast, &is_probed, PROBE_TIMEOUT);
+		wait_client(&slow, &is_probed, PROBE_TIMEOUT);
+	}
+
+	start = get_time();
+
+	for (i = 0; i < NUM_SOURCES; i++) {
+		sources[i] = fork();
+
+		if (!sources[i])
+			_exit(send_packets(source_port, i, NUM_PACKETS) ? \
+				EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	complete = wait_client(&fast, &is_complete, TIMEOUT);
+	elapsed = get_time() - start;
+	ok = true;
+
+	for (i = 0; i < NUM_SOURCES; i++) {
+		if (sources[i] < 0 || waitpid(sources[i], &status, 0) < 0 || \
+				!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "Source %u failed.\n", i);
+			ok = false;
+		}
+	}
+
+	fprintf(stderr, "%u packets in %llu ms with clients connected.\n",
+		NUM_SOURCES * NUM_PACKETS, (unsigned long long)elapsed);
+
+	ok &= check_client(&fast, "Fast", complete);
+	ok &= check_client(&slow, "Slow", wait_client(&slow, &is_complete,
+		TIMEOUT));
+
+	if (!slow.num_dropped) {
+		fprintf(stderr, "Slow client did not lose packets.\n");
+		ok = false;
+	}
+
+out:
+	if (fast.fd >= 0)
+		close(fast.fd);
+
+	if (slow.fd >= 0)
+		close(slow.fd);
+
+	kill(server, SIGTERM);
+	waitpid(server, &status, 0);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSWO_TESTS_TEST_H
+#define LIBSWO_TESTS_TEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libswo/libswo.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--- rng.c -----------------------------------------------------------------*/
+
+void rng_seed(uint32_t seed);
+uint32_t rng(void);
+
+/*--- packet.c --------------------------------------------------------------*/
+
+void random_packet(union libswo_packet *packet);
+bool packet_fields_equal(const union libswo_packet *a,
+		const union libswo_packet *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBSWO_TESTS_TEST_H */
@@ -0,0 +1,440 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of the TPIU deframer with synthetic formatter output.
+ *
+ * Random trace data of multiple trace sources is packed into formatter frames
+ * with immediate and delayed ID changes, and frame synchronization packets
+ * between the frames. The formatter output is fed in chunks of random size
+ * and the trace data of each source must be recovered exactly.
+ */
+
+/* Size of a formatter frame in bytes. */
+#define FRAME_SIZE		16
+
+/* Number of random formatter streams. */
+#define NUM_STREAMS		200
+
+/* Maximum number of trace data bytes per stream. */
+#define MAX_DATA_SIZE		8192
+
+/* Trace source IDs used by the test. ID 0 is used for padding. */
+#define NUM_IDS			4
+
+/* Size of the formatter output buffer in bytes. */
+#define OUTPUT_SIZE		(256 * 1024)
+
+/* Number of instrumentation packets for the context test. */
+#define NUM_PACKETS		16384
+
+/* Buffer size of the contexts for the context test in bytes. */
+#define CONTEXT_BUFFER_SIZE	1024
+
+struct item {
+	uint8_t id;
+	uint8_t data;
+};
+
+struct source {
+	uint8_t data[MAX_DATA_SIZE];
+	size_t length;
+};
+
+struct formatter {
+	uint8_t *output;
+	size_t length;
+	uint8_t id;
+	unsigned int id_changes;
+	unsigned int delayed_id_changes;
+	unsigned int syncs;
+};
+
+static const uint8_t ids[NUM_IDS] = {0x01, 0x02, 0x35, LIBSWO_TPIU_MAX_ID};
+
+static void put_sync(struct formatter *formatter)
+{
+	static const uint8_t sync[] = {0xff, 0xff, 0xff, 0x7f};
+
+	memcpy(formatter->output + formatter->length, sync, sizeof(sync));
+	formatter->length += sizeof(sync);
+	formatter->syncs++;
+}
+
+/*
+ * Pack the given trace data into formatter frames. Returns the number of items
+ * which were packed into the frame. Items with ID 0 are padding.
+ */
+static size_t put_frame(struct formatter *formatter, const struct item *items,
+		size_t num_items)
+{
+	uint8_t frame[FRAME_SIZE];
+	struct item padding;
+	const struct item *a;
+	const struct item *b;
+	unsigned int i;
+	size_t n;
+
+	padding.id = 0;
+	padding.data = 0;
+
+	memset(frame, 0, sizeof(frame));
+	n = 0;
+
+	for (i = 0; i < FRAME_SIZE / 2; i++) {
+		a = (n < num_items) ? &items[n] : &padding;
+		b = (n + 1 < num_items) ? &items[n + 1] : &padding;
+
+		/* No data byte follows the last byte at an even position. */
+		if (i == FRAME_SIZE / 2 - 1) {
+			if (a->id != formatter->id) {
+				frame[2 * i] = (a->id << 1) | 0x01;
+				formatter->id = a->id;
+				formatter->id_changes++;
+				break;
+			}
+
+			frame[2 * i] = a->data & 0xfe;
+			frame[FRAME_SIZE - 1] |= (a->data & 0x01) << i;
+			n += (a != &padding);
+			break;
+		}
+
+		if (a->id != formatter->id) {
+			/* The new ID takes effect immediately. */
+			frame[2 * i] = (a->id << 1) | 0x01;
+			frame[2 * i + 1] = a->data;
+			formatter->id = a->id;
+			formatter->id_changes++;
+			n += (a != &padding);
+		} else if (b->id != formatter->id) {
+			/* The new ID takes effect after the next data byte. */
+			frame[2 * i] = (b->id << 1) | 0x01;
+			frame[2 * i + 1] = a->data;
+			frame[FRAME_SIZE - 1] |= 1 << i;
+			formatter->id = b->id;
+			formatter->delayed_id_changes++;
+			n += (a != &padding);
+		} else {
+			frame[2 * i] = a->data & 0xfe;
+			frame[2 * i + 1] = b->data;
+			frame[FRAME_SIZE - 1] |= (a->data & 0x01) << i;
+			n += (a != &padding) + (b != &padding);
+		}
+	}
+
+	memcpy(formatter->output + formatter->length, frame, FRAME_SIZE);
+	formatter->length += FRAME_SIZE;
+
+	return n;
+}
+
+static void format(struct formatter *formatter, const struct item *items,
+		size_t num_items)
+{
+	size_t n;
+
+	/* Trace data before the first synchronization is discarded. */
+	memset(formatter->output, 0x00, 3);
+	formatter->length = 3;
+	formatter->id = 0;
+	put_sync(formatter);
+
+	while (num_items > 0) {
+		if (!(rng() % 8))
+			put_sync(formatter);
+
+		n = put_frame(formatter, items, num_items);
+		items += n;
+		num_items -= n;
+	}
+}
+
+static int source_sink(struct libswo_tpiu *tpiu, uint8_t id,
+		const uint8_t *data, size_t length, void *user_data)
+{
+	struct source *source;
+
+	(void)tpiu;
+	(void)id;
+
+	source = (struct source *)user_data;
+
+	if (source->length + length > MAX_DATA_SIZE)
+		return LIBSWO_ERR;
+
+	memcpy(source->data + source->length, data, length);
+	source->length += length;
+
+	return LIBSWO_OK;
+}
+
+/* Feed the formatter output in chunks of random size. */
+static int feed(struct libswo_tpiu *tpiu, const uint8_t *output,
+		size_t length)
+{
+	static const size_t max_sizes[] = {1, 3, 16, 17, 256, OUTPUT_SIZE};
+	size_t max_size;
+	size_t tmp;
+	int ret;
+
+	max_size = max_sizes[rng() % (sizeof(max_sizes) / \
+		sizeof(max_sizes[0]))];
+
+	while (length > 0) {
+		tmp = 1 + rng() % max_size;
+		tmp = (tmp < length) ? tmp : length;
+
+		ret = libswo_tpiu_feed(tpiu, output, tmp);
+
+		if (ret != LIBSWO_OK)
+			return ret;
+
+		output += tmp;
+		length -= tmp;
+	}
+
+	return LIBSWO_OK;
+}
+
+static bool check_stream(unsigned int seed, struct formatter *formatter)
+{
+	static struct item items[MAX_DATA_SIZE];
+	static struct source expected[NUM_IDS];
+	static struct source sources[NUM_IDS];
+	struct libswo_tpiu *tpiu;
+	struct source *source;
+	size_t num_items;
+	unsigned int index;
+	size_t i;
+	int ret;
+
+	rng_seed(seed);
+
+	for (i = 0; i < NUM_IDS; i++) {
+		expected[i].length = 0;
+		sources[i].length = 0;
+	}
+
+	num_items = rng() % MAX_DATA_SIZE;
+	index = rng() % NUM_IDS;
+
+	for (i = 0; i < num_items; i++) {
+		/* Change the trace source from time to time. */
+		if (!(rng() % 8))
+			index = rng() % NUM_IDS;
+
+		items[i].id = ids[index];
+		items[i].data = rng();
+
+		source = &expected[index];
+		source->data[source->length++] = items[i].data;
+	}
+
+	format(formatter, items, num_items);
+
+	if (libswo_tpiu_init(&tpiu) != LIBSWO_OK)
+		return false;
+
+	for (i = 0; i < NUM_IDS; i++)
+		libswo_tpiu_set_sink(tpiu, ids[i], &source_sink, &sources[i]);
+
+	ret = feed(tpiu, formatter->output, formatter->length);
+	libswo_tpiu_exit(tpiu);
+
+	if (ret != LIBSWO_OK) {
+		fprintf(stderr, "Stream %u: feeding failed: %s.\n", seed,
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	for (i = 0; i < NUM_IDS; i++) {
+		if (sources[i].length == expected[i].length && \
+				!memcmp(sources[i].data, expected[i].data,
+				expected[i].length))
+			continue;
+
+		fprintf(stderr, "Stream %u: trace data of ID %02x differs.\n",
+			seed, ids[i]);
+		return false;
+	}
+
+	return true;
+}
+
+struct packets {
+	uint32_t address;
+	size_t num_packets;
+	bool valid;
+};
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct packets *packets;
+
+	(void)ctx;
+
+	packets = (struct packets *)user_data;
+
+	if (packet->type != LIBSWO_PACKET_TYPE_INST || \
+			packet->inst.address != packets->address || \
+			packet->inst.value != packets->num_packets)
+		packets->valid = false;
+
+	packets->num_packets++;
+
+	return true;
+}
+
+/*
+ * Check that libswo_tpiu_set_context() decodes the trace data right away such
+ * that the formatter output may be much larger than the buffer of the
+ * contexts.
+ */
+static bool check_context(struct formatter *formatter)
+{
+	static struct item items[2 * NUM_PACKETS * 5];
+	struct libswo_context *ctx[2];
+	struct packets packets[2];
+	union libswo_packet packet;
+	struct libswo_tpiu *tpiu;
+	uint8_t buffer[5];
+	size_t num_items;
+	size_t length;
+	size_t i;
+	size_t j;
+	size_t k;
+	int ret;
+
+	rng_seed(1);
+	num_items = 0;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = LIBSWO_PACKET_TYPE_INST;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		for (j = 0; j < 2; j++) {
+			packet.inst.address = j;
+			packet.inst.value = i;
+			packet.inst.size = 0;
+
+			ret = libswo_encode_packet(buffer, sizeof(buffer),
+				&packet, &length);
+
+			if (ret != LIBSWO_OK)
+				return false;
+
+			for (k = 0; k < length; k++) {
+				items[num_items].id = ids[j];
+				items[num_items++].data = buffer[k];
+			}
+		}
+	}
+
+	format(formatter, items, num_items);
+
+	if (formatter->length < 64 * 1024) {
+		fprintf(stderr, "Formatter output too small.\n");
+		return false;
+	}
+
+	if (libswo_tpiu_init(&tpiu) != LIBSWO_OK)
+		return false;
+
+	for (i = 0; i < 2; i++) {
+		if (libswo_init(&ctx[i], NULL, CONTEXT_BUFFER_SIZE) != \
+				LIBSWO_OK)
+			return false;
+
+		packets[i].address = i;
+		packets[i].num_packets = 0;
+		packets[i].valid = true;
+
+		libswo_set_callback(ctx[i], &packet_callback, &packets[i]);
+		libswo_tpiu_set_context(tpiu, ids[i], ctx[i]);
+	}
+
+	/* Feed all formatter output at once. */
+	ret = libswo_tpiu_feed(tpiu, formatter->output, formatter->length);
+
+	for (i = 0; i < 2; i++) {
+		if (ret == LIBSWO_OK)
+			ret = libswo_decode(ctx[i], LIBSWO_DF_EOS);
+
+		libswo_exit(ctx[i]);
+	}
+
+	libswo_tpiu_exit(tpiu);
+
+	if (ret != LIBSWO_OK) {
+		fprintf(stderr, "Context: decoding failed: %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (packets[i].valid && packets[i].num_packets == NUM_PACKETS)
+			continue;
+
+		fprintf(stderr, "Context: %zu packets of ID %02x decoded.\n",
+			packets[i].num_packets, ids[i]);
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	static uint8_t output[OUTPUT_SIZE];
+	struct formatter formatter;
+	unsigned int i;
+
+	formatter.output = output;
+	formatter.id_changes = 0;
+	formatter.delayed_id_changes = 0;
+	formatter.syncs = 0;
+
+	for (i = 1; i <= NUM_STREAMS; i++) {
+		if (!check_stream(i, &formatter))
+			return EXIT_FAILURE;
+	}
+
+	if (!formatter.id_changes || !formatter.delayed_id_changes || \
+			!formatter.syncs) {
+		fprintf(stderr, "Not all frame types were generated.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!check_context(&formatter))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
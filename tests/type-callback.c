@@ -0,0 +1,489 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libswo/libswo.h>
+
+#include "test.h"
+
+/*
+ * Test of the callback functions of packet types.
+ *
+ * Random packets are encoded and decoded with callback functions for some
+ * packet types. Packets of these types must be passed to the callback
+ * function of their type instead of the decoder callback function, also if
+ * the callback function of their type stops decoding. Packets which are not
+ * passed to any callback function are skipped without copying their raw data
+ * and must not disturb the decoding of the other packets.
+ */
+
+/* Number of random packet sequences. */
+#define NUM_SEQUENCES		20
+
+/* Number of packets per sequence. */
+#define NUM_PACKETS		1024
+
+/* Size of the buffer for the encoded packets in bytes. */
+#define BUFFER_SIZE		(NUM_PACKETS * 16)
+
+/* Stop decoding on every Nth instrumentation packet. */
+#define STOP_INTERVAL		3
+
+/* Callback functions which are logged. */
+enum callback {
+	CALLBACK_DECODER,
+	CALLBACK_INST,
+	CALLBACK_HW,
+	CALLBACK_SUBSCRIBER
+};
+
+struct event {
+	enum callback callback;
+	/* Index of the packet. */
+	size_t index;
+};
+
+static union libswo_packet packets[NUM_PACKETS];
+/* Stream position of the end of each packet. */
+static size_t ends[NUM_PACKETS];
+static uint8_t buffer[BUFFER_SIZE];
+static size_t length;
+
+static struct event events[NUM_PACKETS];
+static size_t num_events;
+/* Index of the next packet which is expected to be passed on. */
+static size_t next_index;
+/* Packet types which are passed to a callback function. */
+static uint32_t wanted_types;
+static bool mismatch;
+static unsigned int num_inst;
+
+/*
+ * Log a packet and check that it matches the next original packet which is
+ * passed to a callback function, including its raw data.
+ */
+static int log_event(enum callback callback,
+		const union libswo_packet *packet)
+{
+	size_t index;
+	size_t start;
+
+	index = next_index;
+
+	while (index < NUM_PACKETS && !(wanted_types & \
+			LIBSWO_PACKET_TYPE_MASK(packets[index].type)))
+		index++;
+
+	if (index == NUM_PACKETS || num_events == NUM_PACKETS)
+		return LIBSWO_ERR;
+
+	start = index ? ends[index - 1] : 0;
+
+	if (packet->type != packets[index].type || \
+			!packet_fields_equal(packet, &packets[index]) || \
+			(packet->type != LIBSWO_PACKET_TYPE_SYNC && \
+			(packet->any.size != ends[index] - start || \
+			memcmp(packet->any.data, buffer + start,
+			packet->any.size))))
+		mismatch = true;
+
+	events[num_events].callback = callback;
+	events[num_events].index = index;
+	num_events++;
+	next_index = index + 1;
+
+	return true;
+}
+
+static int decoder_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	return log_event(CALLBACK_DECODER, packet);
+}
+
+static int inst_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	int ret;
+
+	(void)ctx;
+
+	ret = log_event(CALLBACK_INST, packet);
+
+	/* Stop decoding on every Nth packet if requested. */
+	if (ret > 0 && user_data && !(++num_inst % STOP_INTERVAL))
+		return false;
+
+	return ret;
+}
+
+static int hw_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	return log_event(CALLBACK_HW, packet);
+}
+
+static int subscriber_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)user_data;
+
+	return log_event(CALLBACK_SUBSCRIBER, packet);
+}
+
+static int error_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	(void)ctx;
+	(void)packet;
+	(void)user_data;
+
+	return LIBSWO_ERR_ARG;
+}
+
+static void encode(unsigned int seed)
+{
+	size_t tmp;
+	size_t i;
+
+	rng_seed(seed);
+	length = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		random_packet(&packets[i]);
+		libswo_encode_packets(buffer + length, sizeof(buffer) - length,
+			&packets[i], 1, &tmp, &tmp);
+		length += tmp;
+		ends[i] = length;
+	}
+}
+
+static void reset_events(uint32_t types)
+{
+	num_events = 0;
+	next_index = 0;
+	wanted_types = types;
+	mismatch = false;
+	num_inst = 0;
+}
+
+/* Check that each wanted packet was passed to the given callback function. */
+static bool check_events(const char *name, unsigned int seed,
+		enum callback inst, enum callback hw, enum callback other)
+{
+	size_t num_expected;
+	size_t i;
+	enum callback callback;
+
+	num_expected = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (wanted_types & LIBSWO_PACKET_TYPE_MASK(packets[i].type))
+			num_expected++;
+	}
+
+	if (mismatch || num_events != num_expected) {
+		fprintf(stderr, "%s: sequence %u: %zu of %zu packets passed "
+			"on.\n", name, seed, num_events, num_expected);
+		return false;
+	}
+
+	for (i = 0; i < num_events; i++) {
+		if (packets[events[i].index].type == LIBSWO_PACKET_TYPE_INST)
+			callback = inst;
+		else if (packets[events[i].index].type == \
+				LIBSWO_PACKET_TYPE_HW)
+			callback = hw;
+		else
+			callback = other;
+
+		if (events[i].callback == callback)
+			continue;
+
+		fprintf(stderr, "%s: sequence %u: packet %zu passed to the "
+			"wrong callback function.\n", name, seed,
+			events[i].index);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check that the callback functions of packet types take precedence over the
+ * decoder callback function until they are removed.
+ */
+static bool check_precedence(unsigned int seed)
+{
+	struct libswo_context *ctx;
+	int ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	reset_events(UINT32_MAX);
+
+	libswo_set_callback(ctx, &decoder_callback, NULL);
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_INST, &inst_callback,
+		NULL);
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_HW, &hw_callback,
+		NULL);
+
+	ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	if (ret != LIBSWO_OK || !check_events("Precedence", seed,
+			CALLBACK_INST, CALLBACK_HW, CALLBACK_DECODER)) {
+		libswo_exit(ctx);
+		return false;
+	}
+
+	/* Packets are passed to the decoder callback function again. */
+	reset_events(UINT32_MAX);
+
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_INST, NULL, NULL);
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_HW, NULL, NULL);
+
+	ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	return ret == LIBSWO_OK && check_events("Removal", seed,
+		CALLBACK_DECODER, CALLBACK_DECODER, CALLBACK_DECODER);
+}
+
+/*
+ * Check that a callback function of a packet type stops decoding right after
+ * its packet and decoding is resumed with the next packet.
+ */
+static bool check_stop(unsigned int seed)
+{
+	struct libswo_context *ctx;
+	size_t num_events_old;
+	unsigned int num_stops;
+	int ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	reset_events(UINT32_MAX);
+
+	libswo_set_callback(ctx, &decoder_callback, NULL);
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_INST, &inst_callback,
+		&num_inst);
+
+	ret = libswo_feed(ctx, buffer, length);
+	num_stops = 0;
+
+	while (ret == LIBSWO_OK) {
+		num_events_old = num_events;
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+		if (ret != LIBSWO_OK || num_events == num_events_old)
+			break;
+
+		/*
+		 * Decoding is stopped right after an instrumentation packet or
+		 * ends with the last packet.
+		 */
+		if (events[num_events - 1].callback == CALLBACK_INST && \
+				!(num_inst % STOP_INTERVAL)) {
+			num_stops++;
+		} else if (num_events < NUM_PACKETS) {
+			fprintf(stderr, "Stop: sequence %u: decoding not "
+				"stopped by packet %zu.\n", seed,
+				events[num_events - 1].index);
+			libswo_exit(ctx);
+			return false;
+		}
+	}
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK || num_stops != num_inst / STOP_INTERVAL) {
+		fprintf(stderr, "Stop: sequence %u: decoding stopped %u times "
+			"for %u packets: %s.\n", seed, num_stops, num_inst,
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	return check_events("Stop", seed, CALLBACK_INST, CALLBACK_DECODER,
+		CALLBACK_DECODER);
+}
+
+/*
+ * Check that only instrumentation and hardware source packets are copied if
+ * they are the only packets passed to a callback function or a subscriber.
+ */
+static bool check_skip(unsigned int seed)
+{
+	struct libswo_context *ctx;
+	struct libswo_filter filter;
+	struct libswo_stats stats;
+	unsigned int id;
+	bool stats_enabled;
+	uint64_t num_copies;
+	size_t i;
+	int ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	reset_events(LIBSWO_PACKET_TYPE_MASK(LIBSWO_PACKET_TYPE_INST) | \
+		LIBSWO_PACKET_TYPE_MASK(LIBSWO_PACKET_TYPE_HW));
+
+	filter.types = LIBSWO_PACKET_TYPE_MASK(LIBSWO_PACKET_TYPE_HW);
+	filter.ports = 0;
+
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_INST, &inst_callback,
+		NULL);
+	ret = libswo_subscribe(ctx, &filter, &subscriber_callback, NULL, &id);
+
+	/* Decoder statistics are not available in all builds. */
+	stats_enabled = libswo_stats_enable(ctx, true) == LIBSWO_OK;
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_feed(ctx, buffer, length);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_stats_get(ctx, &stats);
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_OK || !check_events("Skip", seed, CALLBACK_INST,
+			CALLBACK_SUBSCRIBER, CALLBACK_DECODER))
+		return false;
+
+	if (!stats_enabled)
+		return true;
+
+	num_copies = 0;
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (packets[i].type == LIBSWO_PACKET_TYPE_INST || \
+				packets[i].type == LIBSWO_PACKET_TYPE_HW)
+			num_copies++;
+	}
+
+	if (stats.stages[LIBSWO_STATS_STAGE_COPY].calls != num_copies) {
+		fprintf(stderr, "Skip: sequence %u: %llu packets copied "
+			"instead of %llu.\n", seed, (unsigned long long)
+			stats.stages[LIBSWO_STATS_STAGE_COPY].calls,
+			(unsigned long long)num_copies);
+		return false;
+	}
+
+	return true;
+}
+
+static bool check_arguments(void)
+{
+	struct libswo_context *ctx;
+	bool ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	ret = libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_HW + 1,
+		&hw_callback, NULL) == LIBSWO_ERR_ARG && \
+		libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_USER - 1,
+		&hw_callback, NULL) == LIBSWO_ERR_ARG && \
+		libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_USER_MAX + 1,
+		&hw_callback, NULL) == LIBSWO_ERR_ARG && \
+		libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_USER_MAX,
+		&hw_callback, NULL) == LIBSWO_OK;
+
+	libswo_exit(ctx);
+
+	if (!ret)
+		fprintf(stderr, "Invalid packet types accepted.\n");
+
+	return ret;
+}
+
+/* Check that an error of a callback function of a packet type is reported. */
+static bool check_error(void)
+{
+	struct libswo_context *ctx;
+	union libswo_packet packet;
+	uint8_t data[8];
+	size_t tmp;
+	int ret;
+
+	if (libswo_init(&ctx, NULL, BUFFER_SIZE) != LIBSWO_OK)
+		return false;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = LIBSWO_PACKET_TYPE_INST;
+	packet.inst.size = 2;
+	libswo_encode_packets(data, sizeof(data), &packet, 1, &tmp, &tmp);
+
+	libswo_set_callback(ctx, &decoder_callback, NULL);
+	libswo_set_type_callback(ctx, LIBSWO_PACKET_TYPE_INST, &error_callback,
+		NULL);
+	ret = libswo_feed(ctx, data, tmp);
+
+	if (ret == LIBSWO_OK)
+		ret = libswo_decode(ctx, LIBSWO_DF_EOS);
+
+	libswo_exit(ctx);
+
+	if (ret != LIBSWO_ERR) {
+		fprintf(stderr, "Error: decoding returned %s.\n",
+			libswo_strerror_name(ret));
+		return false;
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 1; i <= NUM_SEQUENCES; i++) {
+		encode(i);
+
+		if (!check_precedence(i) || !check_stop(i) || !check_skip(i))
+			return EXIT_FAILURE;
+	}
+
+	if (!check_arguments() || !check_error())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1133 @@
+/*
+ * This file is part of the libswo project.
+ *
+ * Copyright (C) 2016 Marc Schink <swo-dev@marcschink.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <libswo/libswo.h>
+
+/**
+ * @file
+ *
+ * TCP ingest server.
+ *
+ * The server receives raw SWO trace data from any number of upstream TCP
+ * sources, for example the SWO ports of debug servers, decodes each source
+ * with its own libswo context and sends the decoded packets to all connected
+ * clients, either as text lines or as binary records. Each packet is only
+ * formatted once for all clients. The memory usage is bounded by the number
+ * of sources and clients. Clients which do not keep up lose packets instead
+ * of slowing down the sources. The number of lost packets is reported to the
+ * client as soon as there is space in its buffer again.
+ *
+ * Each text line starts with the number of the source, followed by the packet
+ * type and its fields. Lost packets are reported with a line of the form
+ * "dropped count=N".
+ *
+ * A binary record is RECORD_SIZE bytes long:
+ *
+ *   Offset  Size  Description
+ *   0       1     Number of the source
+ *   1       1     Packet type, or RECORD_DROPPED
+ *   2       1     Packet size in bytes, or 0 for synchronization packets
+ *   3       1     Packet type specific field, see format_record()
+ *   4       4     Packet type specific value in little-endian byte order
+ *
+ * For RECORD_DROPPED, the value is the number of lost packets.
+ */
+
+/* Maximum number of upstream sources. */
+#define MAX_SOURCES		256
+
+/* Maximum number of clients. */
+#define MAX_CLIENTS		64
+
+/* Size of the decoder buffer of a source in bytes. */
+#define BUFFER_SIZE		(64 * 1024)
+
+/* Maximum number of bytes read from a source at once. */
+#define READ_SIZE		(BUFFER_SIZE / 2)
+
+/* Size of the output buffer of a client in bytes. */
+#define CLIENT_BUFFER_SIZE	(256 * 1024)
+
+/* Maximum length of a packet line in bytes. */
+#define LINE_SIZE		128
+
+/* Size of a binary record in bytes. */
+#define RECORD_SIZE		8
+
+/* Record type to report lost packets. */
+#define RECORD_DROPPED		0xff
+
+/* Maximum number of events handled at once. */
+#define MAX_EVENTS		64
+
+/* Interval between reconnection attempts in milliseconds. */
+#define RECONNECT_INTERVAL	1000
+
+/* Default client port. */
+#define DEFAULT_CLIENT_PORT	"4242"
+
+/* Default host to listen on. */
+#define DEFAULT_HOST		"127.0.0.1"
+
+enum event_kind {
+	EVENT_SOURCE_LISTEN,
+	EVENT_CLIENT_LISTEN,
+	EVENT_SOURCE,
+	EVENT_CLIENT
+};
+
+struct source {
+	/* Socket, or -1 if the slot is unused or not connected. */
+	int fd;
+	/* Indicates whether the slot is in use. */
+	bool used;
+	/* Host and port to connect to, or NULL for accepted sources. */
+	char *host;
+	char *port;
+	/* Indicates whether a non-blocking connect is in progress. */
+	bool connecting;
+	/* Time of the next connection attempt in milliseconds. */
+	uint64_t retry_time;
+	struct libswo_context *ctx;
+	uint64_t num_bytes;
+};
+
+struct client {
+	/* Socket, or -1 if the slot is unused. */
+	int fd;
+	/* Indicates whether the socket is polled for writing. */
+	bool polling_out;
+	uint8_t *buffer;
+	/* Offset and number of pending bytes in the buffer. */
+	size_t start;
+	size_t length;
+	uint64_t num_dropped;
+	/* Number of lost packets which were not reported to the client yet. */
+	uint64_t num_unreported;
+};
+
+struct server {
+	int epoll_fd;
+	int source_listen_fd;
+	int client_listen_fd;
+	struct source sources[MAX_SOURCES];
+	struct client clients[MAX_CLIENTS];
+	unsigned int num_clients;
+	/* Indicates whether packets are sent as binary records. */
+	bool binary;
+	/* Number of the source which is currently decoded. */
+	unsigned int current;
+	uint8_t read_buffer[READ_SIZE];
+};
+
+static volatile sig_atomic_t terminate;
+
+static void signal_handler(int signum)
+{
+	(void)signum;
+
+	terminate = 1;
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t event_data(enum event_kind kind, unsigned int index)
+{
+	return ((uint64_t)kind << 32) | index;
+}
+
+static int set_nonblocking(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0)
+		return -1;
+
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*
+ * Split an address of the form [host:]port. The host defaults to the
+ * loopback address.
+ */
+static bool parse_address(char *address, char **host, char **port)
+{
+	char *tmp;
+
+	tmp = strrchr(address, ':');
+
+	if (!tmp) {
+		*host = DEFAULT_HOST;
+		*port = address;
+	} else {
+		*tmp = '\0';
+		*host = address;
+		*port = tmp + 1;
+	}
+
+	return **host != '\0' && **port != '\0';
+}
+
+static int create_listener(const char *host, const char *port)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *ai;
+	int fd;
+	int ret;
+	int opt;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	ret = getaddrinfo(host, port, &hints, &res);
+
+	if (ret) {
+		fprintf(stderr, "Failed to resolve %s:%s: %s.\n", host, port,
+			gai_strerror(ret));
+		return -1;
+	}
+
+	fd = -1;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+		if (fd < 0)
+			continue;
+
+		opt = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+		if (!bind(fd, ai->ai_addr, ai->ai_addrlen) && \
+				!listen(fd, SOMAXCONN) && !set_nonblocking(fd))
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd < 0)
+		fprintf(stderr, "Failed to listen on %s:%s: %s.\n", host, port,
+			strerror(errno));
+
+	return fd;
+}
+
+static int format_packet(char *line, unsigned int source,
+		const union libswo_packet *packet)
+{
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_SYNC:
+		return snprintf(line, LINE_SIZE, "%u sync size=%zu\n", source,
+			packet->sync.size);
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+		return snprintf(line, LINE_SIZE, "%u overflow\n", source);
+	case LIBSWO_PACKET_TYPE_LTS:
+		return snprintf(line, LINE_SIZE, "%u lts relation=%u value=%u\n",
+			source, packet->lts.relation, packet->lts.value);
+	case LIBSWO_PACKET_TYPE_GTS1:
+		return snprintf(line, LINE_SIZE,
+			"%u gts1 value=%u clkch=%u wrap=%u\n", source,
+			packet->gts1.value, packet->gts1.clkch,
+			packet->gts1.wrap);
+	case LIBSWO_PACKET_TYPE_GTS2:
+		return snprintf(line, LINE_SIZE, "%u gts2 value=%u\n", source,
+			packet->gts2.value);
+	case LIBSWO_PACKET_TYPE_EXT:
+		return snprintf(line, LINE_SIZE, "%u ext source=%u value=%u\n",
+			source, packet->ext.source, packet->ext.value);
+	case LIBSWO_PACKET_TYPE_INST:
+		return snprintf(line, LINE_SIZE,
+			"%u inst address=%u value=0x%x size=%zu\n", source,
+			packet->inst.address, packet->inst.value,
+			packet->inst.size);
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+		return snprintf(line, LINE_SIZE, "%u unknown size=%zu\n",
+			source, packet->unknown.size);
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		return snprintf(line, LINE_SIZE, "%u evtcnt cpi=%u exc=%u "
+			"sleep=%u lsu=%u fold=%u cyc=%u\n", source,
+			packet->evtcnt.cpi, packet->evtcnt.exc,
+			packet->evtcnt.sleep, packet->evtcnt.lsu,
+			packet->evtcnt.fold, packet->evtcnt.cyc);
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		return snprintf(line, LINE_SIZE,
+			"%u exctrace exception=%u function=%u\n", source,
+			packet->exctrace.exception, packet->exctrace.function);
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		return snprintf(line, LINE_SIZE,
+			"%u pc_sample sleep=%u pc=0x%08x\n", source,
+			packet->pc_sample.sleep, packet->pc_sample.pc);
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		return snprintf(line, LINE_SIZE,
+			"%u pc_value cmpn=%u pc=0x%08x\n", source,
+			packet->pc_value.cmpn, packet->pc_value.pc);
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		return snprintf(line, LINE_SIZE,
+			"%u addr_offset cmpn=%u offset=0x%04x\n", source,
+			packet->addr_offset.cmpn, packet->addr_offset.offset);
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		return snprintf(line, LINE_SIZE,
+			"%u data_value cmpn=%u wnr=%u value=0x%x size=%zu\n",
+			source, packet->data_value.cmpn,
+			packet->data_value.wnr, packet->data_value.data_value,
+			packet->data_value.size);
+	case LIBSWO_PACKET_TYPE_HW:
+	default:
+		return snprintf(line, LINE_SIZE,
+			"%u hw address=%u value=0x%x size=%zu\n", source,
+			packet->hw.address, packet->hw.value, packet->hw.size);
+	}
+}
+
+static void put_le32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = value;
+	buffer[1] = value >> 8;
+	buffer[2] = value >> 16;
+	buffer[3] = value >> 24;
+}
+
+static int format_record(uint8_t *record, unsigned int source,
+		const union libswo_packet *packet)
+{
+	uint8_t field;
+	uint32_t value;
+
+	field = 0;
+	value = 0;
+
+	switch (packet->type) {
+	case LIBSWO_PACKET_TYPE_SYNC:
+		value = packet->sync.size;
+		break;
+	case LIBSWO_PACKET_TYPE_OVERFLOW:
+	case LIBSWO_PACKET_TYPE_UNKNOWN:
+		break;
+	case LIBSWO_PACKET_TYPE_LTS:
+		field = packet->lts.relation;
+		value = packet->lts.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS1:
+		field = packet->gts1.clkch | (packet->gts1.wrap << 1);
+		value = packet->gts1.value;
+		break;
+	case LIBSWO_PACKET_TYPE_GTS2:
+		value = packet->gts2.value;
+		break;
+	case LIBSWO_PACKET_TYPE_EXT:
+		field = packet->ext.source;
+		value = packet->ext.value;
+		break;
+	case LIBSWO_PACKET_TYPE_INST:
+		field = packet->inst.address;
+		value = packet->inst.value;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EVTCNT:
+		field = packet->evtcnt.cpi | (packet->evtcnt.exc << 1) | \
+			(packet->evtcnt.sleep << 2) | \
+			(packet->evtcnt.lsu << 3) | \
+			(packet->evtcnt.fold << 4) | \
+			(packet->evtcnt.cyc << 5);
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_EXCTRACE:
+		field = packet->exctrace.function;
+		value = packet->exctrace.exception;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_SAMPLE:
+		field = packet->pc_sample.sleep;
+		value = packet->pc_sample.pc;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_PC_VALUE:
+		field = packet->pc_value.cmpn;
+		value = packet->pc_value.pc;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_ADDR_OFFSET:
+		field = packet->addr_offset.cmpn;
+		value = packet->addr_offset.offset;
+		break;
+	case LIBSWO_PACKET_TYPE_DWT_DATA_VALUE:
+		field = packet->data_value.cmpn | \
+			(packet->data_value.wnr << 2);
+		value = packet->data_value.data_value;
+		break;
+	case LIBSWO_PACKET_TYPE_HW:
+	default:
+		field = packet->hw.address;
+		value = packet->hw.value;
+		break;
+	}
+
+	record[0] = source;
+	record[1] = packet->type;
+	record[2] = (packet->type == LIBSWO_PACKET_TYPE_SYNC) ? 0 : \
+		packet->any.size;
+	record[3] = field;
+	put_le32(record + 4, value);
+
+	return RECORD_SIZE;
+}
+
+static bool append(struct client *client, const void *data, size_t length)
+{
+	if (client->length + length > CLIENT_BUFFER_SIZE)
+		return false;
+
+	if (client->start + client->length + length > CLIENT_BUFFER_SIZE) {
+		memmove(client->buffer, client->buffer + client->start,
+			client->length);
+		client->start = 0;
+	}
+
+	memcpy(client->buffer + client->start + client->length, data, length);
+	client->length += length;
+
+	return true;
+}
+
+/*
+ * Report the lost packets of a client if there is space in its buffer.
+ * Returns false if there are still unreported lost packets.
+ */
+static bool report_dropped(const struct server *server, struct client *client)
+{
+	uint8_t data[LINE_SIZE];
+	uint64_t count;
+	int length;
+
+	if (!client->num_unreported)
+		return true;
+
+	count = client->num_unreported;
+
+	if (server->binary) {
+		count = count < UINT32_MAX ? count : UINT32_MAX;
+
+		memset(data, 0, RECORD_SIZE);
+		data[1] = RECORD_DROPPED;
+		put_le32(data + 4, count);
+		length = RECORD_SIZE;
+	} else {
+		length = snprintf((char *)data, LINE_SIZE,
+			"dropped count=%llu\n", (unsigned long long)count);
+	}
+
+	if (!append(client, data, length))
+		return false;
+
+	client->num_unreported -= count;
+
+	return !client->num_unreported;
+}
+
+static int packet_callback(struct libswo_context *ctx,
+		const union libswo_packet *packet, void *user_data)
+{
+	struct server *server;
+	struct client *client;
+	char line[LINE_SIZE];
+	size_t length;
+	unsigned int i;
+	int ret;
+
+	(void)ctx;
+
+	server = (struct server *)user_data;
+
+	if (server->binary)
+		ret = format_record((uint8_t *)line, server->current, packet);
+	else
+		ret = format_packet(line, server->current, packet);
+
+	if (ret < 0)
+		return true;
+
+	length = (size_t)ret < LINE_SIZE ? (size_t)ret : LINE_SIZE - 1;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = &server->clients[i];
+
+		if (client->fd < 0)
+			continue;
+
+		/* Keep the order of lost and sent packets. */
+		if (!report_dropped(server, client) || \
+				!append(client, line, length)) {
+			client->num_dropped++;
+			client->num_unreported++;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Only decode packets while there are clients. Otherwise, the decoder skips
+ * the packets without invoking any callback function.
+ */
+static void update_callbacks(struct server *server)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (!server->sources[i].used)
+			continue;
+
+		libswo_set_callback(server->sources[i].ctx,
+			server->num_clients > 0 ? &packet_callback : NULL,
+			server);
+	}
+}
+
+static int add_source(struct server *server, int fd, char *host, char *port)
+{
+	struct source *source;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (!server->sources[i].used)
+			break;
+	}
+
+	if (i == MAX_SOURCES) {
+		fprintf(stderr, "Maximum number of sources reached.\n");
+		return -1;
+	}
+
+	source = &server->sources[i];
+	ret = libswo_init(&source->ctx, NULL, BUFFER_SIZE);
+
+	if (ret != LIBSWO_OK) {
+		fprintf(stderr, "libswo_init() failed: %s.\n",
+			libswo_strerror(ret));
+		return -1;
+	}
+
+	libswo_set_callback(source->ctx,
+		server->num_clients > 0 ? &packet_callback : NULL, server);
+
+	source->used = true;
+	source->fd = -1;
+	source->host = host;
+	source->port = port;
+	source->connecting = false;
+	source->retry_time = 0;
+	source->num_bytes = 0;
+
+	if (fd >= 0) {
+		struct epoll_event ev;
+
+		ev.events = EPOLLIN;
+		ev.data.u64 = event_data(EVENT_SOURCE, i);
+
+		if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			libswo_exit(source->ctx);
+			source->used = false;
+			return -1;
+		}
+
+		source->fd = fd;
+		fprintf(stderr, "Source %u connected.\n", i);
+	}
+
+	return i;
+}
+
+static void disconnect_source(struct server *server, unsigned int index)
+{
+	struct source *source;
+
+	source = &server->sources[index];
+
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	close(source->fd);
+	source->fd = -1;
+	source->connecting = false;
+
+	/* Flush incomplete packets of the lost stream. */
+	server->current = index;
+	libswo_decode(source->ctx, LIBSWO_DF_EOS);
+
+	fprintf(stderr, "Source %u disconnected after %llu bytes.\n", index,
+		(unsigned long long)source->num_bytes);
+
+	if (source->host) {
+		source->retry_time = get_time() + RECONNECT_INTERVAL;
+		return;
+	}
+
+	libswo_exit(source->ctx);
+	source->used = false;
+}
+
+static void connect_source(struct server *server, unsigned int index)
+{
+	struct source *source;
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct epoll_event ev;
+	int fd;
+	int ret;
+
+	source = &server->sources[index];
+	source->retry_time = get_time() + RECONNECT_INTERVAL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(source->host, source->port, &hints, &res))
+		return;
+
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+	if (fd < 0 || set_nonblocking(fd) < 0) {
+		if (fd >= 0)
+			close(fd);
+
+		freeaddrinfo(res);
+		return;
+	}
+
+	ret = connect(fd, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo(res);
+
+	if (ret < 0 && errno != EINPROGRESS) {
+		close(fd);
+		return;
+	}
+
+	/* Wait for the connection to be established. */
+	ev.events = EPOLLOUT;
+	ev.data.u64 = event_data(EVENT_SOURCE, index);
+
+	if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		close(fd);
+		return;
+	}
+
+	source->fd = fd;
+	source->connecting = true;
+}
+
+static void handle_connected(struct server *server, unsigned int index)
+{
+	struct source *source;
+	struct epoll_event ev;
+	socklen_t length;
+	int error;
+
+	source = &server->sources[index];
+	length = sizeof(error);
+
+	if (getsockopt(source->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 \
+			|| error) {
+		epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+		close(source->fd);
+		source->fd = -1;
+		source->connecting = false;
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = event_data(EVENT_SOURCE, index);
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, source->fd, &ev);
+
+	source->connecting = false;
+	fprintf(stderr, "Source %u connected to %s:%s.\n", index, source->host,
+		source->port);
+}
+
+static void handle_source(struct server *server, unsigned int index)
+{
+	struct source *source;
+	ssize_t ret;
+
+	source = &server->sources[index];
+
+	if (source->connecting) {
+		handle_connected(server, index);
+		return;
+	}
+
+	/*
+	 * Read once per event such that all sources are served fairly. The
+	 * decoder buffer is empty except for an incomplete packet afterwards.
+	 */
+	ret = read(source->fd, server->read_buffer, READ_SIZE);
+
+	if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if (ret <= 0) {
+		disconnect_source(server, index);
+		return;
+	}
+
+	source->num_bytes += ret;
+	server->current = index;
+
+	if (libswo_feed(source->ctx, server->read_buffer, ret) != LIBSWO_OK || \
+			libswo_decode(source->ctx, 0) != LIBSWO_OK) {
+		fprintf(stderr, "Failed to decode source %u.\n", index);
+		disconnect_source(server, index);
+	}
+}
+
+static void accept_source(struct server *server)
+{
+	int fd;
+
+	fd = accept(server->source_listen_fd, NULL, NULL);
+
+	if (fd < 0)
+		return;
+
+	if (set_nonblocking(fd) < 0 || add_source(server, fd, NULL, NULL) < 0)
+		close(fd);
+}
+
+static void remove_client(struct server *server, unsigned int index)
+{
+	struct client *client;
+
+	client = &server->clients[index];
+
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	client->fd = -1;
+
+	free(client->buffer);
+	client->buffer = NULL;
+
+	fprintf(stderr, "Client %u disconnected, %llu packets dropped.\n",
+		index, (unsigned long long)client->num_dropped);
+
+	server->num_clients--;
+
+	if (!server->num_clients)
+		update_callbacks(server);
+}
+
+static void accept_client(struct server *server)
+{
+	struct client *client;
+	struct epoll_event ev;
+	unsigned int i;
+	int fd;
+
+	fd = accept(server->client_listen_fd, NULL, NULL);
+
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (server->clients[i].fd < 0)
+			break;
+	}
+
+	if (i == MAX_CLIENTS || set_nonblocking(fd) < 0) {
+		close(fd);
+		return;
+	}
+
+	client = &server->clients[i];
+	client->buffer = malloc(CLIENT_BUFFER_SIZE);
+
+	if (!client->buffer) {
+		close(fd);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = event_data(EVENT_CLIENT, i);
+
+	if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		free(client->buffer);
+		client->buffer = NULL;
+		close(fd);
+		return;
+	}
+
+	client->fd = fd;
+	client->polling_out = false;
+	client->start = 0;
+	client->length = 0;
+	client->num_dropped = 0;
+	client->num_unreported = 0;
+
+	server->num_clients++;
+
+	if (server->num_clients == 1)
+		update_callbacks(server);
+
+	fprintf(stderr, "Client %u connected.\n", i);
+}
+
+static void handle_client(struct server *server, unsigned int index,
+		uint32_t events)
+{
+	uint8_t tmp[256];
+	ssize_t ret;
+
+	/* Input of clients is ignored, only a closed connection matters. */
+	if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+		ret = read(server->clients[index].fd, tmp, sizeof(tmp));
+
+		if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR))
+			remove_client(server, index);
+	}
+}
+
+/*
+ * Send the pending packets of all clients. The sockets are only polled for
+ * writing while they cannot take all pending packets.
+ */
+static void flush_clients(struct server *server)
+{
+	struct client *client;
+	struct epoll_event ev;
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = &server->clients[i];
+
+		if (client->fd < 0)
+			continue;
+
+		if (client->length > 0) {
+			ret = write(client->fd, client->buffer + client->start,
+				client->length);
+
+			if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+				remove_client(server, i);
+				continue;
+			}
+
+			if (ret > 0) {
+				client->start += ret;
+				client->length -= ret;
+			}
+
+			if (!client->length)
+				client->start = 0;
+		}
+
+		report_dropped(server, client);
+
+		if ((client->length > 0) == client->polling_out)
+			continue;
+
+		client->polling_out = client->length > 0;
+		ev.events = EPOLLIN | (client->polling_out ? EPOLLOUT : 0);
+		ev.data.u64 = event_data(EVENT_CLIENT, i);
+		epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+	}
+}
+
+static int get_timeout(const struct server *server)
+{
+	const struct source *source;
+	uint64_t now;
+	int timeout;
+	unsigned int i;
+
+	now = get_time();
+	timeout = -1;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		source = &server->sources[i];
+
+		if (!source->used || source->fd >= 0)
+			continue;
+
+		if (source->retry_time <= now)
+			return 0;
+
+		if (timeout < 0 || source->retry_time - now < (uint64_t)timeout)
+			timeout = source->retry_time - now;
+	}
+
+	return timeout;
+}
+
+static void reconnect_sources(struct server *server)
+{
+	struct source *source;
+	uint64_t now;
+	unsigned int i;
+
+	now = get_time();
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		source = &server->sources[i];
+
+		if (source->used && source->fd < 0 && source->retry_time <= now)
+			connect_source(server, i);
+	}
+}
+
+static void run(struct server *server)
+{
+	struct epoll_event events[MAX_EVENTS];
+	unsigned int index;
+	int num_events;
+	int i;
+
+	while (!terminate) {
+		reconnect_sources(server);
+
+		num_events = epoll_wait(server->epoll_fd, events, MAX_EVENTS,
+			get_timeout(server));
+
+		if (num_events < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "epoll_wait() failed: %s.\n",
+				strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < num_events; i++) {
+			index = events[i].data.u64 & UINT32_MAX;
+
+			switch (events[i].data.u64 >> 32) {
+			case EVENT_SOURCE_LISTEN:
+				accept_source(server);
+				break;
+			case EVENT_CLIENT_LISTEN:
+				accept_client(server);
+				break;
+			case EVENT_SOURCE:
+				if (server->sources[index].fd >= 0)
+					handle_source(server, index);
+				break;
+			case EVENT_CLIENT:
+				if (server->clients[index].fd >= 0)
+					handle_client(server, index,
+						events[i].events);
+				break;
+			default:
+				break;
+			}
+		}
+
+		flush_clients(server);
+	}
+}
+
+static bool add_listener(struct server *server, int fd, enum event_kind kind)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = event_data(kind, 0);
+
+	return !epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void show_help(const char *name)
+{
+	printf("Usage: %s [options]\n", name);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -b              Send packets as binary records instead of text "
+		"lines\n");
+	printf("  -c [HOST:]PORT  Connect to an upstream source, can be given "
+		"multiple times\n");
+	printf("  -l [HOST:]PORT  Accept upstream sources on the given "
+		"address\n");
+	printf("  -p [HOST:]PORT  Accept clients on the given address (default: "
+		"%s:%s)\n", DEFAULT_HOST, DEFAULT_CLIENT_PORT);
+	printf("  -h              Show this help\n");
+	printf("\n");
+	printf("The host defaults to %s.\n", DEFAULT_HOST);
+}
+
+int main(int argc, char **argv)
+{
+	static struct server server;
+	struct sigaction sa;
+	char *client_address;
+	char *source_address;
+	char *host;
+	char *port;
+	unsigned int i;
+	int opt;
+	int ret;
+
+	server.source_listen_fd = -1;
+	server.client_listen_fd = -1;
+	server.num_clients = 0;
+	server.binary = false;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		server.sources[i].used = false;
+		server.sources[i].fd = -1;
+	}
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		server.clients[i].fd = -1;
+		server.clients[i].buffer = NULL;
+	}
+
+	server.epoll_fd = epoll_create1(0);
+
+	if (server.epoll_fd < 0) {
+		fprintf(stderr, "epoll_create1() failed: %s.\n",
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	client_address = NULL;
+	source_address = NULL;
+	ret = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "bc:l:p:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			server.binary = true;
+			break;
+		case 'c':
+			if (!parse_address(optarg, &host, &port)) {
+				fprintf(stderr, "Invalid address.\n");
+				goto out;
+			}
+
+			if (add_source(&server, -1, host, port) < 0)
+				goto out;
+
+			break;
+		case 'l':
+			source_address = optarg;
+			break;
+		case 'p':
+			client_address = optarg;
+			break;
+		case 'h':
+			show_help(argv[0]);
+			ret = EXIT_SUCCESS;
+			goto out;
+		default:
+			show_help(argv[0]);
+			goto out;
+		}
+	}
+
+	if (source_address) {
+		if (!parse_address(source_address, &host, &port)) {
+			fprintf(stderr, "Invalid address.\n");
+			goto out;
+		}
+
+		server.source_listen_fd = create_listener(host, port);
+
+		if (server.source_listen_fd < 0 || !add_listener(&server,
+				server.source_listen_fd, EVENT_SOURCE_LISTEN))
+			goto out;
+	}
+
+	if (client_address) {
+		if (!parse_address(client_address, &host, &port)) {
+			fprintf(stderr, "Invalid address.\n");
+			goto out;
+		}
+	} else {
+		host = DEFAULT_HOST;
+		port = DEFAULT_CLIENT_PORT;
+	}
+
+	server.client_listen_fd = create_listener(host, port);
+
+	if (server.client_listen_fd < 0 || !add_listener(&server,
+			server.client_listen_fd, EVENT_CLIENT_LISTEN))
+		goto out;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+
+	sa.sa_handler = &signal_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	run(&server);
+	ret = EXIT_SUCCESS;
+
+out:
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (server.clients[i].fd >= 0)
+			close(server.clients[i].fd);
+
+		free(server.clients[i].buffer);
+	}
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (!server.sources[i].used)
+			continue;
+
+		if (server.sources[i].fd >= 0)
+			close(server.sources[i].fd);
+
+		libswo_exit(server.sources[i].ctx);
+	}
+
+	if (server.client_listen_fd >= 0)
+		close(server.client_listen_fd);
+
+	if (server.source_listen_fd >= 0)
+		close(server.source_listen_fd);
+
+	close(server.epoll_fd);
+
+	return ret;
+}